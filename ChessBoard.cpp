@@ -2,7 +2,17 @@
 #include "ChessBoard.h"
 #include <iostream>
 //#include <cstring>
+#include <algorithm>
 #include "helper.h"
+#include "rules.h"
+#include "geometry.h"
+#include "tbfile.h"
+#include "bitbase.h"
+#include "zobrist.h"
+#include "pst.h"
+#include "stats.h"
+#include "trace.h"
+#include "session.h"
 
 using namespace std;
 
@@ -10,31 +20,48 @@ using namespace std;
 const int ChessBoard::NUM_P = 16;
 
 
-ChessBoard::ChessBoard():board(nullptr),whitePieces(nullptr),blackPieces(nullptr),
-                         moveTurn(WHITE),gameOver(false)
+ChessBoard::ChessBoard(): ChessBoard(cout){}
+
+
+
+ChessBoard::ChessBoard(ostream& reportStream):board(nullptr),whitePieces(nullptr),blackPieces(nullptr),
+                                              moveTurn(WHITE),gameOver(false),
+                                              reports(&reportStream),recorder(nullptr),
+                                              endgameTables(nullptr),
+                                              positionKey(0),pawnKey(0),pawnTable(nullptr),
+                                              mgScore(0),egScore(0),gamePhase(0),network(nullptr),
+                                              kingSquare{0,0},boardVersion(0),
+                                              targetsVersion(~0UL),halfmoveClock(0),
+                                              reversibleStart(0)
 {
   setupBoard(); // set up a chess board
 }
 
 
 
+ChessBoard::ChessBoard(char const * fen):board(nullptr),whitePieces(nullptr),blackPieces(nullptr),
+                                         moveTurn(WHITE),gameOver(false),reports(&cout),
+                                         recorder(nullptr),endgameTables(nullptr),
+                                         positionKey(0),pawnKey(0),pawnTable(nullptr),
+                                         mgScore(0),egScore(0),gamePhase(0),network(nullptr),
+                                         kingSquare{0,0},boardVersion(0),targetsVersion(~0UL),
+                                         halfmoveClock(0),reversibleStart(0)
+{
+  loadPosition(fen); // set up the given position
+}
+
+
+
 /**                                                                                                
  * Set up a chess board. Called by the constructor or the reset() only.
- * Make sure board, whitePieces and blackPieces are all nullptr when calling 
+ * Make sure the board is cleared (clearBoard()) when calling
  */                                                                                                
 void ChessBoard::setupBoard()
 {
   // Make an empty board first
-  board = new Piece** [BOARD_SIZE];
-  for(int i = 0; i < BOARD_SIZE; i++)
-    board[i] = new Piece* [BOARD_SIZE];
-      
-  for(int i = 0; i < BOARD_SIZE; i++)
-    for(int j = 0; j < BOARD_SIZE; j++)
-      board[i][j] = nullptr;
+  makeEmptyBoard();
 
   // Generate the pieces and populate the chess board accordingly
-  whitePieces = new Piece*[NUM_P], blackPieces = new Piece*[NUM_P];
   for(int i = 0; i < NUM_P; i++)
   {
     switch(i)
@@ -42,56 +69,178 @@ void ChessBoard::setupBoard()
       // rook: in rank 8 or rank 1
     case 0:
     case 7:
-      whitePieces[i] = new Rook(WHITE,0,i);
+      whitePieces[i] = piecePool.make<Rook>(WHITE,0,i);
       board[0][i] = whitePieces[i]; // the board[i][j] also have the ptr to a piece 
-      blackPieces[i] = new Rook(BLACK,BOARD_SIZE-1,i);
+      blackPieces[i] = piecePool.make<Rook>(BLACK,BOARD_SIZE-1,i);
       board[BOARD_SIZE-1][i] = blackPieces[i];
       break;
       
       // knight: in rank 8 or 1
     case 1:
     case 6:
-      whitePieces[i] = new Knight(WHITE,0,i);
+      whitePieces[i] = piecePool.make<Knight>(WHITE,0,i);
       board[0][i] = whitePieces[i];
-      blackPieces[i] = new Knight(BLACK,BOARD_SIZE-1,i);
+      blackPieces[i] = piecePool.make<Knight>(BLACK,BOARD_SIZE-1,i);
       board[BOARD_SIZE-1][i] = blackPieces[i];
       break;
       
       // bishop: in rank 8 or 1
     case 2:
     case 5:
-      whitePieces[i] = new Bishop(WHITE,0,i);
+      whitePieces[i] = piecePool.make<Bishop>(WHITE,0,i);
       board[0][i] = whitePieces[i];
-      blackPieces[i] = new Bishop(BLACK,BOARD_SIZE-1,i);
+      blackPieces[i] = piecePool.make<Bishop>(BLACK,BOARD_SIZE-1,i);
       board[BOARD_SIZE-1][i] = blackPieces[i];
       break;
       
       // queen: in rank 8 or 1
     case 3:
-      whitePieces[i] = new Queen(WHITE,0,i);
+      whitePieces[i] = piecePool.make<Queen>(WHITE,0,i);
       board[0][i] = whitePieces[i];
-      blackPieces[i] = new Queen(BLACK,BOARD_SIZE-1,i);
+      blackPieces[i] = piecePool.make<Queen>(BLACK,BOARD_SIZE-1,i);
       board[BOARD_SIZE-1][i] = blackPieces[i];
       break;
       
       // king: in rank 8 or 1
     case 4:
-      whitePieces[i] = new King(WHITE,0,i);
+      whitePieces[i] = piecePool.make<King>(WHITE,0,i);
       board[0][i] = whitePieces[i];
-      blackPieces[i] = new King(BLACK,BOARD_SIZE-1,i);
+      blackPieces[i] = piecePool.make<King>(BLACK,BOARD_SIZE-1,i);
       board[BOARD_SIZE-1][i] = blackPieces[i];
       break;
       
       // pawn: in rank 7 or 2
     default:
-      whitePieces[i] = new Pawn(WHITE,1,i%BOARD_SIZE);
+      whitePieces[i] = piecePool.make<Pawn>(WHITE,1,i%BOARD_SIZE);
       board[1][i%BOARD_SIZE] = whitePieces[i];
-      blackPieces[i] = new Pawn(BLACK,BOARD_SIZE-2,i%BOARD_SIZE);
+      blackPieces[i] = piecePool.make<Pawn>(BLACK,BOARD_SIZE-2,i%BOARD_SIZE);
       board[BOARD_SIZE-2][i%BOARD_SIZE] = blackPieces[i];
     }
   }
 
-  cout << "A new chess game is started!" << endl;
+  halfmoveClock = 0;
+  resetIncrementalState();
+  *reports << "A new chess game is started!" << endl;
+}
+
+
+
+/**
+ * Set up a chess board from a FEN string. Only the piece placement, the side to move and the
+ * castling rights are used; the move counters of the kings, rooks and pawns are set so that
+ * the rules in piece.cpp see the same rights as the FEN string describes
+ */
+bool ChessBoard::setupFromFEN(char const * fen)
+{
+  // Make an empty board first
+  makeEmptyBoard();
+
+  //=== 1. Piece placement, from rank 8 down to rank 1
+  int numWhite = 0, numBlack = 0, numWhiteKing = 0, numBlackKing = 0;
+  int rank = BOARD_SIZE-1, file = 0;
+  char const * c = fen;
+  for(; *c && *c != ' '; c++)
+  {
+    if(*c == '/')
+    {
+      if(file != BOARD_SIZE || rank == 0) return false;
+      rank--; file = 0;
+      continue;
+    }
+
+    if(*c >= '1' && *c <= '8')
+    {
+      file += *c - '0';
+      if(file > BOARD_SIZE) return false;
+      continue;
+    }
+
+    if(file >= BOARD_SIZE) return false;
+
+    bool color = (*c >= 'a' && *c <= 'z') ? BLACK : WHITE;
+    Piece* newPiece = nullptr;
+    switch(color == BLACK ? char(*c - 'a' + 'A') : *c)
+    {
+    case 'K':
+      newPiece = piecePool.make<King>(color,rank,file);
+      (color == WHITE ? numWhiteKing : numBlackKing)++; break;
+    case 'Q':
+      newPiece = piecePool.make<Queen>(color,rank,file); break;
+    case 'R':
+      newPiece = piecePool.make<Rook>(color,rank,file); break;
+    case 'B':
+      newPiece = piecePool.make<Bishop>(color,rank,file); break;
+    case 'N':
+      newPiece = piecePool.make<Knight>(color,rank,file); break;
+    case 'P':
+      // A pawn away from its initial rank has moved and cannot advance 2 squares anymore
+      newPiece = piecePool.make<Pawn>(color,rank,file);
+      if(rank != (color == WHITE ? 1 : BOARD_SIZE-2)) newPiece->incCount();
+      break;
+    default:
+      return false;
+    }
+
+    // Put it into the look-up of its side
+    int& num = (color == WHITE ? numWhite : numBlack);
+    if(num == NUM_P)
+    {
+      return false; // its slot is reclaimed with the others
+    }
+    (color == WHITE ? whitePieces : blackPieces)[num++] = newPiece;
+    board[rank][file] = newPiece;
+    file++;
+  }
+  if(rank != 0 || file != BOARD_SIZE) return false;
+  if(numWhiteKing != 1 || numBlackKing != 1) return false;
+
+  //=== 2. Side to move
+  while(*c == ' ') c++;
+  if(*c == 'w') moveTurn = WHITE;
+  else if(*c == 'b') moveTurn = BLACK;
+  else return false;
+  c++;
+
+  //=== 3. Castling rights: a king or a rook that lost them counts as having moved
+  while(*c == ' ') c++;
+  std::string rights;
+  for(; *c && *c != ' '; c++) rights += *c;
+
+  for(int side = 0; side < 2; side++)
+  {
+    bool color = (side == 0 ? WHITE : BLACK);
+    int const HOME = (color == WHITE ? 0 : BOARD_SIZE-1);
+    char const KING_SIDE = (color == WHITE ? 'K' : 'k');
+    char const QUEEN_SIDE = (color == WHITE ? 'Q' : 'q');
+    bool kingSide = rights.find(KING_SIDE) != std::string::npos;
+    bool queenSide = rights.find(QUEEN_SIDE) != std::string::npos;
+
+    Piece* myKing = findKing(color);
+    if(myKing->getRank() != HOME || myKing->getFile() != 4) kingSide = queenSide = false;
+    if(!kingSide && !queenSide) myKing->incCount();
+
+    Piece** pieceList = (color == WHITE ? whitePieces : blackPieces);
+    for(int i = 0; i < NUM_P; i++)
+    {
+      if(!pieceList[i] || pieceList[i]->getType() != ROOK) continue;
+
+      bool hasRight = pieceList[i]->getRank() == HOME &&
+        ((pieceList[i]->getFile() == 0 && queenSide) ||
+         (pieceList[i]->getFile() == BOARD_SIZE-1 && kingSide));
+      if(!hasRight) pieceList[i]->incCount();
+    }
+  }
+
+  //=== 4. Halfmove clock, after the en passant field (optional)
+  halfmoveClock = 0;
+  while(*c == ' ') c++;
+  for(; *c && *c != ' '; c++); // en passant target: there is no en passant
+  while(*c == ' ') c++;
+  for(; *c >= '0' && *c <= '9'; c++) halfmoveClock = halfmoveClock*10 + (*c - '0');
+
+  resetIncrementalState();
+  *reports << "A new chess game is started!" << endl;
+  return true;
 }
 
 
@@ -101,335 +250,1294 @@ void ChessBoard::setupBoard()
  */
 inline void ChessBoard::clearBoard()
 {
-  // Clearing the pieces
-  if(whitePieces!=nullptr)
+  undoStack.clear();
+  redoStack.clear();
+
+  // Every piece, those taken by the moves included, goes at once; the board and the look-ups
+  // are kept for the next game and emptied by makeEmptyBoard()
+  piecePool.rewind();
+}
+
+
+
+/**
+ * Allocate the board and the look-ups the first time, and empty them
+ */
+void ChessBoard::makeEmptyBoard()
+{
+  if(!board)
   {
-    for(int i = 0; i < NUM_P ; i++)
-      if(whitePieces[i]) delete whitePieces[i];
-    
-    delete [] whitePieces; whitePieces = nullptr;
+    board = new Piece** [BOARD_SIZE];
+    for(int i = 0; i < BOARD_SIZE; i++)
+      board[i] = new Piece* [BOARD_SIZE];
+    whitePieces = new Piece*[NUM_P], blackPieces = new Piece*[NUM_P];
+  }
+
+  for(int i = 0; i < BOARD_SIZE; i++)
+    for(int j = 0; j < BOARD_SIZE; j++)
+      board[i][j] = nullptr;
+  for(int i = 0; i < NUM_P; i++)
+    whitePieces[i] = nullptr, blackPieces[i] = nullptr;
+}
+
+
+
+/**
+ * Clear the chessboard and reset the flags then generate a new game board
+ */
+void ChessBoard::resetBoard()
+{
+  if(recorder) recorder->recordReset();
+  newGame();
+}
+
+
+
+/**
+ * Start the game again from the initial position, as resetBoard() does unrecorded
+ */
+void ChessBoard::newGame()
+{
+  // Reset the flags first: the new game's history starts with White to move
+  moveTurn = WHITE;  gameOver = false;
+  // Get a new chess board
+  clearBoard(); setupBoard();
+}
+
+
+
+/**
+ * Replace the current game by a position given as a FEN string
+ */
+bool ChessBoard::loadPosition(char const * fen)
+{
+  if(recorder) recorder->recordLoad(fen);
+  clearBoard();
+  gameOver = false;
+  if(setupFromFEN(fen)) return true;
+
+  cerr << "Cannot set up the position \"" << fen << "\"!" << endl;
+  newGame();
+  return false;
+}
+
+
+
+/**
+ * Return the piece at a square, nullptr if the square is empty
+ */
+Piece* ChessBoard::pieceAt(int rank, int file) const { return board[rank][file]; }
+
+
+
+/**
+ * Return the pool of the pieces
+ */
+PiecePool const & ChessBoard::getPiecePool() const { return piecePool; }
+
+
+
+/**
+ * Return the side to move
+ */
+bool ChessBoard::getMoveTurn() const { return moveTurn; }
+
+
+
+/**
+ * Consult a set of endgame table files after each move
+ */
+void ChessBoard::setEndgameTables(EndgameTables const* tables) { endgameTables = tables; }
+
+
+
+/**
+ * Append the calls received to a session log
+ */
+void ChessBoard::setRecorder(SessionRecorder* rec) { recorder = rec; }
+
+
+
+/**
+ * Look up the current position in the endgame tables
+ */
+bool ChessBoard::probeEndgameTables(TbResult& result) const
+{
+  if(!endgameTables) return false;
+
+  result = endgameTables->probe(*this);
+  return result.found;
+}
+
+
+
+/**
+ * Look up the result and the distance to mate of the current position in the endgame tables
+ */
+bool ChessBoard::probeEndgameValue(TbWDL& wdl, int& dtm) const
+{
+  if(!endgameTables) return false;
+
+  // Most positions have more pieces than any table: don't even look them up
+  int numPieces = 0;
+  for(int i = 0; i < NUM_P; i++)
+    numPieces += (whitePieces[i] != nullptr) + (blackPieces[i] != nullptr);
+  if(numPieces > MAX_TB_PIECES) return false;
+
+  return endgameTables->probeValue(*this,wdl,dtm);
+}
+
+
+
+/**
+ * Look up a king and pawn versus king position in the KPK bitbase
+ */
+bool ChessBoard::probeKPK(TbWDL& wdl) const
+{
+  Piece* kings[2] = {nullptr, nullptr}; // [0]: white, [1]: black
+  Piece* pawn = nullptr;
+  int numPieces = 0;
+
+  for(int side = 0; side < 2; side++)
+  {
+    Piece** pieceList = (side == 0 ? whitePieces : blackPieces);
+    for(int i = 0; i < NUM_P; i++)
+    {
+      if(!pieceList[i]) continue;
+
+      if(++numPieces > 3) return false;
+      if(pieceList[i]->getType() == KING) kings[side] = pieceList[i];
+      else if(pieceList[i]->getType() == PAWN && !pawn) pawn = pieceList[i];
+      else return false;
+    }
   }
+  if(!pawn || !kings[0] || !kings[1]) return false;
 
-  if(blackPieces!=nullptr)
+  // Look at the board from the side of the pawn, so that it moves up the ranks
+  bool const STRONG = pawn->getColor();
+  Piece* strongKing = kings[STRONG == WHITE ? 0 : 1];
+  Piece* weakKing = kings[STRONG == WHITE ? 1 : 0];
+  auto square = [STRONG](Piece const * p)
   {
-    for(int i = 0; i < NUM_P ; i++)
-      if(blackPieces[i]) delete blackPieces[i];
-    
-    delete [] blackPieces; blackPieces = nullptr;
+    int rank = (STRONG == WHITE ? p->getRank() : BOARD_SIZE-1-p->getRank());
+    return rank*BOARD_SIZE + p->getFile();
+  };
+
+  bool const WINS = kpkProbe(square(strongKing),square(pawn),square(weakKing),
+                             moveTurn == STRONG);
+  wdl = !WINS ? TB_DRAW : (moveTurn == STRONG ? TB_WIN : TB_LOSS);
+  return true;
+}
+
+
+
+/**
+ * End the game if the endgame tables cover the position, e.g. "White mates in 8. Game over."
+ */
+void ChessBoard::reportEndgameTables()
+{
+  TbWDL wdl; int dtm;
+  if(!probeEndgameValue(wdl,dtm)) return;
+
+  gameOver = true;
+  if(wdl == TB_DRAW)
+  {
+    *reports << "Endgame tables: the position is a draw. Game over." << endl;
+    return;
   }
 
-  // Clearing the board
-  if(board)
+  bool winner = (wdl == TB_WIN ? moveTurn : !moveTurn);
+  *reports << "Endgame tables: " << (winner == WHITE ? "White" : "Black") << " mates in "
+       << (dtm + 1) / 2 << ". Game over." << endl;
+}
+
+
+
+/**
+ * Return a ptr to a king
+ */
+Piece* ChessBoard::findKing(bool color) const
+{
+  Piece* pieceList[NUM_P]; // ptrs to all the pieces of "color" colour
+  if(color == WHITE)
   {
-    for(int i = 0; i < BOARD_SIZE; i++)
-      delete [] board[i];
+    for(int i = 0; i < NUM_P; i++)
+      pieceList[i] = whitePieces[i];
+  }
+  else
+  {
+    for(int i = 0; i < NUM_P; i++)
+      pieceList[i] = blackPieces[i];
+  }
+
+  // Get the king
+  for(int i = 0; i < NUM_P; i++)
+  {
+    if(pieceList[i] && pieceList[i]->getType() == KING) return pieceList[i];
+  }
+
+  cerr << "Cannot find the king!" << endl << endl;
+  return nullptr;
+}
+
+
+
+/**
+ * The squares a piece could reach from each square on an empty board, castling aside (a pawn:
+ * one or two squares forwards and the two captures). A superset of what movePieceRuleTest()
+ * accepts, so that the squares it would reject anyway aren't even tried
+ */
+struct ReachTable
+{
+  uint64_t mask[6][2][BOARD_SIZE*BOARD_SIZE]; // [PieceType][colour][rank*BOARD_SIZE+file]
+};
+
+constexpr ReachTable makeReachTable()
+{
+  typedef StandardGeometry G;
+  GeometryTables<G> const & T = GEOMETRY_TABLES<G>;
+  ReachTable table = {};
+
+  for(int c = 0; c < 2; c++)
+    for(int sq = 0; sq < G::SQUARES; sq++)
+    {
+      uint64_t reach[6] = {0, 0, 0, 0, 0, 0};
+      for(int i = 0; i < T.leaperCount[KING_LEAP][sq]; i++)
+        reach[KING] |= uint64_t(1) << T.leaper[KING_LEAP][sq][i];
+      for(int i = 0; i < T.leaperCount[KNIGHT_LEAP][sq]; i++)
+        reach[KNIGHT] |= uint64_t(1) << T.leaper[KNIGHT_LEAP][sq][i];
+      for(int d = 0; d < 8; d++)
+        for(int i = 0; i < T.rayLength[sq][d]; i++)
+          reach[d < 4 ? ROOK : BISHOP] |= uint64_t(1) << T.ray[sq][d][i];
+      reach[QUEEN] = reach[ROOK] | reach[BISHOP];
+
+      int const R = G::rankOf(sq), F = G::fileOf(sq), FORWARD = (c == WHITE ? 1 : -1);
+      for(int df = -1; df <= 1; df++)
+        if(G::inside(R + FORWARD,F + df))
+          reach[PAWN] |= uint64_t(1) << G::square(R + FORWARD,F + df);
+      if(G::inside(R + 2*FORWARD,F))
+        reach[PAWN] |= uint64_t(1) << G::square(R + 2*FORWARD,F);
+
+      for(int t = KING; t <= PAWN; t++) table.mask[t][c][sq] = reach[t];
+    }
+  return table;
+}
+
+static constexpr ReachTable REACH = makeReachTable();
+
+static inline uint64_t reachOf(Piece const * piece)
+{
+  int const SQ = piece->getRank()*BOARD_SIZE + piece->getFile();
+  return REACH.mask[piece->getType()][piece->getColor()][SQ];
+}
+
+
+
+/**
+ * Check if a king is in check
+ */
+bool ChessBoard::isInCheck(bool color) const
+{
+  STATS_COUNT(STAT_CHECK_TESTS);
+
+  // Locate my king (own side's king of "color" colour) and get its coodinates
+  int const KING_SQ = kingSquare[color];
+  int const rankKing = KING_SQ / BOARD_SIZE; int const fileKing = KING_SQ % BOARD_SIZE;
+  
+  // Get the ptrs to all the pieces of the opponent
+  Piece* oppoPieceList[NUM_P];
+  if(color == WHITE)
+  {
+    for(int i = 0; i < NUM_P; i++)
+      oppoPieceList[i] = blackPieces[i];
+  }
+  else
+  {
+    for(int i = 0; i < NUM_P; i++)
+      oppoPieceList[i] = whitePieces[i];
+  }
+
+  // Traverse the opponent's pieces to see if my king would be attacked
+  for(int i = 0; i < NUM_P; i++)
+  {
+    if(!oppoPieceList[i] || !((reachOf(oppoPieceList[i]) >> KING_SQ) & 1)) continue;
     
-    delete [] board; board = nullptr;
+    STATS_COUNT(STAT_RULE_TESTS);
+    if(ruleTest(oppoPieceList[i],rankKing,fileKing,board)) return true;
+  }
+  
+  return false;
+}
+
+
+/**
+ * Add or remove the contribution of a piece on a square to the running evaluation
+ */
+inline void ChessBoard::updateEvaluation(Piece const * piece, int const RANK, int const FILE,
+                                         int const sign)
+{
+  PieceType const TYPE = piece->getType();
+  int const SQ = pstSquare(piece->getColor(),RANK,FILE);
+  int const SIGN = (piece->getColor() == WHITE ? sign : -sign);
+
+  mgScore += SIGN * (PIECE_VALUE_MG[TYPE] + PST_MG[TYPE][SQ]);
+  egScore += SIGN * (PIECE_VALUE_EG[TYPE] + PST_EG[TYPE][SQ]);
+  gamePhase += sign * PHASE_WEIGHT[TYPE];
+}
+
+
+
+/**
+ * Add or remove the network features of a piece on a square
+ */
+void ChessBoard::updateAccumulator(Piece const * piece, int const RANK, int const FILE,
+                                   int const sign)
+{
+  bool const COLOR = piece->getColor();
+  int const SQ = RANK*BOARD_SIZE + FILE;
+
+  // Every feature of a side depends on where its king is
+  if(piece->getType() == KING)
+  {
+    if(sign > 0) refreshAccumulator(COLOR); // a king lifted off waits until it is put back
+    return;
+  }
+
+  for(int p = 0; p < 2; p++)
+  {
+    int const FEATURE = Nnue::featureIndex(bool(p),kingSquare[p],COLOR,piece->getType(),SQ);
+    if(sign > 0) network->addFeature(accumulator.values[p],FEATURE);
+    else network->removeFeature(accumulator.values[p],FEATURE);
   }
 }
 
 
 
 /**
- * Clear the chessboard and reset the flags then generate a new game board
+ * Recompute one side's accumulator from the pieces on the board
+ */
+void ChessBoard::refreshAccumulator(bool perspective)
+{
+  int features[2*NUM_P];
+  int n = 0;
+  for(int i = 0; i < BOARD_SIZE; i++)
+    for(int j = 0; j < BOARD_SIZE; j++)
+      if(board[i][j] && board[i][j]->getType() != KING)
+        features[n++] = Nnue::featureIndex(perspective,kingSquare[perspective],
+                                           board[i][j]->getColor(),board[i][j]->getType(),
+                                           i*BOARD_SIZE + j);
+  network->refresh(accumulator.values[perspective],features,n);
+}
+
+
+
+/**
+ * Put a piece on an empty square, changing the board only
+ */
+inline void ChessBoard::setSquare(Piece* piece, int const RANK, int const FILE)
+{
+  board[RANK][FILE] = piece; piece->setPos(RANK,FILE);
+  if(piece->getType() == KING) kingSquare[piece->getColor()] = RANK*BOARD_SIZE + FILE;
+}
+
+
+
+/**
+ * Lift the piece off a square and return it, changing the board only
+ */
+inline Piece* ChessBoard::clearSquare(int const RANK, int const FILE)
+{
+  Piece* piece = board[RANK][FILE];
+  board[RANK][FILE] = nullptr;
+  return piece;
+}
+
+
+
+/**
+ * Put a piece on an empty square, keeping the position key and the evaluation up to date
+ */
+inline void ChessBoard::putPiece(Piece* piece, int const RANK, int const FILE)
+{
+  setSquare(piece,RANK,FILE);
+  boardVersion++;
+  positionKey ^= zobristPiece(piece->getColor(),piece->getType(),RANK,FILE);
+  if(piece->getType() == PAWN) pawnKey ^= zobristPiece(piece->getColor(),PAWN,RANK,FILE);
+  updateEvaluation(piece,RANK,FILE,1);
+  if(network) updateAccumulator(piece,RANK,FILE,1);
+}
+
+
+
+/**
+ * Lift the piece off a square and return it, keeping the position key and the evaluation up
+ * to date
+ */
+inline Piece* ChessBoard::takePiece(int const RANK, int const FILE)
+{
+  Piece* piece = clearSquare(RANK,FILE);
+  boardVersion++;
+  positionKey ^= zobristPiece(piece->getColor(),piece->getType(),RANK,FILE);
+  if(piece->getType() == PAWN) pawnKey ^= zobristPiece(piece->getColor(),PAWN,RANK,FILE);
+  updateEvaluation(piece,RANK,FILE,-1);
+  if(network) updateAccumulator(piece,RANK,FILE,-1);
+  return piece;
+}
+
+
+
+/**
+ * Move a piece to an empty square
+ */
+inline void ChessBoard::movePiece(int const RANK_S, int const FILE_S, int const RANK_D,
+                                  int const FILE_D)
+{
+  putPiece(takePiece(RANK_S,FILE_S),RANK_D,FILE_D);
+}
+
+
+
+/** 
+ * Make a "fake move" on the board, it can handle scenarios where there is an opponent's piece
+ * as well as simplly moveing
+ * Piece* & hostPiece should be a nullptr
+ * The oppent's "taken out" piece is stored in Piece* & hostPiece
+ */
+void ChessBoard::makeFakeMove(int const RANK_S, int const FILE_S, int const RANK_D,
+                              int const FILE_D, Piece* & hostPiece)
+{
+  STATS_COUNT(STAT_FAKE_MOVES);
+
+  // Find my Piece
+  Piece* myPiece = board[RANK_S][FILE_S];
+
+  // Increment the moving counter (only those of the pawns, kings and rooks matter)
+  myPiece->incCount();
+
+  if(hostPiece)
+  {
+    cerr << "Should Pass a null pointer in makeFakeMove()" << endl << endl;
+    return;
+  }
+
+  // Test if the destination is hostile, if so: "take that piece"
+  if(myPiece->isDestHostile(RANK_D,FILE_D,board))
+  {
+    hostPiece = clearSquare(RANK_D,FILE_D); // get the ptr to that hostile piece
+    unlistPiece(hostPiece);
+  }
+  
+  // My piece makes a "fake" move to board[RANK_D][FILE_D]
+  setSquare(clearSquare(RANK_S,FILE_S),RANK_D,FILE_D);
+}
+
+
+/**
+ * Undo the fake move via makeFakeMove()
+ */
+void ChessBoard::undoMakeFakeMove(int const RANK_S, int const FILE_S, int const RANK_D,
+                                  int const FILE_D, Piece* & hostPiece)
+{
+  // My piece
+  Piece* myPiece = board[RANK_D][FILE_D];
+
+  // Decrement the moving counter (only those of the pawns, kings and rooks matter)
+  myPiece->decCount();
+  
+  // Restore my piece
+  setSquare(clearSquare(RANK_D,FILE_D),RANK_S,FILE_S);
+
+  // Restore the taken piece
+  if(hostPiece != nullptr)
+  {
+    setSquare(hostPiece,RANK_D,FILE_D);
+    relistPiece(hostPiece);
+  }
+}
+
+
+
+/**
+ * Make a move for good, keeping the incrementally updated state in step
+ */
+void ChessBoard::makeBoardMove(int const RANK_S, int const FILE_S, int const RANK_D,
+                               int const FILE_D, Piece* & hostPiece)
+{
+  Piece* myPiece = board[RANK_S][FILE_S];
+  myPiece->incCount();
+
+  if(myPiece->isDestHostile(RANK_D,FILE_D,board))
+  {
+    hostPiece = takePiece(RANK_D,FILE_D);
+    unlistPiece(hostPiece);
+  }
+  putPiece(takePiece(RANK_S,FILE_S),RANK_D,FILE_D);
+}
+
+
+/**
+ * Undo makeBoardMove()
+ */
+void ChessBoard::undoBoardMove(int const RANK_S, int const FILE_S, int const RANK_D,
+                               int const FILE_D, Piece* & hostPiece)
+{
+  board[RANK_D][FILE_D]->decCount();
+  putPiece(takePiece(RANK_D,FILE_D),RANK_S,FILE_S);
+
+  if(hostPiece != nullptr)
+  {
+    putPiece(hostPiece,RANK_D,FILE_D);
+    relistPiece(hostPiece);
+  }
+}
+
+
+
+/**
+ * "Take" a piece from the look-up of its side
+ */
+void ChessBoard::unlistPiece(Piece* piece)
+{
+  Piece** list = (piece->getColor() == WHITE ? whitePieces : blackPieces);
+  for(int i = 0; i < NUM_P; i++) // locate the victim piece in the look-up
+  {
+    if(list[i] == piece)
+    {
+      list[i] = nullptr; // temporarily whiping out from the look up, not deleting!
+      return;
+    }
+  }
+}
+
+
+/**
+ * Put back a taken-out piece into the white(black)Pieces
+ */
+void ChessBoard::relistPiece(Piece* piece)
+{
+  Piece** list = (piece->getColor() == WHITE ? whitePieces : blackPieces);
+  for(int i = 0; i < NUM_P; i++)
+  {
+    if(list[i] == nullptr)
+    {
+      list[i] = piece; return;
+    }
+  }
+
+  cerr << "Cannot put back the taken piece!" << endl << endl;
+}
+
+
+
+/**
+ * Simply telling if an action of moving a piece and/or take a piece would save the king from
+ * being in check, effectively will not modify the data members 
+ */
+bool ChessBoard::doesThisMoveSaveKing(int const RANK_S, int const FILE_S,
+                                      int const RANK_D, int const FILE_D)
+{
+  //--- 1. Find my Piece at the destination and get its position and color
+  Piece* myPiece = board[RANK_S][FILE_S];
+  bool myColor = myPiece->getColor();
+ 
+  //--- 2. Test if legal
+  STATS_COUNT(STAT_RULE_TESTS);
+  if(ruleTest(myPiece,RANK_D,FILE_D,board) == false) return false;
+
+  //--- 3.  Attempting some "fake moves" here:
+  Piece* hostPiece = nullptr; // ptr to the hostile piece at destination (if there is such one)
+  makeFakeMove(RANK_S,FILE_S,RANK_D,FILE_D,hostPiece); // make a "fake move"
+
+  //--- 4.  Test if the king would be safe
+  if(!isInCheck(myColor)) // no checkmate anymore: god save the king!
+  {
+    undoMakeFakeMove(RANK_S,FILE_S,RANK_D,FILE_D,hostPiece); // restore the pieces
+    return true;
+  }
+  else // can't save the king: restore anyway
+  {
+    undoMakeFakeMove(RANK_S,FILE_S,RANK_D,FILE_D,hostPiece);
+    return false; // can't save the king sorry
+  }
+}
+
+
+
+/**
+ * Return the squares of the pieces whose moves need a fake move to be tested
+ */
+uint64_t ChessBoard::piecesToProbe(bool color) const
+{
+  if(isInCheck(color)) return ~uint64_t(0);
+
+  typedef StandardGeometry G;
+  GeometryTables<G> const & T = GEOMETRY_TABLES<G>;
+  int const KING_SQ = kingSquare[color];
+  uint64_t probed = uint64_t(1) << KING_SQ;
+
+  // Along each ray from the king: a single own piece, then an opponent's slider moving that way
+  for(int d = 0; d < 8; d++)
+  {
+    int shield = -1;
+    for(int i = 0; i < T.rayLength[KING_SQ][d]; i++)
+    {
+      int const SQ = T.ray[KING_SQ][d][i];
+      Piece const * const p = board[G::rankOf(SQ)][G::fileOf(SQ)];
+      if(!p) continue;
+      if(p->getColor() == color && shield < 0)
+      {
+        shield = SQ;
+        continue;
+      }
+
+      PieceType const TYPE = p->getType();
+      if(shield >= 0 && p->getColor() != color &&
+         (TYPE == QUEEN || TYPE == (d < 4 ? ROOK : BISHOP)))
+        probed |= uint64_t(1) << shield;
+      break;
+    }
+  }
+  return probed;
+}
+
+
+
+/**
+ * Test if a move of a piece is legal, given piecesToProbe() of its side
+ */
+inline bool ChessBoard::isMoveLegal(int const RANK_S, int const FILE_S, int const RANK_D,
+                                    int const FILE_D, uint64_t const PROBED)
+{
+  if((PROBED >> (RANK_S*BOARD_SIZE + FILE_S)) & 1)
+    return doesThisMoveSaveKing(RANK_S,FILE_S,RANK_D,FILE_D);
+
+  STATS_COUNT(STAT_RULE_TESTS);
+  return ruleTest(board[RANK_S][FILE_S],RANK_D,FILE_D,board);
+}
+
+
+
+/**
+ * Given a set of a board plus the pieces (not necessary the member ones), Check if there
+ * is no further valid move. Used to test for checkmate and stalemate, provided that a 
+ * valid move has been ubmitted.
+ */
+bool ChessBoard::isNoFurtherValidMove(bool color)
+{
+  STATS_COUNT(STAT_MATE_SCANS);
+  int myRank, myFile;
+
+  // Get the ptrs to the white/black pieces only
+  Piece* pieceList[NUM_P];
+  if(color == WHITE)
+  {
+    for(int i = 0; i < NUM_P; i++)
+      pieceList[i] = whitePieces[i];
+  }
+  else
+  {
+    for(int i = 0; i < NUM_P; i++)
+      pieceList[i] = blackPieces[i];
+  }
+  
+  // Move my pieces 
+  uint64_t const PROBED = piecesToProbe(color);
+  for(int k = 0; k < NUM_P; k++)
+  {  
+    if(!pieceList[k]) continue;
+
+    myRank = pieceList[k]->getRank(); myFile = pieceList[k]->getFile();
+
+    for(uint64_t targets = reachOf(pieceList[k]); targets; targets &= targets - 1)
+    {
+      //See if any moves of the pieces of the own side could save the king
+      int const SQ = __builtin_ctzll(targets);
+      if(isMoveLegal(myRank,myFile,SQ / BOARD_SIZE,SQ % BOARD_SIZE,PROBED)) return false;
+    }
+  }
+
+  return true;
+}
+
+
+
+/**
+ * Test if castling is allowed for a king going to (RANK_D, FILE_D), without moving anything
+ */
+bool ChessBoard::isCastlingLegal(Piece* const myKing, int const RANK_D, int const FILE_D)
+{
+  //=== If myKing isn't really a king: reject his request
+  if(myKing->getType() != KING) return false;
+
+  //=== myKing mustn't have ever moved
+  if(myKing->getCount() != 0) return false;
+
+  bool const MY_COLOR = myKing->getColor();
+  int const FILE_S = myKing->getFile(); int const RANK_S = myKing->getRank();
+
+  //=== The king should moves horizontally by 2 squares
+  if(RANK_S != RANK_D || (FILE_S - FILE_D != 2 && FILE_D - FILE_S != 2)) return false;
+
+  //=== myKing should be safe now
+  if(isInCheck(MY_COLOR)) return false;
+
+  //=== The rook mustn't have ever moved as well
+  int const STEP = (FILE_D < FILE_S ? -1 : 1); // white moving left, black moving right: -1
+  int const FILE_R = (STEP < 0 ? 0 : BOARD_SIZE-1);
+  Piece* myRook = board[RANK_S][FILE_R];
+  if(!myRook) return false;
+
+  if(myRook->getType()!=ROOK || myRook->getColor()!= MY_COLOR) return false;
+
+  if(myRook->getCount() != 0) return false;
+
+  //=== Ensure that there is nothing between the king and the rook
+  for(int f = FILE_S + STEP; f != FILE_R; f += STEP)
+  {
+    if(board[RANK_S][f] != nullptr) return false;
+  }
+
+  //=== His majesty cannot be attacked during his moving
+  if(!doesThisMoveSaveKing(RANK_S,FILE_S,RANK_S,FILE_S+STEP)) return false;
+
+  // Step aside to test the next square
+  setSquare(clearSquare(RANK_S,FILE_S),RANK_S,FILE_S+STEP);
+  bool safe = doesThisMoveSaveKing(RANK_S,FILE_S+STEP,RANK_S,FILE_D);
+  setSquare(clearSquare(RANK_S,FILE_S+STEP),RANK_S,FILE_S);
+
+  return safe;
+}
+
+
+
+/**
+ * Move the king and the rook of a castling, which must be legal
+ */
+void ChessBoard::makeCastlingMove(int const RANK_S, int const FILE_S, int const FILE_D)
+{
+  int const FILE_R = (FILE_D < FILE_S ? 0 : BOARD_SIZE-1);
+  int const FILE_R_D = (FILE_D < FILE_S ? FILE_D+1 : FILE_D-1); // rook jumps over the king
+
+  board[RANK_S][FILE_S]->incCount();
+  board[RANK_S][FILE_R]->incCount();
+  movePiece(RANK_S,FILE_S,RANK_S,FILE_D);
+  movePiece(RANK_S,FILE_R,RANK_S,FILE_R_D);
+}
+
+
+
+/**
+ * Undo makeCastlingMove()
+ */
+void ChessBoard::undoCastlingMove(int const RANK_S, int const FILE_S, int const FILE_D)
+{
+  int const FILE_R = (FILE_D < FILE_S ? 0 : BOARD_SIZE-1);
+  int const FILE_R_D = (FILE_D < FILE_S ? FILE_D+1 : FILE_D-1);
+
+  movePiece(RANK_S,FILE_D,RANK_S,FILE_S);
+  movePiece(RANK_S,FILE_R_D,RANK_S,FILE_R);
+  board[RANK_S][FILE_S]->decCount();
+  board[RANK_S][FILE_R]->decCount();
+}
+
+
+
+/**
+ * Make a legal move quietly, to be taken back by undoMove()
+ */
+void ChessBoard::makeMove(Move const & move)
+{
+  if(recorder) recorder->recordMakeMove(move);
+  applyMove(move);
+}
+
+
+
+/**
+ * Make a legal move, as makeMove() does unrecorded
+ */
+void ChessBoard::applyMove(Move const & move)
+{
+  UndoInfo u;
+  u.move = move; u.hostPiece = nullptr;
+  u.halfmoveClock = halfmoveClock; u.reversibleStart = reversibleStart;
+
+  Piece* myPiece = board[move.rankS][move.fileS];
+  u.castling = myPiece->getType() == KING &&
+               (move.fileD - move.fileS == 2 || move.fileS - move.fileD == 2);
+  bool resetsClock;
+  bool const IRREVERSIBLE = isIrreversible(move,resetsClock);
+
+  if(u.castling) makeCastlingMove(move.rankS,move.fileS,move.fileD);
+  else makeBoardMove(move.rankS,move.fileS,move.rankD,move.fileD,u.hostPiece);
+
+  undoStack.push_back(u);
+  moveTurn = !moveTurn;
+  recordPosition(IRREVERSIBLE,resetsClock);
+}
+
+
+
+/**
+ * Take back the last move made by makeMove()
+ */
+void ChessBoard::undoMove()
+{
+  if(recorder) recorder->recordUndoMove();
+  retractMove();
+}
+
+
+
+/**
+ * Take back the last move, as undoMove() does unrecorded
+ */
+void ChessBoard::retractMove()
+{
+  if(undoStack.empty())
+  {
+    cerr << "There is no move to undo!" << endl;
+    return;
+  }
+
+  UndoInfo u = undoStack.back();
+  undoStack.pop_back();
+  moveTurn = !moveTurn;
+  keyHistory.pop_back();
+  halfmoveClock = u.halfmoveClock; reversibleStart = u.reversibleStart;
+
+  Move const & m = u.move;
+  if(u.castling) undoCastlingMove(m.rankS,m.fileS,m.fileD);
+  else undoBoardMove(m.rankS,m.fileS,m.rankD,m.fileD,u.hostPiece);
+}
+
+
+
+/**
+ * Take back the last n moves of the game
+ */
+int ChessBoard::takeBack(int n)
+{
+  if(recorder) recorder->recordTakeBack(n);
+  int count = 0;
+  for(; count < n && !undoStack.empty(); count++)
+  {
+    RedoInfo r;
+    r.move = undoStack.back().move; r.gameOver = gameOver;
+    redoStack.push_back(r);
+
+    retractMove();
+    gameOver = false; // the game went on from every earlier position
+  }
+  return count;
+}
+
+
+
+/**
+ * Replay up to n moves taken back
+ */
+int ChessBoard::redo(int n)
+{
+  if(recorder) recorder->recordRedo(n);
+  int count = 0;
+  for(; count < n && !redoStack.empty(); count++)
+  {
+    RedoInfo r = redoStack.back();
+    redoStack.pop_back();
+
+    applyMove(r.move); // takes the very piece it took the first time
+    gameOver = r.gameOver;
+  }
+  return count;
+}
+
+
+
+/**
+ * List every legal move of the side to move
+ */
+void ChessBoard::generateLegalMoves(std::vector<Move>& moves)
+{
+  moves.clear();
+
+  // Get the ptrs to my pieces only: the fake moves may reorder the opponent's look-up
+  Piece* pieceList[NUM_P];
+  for(int i = 0; i < NUM_P; i++)
+    pieceList[i] = (moveTurn == WHITE ? whitePieces[i] : blackPieces[i]);
+
+  uint64_t const PROBED = piecesToProbe(moveTurn);
+  for(int k = 0; k < NUM_P; k++)
+  {
+    if(!pieceList[k]) continue;
+
+    int const RANK_S = pieceList[k]->getRank(), FILE_S = pieceList[k]->getFile();
+    for(uint64_t targets = reachOf(pieceList[k]); targets; targets &= targets - 1)
+    {
+      int const SQ = __builtin_ctzll(targets);
+      int const RANK_D = SQ / BOARD_SIZE, FILE_D = SQ % BOARD_SIZE;
+      if(isMoveLegal(RANK_S,FILE_S,RANK_D,FILE_D,PROBED))
+        moves.push_back(Move(RANK_S,FILE_S,RANK_D,FILE_D));
+    }
+
+    // The king may castle on either side as well
+    if(pieceList[k]->getType() == KING)
+      for(int step = -2; step <= 2; step += 4)
+        if(isCastlingLegal(pieceList[k],RANK_S,FILE_S+step))
+          moves.push_back(Move(RANK_S,FILE_S,RANK_S,FILE_S+step));
+  }
+}
+
+
+
+/**
+ * Test if the side to move is in check
+ */
+bool ChessBoard::isSideToMoveInCheck() const { return isInCheck(moveTurn); }
+
+
+
+/**
+ * Return the hash key of the current position
+ */
+uint64_t ChessBoard::getKey() const
+{
+  return moveTurn == BLACK ? positionKey ^ ZOBRIST.blackToMove : positionKey;
+}
+
+
+
+/**
+ * Return the squares of the pieces attacking (RANK, FILE), sliders seeing through the squares
+ * missing from occupied
+ */
+uint64_t ChessBoard::attackersTo(int const RANK, int const FILE, uint64_t const occupied) const
+{
+  typedef StandardGeometry G;
+  GeometryTables<G> const & T = GEOMETRY_TABLES<G>;
+  int const SQ = G::square(RANK,FILE);
+  uint64_t attackers = 0;
+
+  //=== 1. Kings and knights next to / a jump away from the square
+  for(int leap = KING_LEAP; leap <= KNIGHT_LEAP; leap++)
+    for(int i = 0; i < T.leaperCount[leap][SQ]; i++)
+    {
+      int const FROM = T.leaper[leap][SQ][i];
+      Piece const * const p = board[G::rankOf(FROM)][G::fileOf(FROM)];
+      if(p && ((occupied >> FROM) & 1) && p->getType() == (leap == KING_LEAP ? KING : KNIGHT))
+        attackers |= uint64_t(1) << FROM;
+    }
+
+  //=== 2. The first piece along each ray, if it slides that way (or is a pawn taking there)
+  for(int d = 0; d < 8; d++)
+    for(int steps = 1; steps <= T.rayLength[SQ][d]; steps++)
+    {
+      int const FROM = T.ray[SQ][d][steps-1];
+      if(!((occupied >> FROM) & 1)) continue;
+
+      Piece const * const p = board[G::rankOf(FROM)][G::fileOf(FROM)];
+      PieceType const TYPE = p->getType();
+      bool const DIAGONAL = (d >= 4);
+      if(TYPE == QUEEN || (TYPE == ROOK && !DIAGONAL) || (TYPE == BISHOP && DIAGONAL) ||
+         (TYPE == PAWN && DIAGONAL && steps == 1 &&
+          GEOMETRY_STEPS[d][0] == (p->getColor() == WHITE ? -1 : 1)))
+        attackers |= uint64_t(1) << FROM;
+      break;
+    }
+  return attackers;
+}
+
+
+
+/**
+ * Static exchange evaluation of a move, in centipawns for the side making it
+ */
+int ChessBoard::see(Move const & move) const
+{
+  static int const VALUE[6] = {20000, 900, 500, 330, 320, 100}; // indexed by PieceType
+  int const RANK = move.rankD, FILE = move.fileD;
+
+  Piece const * const mover = board[move.rankS][move.fileS];
+  if(!mover || (mover->getType() == KING && abs(move.fileD - move.fileS) == 2)) return 0;
+
+  //=== 1. Every piece on the board
+  uint64_t occupied = 0;
+  for(int i = 0; i < BOARD_SIZE; i++)
+    for(int j = 0; j < BOARD_SIZE; j++)
+      if(board[i][j]) occupied |= uint64_t(1) << (i*BOARD_SIZE + j);
+
+  //=== 2. Swap list: gain[d] is what the side capturing at depth d wins if nobody stops
+  int gain[2*NUM_P+1];
+  int d = 0;
+  gain[0] = (board[RANK][FILE] ? VALUE[board[RANK][FILE]->getType()] : 0);
+
+  uint64_t attackers = attackersTo(RANK,FILE,occupied);
+  int from = move.rankS*BOARD_SIZE + move.fileS;
+  PieceType onSquare = mover->getType(); // the piece the next capture takes
+  bool side = mover->getColor();
+
+  while(true)
+  {
+    // The capturing piece leaves its square: look again along the ray behind it, since a
+    // slider may have been lined up there (attackersTo() only ever sees the first piece)
+    occupied &= ~(uint64_t(1) << from);
+    attackers = (attackers | attackersTo(RANK,FILE,occupied)) & occupied;
+    side = !side;
+
+    // The least valuable piece of the side to capture
+    int next = -1;
+    for(int type = PAWN; type >= KING && next < 0; type--)
+    {
+      for(uint64_t a = attackers; a; a &= a - 1)
+      {
+        int const SQ = __builtin_ctzll(a);
+        Piece const * const p = board[SQ / BOARD_SIZE][SQ % BOARD_SIZE];
+        if(p->getColor() == side && p->getType() == type)
+        {
+          next = SQ; break;
+        }
+      }
+    }
+    if(next < 0) break;
+
+    d++;
+    gain[d] = VALUE[onSquare] - gain[d-1];
+    from = next;
+    onSquare = board[next / BOARD_SIZE][next % BOARD_SIZE]->getType();
+  }
+
+  //=== 3. Each side stops as soon as capturing again would lose
+  while(d > 0)
+  {
+    gain[d-1] = -max(-gain[d-1],gain[d]);
+    d--;
+  }
+  return gain[0];
+}
+
+
+
+/**
+ * Return the analysis of the pawn structure, from the pawn hash table if it has been seen
+ */
+PawnInfo const & ChessBoard::pawnStructure()
+{
+  if(!pawnTable) pawnTable = new PawnTable();
+  return pawnTable->probe(pawnKey,board);
+}
+
+
+
+/**
+ * Return the number of own pawns sheltering the king of a colour
+ */
+int ChessBoard::pawnShield(bool color)
+{
+  int const SQ = kingSquare[color];
+  return pawnStructure().shield(color,SQ / BOARD_SIZE,SQ % BOARD_SIZE);
+}
+
+
+
+/**
+ * Evaluate with a neural network from now on
+ */
+void ChessBoard::setNetwork(Nnue const* net)
+{
+  network = net;
+  if(network)
+  {
+    refreshAccumulator(WHITE); refreshAccumulator(BLACK);
+  }
+}
+
+
+
+/**
+ * Recompute the incrementally updated state (the position key and the evaluation) from scratch
+ */
+void ChessBoard::resetIncrementalState()
+{
+  positionKey = pawnKey = 0;
+  mgScore = egScore = gamePhase = 0;
+  for(int i = 0; i < BOARD_SIZE; i++)
+  {
+    for(int j = 0; j < BOARD_SIZE; j++)
+    {
+      if(!board[i][j]) continue;
+
+      positionKey ^= zobristPiece(board[i][j]->getColor(),board[i][j]->getType(),i,j);
+      if(board[i][j]->getType() == PAWN)
+        pawnKey ^= zobristPiece(board[i][j]->getColor(),PAWN,i,j);
+      updateEvaluation(board[i][j],i,j,1);
+      if(board[i][j]->getType() == KING) kingSquare[board[i][j]->getColor()] = i*BOARD_SIZE + j;
+    }
+  }
+
+  if(network)
+  {
+    refreshAccumulator(WHITE); refreshAccumulator(BLACK);
+  }
+
+  boardVersion++;
+
+  // A new game history starts from this position
+  keyHistory.assign(1,getKey());
+  reversibleStart = 0;
+}
+
+
+
+/**
+ * Evaluation for the side to move
+ */
+int ChessBoard::evaluate() const
+{
+  TbWDL wdl; int dtm;
+  if(probeEndgameValue(wdl,dtm)) return wdl == TB_DRAW ? 0 : wdl * (TB_WIN_SCORE - dtm);
+
+  if(network) return network->evaluate(accumulator,moveTurn);
+
+  int const PHASE = (gamePhase > PHASE_MAX ? PHASE_MAX : gamePhase);
+  int const SCORE = (mgScore * PHASE + egScore * (PHASE_MAX - PHASE)) / PHASE_MAX;
+  return moveTurn == WHITE ? SCORE : -SCORE;
+}
+
+
+
+/**
+ * Keep a submitted move (and the piece it took) for takeBack()
+ */
+void ChessBoard::commitMove(Move const & move, Piece* hostPiece, bool castling)
+{
+  UndoInfo u;
+  u.move = move; u.hostPiece = hostPiece; u.castling = castling;
+  u.halfmoveClock = halfmoveClock; u.reversibleStart = reversibleStart;
+  undoStack.push_back(u);
+
+  redoStack.clear(); // a new line of play
+}
+
+
+
+/**
+ * Test if a move about to be made is irreversible
  */
-void ChessBoard::resetBoard()
+bool ChessBoard::isIrreversible(Move const & move, bool& resetsClock)
 {
-  // Get a new chess board
-  clearBoard(); setupBoard();
-  // Reset the flags
-  moveTurn = WHITE;  gameOver = false;
+  Piece* const myPiece = board[move.rankS][move.fileS];
+  resetsClock = myPiece->getType() == PAWN || board[move.rankD][move.fileD] != nullptr;
+
+  if(resetsClock) return true;
+  if(myPiece->getType() == KING || myPiece->getType() == ROOK) return myPiece->getCount() == 0;
+  return false;
 }
 
 
 
 /**
- * Return a ptr to a king
+ * Append the position reached by a move to the history
  */
-Piece* ChessBoard::findKing(bool color) const
+void ChessBoard::recordPosition(bool irreversible, bool resetsClock)
 {
-  Piece* pieceList[NUM_P]; // ptrs to all the pieces of "color" colour
-  if(color == WHITE)
-  {
-    for(int i = 0; i < NUM_P; i++)
-      pieceList[i] = whitePieces[i];
-  }
-  else
-  {
-    for(int i = 0; i < NUM_P; i++)
-      pieceList[i] = blackPieces[i];
-  }
-
-  // Get the king
-  for(int i = 0; i < NUM_P; i++)
-  {
-    if(pieceList[i] && pieceList[i]->getType() == KING) return pieceList[i];
-  }
-
-  cerr << "Cannot find the king!" << endl << endl;
-  return nullptr;
+  halfmoveClock = (resetsClock ? 0 : halfmoveClock + 1);
+  keyHistory.push_back(getKey());
+  if(irreversible) reversibleStart = int(keyHistory.size()) - 1;
 }
 
 
 
 /**
- * Check if a king is in check
+ * Return how many times the current position has occurred in the game
  */
-bool ChessBoard::isInCheck(bool color) const
+int ChessBoard::repetitionCount() const
 {
-  // Locate my king (own side's king of "color" colour) and get its coodinates
-  Piece* myKing = findKing(color);
-  std::string p = myKing->getPos();
-  int fileKing = p[0] - 'A'; int rankKing = p[1] - '1';
-  
-  // Get the ptrs to all the pieces of the opponent
-  Piece* oppoPieceList[NUM_P];
-  if(color == WHITE)
-  {
-    for(int i = 0; i < NUM_P; i++)
-      oppoPieceList[i] = blackPieces[i];
-  }
-  else
-  {
-    for(int i = 0; i < NUM_P; i++)
-      oppoPieceList[i] = whitePieces[i];
-  }
-
-  // Traverse the opponent's pieces to see if my king would be attacked
-  for(int i = 0; i < NUM_P; i++)
-  {
-    if(!oppoPieceList[i]) continue;
-    
-    if(oppoPieceList[i]->movePieceRuleTest(rankKing,fileKing,board)) return true;
-  }
-  
-  return false;
+  // Same side to move: every other position, back to the last irreversible move
+  int const LAST = int(keyHistory.size()) - 1;
+  int count = 1;
+  for(int i = LAST - 2; i >= reversibleStart; i -= 2)
+    if(keyHistory[i] == keyHistory[LAST]) count++;
+  return count;
 }
 
 
-/** 
- * Make a "fake move" on the board, it can handle scenarios where there is an opponent's piece
- * as well as simplly moveing
- * Piece* & hostPiece should be a nullptr
- * The oppent's "taken out" piece is stored in Piece* & hostPiece
+
+/**
+ * Return the number of plies since the last capture or pawn move
  */
-void ChessBoard::makeFakeMove(int const RANK_S, int const FILE_S, int const RANK_D,
-                              int const FILE_D, Piece* & hostPiece)
-{
-  // Find my Piece
-  Piece* myPiece = board[RANK_S][FILE_S];
+int ChessBoard::getHalfmoveClock() const { return halfmoveClock; }
 
-  // Increment pawn/king/rook's moving counter
-  if(myPiece->getType() == PAWN)
-  {
-    static_cast<Pawn*>(myPiece)->incCount();
-  }
-  else if(myPiece->getType() == KING)
-  {
-    static_cast<King*>(myPiece)->incCount();
-  }
-  else if(myPiece->getType() == ROOK)
-  {
-    static_cast<Rook*>(myPiece)->incCount(); 
-  }
 
-  if(hostPiece)
-  {
-    cerr << "Should Pass a null pointer in makeFakeMove()" << endl << endl;
-    return;
-  }
 
-  // Test if the destination is hostile, if so: "take that piece"
-  if(myPiece->isDestHostile(RANK_D,FILE_D,board))
-  {
-    hostPiece = board[RANK_D][FILE_D]; // get the ptr to that hostile piece
-    const char hostPos[] = { char(FILE_D+'A'), char(RANK_D+'1'), '\0'};
-    
-    // "Taking" the hostile from the look-up on which isInCheck() and so forth depend
-    std::string tempPos;
-    if(hostPiece->getColor() == WHITE) // white hostile
-    {
-      for(int i = 0; i < NUM_P; i++) // locate the victim piece in whitePieces[]
-      {
-        if(!whitePieces[i]) continue;
-        
-        tempPos = whitePieces[i]->getPos();
-        if(tempPos.compare(hostPos) == 0)
-        {
-          whitePieces[i] = nullptr; // temporarily whiping out from the look up, not deleting!
-          break;
-        }
-      }
-    }
-    else// black hostile
+/**
+ * Test if neither side can ever mate
+ */
+bool ChessBoard::isInsufficientMaterial() const
+{
+  int minors = 0;
+  for(int i = 0; i < NUM_P; i++)
+    for(Piece const * p : {whitePieces[i], blackPieces[i]})
     {
-      for(int i = 0; i < NUM_P; i++)
-      {
-        if(!blackPieces[i]) continue;
-        
-        tempPos = blackPieces[i]->getPos();
-        if(tempPos.compare(hostPos) == 0)
-        {
-          blackPieces[i] = nullptr; 
-          break;
-        }
-      }
+      if(!p || p->getType() == KING) continue;
+      if(p->getType() != KNIGHT && p->getType() != BISHOP) return false;
+      minors++;
     }
-  }
-  
-  // My piece makes a "fake" move to board[RANK_D][FILE_D]
-  board[RANK_D][FILE_D] = myPiece;
-  board[RANK_S][FILE_S] = nullptr;
-  myPiece->setPos(RANK_D,FILE_D);
+  return minors <= 1;
 }
 
 
+
 /**
- * Undo the fake move via makeFakeMove()
+ * Return the legal destinations of the piece on a square
  */
-void ChessBoard::undoMakeFakeMove(int const RANK_S, int const FILE_S, int const RANK_D,
-                                  int const FILE_D, Piece* & hostPiece)
+uint64_t ChessBoard::legalTargets(char const * square)
 {
-  // My piece
-  Piece* myPiece = board[RANK_D][FILE_D];
-  bool myColor = myPiece->getColor();
-
-  // Decrement pawn/king/rook's moving counter
-  if(myPiece->getType() == PAWN)
-  {
-    static_cast<Pawn*>(myPiece)->decCount();
-  } 
-  else if(myPiece->getType() == KING)
-  {
-    static_cast<King*>(myPiece)->decCount();
-  }
-  else if(myPiece->getType() == ROOK)
-  {
-    static_cast<Rook*>(myPiece)->decCount();
-  }
-  
-  // Restore my piece
-  board[RANK_S][FILE_S] = myPiece; myPiece->setPos(RANK_S,FILE_S);
-
-  // Restore the taken piece
-  if(hostPiece != nullptr)
-  {
-    board[RANK_D][FILE_D] = hostPiece;
+  int const FILE = square[0] - 'A', RANK = square[1] - '1';
+  if(FILE < 0 || FILE >= BOARD_SIZE || RANK < 0 || RANK >= BOARD_SIZE) return 0;
 
-    // Put back the taken-out piece into the white(black)Pieces
-    if(hostPiece->getColor()==WHITE && hostPiece->getColor()!= myColor)
-    {
-      for(int i = 0; i < NUM_P; i++)
-      {
-        if(whitePieces[i] == nullptr)
-        {
-          whitePieces[i] = hostPiece; return;
-        }
-      }
-    }
-    else
-    {
-      cerr << "Cannot put back the taken piece!" << endl << endl;
-      return;
-    }
-    
-    // Put back into the blackPieces list
-    if(hostPiece->getColor()==BLACK && hostPiece->getColor()!= myColor)
-    {
-      for(int i = 0; i < NUM_P; i++)
-      {
-        if(blackPieces[i] == nullptr)
-        {
-          blackPieces[i] = hostPiece; return; 
-        }
-      }
-    }
-    else
-    {
-      cerr << "Cannot put back the taken piece!" << endl << endl;
-      return;
-    }
-  }
-  else
-    board[RANK_D][FILE_D] = nullptr;
+  return legalTargetsAll()[RANK*BOARD_SIZE + FILE];
 }
 
 
 
 /**
- * Simply telling if an action of moving a piece and/or take a piece would save the king from
- * being in check, effectively will not modify the data members 
+ * Return the legal destination masks of all the squares, computed once per position
  */
-bool ChessBoard::doesThisMoveSaveKing(int const RANK_S, int const FILE_S,
-                                      int const RANK_D, int const FILE_D)
+uint64_t const * ChessBoard::legalTargetsAll()
 {
-  //--- 1. Find my Piece at the destination and get its position and color
-  Piece* myPiece = board[RANK_S][FILE_S];
-  bool myColor = myPiece->getColor();
- 
-  //--- 2. Test if legal
-  if(myPiece->movePieceRuleTest(RANK_D,FILE_D,board) == false) return false;
-
-  //--- 3.  Attempting some "fake moves" here:
-  Piece* hostPiece = nullptr; // ptr to the hostile piece at destination (if there is such one)
-  makeFakeMove(RANK_S,FILE_S,RANK_D,FILE_D,hostPiece); // make a "fake move"
+  if(targetsVersion == boardVersion) return legalTargetCache;
 
-  //--- 4.  Test if the king would be safe
-  if(!isInCheck(myColor)) // no checkmate anymore: god save the king!
-  {
-    undoMakeFakeMove(RANK_S,FILE_S,RANK_D,FILE_D,hostPiece); // restore the pieces
-    return true;
-  }
-  else // can't save the king: restore anyway
+  for(int sq = 0; sq < BOARD_SIZE*BOARD_SIZE; sq++) legalTargetCache[sq] = 0;
+  if(!gameOver)
   {
-    undoMakeFakeMove(RANK_S,FILE_S,RANK_D,FILE_D,hostPiece);
-    return false; // can't save the king sorry
+    std::vector<Move> moves;
+    generateLegalMoves(moves);
+    for(Move const & m : moves)
+      legalTargetCache[m.rankS*BOARD_SIZE + m.fileS] |=
+        uint64_t(1) << (m.rankD*BOARD_SIZE + m.fileD);
   }
+
+  targetsVersion = boardVersion; // the probes of the generation leave it as it was
+  return legalTargetCache;
 }
 
 
 
 /**
- * Given a set of a board plus the pieces (not necessary the member ones), Check if there
- * is no further valid move. Used to test for checkmate and stalemate, provided that a 
- * valid move has been ubmitted.
+ * End the game if the last move drew it by repetition or by the fifty-move rule
  */
-bool ChessBoard::isNoFurtherValidMove(bool color)
+void ChessBoard::reportDraw()
 {
-  std::string myPos;
-  int myRank, myFile;
-
-  // Get the ptrs to the white/black pieces only
-  Piece* pieceList[NUM_P];
-  if(color == WHITE)
+  if(repetitionCount() >= 3)
   {
-    for(int i = 0; i < NUM_P; i++)
-      pieceList[i] = whitePieces[i];
+    gameOver = true;
+    *reports << "Draw by threefold repetition. Game over." << endl;
   }
-  else
+  else if(halfmoveClock >= 100)
   {
-    for(int i = 0; i < NUM_P; i++)
-      pieceList[i] = blackPieces[i];
-  }
-  
-  // Move my pieces 
-  for(int k = 0; k < NUM_P; k++)
-  {  
-    if(!pieceList[k]) continue;
-
-    myPos = pieceList[k]->getPos(); myFile = myPos[0] - 'A'; myRank = myPos[1] - '1';
-
-    for(int i = 0; i < BOARD_SIZE; i++)
-    {
-      for(int j = 0; j < BOARD_SIZE; j++)
-      {
-        //See if any moves of the pieces of the own side could save the king
-        if(doesThisMoveSaveKing(myRank,myFile,i,j)) return false;
-      }
-    }
+    gameOver = true;
+    *reports << "Draw by the fifty-move rule. Game over." << endl;
   }
-
-  return true;
 }
 
 
@@ -439,141 +1547,24 @@ bool ChessBoard::isNoFurtherValidMove(bool color)
  */
 bool ChessBoard::castling(Piece* const myKing, int const RANK_D, int const FILE_D)
 {
-  //=== If myKing isn't really a king: reject his request
-  if(myKing->getType() != KING) return false;
-
-  //=== myKing mustn't have ever moved
-  if(static_cast<King*>(myKing)->getCount() != 0) return false;
+  //=== Test all the conditions first
+  if(myKing->getColor() != moveTurn) return false;
+  if(!isCastlingLegal(myKing,RANK_D,FILE_D)) return false;
 
-  //=== myKing should be safe now
-  if(isInCheck(moveTurn)) return false;
-
-  //=== Get myKing's position and color: which is useful
+  //=== Get myKing's and the rook's positions: which is useful for printing
   string myPos = myKing->getPos();
-  int const FILE_S = myPos[0] - 'A'; int const RANK_S = myPos[1] - '1';
+  int const FILE_S = myKing->getFile(); int const RANK_S = myKing->getRank();
+  Piece* myRook = board[RANK_S][FILE_D < FILE_S ? 0 : BOARD_SIZE-1];
+  string rookPos = myRook->getPos();
 
-  Piece* myRook = nullptr; string rookPos; // the rook's position
-  
-  //=== The king should moves horizontally
-  if(RANK_S != RANK_D) return false;
-  
   //=== Castling!
-  if(FILE_S - FILE_D == 2) //----------white moving left, black moving right
-  {
-    myRook = board[RANK_S][0];
-    
-    // The rook mustn't have ever moved as well
-    if(!myRook) return false;
-
-    if(myRook->getType()!=ROOK || myRook->getColor()!= moveTurn) return false;
-
-    if(static_cast<Rook*>(myRook)->getCount() != 0) return false;
-
-    // Ensure that there is nothing between the king and the rook
-    for(int i = 1; i < FILE_S ; i++)
-    {
-      if(board[RANK_S][FILE_S-i] != nullptr) return false;
-    }
-
-    // Get the rook's (origianl) position
-    rookPos = myRook->getPos();
-
-    // His majesty starts to moves and cannot be attacked during his moving
-    for(int i = 0; i < 2; i++)
-    {
-      if(doesThisMoveSaveKing(RANK_S, FILE_S - i, RANK_S, FILE_S - i - 1) == true)
-      {
-        // submit those changes first
-        board[RANK_S][FILE_S-i-1] = myKing;
-        board[RANK_S][FILE_S-i] = nullptr;
-        myKing->setPos(RANK_S,FILE_S-i-1);
-      }
-      else // undo the changes then quit
-      {
-        if(i == 1)
-        {
-          board[RANK_S][FILE_S] = myKing;
-          board[RANK_S][FILE_S-1] = nullptr;
-          myKing->setPos(RANK_S,FILE_S);
-        }
-        
-        return false;
-      }
-    }
-    // Submit the king's move!
-    board[RANK_S][FILE_D] = myKing;
-    board[RANK_S][FILE_S-1] = nullptr;
-    myKing->setPos(RANK_S,FILE_D);
-    static_cast<King*>(myKing)->incCount(); // update count
-      
-    // The rook moves now
-    board[RANK_S][FILE_D+1] = myRook; // rook jumps over the king
-    board[RANK_S][0] = nullptr;
-    myRook->setPos(RANK_S,FILE_D+1);
-    static_cast<Rook*>(myRook)->incCount();
-      
-  }
-  
-  //----- King moving right: the right rook moves
-  if(FILE_D - FILE_S == 2)//----------white moving right, black moving left
-  {
-    myRook = board[RANK_S][BOARD_SIZE-1];
-    
-    // The rook mustn't have ever moved as well
-    if(!myRook) return false;
-
-    if(myRook->getType()!=ROOK || myRook->getColor()!= moveTurn) return false;
-
-    if(static_cast<Rook*>(myRook)->getCount() != 0) return false;
-
-    // Ensure that there is nothing between the king and the rook
-    for(int i = 1; i < BOARD_SIZE-1-FILE_S ; i++)
-    {
-      if(board[RANK_S][FILE_S+i] != nullptr) return false;
-    }
-    
-    // Get the rook's (origianl) position
-    rookPos = myRook->getPos();
-        
-    // His majesty starts to moves and cannot be attacked during his moving
-    for(int i = 0; i < 2; i++)
-    {
-      if(doesThisMoveSaveKing(RANK_S, FILE_S + i, RANK_S, FILE_S + i + 1) == true)
-      {
-        // submit those changes first
-        board[RANK_S][FILE_S+i+1] = myKing;
-        board[RANK_S][FILE_S+i] = nullptr;
-        myKing->setPos(RANK_S,FILE_S+i+1);
-        //static_cast<King*>(myKing)->incCount();
-      }
-      else // undo the changes then quit
-      {
-        if(i == 1)
-        {
-          board[RANK_S][FILE_S] = myKing;
-          board[RANK_S][FILE_S+1] = nullptr;
-          myKing->setPos(RANK_S,FILE_S);
-        }
-        
-        return false;
-      }
-    }
-      
-    // Submit the king's move!
-    board[RANK_S][FILE_D] = myKing;
-    board[RANK_S][FILE_S+1] = nullptr;
-    myKing->setPos(RANK_S,FILE_D);
-    static_cast<King*>(myKing)->incCount(); // update count
-
-    board[RANK_S][FILE_D-1] = myRook; // rook at the left to the king
-    board[RANK_S][BOARD_SIZE-1] = nullptr;
-    myRook->setPos(RANK_S,FILE_D-1);
-    static_cast<Rook*>(myRook)->incCount();
-    
-  }
+  bool resetsClock;
+  bool const IRREVERSIBLE = isIrreversible(Move(RANK_S,FILE_S,RANK_D,FILE_D),resetsClock);
+  makeCastlingMove(RANK_S,FILE_S,FILE_D);
+  commitMove(Move(RANK_S,FILE_S,RANK_D,FILE_D),nullptr,true);
   
   //=== Printing
-  cout << *myKing << " commits castling and moves from " << myPos << " to "
+  *reports << *myKing << " commits castling and moves from " << myPos << " to "
        << myKing->getPos() << ", "
        << *myRook << " moves from " << rookPos << " to "
        << myRook->getPos() << endl;
@@ -581,36 +1572,47 @@ bool ChessBoard::castling(Piece* const myKing, int const RANK_D, int const FILE_
   //=== Test if this leads to the opponent being in check or in checkmate or in stalemate
   bool oppoColor = (moveTurn == WHITE ? BLACK : WHITE);
 
-  // Leading to opponent in check? 
-  bool incheckFlag = isInCheck(oppoColor);
-  // Leading to opponent has no legal move?
-  bool noFurtherMove = isNoFurtherValidMove(oppoColor);
+  bool incheckFlag, noFurtherMove;
+  {
+    STATS_TIMER(STAT_GAME_END_NS);
+    // Leading to opponent in check? 
+    TRACE_BEGIN(checkSpan,"opponent check");
+    incheckFlag = isInCheck(oppoColor);
+    TRACE_END(checkSpan);
+    // Leading to opponent has no legal move?
+    TRACE_BEGIN(scanSpan,"mate/stalemate scan");
+    noFurtherMove = isNoFurtherValidMove(oppoColor);
+    TRACE_END(scanSpan);
+  }
 
   if(incheckFlag && noFurtherMove) // opponent in checkmate
   {
     gameOver = true;
-    cout << (moveTurn == WHITE ? "Black " : "White ") << "is in checkmate" << endl; 
+    *reports << (moveTurn == WHITE ? "Black " : "White ") << "is in checkmate" << endl; 
   }
   else if(incheckFlag && !noFurtherMove) // opponent in check only
   {
     if(oppoColor == WHITE)
     {
       //whiteInCheck = true;
-      cout << "White is in check" << endl;
+      *reports << "White is in check" << endl;
     }
     else
     {
       //blackInCheck = true;
-      cout << "Black is in check" << endl;
+      *reports << "Black is in check" << endl;
     }
   }
   else if(!incheckFlag && noFurtherMove) // opponnent in stalemate
   {
     gameOver = true;
-    cout << "Stalemate. Game over." << endl;
+    *reports << "Stalemate. Game over." << endl;
   }
   // Otherwise: normal move and exit
   moveTurn = !moveTurn;// next trun: the opponent moves
+  recordPosition(IRREVERSIBLE,resetsClock);
+  if(!gameOver) reportDraw();
+  if(!gameOver) reportEndgameTables();
 
   return true;
 }
@@ -623,7 +1625,13 @@ bool ChessBoard::castling(Piece* const myKing, int const RANK_D, int const FILE_
  */
 void ChessBoard::submitMove(char const * srcPos, char const * desPos)
 {
+  STATS_TIMER(STAT_SUBMIT_MOVE_NS);
+  STATS_COUNT(STAT_SUBMITTED_MOVES);
+  TRACE_ROOT("submitMove");
+  if(recorder) recorder->recordMove(srcPos,desPos);
+
   //=== Geting coordinates in int
+  TRACE_BEGIN(parseSpan,"parse input");
   int const FILE_S = srcPos[0] - 'A'; int const RANK_S = srcPos[1] - '1';
   int const FILE_D = desPos[0] - 'A'; int const RANK_D = desPos[1] - '1';
 
@@ -652,20 +1660,30 @@ void ChessBoard::submitMove(char const * srcPos, char const * desPos)
   }
   else
     myPiece = board[RANK_S][FILE_S];
+  TRACE_END(parseSpan);
 
   //=== 1.3 Test for castling
+  TRACE_BEGIN(castlingSpan,"castling attempt");
   if(castling(myPiece,RANK_D,FILE_D))
     return;
+  TRACE_END(castlingSpan);
 
   //=== 2. Test if the move is legal
-  if(myPiece->movePieceRuleTest(RANK_D,FILE_D,board) == false)
+  TRACE_BEGIN(ruleSpan,"rule test");
+  STATS_COUNT(STAT_RULE_TESTS);
+  if(ruleTest(myPiece,RANK_D,FILE_D,board) == false)
   {
     cerr << *myPiece << " cannot move to " << desPos << "!" << endl;
     return;
   }
+  TRACE_END(ruleSpan);
 
   //=== 3. My side make a fake move
+  TRACE_BEGIN(fakeMoveSpan,"fake move");
+  bool resetsClock;
+  bool const IRREVERSIBLE = isIrreversible(Move(RANK_S,FILE_S,RANK_D,FILE_D),resetsClock);
   makeFakeMove(RANK_S,FILE_S,RANK_D,FILE_D,hostPiece);
+  TRACE_END(fakeMoveSpan);
 
   //=== 4. Get the info about the hostile piece (to print when a piece is taken out)
   std::string hostPieceInfo;
@@ -694,7 +1712,10 @@ void ChessBoard::submitMove(char const * srcPos, char const * desPos)
   }
   
   //=== 6. Test if this fake move leads to own sides' incheck or save the king
-  if(isInCheck(moveTurn)) // my side is in check
+  TRACE_BEGIN(selfCheckSpan,"self-check test");
+  bool const SELF_CHECK = isInCheck(moveTurn);
+  TRACE_END(selfCheckSpan);
+  if(SELF_CHECK) // my side is in check
   {
     // Restore
     undoMakeFakeMove(RANK_S,FILE_S,RANK_D,FILE_D,hostPiece);
@@ -706,56 +1727,78 @@ void ChessBoard::submitMove(char const * srcPos, char const * desPos)
   {
     //if(moveTurn == WHITE) whiteInCheck = false;
     //else blackInCheck = false;
-    
-    delete hostPiece; // commit this move
+
+    // Make the move for good this time, the incrementally updated state with it
+    undoMakeFakeMove(RANK_S,FILE_S,RANK_D,FILE_D,hostPiece);
+    hostPiece = nullptr;
+    makeBoardMove(RANK_S,FILE_S,RANK_D,FILE_D,hostPiece);
+    commitMove(Move(RANK_S,FILE_S,RANK_D,FILE_D),hostPiece,false);
 
     // print out this move
-    cout << *myPiece << " moves from " << srcPos << " to " << myPiece->getPos();
+    *reports << *myPiece << " moves from " << srcPos << " to " << myPiece->getPos();
     if(hostPiece)
-      cout << " taking " << hostPieceInfo;
+      *reports << " taking " << hostPieceInfo;
     
-    cout << endl;
+    *reports << endl;
   }
 
   //=== 7. Test if this leads to the opponent being in check or in checkmate or in stalemate
   bool oppoColor = (moveTurn == WHITE ? BLACK : WHITE);
 
-  // Leading to opponent in check? 
-  bool incheckFlag = isInCheck(oppoColor);
-  // Leading to opponent has no legal move?
-  bool noFurtherMove = isNoFurtherValidMove(oppoColor);
+  bool incheckFlag, noFurtherMove;
+  {
+    STATS_TIMER(STAT_GAME_END_NS);
+    // Leading to opponent in check? 
+    TRACE_BEGIN(checkSpan,"opponent check");
+    incheckFlag = isInCheck(oppoColor);
+    TRACE_END(checkSpan);
+    // Leading to opponent has no legal move?
+    TRACE_BEGIN(scanSpan,"mate/stalemate scan");
+    noFurtherMove = isNoFurtherValidMove(oppoColor);
+    TRACE_END(scanSpan);
+  }
 
   if(incheckFlag && noFurtherMove) // opponent in checkmate
   {
     gameOver = true;
-    cout << (moveTurn == WHITE ? "Black " : "White ") << "is in checkmate" << endl; 
+    *reports << (moveTurn == WHITE ? "Black " : "White ") << "is in checkmate" << endl; 
   }
   else if(incheckFlag && !noFurtherMove) // opponent in check only
   {
     if(oppoColor == WHITE)
     {
       //whiteInCheck = true;
-      cout << "White is in check" << endl;
+      *reports << "White is in check" << endl;
     }
     else
     {
       //blackInCheck = true;
-      cout << "Black is in check" << endl;
+      *reports << "Black is in check" << endl;
     }
   }
   else if(!incheckFlag && noFurtherMove) // opponnent in stalemate
   {
     gameOver = true;
-    cout << "Stalemate. Game over." << endl;
-    return;
+    *reports << "Stalemate. Game over." << endl;
   }
   // Otherwise: normal move and exit
   moveTurn = !moveTurn;// next trun: the opponent moves
+  recordPosition(IRREVERSIBLE,resetsClock);
+  if(!gameOver) reportDraw();
+  if(!gameOver) reportEndgameTables();
 }
 
 
 
-ChessBoard::~ChessBoard(){ clearBoard(); }
+ChessBoard::~ChessBoard()
+{
+  clearBoard();
+  for(int i = 0; i < BOARD_SIZE; i++)
+    delete [] board[i];
+  delete [] board;
+  delete [] whitePieces; delete [] blackPieces;
+  delete pawnTable;
+}
 
 
 
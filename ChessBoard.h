@@ -1,41 +1,193 @@
 #ifndef CHESSBOARD_H
 #define CHESSBOARD_H
 
+#include <vector>
+#include <ostream>
+#include <cstdint>
 #include "piece.h"
+#include "move.h"
+#include "tablebase.h"
+#include "nnue.h"
+#include "pawns.h"
+
+class EndgameTables;
+class SessionRecorder;
 
 class ChessBoard
 {
+  friend class ChessBoardBench; // bench.cpp times the private rules routines
+  friend class ChessBoardTest; // tests.cpp checks the incrementally updated state
   static const int NUM_P; // the number of pieces at the beginning for each side, which is 16
     
   Piece*** board; // the chess game board
   Piece** whitePieces; // fast look-up for the white piece ptrs
   Piece** blackPieces; // fast look-up for the black piece ptrs
+  PiecePool piecePool; // every piece of the game, taken ones included
 
   bool moveTurn; // if = WHITE: white's turn to move; =BLACK: black's turn to move
   bool gameOver; // true if a board game ends i.e. a king being checkmated or stalemate
+  std::ostream* reports; // where the moves and the ends of the game are reported, not owned
+  SessionRecorder* recorder; // log of the calls received, not owned; nullptr for none
+
+  EndgameTables const* endgameTables; // endgame table files to consult, not owned
+
+  uint64_t positionKey; // Zobrist key of the pieces, updated by putPiece()/takePiece()
+  uint64_t pawnKey; // Zobrist key of the pawns only, updated the same way
+
+  PawnTable* pawnTable; // analysed pawn structures, allocated on the first query
+
+  // Piece-square evaluation, White's minus Black's, updated by putPiece()/takePiece()
+  int mgScore; // middlegame score
+  int egScore; // endgame score
+  int gamePhase; // PHASE_MAX with all the pieces on the board, 0 with kings and pawns only
+
+  Nnue const* network; // neural network evaluation, not owned; nullptr for the tables above
+  NnueAccumulator accumulator; // its first layer, updated by putPiece()/takePiece()
+  int kingSquare[2]; // rank*BOARD_SIZE+file of each king, indexed by colour
+
+  unsigned long boardVersion; // changed by every putPiece()/takePiece(), not by the probes
+  unsigned long targetsVersion; // boardVersion when legalTargetCache was filled
+  uint64_t legalTargetCache[BOARD_SIZE*BOARD_SIZE];
+
+  std::vector<uint64_t> keyHistory; // keys of the positions of the game, the current one last
+  int halfmoveClock; // plies since the last capture or pawn move
+  int reversibleStart; // index in keyHistory of the first position since the last
+                       // irreversible move: no earlier position can occur again
+
+  struct UndoInfo
+  {
+    Move move;
+    Piece* hostPiece; // the piece taken by the move, nullptr if none
+    bool castling;
+    int halfmoveClock; // before the move
+    int reversibleStart;
+  };
+  std::vector<UndoInfo> undoStack; // moves of the game and of makeMove(), for undoMove()
+
+  struct RedoInfo
+  {
+    Move move;
+    bool gameOver; // the game was over after the move
+  };
+  std::vector<RedoInfo> redoStack; // moves taken back by takeBack(), the latest last
   
+  /**
+   * Start the game again from the initial position, as resetBoard() does unrecorded
+   */
+  void newGame();
+
+  /**
+   * Make a move / take back the last one, as makeMove() and undoMove() do unrecorded
+   */
+  void applyMove(Move const & move);
+  void retractMove();
+
   /**
    * Set up a chess board. Called by the constructor or the reset() only.
-   * Make sure board, whitePieces and blackPieces are all nullptr when calling
+   * Make sure the board is cleared (clearBoard()) when calling
    */
   void setupBoard();
 
+  /**
+   * Set up a chess board from the piece placement, side to move and castling fields of a
+   * FEN string. Same preconditions as setupBoard(); returns false if the string is malformed
+   */
+  bool setupFromFEN(char const * fen);
+
   /**
    * Clear the board as well as the two piece lists
    */
   void clearBoard();
 
+  /**
+   * Allocate the board and the two piece lists the first time, and empty them
+   */
+  void makeEmptyBoard();
+
   /**
    * Return a ptr to a king
    * Especially usefully when needing to make a fake move to test for e.g. incheck 
    */
   Piece* findKing(bool color) const;
 
+  /**
+   * Put a piece on an empty square / lift the piece off a square. Every move made goes through
+   * these two so that the incrementally updated state stays in step
+   */
+  void putPiece(Piece* piece, int const RANK, int const FILE);
+  Piece* takePiece(int const RANK, int const FILE);
+
+  /**
+   * Same, changing the board (and where the kings are) only: for the legality probes, which
+   * undo their moves at once and so leave the incrementally updated state as it was
+   */
+  void setSquare(Piece* piece, int const RANK, int const FILE);
+  Piece* clearSquare(int const RANK, int const FILE);
+
+  /**
+   * Take a piece out of / put it back into the look-up of its side, on which isInCheck() and
+   * so forth depend
+   */
+  void unlistPiece(Piece* piece);
+  void relistPiece(Piece* piece);
+
+  /**
+   * Add (sign = 1) or remove (sign = -1) the contribution of a piece on a square to the
+   * running evaluation
+   */
+  void updateEvaluation(Piece const * piece, int const RANK, int const FILE, int const sign);
+
+  /**
+   * Add (sign = 1) or remove (sign = -1) the network features of a piece on a square. A king
+   * put on a square refreshes its side's whole accumulator instead
+   */
+  void updateAccumulator(Piece const * piece, int const RANK, int const FILE, int const sign);
+
+  /**
+   * Recompute one side's accumulator from the pieces on the board
+   */
+  void refreshAccumulator(bool perspective);
+
+  /**
+   * Move a piece to an empty square
+   */
+  void movePiece(int const RANK_S, int const FILE_S, int const RANK_D, int const FILE_D);
+
+  /**
+   * Recompute the incrementally updated state from scratch, after setting up a board
+   */
+  void resetIncrementalState();
+
+  /**
+   * Keep a move made by submitMove() (before its position is recorded) so that it can be
+   * taken back: the piece it took stays allocated until the board is reset
+   */
+  void commitMove(Move const & move, Piece* hostPiece, bool castling);
+
+  /**
+   * Test if a move about to be made can never be undone by later moves: a pawn move, a
+   * capture, castling or the first move of a king or a rook (losing castling rights).
+   * resetsClock tells whether it resets the halfmove clock (pawn moves and captures)
+   */
+  bool isIrreversible(Move const & move, bool& resetsClock);
+
+  /**
+   * Append the position reached by a move (once the side to move has changed) to the history
+   */
+  void recordPosition(bool irreversible, bool resetsClock);
+
+  /**
+   * End the game and say so if the last move drew it by threefold repetition or by the
+   * fifty-move rule
+   */
+  void reportDraw();
+
   /**
    * Make a "fake move" on the board, it can handle scenarios where there is an opponent's piece
    * as well as simplly moveing
    * Piece* & hostPiece should be a nullptr
    * The oppent's "taken out" piece is stored in Piece* & hostPiece
+   * Only the board changes: the move must be undone before any other is made
    */
   void makeFakeMove(int const RANK_S, int const FILE_S,
                     int const RANK_D, int const FILE_D, Piece*& hostPiece);
@@ -45,6 +197,15 @@ class ChessBoard
    */
   void undoMakeFakeMove(int const RANK_S, int const FILE_S, int const RANK_D,
                         int const FILE_D, Piece*& hostPiece);
+
+  /**
+   * Make a move (not castling) for good / undo it, as makeFakeMove() / undoMakeFakeMove()
+   * do but keeping the position key, the evaluation and the accumulators in step
+   */
+  void makeBoardMove(int const RANK_S, int const FILE_S,
+                     int const RANK_D, int const FILE_D, Piece*& hostPiece);
+  void undoBoardMove(int const RANK_S, int const FILE_S, int const RANK_D,
+                     int const FILE_D, Piece*& hostPiece);
   
   /**
    * Check if a king is in check (used to test if a submitted move would lead to this)
@@ -59,6 +220,31 @@ class ChessBoard
   bool doesThisMoveSaveKing(int const RANK_S, int const FILE_S,
                             int const RANK_D, int const FILE_D);
 
+  /**
+   * Return the squares of the pieces of a colour whose moves need a fake move to be tested:
+   * all of them if their king is in check, otherwise the king and the pieces pinned to it by
+   * an opponent's slider. Any other piece cannot expose its king, so that following its rule
+   * is enough
+   */
+  uint64_t piecesToProbe(bool color) const;
+
+  /**
+   * Test if a move of a piece is legal, given piecesToProbe() of its side
+   */
+  bool isMoveLegal(int const RANK_S, int const FILE_S, int const RANK_D, int const FILE_D,
+                   uint64_t const PROBED);
+
+  /**
+   * Test if castling is allowed for a king going to (RANK_D, FILE_D), without moving anything
+   */
+  bool isCastlingLegal(Piece* const myKing, int const RANK_D, int const FILE_D);
+
+  /**
+   * Move the king (from FILE_S to FILE_D) and the rook of a legal castling, and undo it
+   */
+  void makeCastlingMove(int const RANK_S, int const FILE_S, int const FILE_D);
+  void undoCastlingMove(int const RANK_S, int const FILE_S, int const FILE_D);
+
   /**
    * Castling, part of the submitMove()
    */
@@ -71,10 +257,34 @@ class ChessBoard
    */
   bool isNoFurtherValidMove(bool color);
 
+  /**
+   * Return the squares (bit rank*BOARD_SIZE+file) of the pieces of both sides attacking
+   * (RANK, FILE), only counting the pieces in occupied and letting sliders see through the
+   * squares missing from it
+   */
+  uint64_t attackersTo(int const RANK, int const FILE, uint64_t const occupied) const;
+
+  /**
+   * End the game and say so if the endgame tables cover the position after a committed move:
+   * its result is then known
+   */
+  void reportEndgameTables();
+
   
  public:
 
   ChessBoard();
+
+  /**
+   * Same, reporting the game on a stream of one's own instead of cout (e.g. one with no
+   * buffer, which drops everything, for a board embedded in another program)
+   */
+  explicit ChessBoard(std::ostream& reportStream);
+
+  /**
+   * Start a game from an arbitrary position given as a FEN string
+   */
+  explicit ChessBoard(char const * fen);
   
   /**
    * Make one moving on the chessboard
@@ -87,6 +297,156 @@ class ChessBoard
    */
   void resetBoard();
 
+  /**
+   * Replace the current game by the position given as a FEN string, e.g.
+   * "8/8/8/4k3/8/8/8/4KQ2 w - -". Returns false (and resets to the initial position)
+   * if the string cannot be parsed
+   */
+  bool loadPosition(char const * fen);
+
+  /**
+   * Return the pool of the pieces, whose counts show what the games allocated
+   */
+  PiecePool const & getPiecePool() const;
+
+  /**
+   * Return the piece at a square, nullptr if the square is empty
+   */
+  Piece* pieceAt(int rank, int file) const;
+
+  /**
+   * Return the side to move (WHITE or BLACK)
+   */
+  bool getMoveTurn() const;
+
+  /**
+   * Consult a set of endgame table files (nullptr to stop): a move reaching a position they
+   * cover ends the game, and evaluate() scores such positions from them. The tables must
+   * outlive the board
+   */
+  void setEndgameTables(EndgameTables const* tables);
+
+  /**
+   * Append every submitMove(), resetBoard(), loadPosition(), takeBack(), redo(), makeMove()
+   * and undoMove() to a session log from now on (nullptr to stop). A replay starts from the
+   * initial position, so a recorder is attached before the first move of a game. The
+   * recorder must outlive the board
+   */
+  void setRecorder(SessionRecorder* rec);
+
+  /**
+   * Look up the current position in the endgame tables, returns false if none covers it
+   */
+  bool probeEndgameTables(TbResult& result) const;
+
+  /**
+   * Same, without searching for the best move: the result for the side to move and the
+   * distance to mate in plies. Costs a count of the pieces when there are more than any
+   * table has
+   */
+  bool probeEndgameValue(TbWDL& wdl, int& dtm) const;
+
+  /**
+   * Look up a king and pawn versus king position in the KPK bitbase. Returns false if the
+   * material is different; otherwise wdl is TB_WIN/TB_LOSS/TB_DRAW for the side to move.
+   * Does not allocate
+   */
+  bool probeKPK(TbWDL& wdl) const;
+
+  /**
+   * List every legal move of the side to move (castling included)
+   */
+  void generateLegalMoves(std::vector<Move>& moves);
+
+  /**
+   * Make a legal move / take it back, for searching: nothing is printed and the end of the
+   * game is not tested for. Moves must be undone before the next submitMove()
+   */
+  void makeMove(Move const & move);
+  void undoMove();
+
+  /**
+   * Step back / forward through the moves of the game: take back the last n moves, or
+   * replay up to n moves taken back (until another move is submitted). Each step is O(1)
+   * and no piece is allocated or freed, taken pieces being kept until the board is reset.
+   * Return the number of moves actually taken back / replayed
+   */
+  int takeBack(int n = 1);
+  int redo(int n = 1);
+
+  /**
+   * Test if the side to move is in check
+   */
+  bool isSideToMoveInCheck() const;
+
+  /**
+   * Return the Zobrist key of the current position (pieces and side to move)
+   */
+  uint64_t getKey() const;
+
+  /**
+   * Return how many times the current position has occurred in the game, itself included.
+   * Only the positions since the last irreversible move are scanned
+   */
+  int repetitionCount() const;
+
+  /**
+   * Return the number of plies since the last capture or pawn move
+   */
+  int getHalfmoveClock() const;
+
+  /**
+   * Test if neither side can ever mate: the kings alone, or with a single knight or bishop
+   */
+  bool isInsufficientMaterial() const;
+
+  /**
+   * Return the legal destinations of the piece on a square (e.g. "E2") as a mask of bits
+   * rank*BOARD_SIZE+file; 0 for an empty square, a piece of the side not to move or a game
+   * that is over
+   */
+  uint64_t legalTargets(char const * square);
+
+  /**
+   * Return the legal destination masks of all the squares, indexed by rank*BOARD_SIZE+file.
+   * Computed once per position: further calls cost nothing until a move is made
+   */
+  uint64_t const * legalTargetsAll();
+
+  /**
+   * Static exchange evaluation: the material (in centipawns) won by the side making a move
+   * to its destination square once every recapture there has been played out, each side
+   * taking with its least valuable piece and free to stop. Pins are not considered, and the
+   * board is not modified. The move should be legal; castling gives 0
+   */
+  int see(Move const & move) const;
+
+  /**
+   * Evaluation in centipawns, positive if good for the side to move: the network's output if
+   * one is set, otherwise the tapered piece-square evaluation (the middlegame and endgame
+   * scores blended by the game phase). Both are kept up to date by every move. A position
+   * the endgame tables cover scores 0 if drawn, otherwise +/-(TB_WIN_SCORE - distance to mate)
+   */
+  int evaluate() const;
+
+  /**
+   * Return the analysis of the pawn structure (passed, isolated, doubled and backward pawns,
+   * king shelters and their score), cached by pawn key so that a structure already seen
+   * costs a single probe
+   */
+  PawnInfo const & pawnStructure();
+
+  /**
+   * Return the number of own pawns sheltering the king of a colour
+   */
+  int pawnShield(bool color);
+
+  /**
+   * Evaluate with a neural network from now on (nullptr to go back to the piece-square
+   * tables). The network must outlive the board
+   */
+  void setNetwork(Nnue const* net);
+
   virtual ~ChessBoard();
   
 };
@@ -1,14 +1,39 @@
 #include"ChessBoard.h"
+#include"tbfile.h"
+#include"session.h"
 #include<iostream>
+#include<string>
 
 using namespace std;
 
-int main() {
+// Usage: chess [--tables DIR] [--record PATH]
+// --tables: end the games on reaching a position the table files of DIR cover
+// --record: write the calls the board receives to the session log PATH, for replay
+int main(int argc, char** argv) {
+	EndgameTables tables; // outlives the board
+	SessionRecorder recorder; // likewise
+	char const * tableDir = nullptr;
+	char const * recordPath = nullptr;
+	for(int i = 1; i < argc; i++) {
+		if(string(argv[i]) == "--tables" && i + 1 < argc) tableDir = argv[++i];
+		else if(string(argv[i]) == "--record" && i + 1 < argc) recordPath = argv[++i];
+		else {
+			cerr << "Usage: " << argv[0] << " [--tables DIR] [--record PATH]" << endl;
+			return 1;
+		}
+	}
+	if(recordPath && !recorder.open(recordPath)) return 1;
+
 	cout << "========================\n";
 	cout << "Testing the Chess Engine\n";
 	cout << "========================\n\n";
 
 	ChessBoard cb;
+	if(recordPath) cb.setRecorder(&recorder);
+	if(tableDir) {
+		tables.load(tableDir);
+		cb.setEndgameTables(&tables);
+	}
 	cout << '\n';
 
 	cb.submitMove("D7", "D6");
@@ -0,0 +1,424 @@
+#include "ChessBoard.h"
+#include "trace.h"
+#include "boardbatch.h"
+#include "rules.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+
+/*===== POSITIONS =====*/
+// A fixed set, so that timings can be compared from one build to the next
+static char const * const POSITIONS[] =
+{
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -", // initial position
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -", // "Kiwipete"
+  "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1B1PPP/R2QKB1R w KQ -", // middlegame
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -", // endgame
+  "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - -" // back rank mate in one
+};
+static int const NUM_POSITIONS = sizeof(POSITIONS) / sizeof(POSITIONS[0]);
+
+
+/*===== TIMING =====*/
+
+struct BenchResult
+{
+  string name;
+  long opsPerSample; // operations timed in each sample
+  double meanNs; // mean ns/op over the samples
+  double varianceNs; // variance of the ns/op of the samples
+  double minNs;
+};
+
+
+/**
+ * Friend of ChessBoard: exposes the private rules routines to the benchmarks
+ */
+class ChessBoardBench
+{
+ public:
+  static bool virtualRuleTest(ChessBoard& cb, Piece* p, int r, int f)
+  {
+    return p->movePieceRuleTest(r,f,cb.board);
+  }
+  static bool ruleTest(ChessBoard& cb, Piece* p, int r, int f)
+  {
+    return ::ruleTest(p,r,f,cb.board);
+  }
+  static bool isInCheck(ChessBoard& cb, bool color) { return cb.isInCheck(color); }
+  static bool saves(ChessBoard& cb, Move const & m)
+  {
+    return cb.doesThisMoveSaveKing(m.rankS,m.fileS,m.rankD,m.fileD);
+  }
+  static bool noFurtherMove(ChessBoard& cb, bool color)
+  {
+    return cb.isNoFurtherValidMove(color);
+  }
+};
+
+
+/**
+ * Time a benchmark: one warm-up run, then `samples` runs of `run`, which returns the number of
+ * operations it did and adds the time they took (excluding any set-up) to its argument
+ */
+template <typename Run>
+static BenchResult measure(string const & name, int samples, Run run)
+{
+  chrono::nanoseconds warmUp(0);
+  run(warmUp);
+
+  vector<double> nsPerOp;
+  long ops = 0;
+  for(int s = 0; s < samples; s++)
+  {
+    chrono::nanoseconds elapsed(0);
+    ops = run(elapsed);
+    nsPerOp.push_back(double(elapsed.count()) / ops);
+  }
+
+  BenchResult r;
+  r.name = name; r.opsPerSample = ops;
+  r.meanNs = r.varianceNs = 0; r.minNs = nsPerOp[0];
+  for(double x : nsPerOp)
+  {
+    r.meanNs += x / samples;
+    if(x < r.minNs) r.minNs = x;
+  }
+  for(double x : nsPerOp) r.varianceNs += (x - r.meanNs) * (x - r.meanNs) / samples;
+  return r;
+}
+
+
+/**
+ * Run f and add the time it took to elapsed
+ */
+template <typename F>
+static inline void timed(chrono::nanoseconds& elapsed, F f)
+{
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  f();
+  elapsed += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+}
+
+
+
+/*===== BENCHMARKS =====*/
+
+static char const * const TYPE_NAMES[6] = {"king", "queen", "rook", "bishop", "knight", "pawn"};
+
+static volatile bool sink; // keeps the results of the timed calls alive
+
+/**
+ * Time everything; mismatches counts the statuses of BoardBatch that differ from the board's
+ */
+static vector<BenchResult> runAll(int samples, int repeat, int& mismatches)
+{
+  vector<BenchResult> results;
+  vector<ChessBoard*> boards;
+  for(int i = 0; i < NUM_POSITIONS; i++) boards.push_back(new ChessBoard(POSITIONS[i]));
+
+  //=== 1. The rules, every piece of a type to every square: through the virtual
+  //       movePieceRuleTest() and through ruleTest(), which dispatches on the type
+  for(int dispatch = 0; dispatch < 2; dispatch++)
+    for(int type = KING; type <= PAWN; type++)
+    {
+      string const NAME = string(dispatch ? "ruleTest/" : "movePieceRuleTest/") + TYPE_NAMES[type];
+      results.push_back(measure(NAME,samples,[&](chrono::nanoseconds& elapsed)
+      {
+        long ops = 0;
+        timed(elapsed,[&]()
+        {
+          for(int k = 0; k < repeat; k++)
+            for(ChessBoard* cb : boards)
+              for(int r = 0; r < BOARD_SIZE; r++)
+                for(int f = 0; f < BOARD_SIZE; f++)
+                {
+                  Piece* p = cb->pieceAt(r,f);
+                  if(!p || p->getType() != type) continue;
+                  for(int i = 0; i < BOARD_SIZE; i++)
+                    for(int j = 0; j < BOARD_SIZE; j++)
+                    {
+                      sink = (dispatch ? ChessBoardBench::ruleTest(*cb,p,i,j)
+                                       : ChessBoardBench::virtualRuleTest(*cb,p,i,j));
+                      ops++;
+                    }
+                }
+        });
+        return ops;
+      }));
+    }
+
+  //=== 2. isInCheck, both sides
+  results.push_back(measure("isInCheck",samples,[&](chrono::nanoseconds& elapsed)
+  {
+    long ops = 0;
+    timed(elapsed,[&]()
+    {
+      for(int k = 0; k < 50*repeat; k++)
+        for(ChessBoard* cb : boards)
+        {
+          sink = ChessBoardBench::isInCheck(*cb,WHITE);
+          sink = ChessBoardBench::isInCheck(*cb,BLACK);
+          ops += 2;
+        }
+    });
+    return ops;
+  }));
+
+  //=== 3. doesThisMoveSaveKing, every move following the rules of its piece
+  vector<vector<Move>> pseudoLegal(NUM_POSITIONS);
+  for(int i = 0; i < NUM_POSITIONS; i++)
+    for(int r = 0; r < BOARD_SIZE; r++)
+      for(int f = 0; f < BOARD_SIZE; f++)
+      {
+        Piece* p = boards[i]->pieceAt(r,f);
+        if(!p || p->getColor() != boards[i]->getMoveTurn()) continue;
+        for(int rd = 0; rd < BOARD_SIZE; rd++)
+          for(int fd = 0; fd < BOARD_SIZE; fd++)
+            if(ChessBoardBench::ruleTest(*boards[i],p,rd,fd))
+              pseudoLegal[i].push_back(Move(r,f,rd,fd));
+      }
+
+  results.push_back(measure("doesThisMoveSaveKing",samples,[&](chrono::nanoseconds& elapsed)
+  {
+    long ops = 0;
+    timed(elapsed,[&]()
+    {
+      for(int k = 0; k < 10*repeat; k++)
+        for(int i = 0; i < NUM_POSITIONS; i++)
+          for(Move const & m : pseudoLegal[i])
+          {
+            sink = ChessBoardBench::saves(*boards[i],m); ops++;
+          }
+    });
+    return ops;
+  }));
+
+  //=== 4. isNoFurtherValidMove, side to move
+  results.push_back(measure("isNoFurtherValidMove",samples,[&](chrono::nanoseconds& elapsed)
+  {
+    long ops = 0;
+    timed(elapsed,[&]()
+    {
+      for(int k = 0; k < repeat; k++)
+        for(ChessBoard* cb : boards)
+        {
+          sink = ChessBoardBench::noFurtherMove(*cb,cb->getMoveTurn()); ops++;
+        }
+    });
+    return ops;
+  }));
+
+  //=== 5. submitMove, every legal move (taken back after each, untimed)
+  vector<vector<Move>> legal(NUM_POSITIONS);
+  for(int i = 0; i < NUM_POSITIONS; i++) boards[i]->generateLegalMoves(legal[i]);
+
+  results.push_back(measure("submitMove",samples,[&](chrono::nanoseconds& elapsed)
+  {
+    long ops = 0;
+    for(int i = 0; i < NUM_POSITIONS; i++)
+    {
+      for(Move const & m : legal[i])
+      {
+        string const SRC = m.srcString(), DEST = m.destString();
+        timed(elapsed,[&]() { boards[i]->submitMove(SRC.c_str(),DEST.c_str()); });
+        boards[i]->takeBack();
+        ops++;
+      }
+    }
+    return ops;
+  }));
+
+  //=== 6. resetBoard
+  results.push_back(measure("resetBoard",samples,[&](chrono::nanoseconds& elapsed)
+  {
+    ChessBoard cb;
+    timed(elapsed,[&]() { for(int k = 0; k < 20*repeat; k++) cb.resetBoard(); });
+    return long(20*repeat);
+  }));
+
+  //=== 7. Legality of the pseudo-legal moves and of as many arbitrary ones, one board at a
+  // time and by BoardBatch (one move per board)
+  vector<int> boardOf;
+  vector<Move> tried;
+  for(int i = 0; i < NUM_POSITIONS; i++)
+    for(std::size_t k = 0; k < pseudoLegal[i].size(); k++)
+    {
+      unsigned const R = unsigned(k * 2654435761u);
+      boardOf.push_back(i); tried.push_back(pseudoLegal[i][k]);
+      boardOf.push_back(i);
+      tried.push_back(Move(R % 8,(R >> 3) % 8,(R >> 6) % 8,(R >> 9) % 8));
+    }
+
+  results.push_back(measure("legality/board",samples,[&](chrono::nanoseconds& elapsed)
+  {
+    long ops = 0;
+    timed(elapsed,[&]()
+    {
+      for(int k = 0; k < 10*repeat; k++)
+        for(std::size_t j = 0; j < tried.size(); j++)
+        {
+          ChessBoard& cb = *boards[boardOf[j]];
+          Move const & m = tried[j];
+          Piece* p = cb.pieceAt(m.rankS,m.fileS);
+          sink = p && p->getColor() == cb.getMoveTurn() &&
+                 ChessBoardBench::ruleTest(cb,p,m.rankD,m.fileD) && ChessBoardBench::saves(cb,m);
+          ops++;
+        }
+    });
+    return ops;
+  }));
+
+  // The statuses the board gives, for the batch to be checked against (untimed)
+  vector<uint8_t> expected(tried.size());
+  for(std::size_t j = 0; j < tried.size(); j++)
+  {
+    ChessBoard& cb = *boards[boardOf[j]];
+    vector<Move> moves;
+    cb.generateLegalMoves(moves);
+    Move const & m = tried[j];
+    expected[j] = BATCH_ILLEGAL;
+    for(Move const & legal : moves)
+    {
+      if(legal.rankS != m.rankS || legal.fileS != m.fileS || legal.rankD != m.rankD ||
+         legal.fileD != m.fileD)
+        continue;
+      cb.makeMove(m);
+      expected[j] = (cb.isSideToMoveInCheck() ? BATCH_CHECK : BATCH_LEGAL);
+      cb.undoMove();
+      break;
+    }
+  }
+
+  BoardBatch batch(tried.size());
+  for(std::size_t j = 0; j < tried.size(); j++) batch.load(j,*boards[boardOf[j]]);
+  vector<uint8_t> status(tried.size());
+  for(int vectorised = 0; vectorised < 2; vectorised++)
+  {
+    batch.setVectorised(vectorised);
+    if(vectorised && !batch.isVectorised()) break; // no AVX2
+    results.push_back(measure(vectorised ? "legality/batch avx2" : "legality/batch scalar",
+                              samples,[&](chrono::nanoseconds& elapsed)
+    {
+      timed(elapsed,[&]()
+      {
+        for(int k = 0; k < 10*repeat; k++) batch.validate(tried.data(),status.data());
+      });
+      sink = status[0];
+      return long(10*repeat*tried.size());
+    }));
+
+    for(std::size_t j = 0; j < tried.size(); j++)
+    {
+      if(status[j] == expected[j]) continue;
+      Move const & m = tried[j];
+      if(mismatches++ < 10)
+        cerr << results.back().name << ": status " << int(status[j]) << " for "
+             << m.srcString() << m.destString() << " on position " << boardOf[j]
+             << ", the board's is " << int(expected[j]) << endl;
+    }
+  }
+
+  for(ChessBoard* cb : boards) delete cb;
+  return results;
+}
+
+
+
+/*===== REPORTS =====*/
+
+/**
+ * A stream buffer dropping everything written to it
+ */
+struct NullBuffer: public streambuf
+{
+  int overflow(int c) override { return c; }
+};
+
+static void printText(ostream& out, vector<BenchResult> const & results, int samples)
+{
+  out << "Rules engine benchmarks, " << NUM_POSITIONS << " positions, " << samples
+      << " samples each" << endl;
+  char line[160];
+  snprintf(line,sizeof(line),"%-26s %10s %10s %11s %11s","benchmark","ns/op","stddev","min ns",
+           "ops/s");
+  out << line << endl;
+  for(BenchResult const & r : results)
+  {
+    snprintf(line,sizeof(line),"%-26s %10.1f %10.1f %11.1f %11.0f",r.name.c_str(),r.meanNs,
+             sqrt(r.varianceNs),r.minNs,1e9 / r.meanNs);
+    out << line << endl;
+  }
+}
+
+static void printJson(ostream& out, vector<BenchResult> const & results, int samples)
+{
+  out << "{\"positions\": " << NUM_POSITIONS << ", \"samples\": " << samples
+      << ", \"benchmarks\": [" << endl;
+  for(std::size_t i = 0; i < results.size(); i++)
+  {
+    BenchResult const & r = results[i];
+    out << "  {\"name\": \"" << r.name << "\", \"ops_per_sample\": " << r.opsPerSample
+        << ", \"ns_per_op\": " << r.meanNs << ", \"variance_ns2\": " << r.varianceNs
+        << ", \"stddev_ns\": " << sqrt(r.varianceNs) << ", \"min_ns\": " << r.minNs
+        << ", \"ops_per_sec\": " << 1e9 / r.meanNs << "}"
+        << (i + 1 < results.size() ? "," : "") << endl;
+  }
+  out << "]}" << endl;
+}
+
+
+/**
+ * Usage: bench [--json] [--samples N] [--repeat N] [--trace FILE [--trace-every N]]
+ * --trace records the submitMove() spans while benchmarking (built with make TRACE=1), of
+ * every call or one call in N, and writes them to FILE in the Chrome trace format. bench fails
+ * if the statuses of BoardBatch differ from the board's
+ */
+int main(int argc, char** argv)
+{
+  bool json = false;
+  int samples = 10, repeat = 20;
+  string traceFile;
+  int traceEvery = 1;
+  for(int i = 1; i < argc; i++)
+  {
+    string const ARG = argv[i];
+    if(ARG == "--json") json = true;
+    else if(ARG == "--samples" && i + 1 < argc) samples = atoi(argv[++i]);
+    else if(ARG == "--repeat" && i + 1 < argc) repeat = atoi(argv[++i]);
+    else if(ARG == "--trace" && i + 1 < argc) traceFile = argv[++i];
+    else if(ARG == "--trace-every" && i + 1 < argc) traceEvery = atoi(argv[++i]);
+    else
+    {
+      cerr << "Usage: " << argv[0]
+           << " [--json] [--samples N] [--repeat N] [--trace FILE [--trace-every N]]" << endl;
+      return 1;
+    }
+  }
+  if(samples < 1 || repeat < 1 || traceEvery < 1)
+  {
+    cerr << "The numbers of samples, repeats and traced calls must be positive!" << endl;
+    return 1;
+  }
+
+  // The board reports every move on cout: keep that out of the results
+  ostream out(cout.rdbuf());
+  NullBuffer discarded;
+  cout.rdbuf(&discarded);
+
+  traceSetEnabled(!traceFile.empty(),traceEvery);
+  int mismatches = 0;
+  vector<BenchResult> results = runAll(samples,repeat,mismatches);
+  traceSetEnabled(false);
+
+  cout.rdbuf(out.rdbuf());
+  if(json) printJson(out,results,samples);
+  else printText(out,results,samples);
+  if(!traceFile.empty() && !traceDump(traceFile)) return 1;
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+#include "bitbase.h"
+#include "piece.h"
+#include <cstdlib>
+
+/*===== INDEXING =====*/
+// Bits 0-5: strong king, 6-11: weak king, 12: 1 if the weak side moves, 13-14: pawn file
+// (A to D), 15-17: pawn rank - 1 (rank 2 to 7)
+
+static uint32_t kpkBits[KPK_INDEX_MAX / 32];
+
+enum KpkResult {KPK_INVALID = 0, KPK_UNKNOWN = 1, KPK_DRAW = 2, KPK_WIN = 4};
+
+static inline int kpkIndex(bool weakToMove, int weakKing, int strongKing, int pawn)
+{
+  int const FILE = pawn % BOARD_SIZE, RANK = pawn / BOARD_SIZE;
+  return strongKing | (weakKing << 6) | (weakToMove << 12) | (FILE << 13) | ((RANK-1) << 15);
+}
+
+static inline int distance(int a, int b)
+{
+  int dr = abs(a / BOARD_SIZE - b / BOARD_SIZE), df = abs(a % BOARD_SIZE - b % BOARD_SIZE);
+  return dr > df ? dr : df;
+}
+
+/**
+ * Test if the pawn on square pawn attacks square sq
+ */
+static inline bool pawnAttacks(int pawn, int sq)
+{
+  return sq / BOARD_SIZE == pawn / BOARD_SIZE + 1 &&
+         abs(sq % BOARD_SIZE - pawn % BOARD_SIZE) == 1;
+}
+
+/**
+ * List the squares a king on sq steps to, returns how many
+ */
+static int kingSteps(int sq, int* out)
+{
+  int n = 0;
+  int const RANK = sq / BOARD_SIZE, FILE = sq % BOARD_SIZE;
+  for(int dr = -1; dr <= 1; dr++)
+  {
+    for(int df = -1; df <= 1; df++)
+    {
+      int r = RANK + dr, f = FILE + df;
+      if((dr || df) && r >= 0 && r < BOARD_SIZE && f >= 0 && f < BOARD_SIZE)
+        out[n++] = r*BOARD_SIZE + f;
+    }
+  }
+  return n;
+}
+
+
+
+/*===== GENERATION =====*/
+
+/**
+ * Classify a position from its own squares only: invalid, immediate win (safe promotion),
+ * immediate draw (stalemate or the pawn falls) or unknown
+ */
+static KpkResult kpkInitial(int index)
+{
+  int const SK = index & 63, WK = (index >> 6) & 63;
+  bool const WEAK_TO_MOVE = (index >> 12) & 1;
+  int const PAWN = ((index >> 15) + 1) * BOARD_SIZE + ((index >> 13) & 3);
+
+  if(distance(SK,WK) <= 1 || SK == PAWN || WK == PAWN) return KPK_INVALID;
+  if(!WEAK_TO_MOVE && pawnAttacks(PAWN,WK)) return KPK_INVALID;
+
+  int const PROMOTION = PAWN + BOARD_SIZE;
+  if(!WEAK_TO_MOVE && PAWN / BOARD_SIZE == BOARD_SIZE-2 && SK != PROMOTION &&
+     (distance(WK,PROMOTION) > 1 || distance(SK,PROMOTION) == 1))
+    return KPK_WIN;
+
+  if(WEAK_TO_MOVE)
+  {
+    int steps[8];
+    int n = kingSteps(WK,steps);
+    bool canMove = false;
+    for(int i = 0; i < n; i++)
+    {
+      if(steps[i] == PAWN && distance(SK,PAWN) > 1) return KPK_DRAW; // takes the pawn
+      if(distance(steps[i],SK) > 1 && !pawnAttacks(PAWN,steps[i])) canMove = true;
+    }
+    if(!canMove) return KPK_DRAW; // stalemate
+  }
+  return KPK_UNKNOWN;
+}
+
+/**
+ * Classify an unknown position from the results of its successors
+ */
+static KpkResult kpkClassify(int index, uint8_t const * results)
+{
+  int const SK = index & 63, WK = (index >> 6) & 63;
+  bool const WEAK_TO_MOVE = (index >> 12) & 1;
+  int const PAWN = ((index >> 15) + 1) * BOARD_SIZE + ((index >> 13) & 3);
+
+  int r = KPK_INVALID;
+  int steps[8];
+  if(WEAK_TO_MOVE)
+  {
+    int n = kingSteps(WK,steps);
+    for(int i = 0; i < n; i++) r |= results[kpkIndex(false,steps[i],SK,PAWN)];
+
+    return (r & KPK_DRAW) ? KPK_DRAW : ((r & KPK_UNKNOWN) ? KPK_UNKNOWN : KPK_WIN);
+  }
+
+  int n = kingSteps(SK,steps);
+  for(int i = 0; i < n; i++) r |= results[kpkIndex(true,WK,steps[i],PAWN)];
+
+  if(PAWN / BOARD_SIZE < BOARD_SIZE-2) // single push
+    r |= results[kpkIndex(true,WK,SK,PAWN + BOARD_SIZE)];
+  if(PAWN / BOARD_SIZE == 1 && PAWN + BOARD_SIZE != SK && PAWN + BOARD_SIZE != WK) // double
+    r |= results[kpkIndex(true,WK,SK,PAWN + 2*BOARD_SIZE)];
+
+  return (r & KPK_WIN) ? KPK_WIN : ((r & KPK_UNKNOWN) ? KPK_UNKNOWN : KPK_DRAW);
+}
+
+/**
+ * Iterate the classification until nothing changes, then keep one bit per position
+ */
+static bool kpkBuild()
+{
+  static uint8_t results[KPK_INDEX_MAX];
+
+  for(int i = 0; i < KPK_INDEX_MAX; i++) results[i] = uint8_t(kpkInitial(i));
+
+  for(bool changed = true; changed; )
+  {
+    changed = false;
+    for(int i = 0; i < KPK_INDEX_MAX; i++)
+    {
+      if(results[i] != KPK_UNKNOWN) continue;
+
+      results[i] = uint8_t(kpkClassify(i,results));
+      changed |= (results[i] != KPK_UNKNOWN);
+    }
+  }
+
+  for(int i = 0; i < KPK_INDEX_MAX; i++)
+    if(results[i] == KPK_WIN) kpkBits[i / 32] |= 1u << (i % 32);
+
+  return true;
+}
+
+
+
+/*===== PROBING =====*/
+
+/**
+ * Build the bitbase if it hasn't been yet
+ */
+void kpkInit()
+{
+  static bool const BUILT = kpkBuild(); // thread-safe one-time initialisation
+  (void)BUILT;
+}
+
+
+/**
+ * Test if a KPK position is won for the side owning the pawn
+ */
+bool kpkProbe(int strongKing, int pawn, int weakKing, bool strongToMove)
+{
+  kpkInit();
+
+  // A pawn left on the last rank (there are no promotions yet) is out of the bitbase
+  if(pawn / BOARD_SIZE == 0 || pawn / BOARD_SIZE == BOARD_SIZE-1) return false;
+
+  // Only the files A to D are stored: mirror the others
+  if(pawn % BOARD_SIZE >= BOARD_SIZE/2)
+  {
+    strongKing += BOARD_SIZE-1 - 2*(strongKing % BOARD_SIZE);
+    pawn += BOARD_SIZE-1 - 2*(pawn % BOARD_SIZE);
+    weakKing += BOARD_SIZE-1 - 2*(weakKing % BOARD_SIZE);
+  }
+
+  int const INDEX = kpkIndex(!strongToMove,weakKing,strongKing,pawn);
+  return (kpkBits[INDEX / 32] >> (INDEX % 32)) & 1;
+}
@@ -0,0 +1,31 @@
+#ifndef BITBASE_H
+#define BITBASE_H
+
+#include <cstdint>
+
+/*===== KING AND PAWN VERSUS KING BITBASE =====*/
+/**
+ * One bit per position of the strong side's king, the pawn (files A to D only, ranks 2 to
+ * 7) and the weak side's king, for both sides to move: 2*24*64*64 bits = 24 KB, built into a
+ * static array in a few milliseconds the first time it is probed.
+ * A set bit means the strong side wins, i.e. the pawn promotes safely (the standard rules of
+ * chess are assumed here: the board itself does not promote pawns yet).
+ */
+
+#define KPK_INDEX_MAX (2*24*64*64) // stm * pawn square * weak king * strong king
+
+/**
+ * Build the bitbase if it hasn't been yet, thread-safe. Called by kpkProbe() anyway, so only
+ * needed to move the (small) cost out of the first probe
+ */
+void kpkInit();
+
+/**
+ * Test if a KPK position is won for the side owning the pawn. The squares are
+ * rank*BOARD_SIZE+file seen from the strong side (its pawn moving up the ranks), and
+ * strongToMove tells whether the strong side is to move. Never allocates
+ */
+bool kpkProbe(int strongKing, int pawn, int weakKing, bool strongToMove);
+
+
+#endif
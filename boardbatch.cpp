@@ -0,0 +1,466 @@
+#include "boardbatch.h"
+#include "ChessBoard.h"
+#include "piece.h"
+#include "geometry.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+/*===== TABLES =====*/
+
+static inline uint64_t bit(int sq) { return uint64_t(1) << sq; }
+
+/**
+ * The squares strictly between two squares on a line, all of them if there is no line (so
+ * that the way is never clear), and whether the line is a rank or a file
+ */
+struct BatchTables
+{
+  uint64_t between[BOARD_SIZE*BOARD_SIZE][BOARD_SIZE*BOARD_SIZE];
+  bool orthogonal[BOARD_SIZE*BOARD_SIZE][BOARD_SIZE*BOARD_SIZE];
+};
+
+constexpr BatchTables makeBatchTables()
+{
+  typedef StandardGeometry G;
+  static_assert(G::SQUARES == 64, "the batches are bitboards");
+  GeometryTables<G> const & T = GEOMETRY_TABLES<G>;
+  BatchTables tables = {};
+
+  for(int sq = 0; sq < G::SQUARES; sq++)
+  {
+    for(int to = 0; to < G::SQUARES; to++) tables.between[sq][to] = ~uint64_t(0);
+    for(int d = 0; d < 8; d++)
+    {
+      uint64_t passed = 0;
+      for(int i = 0; i < T.rayLength[sq][d]; i++)
+      {
+        int const TO = T.ray[sq][d][i];
+        tables.between[sq][TO] = passed;
+        tables.orthogonal[sq][TO] = d < 4;
+        passed |= uint64_t(1) << TO;
+      }
+    }
+  }
+  return tables;
+}
+
+static constexpr BatchTables TABLES = makeBatchTables();
+
+
+
+/*===== MOVE KERNEL =====*/
+/**
+ * The test of a move on a position, written once for a plain uint64_t (one board) and for
+ * GCC vectors of 4 of them (4 boards): no table look-up and no branch, the rules of every
+ * type of piece being computed for every lane and the right one picked with masks. Forced
+ * inline so that it is compiled with the instructions of its caller
+ */
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BATCH_AVX2 1
+typedef uint64_t U64x4 __attribute__((vector_size(32)));
+#endif
+
+static uint64_t const NOT_A = 0xfefefefefefefefeULL, NOT_H = 0x7f7f7f7f7f7f7f7fULL;
+static uint64_t const NOT_AB = 0xfcfcfcfcfcfcfcfcULL, NOT_GH = 0x3f3f3f3f3f3f3f3fULL;
+static uint64_t const RANK_3 = 0xff0000ULL, RANK_6 = 0xff0000000000ULL;
+static uint64_t const C_FILE = 0x0404040404040404ULL, G_FILE = 0x4040404040404040ULL;
+
+// The vectors go by reference: passed by value, they would have a different ABI with and
+// without AVX
+
+/**
+ * All ones where x is zero, all zeros where it is not (a single compare with AVX2; the
+ * masks are used inverted through and-not)
+ */
+static ALWAYS_INLINE void isZero(uint64_t& mask, uint64_t const & x) { mask = -uint64_t(x == 0); }
+
+#ifdef BATCH_AVX2
+static ALWAYS_INLINE void isZero(U64x4& mask, U64x4 const & x) { mask = (U64x4)(x == 0); }
+#endif
+
+/**
+ * Add to reached[j] the squares reached from the squares of from[j] by sliding one way
+ * through those of through, for two sets of squares sharing the propagation: SHIFT bits a
+ * step, wrapping excluded by the mask WRAP (to be applied to the destinations of a step)
+ */
+template <typename T, int SHIFT, uint64_t WRAP>
+static ALWAYS_INLINE void slide(T (&reached)[2], T const (&from)[2], T const & through)
+{
+  T a = from[0], b = from[1], pro = through & WRAP;
+  if constexpr(SHIFT > 0)
+  {
+    a |= pro & (a << SHIFT); b |= pro & (b << SHIFT); pro &= pro << SHIFT;
+    a |= pro & (a << 2*SHIFT); b |= pro & (b << 2*SHIFT); pro &= pro << 2*SHIFT;
+    a |= pro & (a << 4*SHIFT); b |= pro & (b << 4*SHIFT);
+    reached[0] |= (a << SHIFT) & WRAP; reached[1] |= (b << SHIFT) & WRAP;
+  }
+  else
+  {
+    a |= pro & (a >> -SHIFT); b |= pro & (b >> -SHIFT); pro &= pro >> -SHIFT;
+    a |= pro & (a >> -2*SHIFT); b |= pro & (b >> -2*SHIFT); pro &= pro >> -2*SHIFT;
+    a |= pro & (a >> -4*SHIFT); b |= pro & (b >> -4*SHIFT);
+    reached[0] |= (a >> -SHIFT) & WRAP; reached[1] |= (b >> -SHIFT) & WRAP;
+  }
+}
+
+/**
+ * The squares a knight jumps to and a king steps to (and stands on) from those of from
+ */
+template <typename T>
+static ALWAYS_INLINE void leaps(T& knight, T& king, T const & from)
+{
+  T const L1 = (from >> 1) & NOT_H, L2 = (from >> 2) & NOT_GH;
+  T const R1 = (from << 1) & NOT_A, R2 = (from << 2) & NOT_AB;
+  T const H1 = L1 | R1, H2 = L2 | R2;
+  knight = (H1 << 16) | (H1 >> 16) | (H2 << 8) | (H2 >> 8);
+
+  T const ROW = from | L1 | R1;
+  king = ROW | (ROW << 8) | (ROW >> 8);
+}
+
+/**
+ * The lanes of a vector from their values, built in registers: stored one by one and loaded
+ * at once, they would stall the load
+ */
+static ALWAYS_INLINE void lanesOf(uint64_t& v, uint64_t const (&x)[1]) { v = x[0]; }
+
+#ifdef BATCH_AVX2
+static ALWAYS_INLINE void lanesOf(U64x4& v, uint64_t const (&x)[4])
+{
+  v = U64x4{x[0], x[1], x[2], x[3]};
+}
+#endif
+
+/**
+ * Whether anything attacks two sets of target squares on the same occupied squares: in[j][0]
+ * the targets, then their attackers (white pawns, black pawns, knights, diagonal sliders,
+ * orthogonal sliders, kings). The attackers are found by spreading from the targets, the
+ * sliding ones by Kogge-Stone fills through the empty squares
+ */
+template <typename T>
+static ALWAYS_INLINE void attackersOf(T (&result)[2], T const (&in)[2][7], T const & occupied)
+{
+  T const TARGETS[2] = {in[0][0], in[1][0]};
+  T const EMPTY = ~occupied;
+  T orthogonal[2] = {EMPTY & 0, EMPTY & 0}, diagonal[2] = {EMPTY & 0, EMPTY & 0};
+  uint64_t const ALL = ~uint64_t(0);
+  slide<T,8,ALL>(orthogonal,TARGETS,EMPTY); slide<T,-8,ALL>(orthogonal,TARGETS,EMPTY);
+  slide<T,1,NOT_A>(orthogonal,TARGETS,EMPTY); slide<T,-1,NOT_H>(orthogonal,TARGETS,EMPTY);
+  slide<T,9,NOT_A>(diagonal,TARGETS,EMPTY); slide<T,7,NOT_H>(diagonal,TARGETS,EMPTY);
+  slide<T,-7,NOT_A>(diagonal,TARGETS,EMPTY); slide<T,-9,NOT_H>(diagonal,TARGETS,EMPTY);
+
+  for(int j = 0; j < 2; j++)
+  {
+    T knight, king;
+    leaps<T>(knight,king,TARGETS[j]);
+
+    // A white pawn attacks a target from the rank below, a black one from the rank above
+    T const WHITE_PAWN = ((TARGETS[j] >> 7) & NOT_A) | ((TARGETS[j] >> 9) & NOT_H);
+    T const BLACK_PAWN = ((TARGETS[j] << 7) & NOT_H) | ((TARGETS[j] << 9) & NOT_A);
+
+    result[j] = (WHITE_PAWN & in[j][1]) | (BLACK_PAWN & in[j][2]) | (knight & in[j][3]) |
+                (diagonal[j] & in[j][4]) | (orthogonal[j] & in[j][5]) | (king & in[j][6]);
+  }
+}
+
+/**
+ * Test a move on a position and, with play, make it if legal. bb holds the bitboards [0 side
+ * to move, 1 other side][PieceType], swapped when a move is made. in[] holds the move's
+ * squares as bits (none for a move off the board), all ones if Black moves, the squares its
+ * king may castle to, the squares between the move's (all if not on a line), and all ones if
+ * on a rank or file. out[] gets all ones or all zeros: legal, check, king moved
+ */
+template <typename T, bool PLAY>
+static ALWAYS_INLINE void moveOf(T (&bb)[2][6], T const * in, T* out)
+{
+  T const & FROM = in[0];
+  T const & TO = in[1];
+  T const & BLACK_MOVES = in[2];
+  T const WHITE_MOVES = ~BLACK_MOVES;
+
+  T const (&OWN)[6] = bb[0];
+  T const (&THEIRS)[6] = bb[1];
+  T ownAll = OWN[KING], theirAll = THEIRS[KING];
+  for(int t = QUEEN; t <= PAWN; t++)
+  {
+    ownAll |= OWN[t]; theirAll |= THEIRS[t];
+  }
+  T const OCCUPIED = ownAll | theirAll, EMPTY = ~OCCUPIED;
+
+  //=== 1. The pattern: the squares the piece on FROM reaches, as each type of piece. A
+  // slider needs a clear way to TO, along a rank or file (in[5] all ones) or a diagonal
+  T knight, king;
+  leaps<T>(knight,king,FROM);
+  T clear;
+  isZero(clear,in[4] & OCCUPIED);
+  T const & ORTHOGONAL = in[5];
+
+  T const WHITE_PUSH = (FROM << 8) & EMPTY, BLACK_PUSH = (FROM >> 8) & EMPTY;
+  T const WHITE_PAWN = WHITE_PUSH | (((WHITE_PUSH & RANK_3) << 8) & EMPTY) |
+                       ((((FROM << 9) & NOT_A) | ((FROM << 7) & NOT_H)) & theirAll);
+  T const BLACK_PAWN = BLACK_PUSH | (((BLACK_PUSH & RANK_6) >> 8) & EMPTY) |
+                       ((((FROM >> 7) & NOT_A) | ((FROM >> 9) & NOT_H)) & theirAll);
+
+  // Castling: the right, the rook in its corner, and nothing in between
+  T const RIGHT_K = in[3] & G_FILE & (OWN[ROOK] >> 1), RIGHT_Q = in[3] & C_FILE & (OWN[ROOK] << 2);
+  T const CASTLE_TO = (RIGHT_K & ~((OCCUPIED << 1) | OCCUPIED)) |
+                      (RIGHT_Q & ~((OCCUPIED >> 1) | OCCUPIED | (OCCUPIED << 1)));
+
+  T isNot[6]; // all ones where the piece on FROM is not of the type
+  for(int t = KING; t <= PAWN; t++) isZero(isNot[t],OWN[t] & FROM);
+  T const SLIDER = (~isNot[QUEEN] | (~isNot[ROOK] & ORTHOGONAL) | (~isNot[BISHOP] & ~ORTHOGONAL));
+  T const REACHED = (~isNot[KING] & (king | CASTLE_TO)) | (~isNot[KNIGHT] & knight) |
+                    (clear & SLIDER) |
+                    (~isNot[PAWN] & ((WHITE_PAWN & WHITE_MOVES) | (BLACK_PAWN & BLACK_MOVES)));
+  T noPattern;
+  isZero(noPattern,REACHED & ~ownAll & TO);
+
+  //=== 2. The position after it: a castling king brings its rook along
+  T const KING_SIDE = ~isNot[KING] & CASTLE_TO & TO & G_FILE;
+  T const QUEEN_SIDE = ~isNot[KING] & CASTLE_TO & TO & C_FILE;
+  T const ROOK_MOVE = (KING_SIDE << 1) | (KING_SIDE >> 1) | (QUEEN_SIDE >> 2) | (QUEEN_SIDE << 1);
+  T ownAfter[6], theirsAfter[6];
+  for(int t = KING; t <= PAWN; t++)
+  {
+    ownAfter[t] = OWN[t] ^ (~isNot[t] & (FROM | TO));
+    theirsAfter[t] = THEIRS[t] & ~TO;
+  }
+  ownAfter[ROOK] ^= ROOK_MOVE;
+  T const OCCUPIED_AFTER = ((OCCUPIED & ~FROM) | TO) ^ ROOK_MOVE;
+
+  //=== 3. The attacks on the mover's king after the move (and on the squares a castling king
+  // stood on and crossed: the rook and king moved along the rank do not change the attacks
+  // on them), and on the opponent's king
+  T attack[2][7], attacked[2];
+  attack[0][0] = ownAfter[KING] | (KING_SIDE >> 1) | (KING_SIDE >> 2) |
+                 (QUEEN_SIDE << 1) | (QUEEN_SIDE << 2);
+  attack[1][0] = theirsAfter[KING];
+  T const * const ATTACKERS[2] = {theirsAfter, ownAfter};
+  for(int j = 0; j < 2; j++)
+  {
+    T const * const A = ATTACKERS[j];
+    T const & WHITE_ATTACKS = (j == 0 ? BLACK_MOVES : WHITE_MOVES);
+    attack[j][1] = A[PAWN] & WHITE_ATTACKS; attack[j][2] = A[PAWN] & ~WHITE_ATTACKS;
+    attack[j][3] = A[KNIGHT];
+    attack[j][4] = A[BISHOP] | A[QUEEN];
+    attack[j][5] = A[ROOK] | A[QUEEN];
+    attack[j][6] = A[KING];
+  }
+  attackersOf<T>(attacked,attack,OCCUPIED_AFTER);
+  T safe, noCheck;
+  isZero(safe,attacked[0]); isZero(noCheck,attacked[1]);
+  T const LEGAL = safe & ~noPattern;
+
+  out[0] = LEGAL; out[1] = LEGAL & ~noCheck; out[2] = ~isNot[KING];
+  if(!PLAY) return;
+  for(int t = KING; t <= PAWN; t++)
+  {
+    T const MOVER = (LEGAL & theirsAfter[t]) | (~LEGAL & OWN[t]);
+    T const OTHER = (LEGAL & ownAfter[t]) | (~LEGAL & THEIRS[t]);
+    bb[0][t] = MOVER; bb[1][t] = OTHER;
+  }
+}
+
+/**
+ * The arrays of a BoardBatch and the moves of a run
+ */
+struct BatchRun
+{
+  uint64_t* const * pieces; // [6*side + PieceType][board]
+  uint8_t* turn;
+  uint8_t* rights;
+  Move const * moves;
+  uint8_t* status;
+  std::size_t size;
+};
+
+/**
+ * Test (and with PLAY make) the moves of the boards i to i+LANES-1 in one pass: the kernel
+ * inputs are built lane by lane from the moves, the boards past the end of the batch getting a
+ * move off the board, and the statuses, castling rights and sides to move are written from
+ * its outputs
+ */
+template <typename T, bool PLAY>
+static ALWAYS_INLINE void movesAt(BatchRun const & b, std::size_t i)
+{
+  int const LANES = sizeof(T) / sizeof(uint64_t);
+  uint64_t inputs[6][LANES];
+  for(int l = 0; l < LANES; l++)
+  {
+    bool const REAL = i + l < b.size;
+    Move const m = (REAL ? b.moves[i + l] : Move(-1,-1,-1,-1));
+    bool const INSIDE = unsigned(m.rankS) < BOARD_SIZE && unsigned(m.fileS) < BOARD_SIZE &&
+                        unsigned(m.rankD) < BOARD_SIZE && unsigned(m.fileD) < BOARD_SIZE;
+    int const FROM = (INSIDE ? m.rankS*BOARD_SIZE + m.fileS : 0);
+    int const TO = (INSIDE ? m.rankD*BOARD_SIZE + m.fileD : 0);
+    inputs[0][l] = (INSIDE ? bit(FROM) : 0);
+    inputs[1][l] = (INSIDE ? bit(TO) : 0);
+    inputs[4][l] = TABLES.between[FROM][TO];
+    inputs[5][l] = (TABLES.orthogonal[FROM][TO] ? ~uint64_t(0) : 0);
+
+    bool const US = b.turn[i + l];
+    inputs[2][l] = (US == BLACK ? ~uint64_t(0) : 0);
+    unsigned const RIGHTS = b.rights[i + l] >> 2*US; // of the side to move: G then C file
+    inputs[3][l] = uint64_t(((RIGHTS & 1) << 6) | ((RIGHTS & 2) << 1)) << (US ? 56 : 0);
+  }
+
+  T bb[2][6], in[6], out[3];
+  for(int c = 0; c < 2; c++)
+    for(int t = KING; t <= PAWN; t++) memcpy(&bb[c][t],b.pieces[6*c + t] + i,sizeof(T));
+  for(int a = 0; a < 6; a++) lanesOf(in[a],inputs[a]);
+
+  moveOf<T,PLAY>(bb,in,out);
+
+  if(PLAY)
+    for(int c = 0; c < 2; c++)
+      for(int t = KING; t <= PAWN; t++) memcpy(b.pieces[6*c + t] + i,&bb[c][t],sizeof(T));
+
+  // The statuses, without a branch on them: legal moves are about as many as not
+  uint64_t outputs[3][LANES] __attribute__((aligned(32)));
+  for(int a = 0; a < 3; a++) memcpy(outputs[a],&out[a],sizeof(T));
+  static uint8_t const STATUS[4] = {BATCH_ILLEGAL, BATCH_ILLEGAL, BATCH_LEGAL, BATCH_CHECK};
+  for(int l = 0; l < LANES && i + l < b.size; l++)
+  {
+    b.status[i + l] = STATUS[(outputs[0][l] & 2) | (outputs[1][l] & 1)];
+    if(!PLAY || !outputs[0][l]) continue;
+
+    // A king move loses both rights, a move from or to a corner the right of its rook
+    bool const US = b.turn[i + l];
+    if(outputs[2][l]) b.rights[i + l] &= uint8_t(~(3 << (2*US)));
+    static uint64_t const CORNERS[4] = {bit(7), bit(0), bit(63), bit(56)};
+    for(int r = 0; r < 4; r++)
+      if((inputs[0][l] | inputs[1][l]) & CORNERS[r]) b.rights[i + l] &= uint8_t(~(1 << r));
+    b.turn[i + l] = !US;
+  }
+}
+
+
+static void movesScalar(BatchRun const & b, bool play)
+{
+  for(std::size_t i = 0; i < b.size; i++)
+  {
+    if(play) movesAt<uint64_t,true>(b,i);
+    else movesAt<uint64_t,false>(b,i);
+  }
+}
+
+#ifdef BATCH_AVX2
+__attribute__((target("avx2")))
+static void movesAvx2(BatchRun const & b, bool play)
+{
+  for(std::size_t i = 0; i < b.size; i += 4)
+  {
+    if(play) movesAt<U64x4,true>(b,i);
+    else movesAt<U64x4,false>(b,i);
+  }
+}
+#endif
+
+
+
+/*===== BATCH =====*/
+
+BoardBatch::BoardBatch(std::size_t n): size(n), stride((n + 3) & ~std::size_t(3)),
+  vectorised(true)
+{
+  // Pieces, then the bytes of the side to move and the castling rights
+  std::size_t const WORDS = 12*stride + (2*stride + 7) / 8;
+  block = static_cast<uint64_t*>(aligned_alloc(32,(WORDS*sizeof(uint64_t) + 31) & ~31));
+  if(!block) throw bad_alloc();
+  memset(block,0,WORDS*sizeof(uint64_t));
+
+  uint64_t* p = block;
+  for(int c = 0; c < 2; c++)
+    for(int t = KING; t <= PAWN; t++, p += stride) pieces[c][t] = p;
+  turn = reinterpret_cast<uint8_t*>(p);
+  rights = turn + stride;
+
+  // The initial position everywhere
+  static uint64_t const INITIAL[6] = {bit(4), bit(3), bit(0) | bit(7), bit(2) | bit(5),
+                                      bit(1) | bit(6), 0xff00ULL};
+  for(std::size_t i = 0; i < size; i++)
+  {
+    for(int t = KING; t <= PAWN; t++)
+    {
+      pieces[0][t][i] = INITIAL[t]; // White to move
+      pieces[1][t][i] = __builtin_bswap64(INITIAL[t]); // the ranks mirrored
+    }
+    turn[i] = WHITE; rights[i] = 15;
+  }
+}
+
+
+BoardBatch::~BoardBatch() { free(block); }
+
+
+std::size_t BoardBatch::getSize() const { return size; }
+
+bool BoardBatch::getMoveTurn(std::size_t i) const { return turn[i]; }
+
+void BoardBatch::setVectorised(bool on) { vectorised = on; }
+
+bool BoardBatch::isVectorised() const
+{
+#ifdef BATCH_AVX2
+  return vectorised && __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+
+void BoardBatch::load(std::size_t i, ChessBoard const & cb)
+{
+  for(int c = 0; c < 2; c++)
+    for(int t = KING; t <= PAWN; t++) pieces[c][t][i] = 0;
+
+  turn[i] = cb.getMoveTurn();
+  for(int r = 0; r < BOARD_SIZE; r++)
+    for(int f = 0; f < BOARD_SIZE; f++)
+    {
+      Piece* p = cb.pieceAt(r,f);
+      if(p) pieces[p->getColor() != turn[i]][p->getType()][i] |= bit(r*BOARD_SIZE + f);
+    }
+
+  // A side may castle with a rook if neither it nor its king has moved
+  rights[i] = 0;
+  for(int c = 0; c < 2; c++)
+  {
+    int const HOME = (c == WHITE ? 0 : BOARD_SIZE-1);
+    Piece* king = cb.pieceAt(HOME,4);
+    if(!king || king->getType() != KING || king->getColor() != bool(c) ||
+       king->getCount() != 0)
+      continue;
+    for(int side = 0; side < 2; side++)
+    {
+      Piece* rook = cb.pieceAt(HOME,side == 0 ? BOARD_SIZE-1 : 0);
+      if(rook && rook->getType() == ROOK && rook->getColor() == bool(c) &&
+         rook->getCount() == 0)
+        rights[i] |= uint8_t(1 << (2*c + side));
+    }
+  }
+}
+
+
+void BoardBatch::run(Move const * moves, uint8_t* status, bool play)
+{
+  BatchRun const B = {pieces[0], turn, rights, moves, status, size};
+#ifdef BATCH_AVX2
+  if(isVectorised())
+  {
+    movesAvx2(B,play);
+    return;
+  }
+#endif
+  movesScalar(B,play);
+}
+
+
+void BoardBatch::validate(Move const * moves, uint8_t* status) { run(moves,status,false); }
+
+void BoardBatch::apply(Move const * moves, uint8_t* status) { run(moves,status,true); }
@@ -0,0 +1,90 @@
+#ifndef BOARDBATCH_H
+#define BOARDBATCH_H
+
+#include <cstdint>
+#include <cstddef>
+#include "move.h"
+
+class ChessBoard;
+
+/*===== BATCHES OF BOARDS =====*/
+enum BatchStatus
+{
+  BATCH_LEGAL,
+  BATCH_CHECK, // legal, and the opponent is in check after it
+  BATCH_ILLEGAL
+};
+
+/**
+ * Many independent positions kept as bitboards in a structure-of-arrays layout (one array
+ * per piece type and side, the side to move first, indexed by board), for validating one
+ * move per board across the whole batch at a time. The rules are those of ChessBoard: no
+ * promotion, no en passant.
+ *
+ * Only the inputs of each move are set board by board, from its squares, right before the
+ * kernel runs on them. The kernel is bitboard operations with no table and no branch: the pattern of the piece, the
+ * position after the move, and the attacks on the kings (whether the move leaves its own
+ * king in check, gives check, or castles through an attacked square). It runs on 4 boards
+ * at once with AVX2 when the CPU has it, and on one at a time otherwise
+ */
+class BoardBatch
+{
+  std::size_t size;
+  std::size_t stride; // size rounded up to a multiple of 4
+
+  uint64_t* block; // every array below, 32-byte aligned
+  uint64_t* pieces[2][6]; // [0 side to move, 1 other side][PieceType][board]
+  uint8_t* turn; // [board] side to move
+  uint8_t* rights; // [board] castling rights: 1 White king side, 2 White queen side, 4 and 8 Black
+
+  bool vectorised;
+
+  /**
+   * Test the moves and find their statuses; with play, make the legal ones. One pass over the
+   * boards, 4 at a time with AVX2, from the moves to the statuses
+   */
+  void run(Move const * moves, uint8_t* status, bool play);
+
+  BoardBatch(BoardBatch const &) = delete;
+  BoardBatch& operator=(BoardBatch const &) = delete;
+
+ public:
+
+  /**
+   * n boards, all on the initial position
+   */
+  explicit BoardBatch(std::size_t n);
+  ~BoardBatch();
+
+  std::size_t getSize() const;
+
+  /**
+   * Copy the position of a board (pieces, side to move and castling rights) into board i
+   */
+  void load(std::size_t i, ChessBoard const & cb);
+
+  /**
+   * Test moves[i] on board i for every board, without changing any, and write its
+   * BatchStatus to status[i]
+   */
+  void validate(Move const * moves, uint8_t* status);
+
+  /**
+   * Same, and make the legal moves on their boards
+   */
+  void apply(Move const * moves, uint8_t* status);
+
+  /**
+   * Return the side to move on board i
+   */
+  bool getMoveTurn(std::size_t i) const;
+
+  /**
+   * Use the AVX2 kernel (if the CPU has it) or the scalar one; the former is the default
+   */
+  void setVectorised(bool on);
+  bool isVectorised() const;
+};
+
+
+#endif
@@ -0,0 +1,222 @@
+#include "chessapi.h"
+#include "ChessBoard.h"
+#include "session.h"
+#include <ostream>
+#include <memory>
+#include <vector>
+#include <new>
+#include <cstring>
+
+using namespace std;
+
+/*===== HANDLES =====*/
+/**
+ * A board reporting on a stream with no buffer, which drops everything, and the room to
+ * generate the replies to a move. The legal destinations of the current position are kept
+ * from the replies to the last move made, so that a run of moves costs one generation each
+ */
+struct ChessHandle
+{
+  unique_ptr<SessionRecorder> recorder; // of chessRecord(), outlives the board
+  ostream silent;
+  ChessBoard board;
+  vector<Move> replies;
+  uint64_t targets[BOARD_SIZE*BOARD_SIZE];
+  bool targetsValid; // targets are those of the current position
+  size_t played; // moves made since the last reset or load, which chessUndo() may take back
+
+  ChessHandle(): silent(nullptr), board(silent), targetsValid(false), played(0) {}
+};
+
+
+/**
+ * The status of the last move made on a board
+ */
+static ChessStatus statusAfter(ChessHandle* h)
+{
+  ChessBoard& cb = h->board;
+  cb.generateLegalMoves(h->replies);
+  bool const IN_CHECK = cb.isSideToMoveInCheck();
+
+  if(h->replies.empty()) return IN_CHECK ? CHESS_CHECKMATE : CHESS_STALEMATE;
+  if(cb.isInsufficientMaterial() || cb.repetitionCount() >= 3 || cb.getHalfmoveClock() >= 100)
+    return CHESS_DRAW;
+  return IN_CHECK ? CHESS_CHECK : CHESS_LEGAL;
+}
+
+
+/**
+ * Return the legal destinations of the current position
+ */
+static uint64_t const * legalTargets(ChessHandle* h)
+{
+  if(!h->targetsValid)
+  {
+    memcpy(h->targets,h->board.legalTargetsAll(),sizeof(h->targets));
+    h->targetsValid = true;
+  }
+  return h->targets;
+}
+
+
+static bool isLegal(ChessHandle* h, ChessMove const & m)
+{
+  if(m.from >= BOARD_SIZE*BOARD_SIZE || m.to >= BOARD_SIZE*BOARD_SIZE) return false;
+  return (legalTargets(h)[m.from] >> m.to) & 1;
+}
+
+
+static Move toMove(ChessMove const & m)
+{
+  return Move(m.from / BOARD_SIZE,m.from % BOARD_SIZE,m.to / BOARD_SIZE,m.to % BOARD_SIZE);
+}
+
+
+
+/*===== C INTERFACE =====*/
+
+ChessHandle* chessCreate(void)
+{
+  return new(nothrow) ChessHandle;
+}
+
+
+
+ChessHandle* chessCreateFromFEN(char const * fen)
+{
+  ChessHandle* h = chessCreate();
+  if(h && (!fen || !h->board.loadPosition(fen)))
+  {
+    delete h;
+    return nullptr;
+  }
+  return h;
+}
+
+
+
+void chessDestroy(ChessHandle* handle) { delete handle; }
+
+
+
+void chessReset(ChessHandle* handle)
+{
+  handle->board.resetBoard();
+  handle->targetsValid = false;
+  handle->played = 0;
+}
+
+
+
+int chessLoad(ChessHandle* handle, char const * fen)
+{
+  handle->targetsValid = false;
+  handle->played = 0;
+  if(!fen)
+  {
+    handle->board.resetBoard();
+    return 0;
+  }
+  return handle->board.loadPosition(fen) ? 1 : 0;
+}
+
+
+
+int chessGetMoveTurn(ChessHandle const * handle)
+{
+  return handle->board.getMoveTurn() == WHITE ? 0 : 1;
+}
+
+
+
+size_t chessValidate(ChessHandle* handle, ChessMove const * moves, size_t n, uint8_t* status)
+{
+  // The moves tried are not the game's: keep them out of its log
+  handle->board.setRecorder(nullptr);
+  size_t legal = 0;
+  for(size_t i = 0; i < n; i++)
+  {
+    if(!isLegal(handle,moves[i]))
+    {
+      status[i] = CHESS_ILLEGAL;
+      continue;
+    }
+    handle->board.makeMove(toMove(moves[i]));
+    status[i] = uint8_t(statusAfter(handle));
+    handle->board.undoMove();
+    legal++;
+  }
+  handle->board.setRecorder(handle->recorder.get());
+  return legal;
+}
+
+
+
+size_t chessApply(ChessHandle* handle, ChessMove const * moves, size_t n, uint8_t* status)
+{
+  size_t made = 0;
+  for(size_t i = 0; i < n; i++)
+  {
+    if(!isLegal(handle,moves[i]))
+    {
+      status[i] = CHESS_ILLEGAL;
+      continue;
+    }
+    handle->board.makeMove(toMove(moves[i]));
+    status[i] = uint8_t(statusAfter(handle));
+    made++;
+    handle->played++;
+
+    // The replies are the legal moves of the position now on the board
+    memset(handle->targets,0,sizeof(handle->targets));
+    for(Move const & r : handle->replies)
+      handle->targets[r.rankS*BOARD_SIZE + r.fileS] |=
+        uint64_t(1) << (r.rankD*BOARD_SIZE + r.fileD);
+  }
+  return made;
+}
+
+
+
+size_t chessApplyEach(ChessHandle* const * handles, ChessMove const * moves, size_t n,
+                      uint8_t* status)
+{
+  size_t made = 0;
+  for(size_t i = 0; i < n; i++) made += chessApply(handles[i],moves + i,1,status + i);
+  return made;
+}
+
+
+
+int chessUndo(ChessHandle* handle)
+{
+  // undoMove() rather than takeBack(): there is no redo here to keep the moves for
+  if(handle->played == 0) return 0;
+  handle->board.undoMove();
+  handle->played--;
+  handle->targetsValid = false;
+  return 1;
+}
+
+
+
+uint64_t chessLegalTargets(ChessHandle* handle, int square)
+{
+  if(square < 0 || square >= BOARD_SIZE*BOARD_SIZE) return 0;
+  return legalTargets(handle)[square];
+}
+
+
+
+int chessRecord(ChessHandle* handle, char const * path)
+{
+  handle->board.setRecorder(nullptr);
+  handle->recorder.reset();
+  if(!path) return 1;
+
+  unique_ptr<SessionRecorder> recorder(new(nothrow) SessionRecorder);
+  if(!recorder || !recorder->open(path)) return 0;
+  handle->recorder = std::move(recorder);
+  handle->board.setRecorder(handle->recorder.get());
+  return 1;
+}
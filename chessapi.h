@@ -0,0 +1,112 @@
+#ifndef CHESSAPI_H
+#define CHESSAPI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*===== C INTERFACE =====*/
+/**
+ * The engine as a library (libchess.a / libchess.so), for programs in C or anything with a C
+ * foreign function interface. Boards are opaque handles; squares are rank*8+file (A1 is 0,
+ * H8 is 63); nothing is printed on stdout. A handle must not be used by two threads at once,
+ * different handles may
+ */
+#if defined(__GNUC__)
+#define CHESS_API __attribute__((visibility("default")))
+#else
+#define CHESS_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ChessHandle ChessHandle;
+
+typedef struct ChessMove
+{
+  uint8_t from;
+  uint8_t to;
+} ChessMove;
+
+/**
+ * What a move does, written by the batch calls: one byte per move
+ */
+enum ChessStatus
+{
+  CHESS_LEGAL, /* the game goes on */
+  CHESS_CHECK, /* legal, and the opponent is in check */
+  CHESS_CHECKMATE,
+  CHESS_STALEMATE,
+  CHESS_DRAW, /* legal, and the game is drawn: dead position, threefold repetition or
+                 fifty moves; further moves are still accepted */
+  CHESS_ILLEGAL /* not made */
+};
+
+/**
+ * A board on the initial position, or on the position of a FEN string (placement, side to
+ * move, castling, and optionally the halfmove clock). NULL if the string cannot be parsed
+ */
+CHESS_API ChessHandle* chessCreate(void);
+CHESS_API ChessHandle* chessCreateFromFEN(char const * fen);
+CHESS_API void chessDestroy(ChessHandle* handle);
+
+/**
+ * Start again from the initial position / from a FEN string; the latter returns 0 (and
+ * leaves the initial position) if the string cannot be parsed, 1 otherwise
+ */
+CHESS_API void chessReset(ChessHandle* handle);
+CHESS_API int chessLoad(ChessHandle* handle, char const * fen);
+
+/**
+ * Return the side to move: 0 White, 1 Black
+ */
+CHESS_API int chessGetMoveTurn(ChessHandle const * handle);
+
+/**
+ * Write the ChessStatus of each of moves[0..n-1] played on the current position to
+ * status[0..n-1], without changing the board. Returns the number of legal moves
+ */
+CHESS_API size_t chessValidate(ChessHandle* handle, ChessMove const * moves, size_t n,
+                               uint8_t* status);
+
+/**
+ * Play moves[0..n-1] one after the other, each legal one from the position the previous
+ * ones left, skipping the illegal ones; the ChessStatus of each goes to status[0..n-1].
+ * Returns the number of moves made
+ */
+CHESS_API size_t chessApply(ChessHandle* handle, ChessMove const * moves, size_t n,
+                            uint8_t* status);
+
+/**
+ * Same for many games at once: moves[i] is played on handles[i]
+ */
+CHESS_API size_t chessApplyEach(ChessHandle* const * handles, ChessMove const * moves,
+                                size_t n, uint8_t* status);
+
+/**
+ * Take back the last move made; returns 0 if there is none
+ */
+CHESS_API int chessUndo(ChessHandle* handle);
+
+/**
+ * Return the legal destinations of the piece on a square as bits, 0 if none (or if the
+ * square holds nothing of the side to move)
+ */
+CHESS_API uint64_t chessLegalTargets(ChessHandle* handle, int square);
+
+/**
+ * Write what is done to the board from now on to a session log at path, replacing any file
+ * there, for the replay tool; NULL stops recording and closes the log. The moves tried by
+ * chessValidate() are left out. A replay starts from the initial position: record a board
+ * just made by chessCreate(), or follow with chessReset() or chessLoad(). Returns 0, with
+ * nothing recorded any more, if the log cannot be written
+ */
+CHESS_API int chessRecord(ChessHandle* handle, char const * path);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
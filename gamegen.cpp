@@ -0,0 +1,180 @@
+#include "ChessBoard.h"
+#include "randgame.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+
+static long const CHUNK_GAMES = 64; // games handed to a worker at a time
+static long const WINDOW_CHUNKS = 64; // chunks a worker may run ahead of the output
+
+/*===== ORDERED OUTPUT =====*/
+
+/**
+ * Chunks of games are written in order, whichever worker finishes them first, so that the
+ * output depends on the seed only
+ */
+struct OrderedOutput
+{
+  ostream* out;
+  mutex lock;
+  condition_variable written;
+  long next; // next chunk to write
+  map<long,string> ready;
+
+  /**
+   * Wait until a chunk is within WINDOW_CHUNKS of the output (bounding the memory)
+   */
+  void waitForRoom(long chunk)
+  {
+    unique_lock<mutex> guard(lock);
+    written.wait(guard,[&]() { return chunk < next + WINDOW_CHUNKS; });
+  }
+
+  void submit(long chunk, string& data)
+  {
+    unique_lock<mutex> guard(lock);
+    ready[chunk].swap(data);
+    while(!ready.empty() && ready.begin()->first == next)
+    {
+      out->write(ready.begin()->second.data(),ready.begin()->second.size());
+      ready.erase(ready.begin());
+      next++;
+    }
+    written.notify_all();
+  }
+};
+
+/**
+ * A stream buffer dropping everything written to it
+ */
+struct NullBuffer: public streambuf
+{
+  int overflow(int c) override { return c; }
+};
+
+
+
+/*===== WORKERS =====*/
+
+struct GenerationState
+{
+  atomic<long> nextChunk;
+  atomic<long> plies;
+};
+
+/**
+ * Play chunk after chunk of games, game i with its own random stream
+ */
+static void runWorker(long games, uint64_t seed, bool weighted, int maxPlies, bool binary,
+                      GenerationState& state, OrderedOutput& output)
+{
+  ChessBoard cb;
+  RandomGame game;
+  string buffer;
+  long plies = 0;
+
+  for(long chunk = state.nextChunk++; chunk * CHUNK_GAMES < games; chunk = state.nextChunk++)
+  {
+    output.waitForRoom(chunk);
+    buffer.clear();
+    long const LAST = min(games,(chunk + 1) * CHUNK_GAMES);
+    for(long g = chunk * CHUNK_GAMES; g < LAST; g++)
+    {
+      Rng rng(streamSeed(seed,uint64_t(g)));
+      cb.resetBoard();
+      playRandomGame(cb,rng,weighted,maxPlies,game);
+      plies += long(game.plies.size());
+      if(binary) appendBinary(buffer,game);
+      else appendText(buffer,game);
+    }
+    output.submit(chunk,buffer);
+  }
+  state.plies += plies;
+}
+
+
+/**
+ * Usage: gamegen [--games N] [--seed S] [--threads N] [--weighted] [--maxplies N] [--binary]
+ *                [--out FILE]
+ * Writes the games to FILE (stdout by default) and the throughput to stderr
+ */
+int main(int argc, char** argv)
+{
+  long games = 1000;
+  uint64_t seed = 1;
+  int threads = int(thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1);
+  int maxPlies = 200;
+  bool weighted = false, binary = false;
+  string outFile;
+
+  for(int i = 1; i < argc; i++)
+  {
+    string const ARG = argv[i];
+    bool const VALUE = (i + 1 < argc);
+    if(ARG == "--games" && VALUE) games = atol(argv[++i]);
+    else if(ARG == "--seed" && VALUE) seed = strtoull(argv[++i],nullptr,0);
+    else if(ARG == "--threads" && VALUE) threads = atoi(argv[++i]);
+    else if(ARG == "--maxplies" && VALUE) maxPlies = atoi(argv[++i]);
+    else if(ARG == "--weighted") weighted = true;
+    else if(ARG == "--binary") binary = true;
+    else if(ARG == "--out" && VALUE) outFile = argv[++i];
+    else
+    {
+      cerr << "Usage: " << argv[0] << " [--games N] [--seed S] [--threads N] [--weighted]"
+           << " [--maxplies N] [--binary] [--out FILE]" << endl;
+      return 1;
+    }
+  }
+  if(games < 1 || threads < 1 || maxPlies < 1 || maxPlies > 65535)
+  {
+    cerr << "The numbers of games and threads must be positive, the ply limit in [1, 65535]!"
+         << endl;
+    return 1;
+  }
+
+  ofstream file;
+  if(!outFile.empty())
+  {
+    file.open(outFile,ios::binary);
+    if(!file)
+    {
+      cerr << "Cannot write " << outFile << "!" << endl;
+      return 1;
+    }
+  }
+
+  // The boards report on cout, which may be the output: keep it for the games only
+  ostream out(outFile.empty() ? cout.rdbuf() : file.rdbuf());
+  NullBuffer discarded;
+  cout.rdbuf(&discarded);
+
+  if(binary) writeBinaryHeader(out,seed);
+  OrderedOutput output;
+  output.out = &out; output.next = 0;
+  GenerationState state;
+  state.nextChunk = 0; state.plies = 0;
+
+  chrono::steady_clock::time_point const START = chrono::steady_clock::now();
+  vector<thread> workers;
+  for(int t = 0; t < threads; t++)
+    workers.push_back(thread(runWorker,games,seed,weighted,maxPlies,binary,ref(state),
+                             ref(output)));
+  for(thread& w : workers) w.join();
+  out.flush();
+  double const SECONDS = chrono::duration<double>(chrono::steady_clock::now() - START).count();
+
+  cerr << games << " games, " << state.plies << " plies in " << SECONDS << " s: "
+       << long(state.plies / SECONDS) << " plies/s on " << threads << " threads" << endl;
+  cout.rdbuf(out.rdbuf());
+  return out ? 0 : 1;
+}
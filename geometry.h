@@ -0,0 +1,90 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <cstdint>
+#include "piece.h"
+
+/*===== BOARD GEOMETRY =====*/
+/**
+ * The shape of a board, WIDTH files by HEIGHT ranks, as a type: code templated on it gets
+ * its sizes as constants, so the bounds of the standard board cost no more than a literal 8.
+ * Squares are numbered rank*WIDTH+file. tests checks the tables and the rules on 10x8 and
+ * 10x10 boards
+ */
+template <int WIDTH, int HEIGHT>
+struct Geometry
+{
+  static_assert(WIDTH > 0 && HEIGHT > 0 && WIDTH*HEIGHT <= 256,
+                "squares of a geometry must fit in a byte");
+
+  static constexpr int FILES = WIDTH;
+  static constexpr int RANKS = HEIGHT;
+  static constexpr int SQUARES = WIDTH*HEIGHT;
+  static constexpr int MAX_RAY = (WIDTH > HEIGHT ? WIDTH : HEIGHT) - 1; // squares along a ray
+
+  static constexpr bool inside(int rank, int file)
+  {
+    return rank >= 0 && rank < HEIGHT && file >= 0 && file < WIDTH;
+  }
+
+  static constexpr int square(int rank, int file) { return rank*WIDTH + file; }
+  static constexpr int rankOf(int sq) { return sq / WIDTH; }
+  static constexpr int fileOf(int sq) { return sq % WIDTH; }
+};
+
+typedef Geometry<BOARD_SIZE,BOARD_SIZE> StandardGeometry; // the board of ChessBoard
+
+
+/**
+ * The 8 directions as (rank, file) steps, the orthogonal ones first, and the 8 knight jumps
+ */
+inline constexpr int GEOMETRY_STEPS[8][2] =
+  {{1,0},{-1,0},{0,1},{0,-1},{1,1},{1,-1},{-1,1},{-1,-1}};
+inline constexpr int GEOMETRY_JUMPS[8][2] =
+  {{1,2},{2,1},{2,-1},{1,-2},{-1,-2},{-2,-1},{-2,1},{-1,2}};
+
+enum Leaper {KING_LEAP, KNIGHT_LEAP};
+
+
+/**
+ * Squares reachable from each square of a geometry, off-board ones left out: the king steps
+ * and knight jumps, and the rays in each direction of GEOMETRY_STEPS, nearest square first
+ */
+template <class G>
+struct GeometryTables
+{
+  uint8_t leaperCount[2][G::SQUARES]; // [Leaper][square]
+  uint8_t leaper[2][G::SQUARES][8];
+  uint8_t rayLength[G::SQUARES][8]; // [square][direction]
+  uint8_t ray[G::SQUARES][8][G::MAX_RAY];
+};
+
+template <class G>
+constexpr GeometryTables<G> makeGeometryTables()
+{
+  GeometryTables<G> tables = {};
+  for(int sq = 0; sq < G::SQUARES; sq++)
+  {
+    int const RANK = G::rankOf(sq), FILE = G::fileOf(sq);
+    for(int d = 0; d < 8; d++)
+    {
+      int const RS = RANK + GEOMETRY_STEPS[d][0], FS = FILE + GEOMETRY_STEPS[d][1];
+      if(G::inside(RS,FS))
+        tables.leaper[KING_LEAP][sq][tables.leaperCount[KING_LEAP][sq]++] = G::square(RS,FS);
+
+      int const RJ = RANK + GEOMETRY_JUMPS[d][0], FJ = FILE + GEOMETRY_JUMPS[d][1];
+      if(G::inside(RJ,FJ))
+        tables.leaper[KNIGHT_LEAP][sq][tables.leaperCount[KNIGHT_LEAP][sq]++] = G::square(RJ,FJ);
+
+      for(int r = RS, f = FS; G::inside(r,f); r += GEOMETRY_STEPS[d][0], f += GEOMETRY_STEPS[d][1])
+        tables.ray[sq][d][tables.rayLength[sq][d]++] = G::square(r,f);
+    }
+  }
+  return tables;
+}
+
+template <class G>
+inline constexpr GeometryTables<G> GEOMETRY_TABLES = makeGeometryTables<G>();
+
+
+#endif
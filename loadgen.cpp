@@ -0,0 +1,320 @@
+#include "ChessBoard.h"
+#include "randgame.h"
+#include "stats.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+/*===== LOAD GENERATOR =====*/
+/**
+ * Plays pregenerated random games against the server: each connection keeps a number of
+ * games in flight, sending the next move of a game as soon as the previous one is answered,
+ * and times every round trip
+ */
+
+static chrono::steady_clock::time_point const EPOCH = chrono::steady_clock::now();
+
+static inline int64_t nowNs()
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - EPOCH).count();
+}
+
+/**
+ * A stream buffer dropping everything written to it
+ */
+struct NullBuffer: public streambuf
+{
+  int overflow(int c) override { return c; }
+};
+
+
+static int connectTo(string const & path, int port)
+{
+  int fd = -1;
+  if(!path.empty())
+  {
+    fd = socket(AF_UNIX,SOCK_STREAM,0);
+    sockaddr_un addr;
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path,path.c_str(),sizeof(addr.sun_path) - 1);
+    if(fd < 0 || connect(fd,(sockaddr*)&addr,sizeof(addr)) != 0)
+    {
+      cerr << "Cannot connect to " << path << ": " << strerror(errno) << endl;
+      return -1;
+    }
+  }
+  else
+  {
+    fd = socket(AF_INET,SOCK_STREAM,0);
+    sockaddr_in addr;
+    memset(&addr,0,sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(uint16_t(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(fd < 0 || connect(fd,(sockaddr*)&addr,sizeof(addr)) != 0)
+    {
+      cerr << "Cannot connect to 127.0.0.1:" << port << ": " << strerror(errno) << endl;
+      return -1;
+    }
+    int const ON = 1;
+    setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&ON,sizeof(ON));
+  }
+  return fd;
+}
+
+
+static bool writeAll(int fd, string const & data)
+{
+  std::size_t done = 0;
+  while(done < data.size())
+  {
+    ssize_t const N = write(fd,data.data() + done,data.size() - done);
+    if(N <= 0) return false;
+    done += N;
+  }
+  return true;
+}
+
+
+/**
+ * Lines read from a blocking socket
+ */
+struct LineReader
+{
+  int fd;
+  string buffer;
+  std::size_t start;
+
+  explicit LineReader(int f): fd(f), start(0){}
+
+  bool next(string& line)
+  {
+    for(;;)
+    {
+      std::size_t const END = buffer.find('\n',start);
+      if(END != string::npos)
+      {
+        line.assign(buffer,start,END - start);
+        start = END + 1;
+        return true;
+      }
+      buffer.erase(0,start); start = 0;
+      char chunk[65536];
+      ssize_t const N = read(fd,chunk,sizeof(chunk));
+      if(N <= 0) return false;
+      buffer.append(chunk,N);
+    }
+  }
+};
+
+
+struct LoadState
+{
+  vector<RandomGame> const * games;
+  atomic<long> nextGame; // games started so far
+  long totalGames;
+  atomic<long> moves;
+  atomic<long> errors;
+};
+
+/**
+ * A game being played by a connection
+ */
+struct Slot
+{
+  uint64_t id;
+  RandomGame const * game;
+  std::size_t ply; // next ply to send
+  int64_t sent;
+  bool ended; // no game left for it, END sent
+};
+
+
+/**
+ * One connection: play games with inFlight of them at a time until they are all started,
+ * recording the round trips of the moves in latency
+ */
+static void runConnection(string const & path, int port, int connection, int inFlight,
+                          LoadState& state, HistogramSnapshot& latency)
+{
+  int const FD = connectTo(path,port);
+  if(FD < 0) { state.errors++; return; }
+  LineReader reader(FD);
+
+  vector<Slot> slots(inFlight);
+  int active = 0;
+  auto startGame = [&](Slot& s) -> bool
+  {
+    long const G = state.nextGame++;
+    if(G >= state.totalGames) return false;
+    s.game = &(*state.games)[G % state.games->size()];
+    s.ply = 0;
+    s.sent = nowNs();
+    return writeAll(FD,"NEW " + to_string(s.id) + "\n");
+  };
+
+  for(int i = 0; i < inFlight; i++)
+  {
+    slots[i].id = uint64_t(connection) * uint64_t(inFlight) + i;
+    slots[i].ended = false;
+    active++;
+    if(!startGame(slots[i]))
+    {
+      slots[i].ended = true;
+      writeAll(FD,"END " + to_string(slots[i].id) + "\n");
+    }
+  }
+
+  string line;
+  while(active > 0 && reader.next(line))
+  {
+    //=== 1. Which game is answered: "OK <id> ..." or "ERR <id> ..."
+    std::size_t const SPACE = line.find(' ');
+    uint64_t const ID = (SPACE == string::npos ? 0 :
+                         strtoull(line.c_str() + SPACE + 1,nullptr,10));
+    uint64_t const FIRST = uint64_t(connection) * uint64_t(inFlight);
+    if(ID < FIRST || ID >= FIRST + inFlight) { state.errors++; break; }
+    Slot& s = slots[ID - FIRST];
+    int64_t const NOW = nowNs();
+
+    if(s.ended) { active--; continue; } // "OK <id> ended"
+    if(line.compare(0,3,"ERR") == 0)
+    {
+      if(state.errors++ == 0) cerr << "Game " << ID << ", ply " << s.ply << ": " << line << endl;
+    }
+    if(s.ply > 0)
+    {
+      uint64_t const NS = uint64_t(NOW - s.sent);
+      latency.buckets[statBucket(NS)]++;
+      latency.count++; latency.sum += NS;
+      if(NS > latency.max) latency.max = NS;
+      state.moves++;
+    }
+
+    //=== 2. Its next move, or the next game
+    if(s.ply < s.game->plies.size() && line.compare(0,3,"ERR") != 0)
+    {
+      s.sent = nowNs();
+      string const MOVE = s.game->plies[s.ply++].uciString();
+      if(!writeAll(FD,"MOVE " + to_string(s.id) + " " + MOVE + "\n")) break;
+    }
+    else if(!startGame(s))
+    {
+      s.ended = true;
+      if(!writeAll(FD,"END " + to_string(s.id) + "\n")) break;
+    }
+  }
+  close(FD);
+}
+
+
+/**
+ * Usage: loadgen [--unix PATH | --port N] [--connections N] [--inflight N] [--games N]
+ *                [--distinct N] [--seed S]
+ * Plays games (drawn from distinct pregenerated random ones) and prints the round-trip
+ * latencies, the throughput and the server's own figures
+ */
+int main(int argc, char** argv)
+{
+  string path;
+  int port = 0;
+  int connections = 4, inFlight = 8;
+  long games = 2000, distinct = 256;
+  uint64_t seed = 1;
+  for(int i = 1; i < argc; i++)
+  {
+    string const ARG = argv[i];
+    bool const VALUE = (i + 1 < argc);
+    if(ARG == "--unix" && VALUE) path = argv[++i];
+    else if(ARG == "--port" && VALUE) port = atoi(argv[++i]);
+    else if(ARG == "--connections" && VALUE) connections = atoi(argv[++i]);
+    else if(ARG == "--inflight" && VALUE) inFlight = atoi(argv[++i]);
+    else if(ARG == "--games" && VALUE) games = atol(argv[++i]);
+    else if(ARG == "--distinct" && VALUE) distinct = atol(argv[++i]);
+    else if(ARG == "--seed" && VALUE) seed = strtoull(argv[++i],nullptr,0);
+    else
+    {
+      cerr << "Usage: " << argv[0] << " [--unix PATH | --port N] [--connections N]"
+           << " [--inflight N] [--games N] [--distinct N] [--seed S]" << endl;
+      return 1;
+    }
+  }
+  if((path.empty() && (port <= 0 || port > 65535)) || connections < 1 || inFlight < 1 ||
+     games < 1 || distinct < 1)
+  {
+    cerr << "A socket path or a port is needed, and the counts must be positive!" << endl;
+    return 1;
+  }
+
+  //=== 1. The games to play, generated beforehand so as not to load the server's machine
+  // while measuring
+  NullBuffer discarded;
+  streambuf* const STDOUT = cout.rdbuf(&discarded);
+  vector<RandomGame> pregenerated(distinct);
+  {
+    ChessBoard cb;
+    for(long g = 0; g < distinct; g++)
+    {
+      Rng rng(streamSeed(seed,uint64_t(g)));
+      cb.resetBoard();
+      playRandomGame(cb,rng,true,200,pregenerated[g]);
+    }
+  }
+  cout.rdbuf(STDOUT);
+
+  //=== 2. Play them
+  LoadState state;
+  state.games = &pregenerated; state.nextGame = 0; state.totalGames = games;
+  state.moves = 0; state.errors = 0;
+  vector<HistogramSnapshot> latencies(connections);
+  for(HistogramSnapshot& h : latencies) memset(&h,0,sizeof(h));
+
+  int64_t const START = nowNs();
+  vector<thread> threads;
+  for(int c = 0; c < connections; c++)
+    threads.push_back(thread(runConnection,cref(path),port,c,inFlight,ref(state),
+                             ref(latencies[c])));
+  for(thread& t : threads) t.join();
+  double const SECONDS = (nowNs() - START) / 1e9;
+
+  HistogramSnapshot total;
+  memset(&total,0,sizeof(total));
+  for(HistogramSnapshot const & h : latencies)
+  {
+    for(int b = 0; b < STAT_BUCKETS; b++) total.buckets[b] += h.buckets[b];
+    total.count += h.count; total.sum += h.sum; total.max = max(total.max,h.max);
+  }
+
+  cout << games << " games, " << state.moves << " moves in " << SECONDS << " s over "
+       << connections << " connections (" << inFlight << " games each): "
+       << long(state.moves / SECONDS) << " moves/s" << endl;
+  cout << "round trip: p50 " << total.quantile(0.5) / 1000.0 << " us, p99 "
+       << total.quantile(0.99) / 1000.0 << " us, max " << total.max / 1000.0 << " us" << endl;
+  if(state.errors > 0) cout << state.errors << " errors" << endl;
+
+  //=== 3. The server's side of it
+  int const FD = connectTo(path,port);
+  if(FD >= 0)
+  {
+    LineReader reader(FD);
+    string line;
+    if(writeAll(FD,"STATS\n") && reader.next(line)) cout << "server: " << line << endl;
+    close(FD);
+  }
+  return state.errors > 0 ? 1 : 0;
+}
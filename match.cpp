@@ -0,0 +1,586 @@
+#include "ChessBoard.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <csignal>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+/*===== ENGINE PROCESSES =====*/
+
+/**
+ * A UCI engine run as a child process, talked to through pipes
+ */
+class EngineProcess
+{
+  string path;
+  pid_t pid;
+  int toEngine; // its stdin
+  int fromEngine; // its stdout
+  string pending; // read but not yet returned
+
+ public:
+  string name;
+
+  explicit EngineProcess(string const & p): path(p), pid(-1), toEngine(-1), fromEngine(-1)
+  {
+    std::size_t const SLASH = p.find_last_of('/');
+    name = (SLASH == string::npos ? p : p.substr(SLASH + 1));
+  }
+
+  /**
+   * Start the engine and wait for uciok, returns false if it can't be started
+   */
+  bool start()
+  {
+    int in[2], out[2]; // closed on exec, so that no engine keeps the pipes of another open
+    if(pipe2(in,O_CLOEXEC) != 0 || pipe2(out,O_CLOEXEC) != 0)
+    {
+      cerr << "Cannot create the pipes of " << path << "!" << endl;
+      return false;
+    }
+
+    pid = fork();
+    if(pid < 0)
+    {
+      cerr << "Cannot start " << path << "!" << endl;
+      close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+      return false;
+    }
+    if(pid == 0)
+    {
+      dup2(in[0],STDIN_FILENO); dup2(out[1],STDOUT_FILENO);
+      close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+      execl(path.c_str(),path.c_str(),(char*)nullptr);
+      _exit(127);
+    }
+    close(in[0]); close(out[1]);
+    toEngine = in[1]; fromEngine = out[0];
+
+    send("uci");
+    string line;
+    while(readLine(line,10000))
+      if(line == "uciok") return true;
+    cerr << path << " is not a UCI engine!" << endl;
+    return false;
+  }
+
+  /**
+   * Ask the engine to quit, and kill it if it doesn't
+   */
+  void stop()
+  {
+    if(pid <= 0) return;
+    send("quit");
+    for(int i = 0; i < 100 && waitpid(pid,nullptr,WNOHANG) == 0; i++) usleep(10000);
+    if(waitpid(pid,nullptr,WNOHANG) == 0)
+    {
+      kill(pid,SIGKILL);
+      waitpid(pid,nullptr,0);
+    }
+    close(toEngine); close(fromEngine);
+    pid = -1; pending.clear();
+  }
+
+  bool restart()
+  {
+    stop();
+    return start();
+  }
+
+  void send(string const & line)
+  {
+    string const DATA = line + "\n";
+    if(write(toEngine,DATA.c_str(),DATA.size()) < 0) {} // a dead engine shows at the next read
+  }
+
+  /**
+   * Read a line within timeoutMs, returns false on a timeout or if the engine has exited
+   */
+  bool readLine(string& line, long timeoutMs)
+  {
+    chrono::steady_clock::time_point const DEADLINE =
+      chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    for(;;)
+    {
+      std::size_t const END = pending.find('\n');
+      if(END != string::npos)
+      {
+        line = pending.substr(0,END);
+        pending.erase(0,END + 1);
+        return true;
+      }
+
+      long const LEFT = chrono::duration_cast<chrono::milliseconds>(
+        DEADLINE - chrono::steady_clock::now()).count();
+      if(LEFT <= 0) return false;
+      pollfd p = {fromEngine, POLLIN, 0};
+      if(poll(&p,1,int(LEFT)) <= 0) continue;
+
+      char buffer[4096];
+      ssize_t const N = read(fromEngine,buffer,sizeof(buffer));
+      if(N <= 0) return false;
+      pending.append(buffer,N);
+    }
+  }
+
+  /**
+   * Send isready and wait for readyok
+   */
+  bool sync()
+  {
+    send("isready");
+    string line;
+    while(readLine(line,10000))
+      if(line == "readyok") return true;
+    return false;
+  }
+
+  ~EngineProcess() { stop(); }
+};
+
+
+
+/*===== OPENINGS =====*/
+
+/**
+ * A start position: a FEN and/or moves from it (UCI notation)
+ */
+struct Opening
+{
+  string fen; // empty for the initial position
+  vector<string> moves;
+};
+
+/**
+ * Set up a board on an opening, returns false if it can't be set up or a move is illegal
+ */
+static bool setupOpening(ChessBoard& cb, Opening const & o)
+{
+  if(o.fen.empty()) cb.resetBoard();
+  else if(!cb.loadPosition(o.fen.c_str())) return false;
+
+  vector<Move> legal;
+  for(string const & played : o.moves)
+  {
+    cb.generateLegalMoves(legal);
+    bool found = false;
+    for(Move const & m : legal)
+      if(m.uciString() == played)
+      {
+        cb.makeMove(m);
+        found = true;
+        break;
+      }
+    if(!found) return false;
+  }
+  return true;
+}
+
+
+/**
+ * Read an opening suite: one opening per line, either a FEN (optionally followed by
+ * "moves ...") or a list of moves from the initial position. Blank lines and lines starting
+ * with # are skipped
+ */
+static bool loadOpenings(string const & path, vector<Opening>& openings)
+{
+  ifstream in(path);
+  if(!in)
+  {
+    cerr << "Cannot open the opening suite " << path << "!" << endl;
+    return false;
+  }
+
+  ChessBoard cb;
+  string line;
+  for(int lineNo = 1; getline(in,line); lineNo++)
+  {
+    if(line.empty() || line[0] == '#') continue;
+
+    Opening o;
+    std::size_t const MOVES = line.find("moves");
+    string const HEAD = line.substr(0,MOVES);
+    string const TAIL = (MOVES == string::npos ? "" : line.substr(MOVES + 5));
+    istringstream moves(HEAD.find('/') != string::npos ? TAIL : line);
+    if(HEAD.find('/') != string::npos) o.fen = HEAD;
+    string m;
+    while(moves >> m) o.moves.push_back(m);
+
+    if(!setupOpening(cb,o))
+    {
+      cerr << "Skipping the illegal opening on line " << lineNo << " of " << path << endl;
+      continue;
+    }
+    openings.push_back(o);
+  }
+
+  if(openings.empty())
+  {
+    cerr << "There is no opening in " << path << "!" << endl;
+    return false;
+  }
+  return true;
+}
+
+
+
+/*===== GAMES =====*/
+
+struct TimeControl
+{
+  long base; // ms per game, 0 without a clock
+  long inc; // ms per move
+  long moveTime; // ms per move without a clock
+};
+
+struct GameResult
+{
+  int score; // 1 if White won, 0 for a draw, -1 if Black won
+  string reason;
+  int plies;
+};
+
+
+/**
+ * Play a game from an opening, the board arbitrating every move and the end of the game
+ */
+static GameResult playGame(EngineProcess* engines[2], Opening const & opening,
+                           TimeControl const & tc, int maxPlies)
+{
+  GameResult result = {0, "", 0};
+  ChessBoard cb;
+  setupOpening(cb,opening);
+
+  string position = (opening.fen.empty() ? "position startpos" : "position fen " + opening.fen);
+  position += " moves";
+  for(string const & m : opening.moves) position += " " + m;
+
+  long clock[2] = {tc.base, tc.base};
+  for(int c = 0; c < 2; c++)
+  {
+    engines[c]->send("ucinewgame");
+    engines[c]->sync();
+  }
+
+  vector<Move> legal;
+  for(;; result.plies++)
+  {
+    bool const TURN = cb.getMoveTurn();
+    int const LOSS = (TURN == WHITE ? -1 : 1); // the score if the side to move loses
+
+    //=== 1. The end of the game
+    cb.generateLegalMoves(legal);
+    if(legal.empty())
+    {
+      result.score = (cb.isSideToMoveInCheck() ? LOSS : 0);
+      result.reason = (result.score ? "checkmate" : "stalemate");
+      return result;
+    }
+    if(cb.repetitionCount() >= 3) { result.reason = "threefold repetition"; return result; }
+    if(cb.getHalfmoveClock() >= 100) { result.reason = "fifty-move rule"; return result; }
+    if(cb.isInsufficientMaterial()) { result.reason = "insufficient material"; return result; }
+    if(result.plies >= maxPlies) { result.reason = "adjudicated after the ply limit"; return result; }
+
+    //=== 2. Ask the engine to move
+    EngineProcess* e = engines[TURN];
+    e->send(position);
+    ostringstream go;
+    if(tc.base > 0)
+      go << "go wtime " << clock[WHITE] << " btime " << clock[BLACK] << " winc " << tc.inc
+         << " binc " << tc.inc;
+    else
+      go << "go movetime " << tc.moveTime;
+    e->send(go.str());
+
+    // One deadline for the whole answer: info lines don't buy an engine more time
+    long const ALLOWED = (tc.base > 0 ? clock[TURN] : tc.moveTime) + 1000; // grace for I/O
+    chrono::steady_clock::time_point const START = chrono::steady_clock::now();
+    chrono::steady_clock::time_point const DEADLINE = START + chrono::milliseconds(ALLOWED);
+    string line, best;
+    while(best.empty())
+    {
+      long const LEFT = chrono::duration_cast<chrono::milliseconds>(
+        DEADLINE - chrono::steady_clock::now()).count();
+      if(LEFT <= 0 || !e->readLine(line,LEFT)) break;
+      if(line.compare(0,9,"bestmove ") == 0) best = line.substr(9,line.find(' ',9) - 9);
+    }
+    long const ELAPSED = chrono::duration_cast<chrono::milliseconds>(
+      chrono::steady_clock::now() - START).count();
+
+    if(best.empty()) // hung or crashed: start it again for the next game
+    {
+      e->restart();
+      result.score = LOSS; result.reason = e->name + " stopped responding";
+      return result;
+    }
+    if(tc.base > 0)
+    {
+      clock[TURN] -= ELAPSED;
+      if(clock[TURN] < 0)
+      {
+        result.score = LOSS; result.reason = e->name + " lost on time";
+        return result;
+      }
+      clock[TURN] += tc.inc;
+    }
+
+    //=== 3. Play the move if it is legal
+    bool found = false;
+    for(Move const & m : legal)
+      if(m.uciString() == best)
+      {
+        cb.makeMove(m);
+        found = true;
+        break;
+      }
+    if(!found)
+    {
+      result.score = LOSS; result.reason = e->name + " played the illegal move " + best;
+      return result;
+    }
+    position += " " + best;
+  }
+}
+
+
+
+/*===== SEQUENTIAL PROBABILITY RATIO TEST =====*/
+/**
+ * Generalised SPRT on the trinomial (win/draw/loss) results of the first engine: H0 is an
+ * Elo difference of elo0, H1 of elo1, alpha and beta the error rates. The log-likelihood
+ * ratio uses the normal approximation of the score
+ */
+struct Sprt
+{
+  double elo0, elo1, alpha, beta;
+
+  static double scoreOf(double elo) { return 1 / (1 + pow(10,-elo / 400)); }
+
+  double lowerBound() const { return log(beta / (1 - alpha)); }
+  double upperBound() const { return log((1 - beta) / alpha); }
+
+  double llr(long wins, long draws, long losses) const
+  {
+    double const N = double(wins + draws + losses);
+    if(N == 0) return 0;
+    double const SCORE = (wins + draws / 2.0) / N;
+
+    // An outcome not seen yet counts as half a game in the variance, which would otherwise be
+    // 0 in a one-sided match
+    double const W = max(double(wins),0.5), D = max(double(draws),0.5);
+    double const L = max(double(losses),0.5);
+    double const VARIANCE = (W * pow(1 - SCORE,2) + D * pow(0.5 - SCORE,2) +
+                             L * pow(SCORE,2)) / (W + D + L);
+    double const S0 = scoreOf(elo0), S1 = scoreOf(elo1);
+    return N * (S1 - S0) * (2 * SCORE - S0 - S1) / (2 * VARIANCE);
+  }
+};
+
+
+/**
+ * Elo difference of a score, with the half-width of its 95% interval
+ */
+static void eloOf(long wins, long draws, long losses, double& elo, double& margin)
+{
+  double const N = double(wins + draws + losses);
+  double const SCORE = (wins + draws / 2.0) / N;
+  double const DEVIATION = sqrt((wins * pow(1 - SCORE,2) + draws * pow(0.5 - SCORE,2) +
+                                 losses * pow(SCORE,2)) / N / N);
+  auto toElo = [](double s) { s = min(max(s,1e-6),1 - 1e-6); return -400 * log10(1 / s - 1); };
+  elo = toElo(SCORE) + 0.0; // not -0
+  margin = (toElo(SCORE + 1.96 * DEVIATION) - toElo(SCORE - 1.96 * DEVIATION)) / 2;
+}
+
+
+
+/*===== MATCH =====*/
+
+/**
+ * A stream buffer dropping everything written to it
+ */
+struct NullBuffer: public streambuf
+{
+  int overflow(int c) override { return c; }
+};
+
+
+struct MatchState
+{
+  mutex lock;
+  atomic<long> nextGame;
+  atomic<bool> finished; // by the SPRT or a broken engine
+  long wins, draws, losses; // of the first engine
+  long played;
+};
+
+
+/**
+ * A worker: its own pair of engines, playing game after game. Even games have the first
+ * engine White, odd ones replay the same opening with the colours reversed
+ */
+static void runWorker(string const & path1, string const & path2, vector<Opening> const & openings,
+                      TimeControl const & tc, int maxPlies, long games, Sprt const * sprt,
+                      MatchState& state, ostream& out)
+{
+  EngineProcess first(path1), second(path2);
+  if(!first.start() || !second.start())
+  {
+    state.finished = true;
+    return;
+  }
+
+  for(long g = state.nextGame++; g < games && !state.finished; g = state.nextGame++)
+  {
+    Opening const & o = openings[(g / 2) % openings.size()];
+    bool const FIRST_WHITE = (g % 2 == 0);
+    EngineProcess* engines[2] = {FIRST_WHITE ? &first : &second, FIRST_WHITE ? &second : &first};
+    GameResult const R = playGame(engines,o,tc,maxPlies);
+    int const FIRST_SCORE = (FIRST_WHITE ? R.score : -R.score);
+
+    lock_guard<mutex> guard(state.lock);
+    state.played++;
+    if(FIRST_SCORE > 0) state.wins++;
+    else if(FIRST_SCORE < 0) state.losses++;
+    else state.draws++;
+
+    out << "Game " << g + 1 << ": " << engines[WHITE]->name << " vs " << engines[BLACK]->name
+        << ": " << (R.score > 0 ? "1-0" : R.score < 0 ? "0-1" : "1/2-1/2") << " (" << R.reason
+        << ", " << R.plies << " plies)" << endl;
+    out << "Score of " << first.name << " vs " << second.name << ": " << state.wins << " - "
+        << state.losses << " - " << state.draws << " [" << state.played << " games]";
+    if(sprt)
+    {
+      double const LLR = sprt->llr(state.wins,state.draws,state.losses);
+      out << "  LLR " << LLR << " (" << sprt->lowerBound() << ", " << sprt->upperBound() << ")";
+      if(LLR >= sprt->upperBound() || LLR <= sprt->lowerBound()) state.finished = true;
+    }
+    out << endl;
+  }
+}
+
+
+/**
+ * Usage: match --engine1 PATH --engine2 PATH [--games N] [--concurrency N]
+ *              [--tc BASE+INC | --movetime MS] [--openings FILE] [--maxplies N]
+ *              [--sprt ELO0 ELO1 [ALPHA BETA]]
+ * BASE and INC are in seconds. The match stops after N games (rounded up to pairs), or as
+ * soon as the SPRT accepts either hypothesis
+ */
+int main(int argc, char** argv)
+{
+  string path1, path2, openingFile;
+  long games = 100;
+  int concurrency = int(thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1);
+  int maxPlies = 400;
+  TimeControl tc = {10000, 100, 0};
+  Sprt sprt = {0, 5, 0.05, 0.05};
+  bool useSprt = false;
+
+  for(int i = 1; i < argc; i++)
+  {
+    string const ARG = argv[i];
+    bool const VALUE = (i + 1 < argc);
+    if(ARG == "--engine1" && VALUE) path1 = argv[++i];
+    else if(ARG == "--engine2" && VALUE) path2 = argv[++i];
+    else if(ARG == "--games" && VALUE) games = atol(argv[++i]);
+    else if(ARG == "--concurrency" && VALUE) concurrency = atoi(argv[++i]);
+    else if(ARG == "--openings" && VALUE) openingFile = argv[++i];
+    else if(ARG == "--maxplies" && VALUE) maxPlies = atoi(argv[++i]);
+    else if(ARG == "--movetime" && VALUE)
+    {
+      tc.base = tc.inc = 0; tc.moveTime = atol(argv[++i]);
+    }
+    else if(ARG == "--tc" && VALUE)
+    {
+      string const TC = argv[++i];
+      std::size_t const PLUS = TC.find('+');
+      tc.base = long(atof(TC.substr(0,PLUS).c_str()) * 1000);
+      tc.inc = (PLUS == string::npos ? 0 : long(atof(TC.substr(PLUS + 1).c_str()) * 1000));
+      tc.moveTime = 0;
+    }
+    else if(ARG == "--sprt" && i + 2 < argc)
+    {
+      useSprt = true;
+      sprt.elo0 = atof(argv[++i]); sprt.elo1 = atof(argv[++i]);
+      if(i + 2 < argc && argv[i + 1][0] != '-')
+      {
+        sprt.alpha = atof(argv[++i]); sprt.beta = atof(argv[++i]);
+      }
+    }
+    else
+    {
+      cerr << "Usage: " << argv[0] << " --engine1 PATH --engine2 PATH [--games N]"
+           << " [--concurrency N] [--tc BASE+INC | --movetime MS] [--openings FILE]"
+           << " [--maxplies N] [--sprt ELO0 ELO1 [ALPHA BETA]]" << endl;
+      return 1;
+    }
+  }
+  if(path1.empty() || path2.empty() || games < 1 || concurrency < 1 || maxPlies < 1 ||
+     (tc.base <= 0 && tc.moveTime <= 0))
+  {
+    cerr << "Two engines, and positive numbers of games, workers, plies and time are needed!"
+         << endl;
+    return 1;
+  }
+  if(useSprt && !(sprt.elo1 > sprt.elo0 && sprt.alpha > 0 && sprt.alpha < 1 &&
+                  sprt.beta > 0 && sprt.beta < 1))
+  {
+    cerr << "The SPRT needs ELO0 < ELO1 and error rates between 0 and 1!" << endl;
+    return 1;
+  }
+  games += games % 2; // every opening with both colours
+
+  // The boards report on cout: keep only the match's output
+  ostream out(cout.rdbuf());
+  NullBuffer discarded;
+  cout.rdbuf(&discarded);
+  signal(SIGPIPE,SIG_IGN); // an engine exiting must not end the match
+
+  vector<Opening> openings;
+  if(openingFile.empty()) openings.push_back(Opening());
+  else if(!loadOpenings(openingFile,openings)) return 1;
+
+  MatchState state;
+  state.nextGame = 0; state.finished = false;
+  state.wins = state.draws = state.losses = state.played = 0;
+
+  vector<thread> workers;
+  for(int w = 0; w < concurrency; w++)
+    workers.push_back(thread(runWorker,cref(path1),cref(path2),cref(openings),cref(tc),maxPlies,
+                             games,useSprt ? &sprt : nullptr,ref(state),ref(out)));
+  for(thread& t : workers) t.join();
+
+  //=== Summary
+  if(state.played == 0)
+  {
+    cerr << "No game could be played!" << endl;
+    cout.rdbuf(out.rdbuf());
+    return 1;
+  }
+  double elo, margin;
+  eloOf(state.wins,state.draws,state.losses,elo,margin);
+  out << "Finished: " << state.wins << " - " << state.losses << " - " << state.draws << " in "
+      << state.played << " games, Elo difference " << elo << " +/- " << margin << endl;
+  if(useSprt)
+  {
+    double const LLR = sprt.llr(state.wins,state.draws,state.losses);
+    out << "SPRT (" << sprt.elo0 << ", " << sprt.elo1 << "): "
+        << (LLR >= sprt.upperBound() ? "H1 accepted" :
+            LLR <= sprt.lowerBound() ? "H0 accepted" : "inconclusive") << endl;
+  }
+  cout.rdbuf(out.rdbuf());
+  return 0;
+}
@@ -0,0 +1,260 @@
+#include "matesolver.h"
+#include "ChessBoard.h"
+#include <chrono>
+#include <algorithm>
+
+static uint32_t const PN_INF = 100000000; // "infinite" proof / disproof number
+
+
+/*===== TRANSPOSITION TABLE =====*/
+
+MateSolver::MateSolver(std::size_t ttEntries): nodes(0)
+{
+  std::size_t size = 1;
+  while(size * 2 <= ttEntries) size *= 2;
+  table.resize(size);
+  mask = size - 1;
+}
+
+
+/**
+ * Key of a node: the position key mixed with the attacker moves left
+ */
+uint64_t MateSolver::nodeKey(uint64_t positionKey, int movesLeft)
+{
+  return positionKey ^ (uint64_t(movesLeft + 1) * 0x9e3779b97f4a7c15ULL);
+}
+
+
+/**
+ * Read the numbers of a node, (1, 1) if it has never been searched
+ */
+void MateSolver::lookUp(uint64_t key, uint32_t& phi, uint32_t& delta) const
+{
+  TTEntry const & e = table[key & mask];
+  if(e.key == key)
+  {
+    phi = e.phi; delta = e.delta;
+  }
+  else
+    phi = delta = 1;
+}
+
+
+/**
+ * Write the numbers of a node, always replacing
+ */
+void MateSolver::store(uint64_t key, uint32_t phi, uint32_t delta)
+{
+  TTEntry& e = table[key & mask];
+  e.key = key; e.phi = phi; e.delta = delta;
+}
+
+
+
+/*===== SEARCH =====*/
+
+/**
+ * df-pn: search a node until its phi or delta reaches its threshold
+ */
+void MateSolver::mid(ChessBoard& cb, bool orNode, int movesLeft, uint32_t thPhi,
+                     uint32_t thDelta, uint32_t& phi, uint32_t& delta)
+{
+  nodes++;
+  uint64_t const KEY = nodeKey(cb.getKey(),movesLeft);
+
+  //=== 1. Terminal nodes
+  std::vector<Move> moves;
+  cb.generateLegalMoves(moves);
+  if(moves.empty())
+  {
+    bool const MATE = cb.isSideToMoveInCheck();
+    bool const PROVEN = !orNode && MATE; // the defender is mated; otherwise a stalemate
+    // OR nodes: phi = proof number; AND nodes: phi = disproof number
+    phi = (PROVEN == orNode ? 0 : PN_INF);
+    delta = (PROVEN == orNode ? PN_INF : 0);
+    store(KEY,phi,delta);
+    return;
+  }
+  if(!orNode && movesLeft == 0) // not mated and no move left to the attacker
+  {
+    phi = 0; delta = PN_INF;
+    store(KEY,phi,delta);
+    return;
+  }
+
+  //=== 2. Children's numbers
+  int const CHILD_MOVES_LEFT = (orNode ? movesLeft - 1 : movesLeft);
+  int const N = int(moves.size());
+  std::vector<uint64_t> childKeys(N);
+  std::vector<uint32_t> childPhi(N), childDelta(N);
+  for(int i = 0; i < N; i++)
+  {
+    cb.makeMove(moves[i]);
+    childKeys[i] = nodeKey(cb.getKey(),CHILD_MOVES_LEFT);
+    cb.undoMove();
+    lookUp(childKeys[i],childPhi[i],childDelta[i]);
+  }
+
+  //=== 3. Expand the most proving child until a threshold is reached
+  while(true)
+  {
+    uint32_t minDelta = PN_INF, secondDelta = PN_INF, sumPhi = 0;
+    int best = 0;
+    for(int i = 0; i < N; i++)
+    {
+      sumPhi = std::min(PN_INF,sumPhi + childPhi[i]);
+      if(childDelta[i] < minDelta)
+      {
+        secondDelta = minDelta; minDelta = childDelta[i]; best = i;
+      }
+      else if(childDelta[i] < secondDelta)
+        secondDelta = childDelta[i];
+    }
+
+    phi = minDelta; delta = sumPhi;
+    if(phi >= thPhi || delta >= thDelta)
+    {
+      store(KEY,phi,delta);
+      return;
+    }
+
+    uint32_t const CHILD_TH_PHI = thDelta + childPhi[best] - sumPhi;
+    uint32_t const CHILD_TH_DELTA = std::min(thPhi,
+                                             secondDelta >= PN_INF ? PN_INF : secondDelta + 1);
+
+    cb.makeMove(moves[best]);
+    mid(cb,!orNode,CHILD_MOVES_LEFT,CHILD_TH_PHI,CHILD_TH_DELTA,childPhi[best],childDelta[best]);
+    cb.undoMove();
+  }
+}
+
+
+/**
+ * Search a node to the end
+ */
+bool MateSolver::prove(ChessBoard& cb, bool orNode, int movesLeft)
+{
+  uint32_t phi, delta;
+  mid(cb,orNode,movesLeft,PN_INF,PN_INF,phi,delta);
+  return orNode ? phi == 0 : delta == 0; // a proof number of 0
+}
+
+
+/**
+ * Append the proof of a proven node to the tree
+ */
+int MateSolver::buildTree(ChessBoard& cb, bool orNode, int movesLeft, Move const & move,
+                          std::vector<ProofNode>& tree)
+{
+  int const INDEX = int(tree.size());
+  tree.push_back(ProofNode());
+  tree[INDEX].move = move;
+  tree[INDEX].attackerToMove = orNode;
+
+  std::vector<Move> moves;
+  cb.generateLegalMoves(moves);
+  for(Move const & m : moves)
+  {
+    cb.makeMove(m);
+    int child = -1;
+    if(!orNode) // every reply of the defender
+      child = buildTree(cb,true,movesLeft,m,tree);
+    else if(prove(cb,false,movesLeft-1)) // one mating move of the attacker
+      child = buildTree(cb,false,movesLeft-1,m,tree);
+    cb.undoMove();
+
+    if(child < 0) continue;
+    tree[INDEX].children.push_back(child);
+    if(orNode) break;
+  }
+  return INDEX;
+}
+
+
+/**
+ * Find the shortest forced mate of the side to move in at most maxMoves moves
+ */
+MateSolution MateSolver::solve(ChessBoard& cb, int maxMoves)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::fill(table.begin(),table.end(),TTEntry{0,0,0});
+  nodes = 0;
+
+  MateSolution s;
+  s.proven = false; s.mateIn = 0; s.unique = false;
+
+  //=== 1. Iterative deepening on the number of moves gives the shortest mate
+  for(int n = 1; n <= maxMoves && !s.proven; n++)
+  {
+    if(prove(cb,true,n))
+    {
+      s.proven = true; s.mateIn = n;
+    }
+  }
+
+  //=== 2. The proof tree and the other first moves mating as fast
+  if(s.proven)
+  {
+    buildTree(cb,true,s.mateIn,Move(),s.tree);
+    s.keyMove = s.tree[s.tree[0].children[0]].move;
+
+    std::vector<Move> moves;
+    cb.generateLegalMoves(moves);
+    for(Move const & m : moves)
+    {
+      if(m == s.keyMove) continue;
+
+      cb.makeMove(m);
+      if(prove(cb,false,s.mateIn-1)) s.alternatives.push_back(m);
+      cb.undoMove();
+    }
+    s.unique = s.alternatives.empty();
+  }
+
+  //=== 3. Statistics
+  s.nodes = nodes;
+  s.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  s.nodesPerSecond = (s.seconds > 0 ? s.nodes / s.seconds : 0);
+  s.ttBytes = table.size() * sizeof(TTEntry);
+  s.treeBytes = s.tree.capacity() * sizeof(ProofNode);
+  for(ProofNode const & p : s.tree) s.treeBytes += p.children.capacity() * sizeof(int);
+  return s;
+}
+
+
+
+/**
+ * Print the verdict, the main line and the statistics of a solve
+ */
+std::ostream& operator<<(std::ostream& out, MateSolution const & solution)
+{
+  if(!solution.proven)
+    out << "No forced mate found" << std::endl;
+  else
+  {
+    out << "Mate in " << solution.mateIn << ", key move " << solution.keyMove.srcString()
+        << "-" << solution.keyMove.destString()
+        << (solution.unique ? " (unique)" : " (not unique)") << std::endl;
+
+    for(Move const & m : solution.alternatives)
+      out << "Also mates: " << m.srcString() << "-" << m.destString() << std::endl;
+
+    // Main line: the attacker's move, then the first reply of the defender
+    out << "Main line:";
+    for(int i = solution.tree[0].children.empty() ? -1 : solution.tree[0].children[0]; i >= 0; )
+    {
+      ProofNode const & p = solution.tree[i];
+      out << " " << p.move.srcString() << "-" << p.move.destString();
+      i = p.children.empty() ? -1 : p.children[0];
+    }
+    out << std::endl;
+    out << "Proof tree: " << solution.tree.size() << " nodes" << std::endl;
+  }
+
+  out << solution.nodes << " nodes in " << solution.seconds << " s ("
+      << (unsigned long)solution.nodesPerSecond << " nodes/s), transposition table "
+      << solution.ttBytes / 1024 << " KB, proof tree " << solution.treeBytes / 1024 << " KB"
+      << std::endl;
+  return out;
+}
@@ -0,0 +1,110 @@
+#ifndef MATESOLVER_H
+#define MATESOLVER_H
+
+#include <vector>
+#include <iostream>
+#include <cstdint>
+#include "move.h"
+
+class ChessBoard;
+
+/*===== PROOF TREE =====*/
+/**
+ * A node of the proof of a forced mate. The children of an attacker's node hold the one move
+ * that keeps the mate, the children of a defender's node hold every legal reply
+ */
+struct ProofNode
+{
+  Move move; // the move leading to this node (meaningless for the root)
+  bool attackerToMove;
+  std::vector<int> children; // indices in MateSolution::tree
+};
+
+
+/*===== RESULT OF A SOLVE =====*/
+struct MateSolution
+{
+  bool proven; // a forced mate within the limit exists
+  int mateIn; // the shortest forced mate in moves of the attacker, 0 if not proven
+  Move keyMove; // the first move of the solution
+  bool unique; // no other first move mates within mateIn moves
+  std::vector<Move> alternatives; // the other first moves that mate within mateIn moves
+  std::vector<ProofNode> tree; // tree[0] is the root
+
+  // Statistics
+  unsigned long nodes; // positions expanded
+  double seconds;
+  double nodesPerSecond;
+  std::size_t ttBytes; // memory of the transposition table
+  std::size_t treeBytes; // memory of the proof tree
+};
+
+
+/*===== DEPTH-FIRST PROOF-NUMBER SEARCH =====*/
+/**
+ * Mate-in-N solver for the side to move of a board, searching with df-pn over the moves of
+ * ChessBoard::generateLegalMoves(). Proof and disproof numbers are kept in a fixed-size
+ * transposition table keyed by the position key and the number of attacker moves left
+ */
+class MateSolver
+{
+  struct TTEntry
+  {
+    uint64_t key;
+    uint32_t phi;
+    uint32_t delta;
+  };
+
+  std::vector<TTEntry> table;
+  uint64_t mask;
+  unsigned long nodes;
+
+  /**
+   * Key of a node: the position key mixed with the attacker moves left
+   */
+  static uint64_t nodeKey(uint64_t positionKey, int movesLeft);
+
+  void lookUp(uint64_t key, uint32_t& phi, uint32_t& delta) const;
+  void store(uint64_t key, uint32_t phi, uint32_t delta);
+
+  /**
+   * Multiple iterative deepening of df-pn: search a node until its phi or delta reaches its
+   * threshold. OR nodes (attacker to move) have phi = proof number, AND nodes have
+   * phi = disproof number
+   */
+  void mid(ChessBoard& cb, bool orNode, int movesLeft, uint32_t thPhi, uint32_t thDelta,
+           uint32_t& phi, uint32_t& delta);
+
+  /**
+   * Search a node to the end, returns true if the attacker mates from it
+   */
+  bool prove(ChessBoard& cb, bool orNode, int movesLeft);
+
+  /**
+   * Append the proof of a proven node to the tree, returns its index
+   */
+  int buildTree(ChessBoard& cb, bool orNode, int movesLeft, Move const & move,
+                std::vector<ProofNode>& tree);
+
+ public:
+
+  /**
+   * ttEntries is rounded down to a power of 2
+   */
+  explicit MateSolver(std::size_t ttEntries = std::size_t(1) << 20);
+
+  /**
+   * Find the shortest forced mate of the side to move in at most maxMoves moves, with its
+   * proof tree and whether its key move is unique. The board is left as it was
+   */
+  MateSolution solve(ChessBoard& cb, int maxMoves);
+};
+
+
+/**
+ * Print the verdict, the main line and the statistics of a solve
+ */
+std::ostream& operator<<(std::ostream& out, MateSolution const & solution);
+
+
+#endif
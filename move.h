@@ -0,0 +1,57 @@
+#ifndef MOVE_H
+#define MOVE_H
+
+#include <string>
+
+/*===== A MOVE ON THE BOARD =====*/
+struct Move
+{
+  int rankS; // source position
+  int fileS;
+  int rankD; // destination position
+  int fileD;
+
+  Move(): rankS(0), fileS(0), rankD(0), fileD(0){}
+
+  Move(int rs, int fs, int rd, int fd): rankS(rs), fileS(fs), rankD(rd), fileD(fd){}
+
+  /**
+   * Return the source position of this move (e.g. E2), as taken by ChessBoard::submitMove()
+   */
+  std::string srcString() const
+  {
+    std::string c = ""; c += char('A'+fileS); c += char('1'+rankS);
+    return c;
+  }
+
+  /**
+   * Return the destination position of this move (e.g. E4)
+   */
+  std::string destString() const
+  {
+    std::string c = ""; c += char('A'+fileD); c += char('1'+rankD);
+    return c;
+  }
+
+  /**
+   * Return this move in the long algebraic notation of the UCI protocol (e.g. e2e4, e1g1
+   * for castling)
+   */
+  std::string uciString() const
+  {
+    std::string c = "";
+    c += char('a'+fileS); c += char('1'+rankS); c += char('a'+fileD); c += char('1'+rankD);
+    return c;
+  }
+
+  bool operator==(Move const & other) const
+  {
+    return rankS == other.rankS && fileS == other.fileS &&
+           rankD == other.rankD && fileD == other.fileD;
+  }
+
+  bool operator!=(Move const & other) const { return !(*this == other); }
+};
+
+
+#endif
@@ -0,0 +1,390 @@
+#include "nnue.h"
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NNUE_X86
+#endif
+
+using namespace std;
+
+static char const NNUE_MAGIC[4] = {'M','C','N','N'};
+static uint32_t const NNUE_VERSION = 1;
+
+
+/*===== KERNELS =====*/
+// Every kernel works on whole rows: NNUE_HALF_DIMS int16 accumulator values (added, taken
+// away or clipped to [0, 127]), or dot products of n uint8 inputs by n int8 weights with n a
+// multiple of 32
+
+static void addRowScalar(int16_t* acc, int16_t const * w)
+{
+  for(int i = 0; i < NNUE_HALF_DIMS; i++) acc[i] += w[i];
+}
+
+static void subRowScalar(int16_t* acc, int16_t const * w)
+{
+  for(int i = 0; i < NNUE_HALF_DIMS; i++) acc[i] -= w[i];
+}
+
+static int32_t dotScalar(uint8_t const * in, int8_t const * w, int n)
+{
+  int32_t sum = 0;
+  for(int i = 0; i < n; i++) sum += int32_t(in[i]) * w[i];
+  return sum;
+}
+
+static void clipRowScalar(uint8_t* out, int16_t const * acc)
+{
+  for(int i = 0; i < NNUE_HALF_DIMS; i++)
+    out[i] = uint8_t(acc[i] < 0 ? 0 : (acc[i] > 127 ? 127 : acc[i]));
+}
+
+
+#ifdef NNUE_X86
+//--- SSE2 (always there on x86-64) for the accumulators, SSSE3 for the dot products
+__attribute__((target("sse2"))) static void addRowSse(int16_t* acc, int16_t const * w)
+{
+  for(int i = 0; i < NNUE_HALF_DIMS; i += 8)
+  {
+    __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+    _mm_store_si128(a,_mm_add_epi16(_mm_load_si128(a),
+                                    _mm_load_si128(reinterpret_cast<__m128i const *>(w + i))));
+  }
+}
+
+__attribute__((target("sse2"))) static void subRowSse(int16_t* acc, int16_t const * w)
+{
+  for(int i = 0; i < NNUE_HALF_DIMS; i += 8)
+  {
+    __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+    _mm_store_si128(a,_mm_sub_epi16(_mm_load_si128(a),
+                                    _mm_load_si128(reinterpret_cast<__m128i const *>(w + i))));
+  }
+}
+
+__attribute__((target("sse2"))) static void clipRowSse(uint8_t* out, int16_t const * acc)
+{
+  __m128i const ZERO = _mm_setzero_si128(), MAX = _mm_set1_epi16(127);
+  for(int i = 0; i < NNUE_HALF_DIMS; i += 16)
+  {
+    __m128i a = _mm_load_si128(reinterpret_cast<__m128i const *>(acc + i));
+    __m128i b = _mm_load_si128(reinterpret_cast<__m128i const *>(acc + i + 8));
+    a = _mm_min_epi16(_mm_max_epi16(a,ZERO),MAX);
+    b = _mm_min_epi16(_mm_max_epi16(b,ZERO),MAX);
+    _mm_store_si128(reinterpret_cast<__m128i*>(out + i),_mm_packus_epi16(a,b));
+  }
+}
+
+__attribute__((target("ssse3"))) static int32_t dotSse(uint8_t const * in, int8_t const * w,
+                                                       int n)
+{
+  __m128i const ONES = _mm_set1_epi16(1);
+  __m128i sum = _mm_setzero_si128();
+  for(int i = 0; i < n; i += 16)
+  {
+    __m128i x = _mm_load_si128(reinterpret_cast<__m128i const *>(in + i));
+    __m128i y = _mm_load_si128(reinterpret_cast<__m128i const *>(w + i));
+    sum = _mm_add_epi32(sum,_mm_madd_epi16(_mm_maddubs_epi16(x,y),ONES));
+  }
+  sum = _mm_add_epi32(sum,_mm_shuffle_epi32(sum,0x4e));
+  sum = _mm_add_epi32(sum,_mm_shuffle_epi32(sum,0xb1));
+  return _mm_cvtsi128_si32(sum);
+}
+
+//--- AVX2
+__attribute__((target("avx2"))) static void addRowAvx2(int16_t* acc, int16_t const * w)
+{
+  for(int i = 0; i < NNUE_HALF_DIMS; i += 16)
+  {
+    __m256i* a = reinterpret_cast<__m256i*>(acc + i);
+    _mm256_store_si256(a,_mm256_add_epi16(_mm256_load_si256(a),
+                         _mm256_load_si256(reinterpret_cast<__m256i const *>(w + i))));
+  }
+}
+
+__attribute__((target("avx2"))) static void subRowAvx2(int16_t* acc, int16_t const * w)
+{
+  for(int i = 0; i < NNUE_HALF_DIMS; i += 16)
+  {
+    __m256i* a = reinterpret_cast<__m256i*>(acc + i);
+    _mm256_store_si256(a,_mm256_sub_epi16(_mm256_load_si256(a),
+                         _mm256_load_si256(reinterpret_cast<__m256i const *>(w + i))));
+  }
+}
+
+__attribute__((target("avx2"))) static void clipRowAvx2(uint8_t* out, int16_t const * acc)
+{
+  __m256i const ZERO = _mm256_setzero_si256(), MAX = _mm256_set1_epi16(127);
+  for(int i = 0; i < NNUE_HALF_DIMS; i += 32)
+  {
+    __m256i a = _mm256_load_si256(reinterpret_cast<__m256i const *>(acc + i));
+    __m256i b = _mm256_load_si256(reinterpret_cast<__m256i const *>(acc + i + 16));
+    a = _mm256_min_epi16(_mm256_max_epi16(a,ZERO),MAX);
+    b = _mm256_min_epi16(_mm256_max_epi16(b,ZERO),MAX);
+    // packus works within 128-bit lanes: put the quadwords back in order
+    _mm256_store_si256(reinterpret_cast<__m256i*>(out + i),
+                       _mm256_permute4x64_epi64(_mm256_packus_epi16(a,b),0xd8));
+  }
+}
+
+__attribute__((target("avx2"))) static int32_t dotAvx2(uint8_t const * in, int8_t const * w,
+                                                       int n)
+{
+  __m256i const ONES = _mm256_set1_epi16(1);
+  __m256i sum = _mm256_setzero_si256();
+  for(int i = 0; i < n; i += 32)
+  {
+    __m256i x = _mm256_load_si256(reinterpret_cast<__m256i const *>(in + i));
+    __m256i y = _mm256_load_si256(reinterpret_cast<__m256i const *>(w + i));
+    sum = _mm256_add_epi32(sum,_mm256_madd_epi16(_mm256_maddubs_epi16(x,y),ONES));
+  }
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum),_mm256_extracti128_si256(sum,1));
+  s = _mm_add_epi32(s,_mm_shuffle_epi32(s,0x4e));
+  s = _mm_add_epi32(s,_mm_shuffle_epi32(s,0xb1));
+  return _mm_cvtsi128_si32(s);
+}
+#endif
+
+
+struct NnueKernels
+{
+  char const * name;
+  void (*addRow)(int16_t*, int16_t const *);
+  void (*subRow)(int16_t*, int16_t const *);
+  int32_t (*dot)(uint8_t const *, int8_t const *, int);
+  void (*clipRow)(uint8_t*, int16_t const *);
+};
+
+/**
+ * Every set of kernels, the best first, and whether the CPU runs it
+ */
+static NnueKernels const KERNELS[] =
+{
+#ifdef NNUE_X86
+  {"avx2",addRowAvx2,subRowAvx2,dotAvx2,clipRowAvx2},
+  {"sse",addRowSse,subRowSse,dotSse,clipRowSse},
+#endif
+  {"scalar",addRowScalar,subRowScalar,dotScalar,clipRowScalar}
+};
+
+static bool runs(NnueKernels const & k)
+{
+#ifdef NNUE_X86
+  __builtin_cpu_init();
+  if(k.addRow == addRowAvx2) return __builtin_cpu_supports("avx2");
+  if(k.addRow == addRowSse) return __builtin_cpu_supports("ssse3");
+#endif
+  return k.addRow == addRowScalar;
+}
+
+/**
+ * The kernels in use: the best ones the CPU runs, picked once, unless useKernels() says
+ * otherwise
+ */
+static NnueKernels const* selected = nullptr;
+
+static NnueKernels const & kernels()
+{
+  static NnueKernels const & BEST = []() -> NnueKernels const &
+  {
+    for(NnueKernels const & k : KERNELS)
+      if(runs(k)) return k;
+    return KERNELS[0];
+  }();
+  return selected ? *selected : BEST;
+}
+
+
+char const * Nnue::kernelName() { return kernels().name; }
+
+
+bool Nnue::useKernels(char const * name)
+{
+  for(NnueKernels const & k : KERNELS)
+    if(strcmp(k.name,name) == 0 && runs(k))
+    {
+      selected = &k;
+      return true;
+    }
+  return false;
+}
+
+
+
+/*===== FILE =====*/
+
+/**
+ * File offsets of the arrays of a network file
+ */
+NnueLayout nnueLayout()
+{
+  NnueLayout l;
+  std::size_t at = sizeof(NnueFileHeader);
+  auto section = [&at](std::size_t bytes)
+  {
+    std::size_t const START = (at + 63) & ~std::size_t(63);
+    at = START + bytes;
+    return START;
+  };
+
+  l.ftBiases = section(NNUE_HALF_DIMS * sizeof(int16_t));
+  l.ftWeights = section(std::size_t(NNUE_INPUTS) * NNUE_HALF_DIMS * sizeof(int16_t));
+  l.l1Biases = section(NNUE_HIDDEN * sizeof(int32_t));
+  l.l1Weights = section(NNUE_HIDDEN * 2*NNUE_HALF_DIMS);
+  l.l2Biases = section(NNUE_HIDDEN * sizeof(int32_t));
+  l.l2Weights = section(NNUE_HIDDEN * NNUE_HIDDEN);
+  l.outBias = section(sizeof(int32_t));
+  l.outWeights = section(NNUE_HIDDEN);
+  l.fileSize = at;
+  return l;
+}
+
+
+Nnue::Nnue(): fd(-1), data(nullptr), dataSize(0), ftBiases(nullptr), ftWeights(nullptr),
+              l1Biases(nullptr), l1Weights(nullptr), l2Biases(nullptr), l2Weights(nullptr),
+              outBias(0), outWeights(nullptr){}
+
+
+/**
+ * Map a network file
+ */
+Nnue* Nnue::open(std::string const & path)
+{
+  int fd = ::open(path.c_str(),O_RDONLY);
+  if(fd < 0)
+  {
+    cerr << "Cannot open the network file " << path << "!" << endl;
+    return nullptr;
+  }
+
+  NnueLayout const L = nnueLayout();
+  struct stat st;
+  if(fstat(fd,&st) != 0 || std::size_t(st.st_size) != L.fileSize)
+  {
+    cerr << path << " is not a network file of the expected size!" << endl;
+    ::close(fd); return nullptr;
+  }
+
+  void* m = mmap(nullptr,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+  if(m == MAP_FAILED)
+  {
+    cerr << "Cannot map the network file " << path << "!" << endl;
+    ::close(fd); return nullptr;
+  }
+  madvise(m,st.st_size,MADV_WILLNEED); // the whole first layer is hot
+
+  Nnue* n = new Nnue();
+  n->fd = fd;
+  n->data = static_cast<unsigned char const *>(m);
+  n->dataSize = st.st_size;
+
+  NnueFileHeader const & h = *reinterpret_cast<NnueFileHeader const *>(n->data);
+  if(memcmp(h.magic,NNUE_MAGIC,4) != 0 || h.version != NNUE_VERSION ||
+     h.inputs != NNUE_INPUTS || h.halfDims != NNUE_HALF_DIMS || h.hidden != NNUE_HIDDEN)
+  {
+    cerr << path << " is not a network of the expected shape!" << endl;
+    delete n; return nullptr;
+  }
+
+  n->ftBiases = reinterpret_cast<int16_t const *>(n->data + L.ftBiases);
+  n->ftWeights = reinterpret_cast<int16_t const *>(n->data + L.ftWeights);
+  n->l1Biases = reinterpret_cast<int32_t const *>(n->data + L.l1Biases);
+  n->l1Weights = reinterpret_cast<int8_t const *>(n->data + L.l1Weights);
+  n->l2Biases = reinterpret_cast<int32_t const *>(n->data + L.l2Biases);
+  n->l2Weights = reinterpret_cast<int8_t const *>(n->data + L.l2Weights);
+  memcpy(&n->outBias,n->data + L.outBias,sizeof(int32_t));
+  n->outWeights = reinterpret_cast<int8_t const *>(n->data + L.outWeights);
+  return n;
+}
+
+
+Nnue::~Nnue()
+{
+  if(data) munmap(const_cast<unsigned char*>(data),dataSize);
+  if(fd >= 0) ::close(fd);
+}
+
+
+
+/*===== ACCUMULATORS =====*/
+
+/**
+ * Index of the feature of a piece seen from one side
+ */
+int Nnue::featureIndex(bool perspective, int kingSq, bool color, PieceType type, int sq)
+{
+  if(perspective == BLACK) // flip the board vertically
+  {
+    kingSq ^= (BOARD_SIZE-1) * BOARD_SIZE;
+    sq ^= (BOARD_SIZE-1) * BOARD_SIZE;
+  }
+  int const PIECE = (int(type) - int(QUEEN)) * 2 + (color != perspective); // 0 to 9
+  return kingSq * NNUE_PIECE_SQUARES + PIECE * BOARD_SIZE*BOARD_SIZE + sq;
+}
+
+
+/**
+ * Set one point of view of an accumulator to the biases plus the given features
+ */
+void Nnue::refresh(int16_t* acc, int const * features, int numFeatures) const
+{
+  memcpy(acc,ftBiases,NNUE_HALF_DIMS * sizeof(int16_t));
+  for(int i = 0; i < numFeatures; i++) addFeature(acc,features[i]);
+}
+
+
+void Nnue::addFeature(int16_t* acc, int feature) const
+{
+  kernels().addRow(acc,ftWeights + std::size_t(feature) * NNUE_HALF_DIMS);
+}
+
+
+void Nnue::removeFeature(int16_t* acc, int feature) const
+{
+  kernels().subRow(acc,ftWeights + std::size_t(feature) * NNUE_HALF_DIMS);
+}
+
+
+
+/*===== DENSE LAYERS =====*/
+
+/**
+ * Clip a value to [0, 127], the input range of the int8 layers
+ */
+static inline uint8_t clippedRelu(int32_t x)
+{
+  return uint8_t(x < 0 ? 0 : (x > 127 ? 127 : x));
+}
+
+
+/**
+ * Run the dense layers on an accumulator, side to move's half first
+ */
+int Nnue::evaluate(NnueAccumulator const & acc, bool sideToMove) const
+{
+  NnueKernels const & K = kernels();
+  alignas(64) uint8_t input[2*NNUE_HALF_DIMS];
+  alignas(64) uint8_t hidden1[NNUE_HIDDEN];
+  alignas(64) uint8_t hidden2[NNUE_HIDDEN];
+
+  //=== 1. Clipped accumulators
+  K.clipRow(input,acc.values[sideToMove]);
+  K.clipRow(input + NNUE_HALF_DIMS,acc.values[!sideToMove]);
+
+  //=== 2. Hidden layers
+  for(int i = 0; i < NNUE_HIDDEN; i++)
+    hidden1[i] = clippedRelu((l1Biases[i] + K.dot(input,l1Weights + i*2*NNUE_HALF_DIMS,
+                                                  2*NNUE_HALF_DIMS)) >> NNUE_WEIGHT_SHIFT);
+  for(int i = 0; i < NNUE_HIDDEN; i++)
+    hidden2[i] = clippedRelu((l2Biases[i] + K.dot(hidden1,l2Weights + i*NNUE_HIDDEN,
+                                                  NNUE_HIDDEN)) >> NNUE_WEIGHT_SHIFT);
+
+  //=== 3. Output
+  return (outBias + K.dot(hidden2,outWeights,NNUE_HIDDEN)) / NNUE_OUTPUT_SCALE;
+}
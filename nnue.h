@@ -0,0 +1,138 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <string>
+#include <cstdint>
+#include "piece.h"
+
+#define NNUE_EXT ".mcnn"
+
+/*===== NETWORK SHAPE =====*/
+/**
+ * HalfKP features: for each side's point of view, (own king square, piece, square) for every
+ * piece but the two kings, squares being flipped vertically for Black's point of view and
+ * pieces told apart as own or opponent's. That's 64 * 10 * 64 inputs, of which at most 30
+ * are active, summed into an int16 accumulator of NNUE_HALF_DIMS per point of view.
+ * The two accumulators (side to move first) go through a clipped ReLU into two int8 dense
+ * layers of NNUE_HIDDEN outputs and a final int8 layer giving the evaluation
+ */
+#define NNUE_KING_SQUARES (BOARD_SIZE*BOARD_SIZE)
+#define NNUE_PIECE_SQUARES (10*BOARD_SIZE*BOARD_SIZE)
+#define NNUE_INPUTS (NNUE_KING_SQUARES*NNUE_PIECE_SQUARES)
+#define NNUE_HALF_DIMS 256
+#define NNUE_HIDDEN 32
+
+#define NNUE_WEIGHT_SHIFT 6 // fixed point of the dense layers' weights
+#define NNUE_OUTPUT_SCALE 16 // network output per centipawn
+
+
+/*===== FILE LAYOUT =====*/
+/**
+ * A network file starts with this header, then holds the following arrays in order, each
+ * starting on a multiple of 64 bytes (little endian, row-major: one row per output):
+ *   int16 ftBiases[NNUE_HALF_DIMS], int16 ftWeights[NNUE_INPUTS][NNUE_HALF_DIMS],
+ *   int32 l1Biases[NNUE_HIDDEN],    int8 l1Weights[NNUE_HIDDEN][2*NNUE_HALF_DIMS],
+ *   int32 l2Biases[NNUE_HIDDEN],    int8 l2Weights[NNUE_HIDDEN][NNUE_HIDDEN],
+ *   int32 outBias,                  int8 outWeights[NNUE_HIDDEN]
+ * Training is done elsewhere; the file is used as it is, mapped into memory
+ */
+struct NnueFileHeader
+{
+  char magic[4]; // "MCNN"
+  uint32_t version;
+  uint32_t inputs;
+  uint32_t halfDims;
+  uint32_t hidden;
+  uint32_t reserved[3];
+};
+
+/**
+ * File offsets of the arrays, and the size of a network file
+ */
+struct NnueLayout
+{
+  std::size_t ftBiases, ftWeights, l1Biases, l1Weights, l2Biases, l2Weights, outBias,
+              outWeights, fileSize;
+};
+NnueLayout nnueLayout();
+
+
+/*===== ACCUMULATORS =====*/
+/**
+ * The first layer's output from both points of view, indexed by colour (WHITE/BLACK)
+ */
+struct alignas(64) NnueAccumulator
+{
+  int16_t values[2][NNUE_HALF_DIMS];
+};
+
+
+/*===== A MEMORY-MAPPED NETWORK =====*/
+/**
+ * The weights are used in place in the read-only mapping of the file. The kernels for the
+ * accumulator updates and the dense layers are picked once, at run time, among AVX2, SSE
+ * and plain C++ versions according to what the CPU supports
+ */
+class Nnue
+{
+  int fd;
+  unsigned char const * data; // the mapping
+  std::size_t dataSize;
+
+  int16_t const * ftBiases;
+  int16_t const * ftWeights;
+  int32_t const * l1Biases;
+  int8_t const * l1Weights;
+  int32_t const * l2Biases;
+  int8_t const * l2Weights;
+  int32_t outBias;
+  int8_t const * outWeights;
+
+  Nnue();
+
+ public:
+
+  /**
+   * Map a network file, returns nullptr (with a message) if it can't be read or doesn't have
+   * the shape above
+   */
+  static Nnue* open(std::string const & path);
+
+  /**
+   * Index of the feature of a piece (not a king) of a colour on square sq = rank*8+file, seen
+   * from the point of view of one side whose king is on kingSq
+   */
+  static int featureIndex(bool perspective, int kingSq, bool color, PieceType type, int sq);
+
+  /**
+   * Set one point of view of an accumulator to the biases plus the given features
+   */
+  void refresh(int16_t* acc, int const * features, int numFeatures) const;
+
+  /**
+   * Add / remove the weights of one feature to / from one point of view of an accumulator
+   */
+  void addFeature(int16_t* acc, int feature) const;
+  void removeFeature(int16_t* acc, int feature) const;
+
+  /**
+   * Run the dense layers on an accumulator, returns centipawns for the side to move
+   */
+  int evaluate(NnueAccumulator const & acc, bool sideToMove) const;
+
+  /**
+   * Name of the kernels in use: "avx2", "sse" or "scalar"
+   */
+  static char const * kernelName();
+
+  /**
+   * Use the kernels of a name instead of the best ones, e.g. to compare them; returns false
+   * (changing nothing) if the CPU can't run them. Not to be called while evaluating
+   */
+  static bool useKernels(char const * name);
+
+  ~Nnue();
+};
+
+
+#endif
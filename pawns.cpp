@@ -0,0 +1,159 @@
+#include "pawns.h"
+
+using namespace std;
+
+// Structure terms (middlegame, endgame), in centipawns
+static int const PASSED_MG[BOARD_SIZE] = {0, 5, 10, 15, 30, 55, 90, 0}; // by relative rank
+static int const PASSED_EG[BOARD_SIZE] = {0, 10, 15, 25, 45, 80, 130, 0};
+static int const ISOLATED_MG = -5, ISOLATED_EG = -15;
+static int const DOUBLED_MG = -10, DOUBLED_EG = -20;
+static int const BACKWARD_MG = -8, BACKWARD_EG = -10;
+
+static uint64_t const FILE_A = 0x0101010101010101ULL;
+
+
+/*===== ANALYSIS =====*/
+
+/**
+ * The squares strictly in front of (rank, file) for a colour, on the given file
+ */
+static uint64_t frontSpan(bool color, int rank, int file)
+{
+  uint64_t span = 0;
+  if(color == WHITE)
+    for(int r = rank + 1; r < BOARD_SIZE; r++) span |= uint64_t(1) << (r*BOARD_SIZE + file);
+  else
+    for(int r = rank - 1; r >= 0; r--) span |= uint64_t(1) << (r*BOARD_SIZE + file);
+  return span;
+}
+
+/**
+ * The whole files next to a file
+ */
+static uint64_t adjacentFiles(int file)
+{
+  return (file > 0 ? FILE_A << (file-1) : 0) | (file < BOARD_SIZE-1 ? FILE_A << (file+1) : 0);
+}
+
+
+/**
+ * Analyse a structure
+ */
+void analysePawns(uint64_t const pawns[2], PawnInfo& info)
+{
+  info.mgScore = info.egScore = 0;
+
+  for(int c = 0; c < 2; c++)
+  {
+    bool const COLOR = bool(c);
+    int const SIGN = (COLOR == WHITE ? 1 : -1);
+    int const FORWARD = (COLOR == WHITE ? 1 : -1);
+    uint64_t const OWN = pawns[c], THEIRS = pawns[!c];
+    info.passed[c] = info.isolated[c] = info.doubled[c] = info.backward[c] = 0;
+
+    for(uint64_t p = OWN; p; p &= p - 1)
+    {
+      int const SQ = __builtin_ctzll(p);
+      int const RANK = SQ / BOARD_SIZE, FILE = SQ % BOARD_SIZE;
+      int const RELATIVE_RANK = (COLOR == WHITE ? RANK : BOARD_SIZE-1 - RANK);
+      uint64_t const BIT = uint64_t(1) << SQ;
+      uint64_t const NEIGHBOURS = adjacentFiles(FILE);
+
+      //=== 1. Passed, doubled, isolated
+      uint64_t const FRONT = frontSpan(COLOR,RANK,FILE);
+      uint64_t const FRONT_NEIGHBOURS =
+        (FILE > 0 ? frontSpan(COLOR,RANK,FILE-1) : 0) |
+        (FILE < BOARD_SIZE-1 ? frontSpan(COLOR,RANK,FILE+1) : 0);
+
+      bool const PASSED = !(THEIRS & (FRONT | FRONT_NEIGHBOURS));
+      bool const DOUBLED = (OWN & FRONT) != 0;
+      bool const ISOLATED = !(OWN & NEIGHBOURS);
+
+      //=== 2. Backward: every neighbour is in front, and an enemy pawn guards the stop square
+      bool backward = false;
+      int const STOP_RANK = RANK + FORWARD;
+      if(!ISOLATED && !PASSED && STOP_RANK >= 0 && STOP_RANK < BOARD_SIZE)
+      {
+        uint64_t const SUPPORTERS = NEIGHBOURS & ~FRONT_NEIGHBOURS; // level or behind
+        int const ATTACK_RANK = STOP_RANK + FORWARD;
+        bool attacked = false;
+        if(ATTACK_RANK >= 0 && ATTACK_RANK < BOARD_SIZE)
+          for(int df = -1; df <= 1; df += 2)
+            if(FILE+df >= 0 && FILE+df < BOARD_SIZE &&
+               (THEIRS >> (ATTACK_RANK*BOARD_SIZE + FILE+df) & 1))
+              attacked = true;
+        backward = !(OWN & SUPPORTERS) && attacked;
+      }
+
+      if(PASSED) info.passed[c] |= BIT;
+      if(DOUBLED) info.doubled[c] |= BIT;
+      if(ISOLATED) info.isolated[c] |= BIT;
+      if(backward) info.backward[c] |= BIT;
+
+      info.mgScore += SIGN * ((PASSED && !DOUBLED ? PASSED_MG[RELATIVE_RANK] : 0) +
+                              (DOUBLED ? DOUBLED_MG : 0) + (ISOLATED ? ISOLATED_MG : 0) +
+                              (backward ? BACKWARD_MG : 0));
+      info.egScore += SIGN * ((PASSED && !DOUBLED ? PASSED_EG[RELATIVE_RANK] : 0) +
+                              (DOUBLED ? DOUBLED_EG : 0) + (ISOLATED ? ISOLATED_EG : 0) +
+                              (backward ? BACKWARD_EG : 0));
+    }
+
+    //=== 3. Shelter in front of a king on each file
+    int const SHIELD_RANK = (COLOR == WHITE ? 1 : BOARD_SIZE-2);
+    uint64_t const SHIELD_RANKS = (uint64_t(0xff) << (SHIELD_RANK*BOARD_SIZE)) |
+                                  (uint64_t(0xff) << ((SHIELD_RANK+FORWARD)*BOARD_SIZE));
+    for(int f = 0; f < BOARD_SIZE; f++)
+      info.shelter[c][f] = uint8_t(__builtin_popcountll(OWN & SHIELD_RANKS &
+                                                        ((FILE_A << f) | adjacentFiles(f))));
+  }
+}
+
+
+/**
+ * Number of pawns sheltering a king
+ */
+int PawnInfo::shield(bool color, int rank, int file) const
+{
+  int const RELATIVE_RANK = (color == WHITE ? rank : BOARD_SIZE-1 - rank);
+  return RELATIVE_RANK <= 1 ? shelter[color][file] : 0;
+}
+
+
+
+/*===== PAWN HASH TABLE =====*/
+
+PawnTable::PawnTable(): entries(PAWN_TABLE_ENTRIES), hits(0), misses(0)
+{
+  for(PawnInfo& e : entries) e.valid = false;
+}
+
+
+/**
+ * Return the analysis of the pawns of a board, from the cache if it has been seen
+ */
+PawnInfo const & PawnTable::probe(uint64_t key, Piece*** const board)
+{
+  PawnInfo& e = entries[key & (PAWN_TABLE_ENTRIES-1)];
+  if(e.valid && e.key == key)
+  {
+    hits++;
+    return e;
+  }
+
+  misses++;
+  uint64_t pawns[2] = {0, 0};
+  for(int i = 0; i < BOARD_SIZE; i++)
+    for(int j = 0; j < BOARD_SIZE; j++)
+      if(board[i][j] && board[i][j]->getType() == PAWN)
+        pawns[board[i][j]->getColor()] |= uint64_t(1) << (i*BOARD_SIZE + j);
+
+  analysePawns(pawns,e);
+  e.key = key; e.valid = true;
+  return e;
+}
+
+
+void PawnTable::getStats(unsigned long& numHits, unsigned long& numMisses) const
+{
+  numHits = hits; numMisses = misses;
+}
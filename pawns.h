@@ -0,0 +1,69 @@
+#ifndef PAWNS_H
+#define PAWNS_H
+
+#include <vector>
+#include <cstdint>
+#include "piece.h"
+
+#define PAWN_TABLE_ENTRIES 4096 // a power of 2
+
+/*===== PAWN STRUCTURE =====*/
+/**
+ * What depends on the pawns only. Squares are bits rank*BOARD_SIZE+file, arrays are indexed
+ * by colour (WHITE/BLACK)
+ */
+struct PawnInfo
+{
+  uint64_t key; // pawn key of the structure
+  bool valid; // false for a slot never filled
+
+  uint64_t passed[2]; // no opposing pawn in front on its own or an adjacent file
+  uint64_t isolated[2]; // no own pawn on an adjacent file
+  uint64_t doubled[2]; // another own pawn in front on the same file
+  uint64_t backward[2]; // can't be defended by a pawn and its stop square is attacked by one
+
+  // Own pawns in front of a king standing on each file: on the file and the adjacent ones,
+  // one or two ranks ahead of the back rank
+  uint8_t shelter[2][BOARD_SIZE];
+
+  int mgScore; // structure score, White's minus Black's
+  int egScore;
+
+  /**
+   * Number of pawns sheltering a king of a colour on (rank, file), 0 if it has left its two
+   * first ranks
+   */
+  int shield(bool color, int rank, int file) const;
+};
+
+/**
+ * Analyse a structure given as the pawn squares of each colour
+ */
+void analysePawns(uint64_t const pawns[2], PawnInfo& info);
+
+
+/*===== PAWN HASH TABLE =====*/
+/**
+ * A fixed-size cache of analysed structures, indexed by the pawn key. A probe costs a
+ * single lookup when the structure has been seen, and an analysis overwriting the slot
+ * otherwise
+ */
+class PawnTable
+{
+  std::vector<PawnInfo> entries;
+  unsigned long hits, misses;
+
+ public:
+
+  PawnTable();
+
+  /**
+   * Return the analysis of the pawns of a board whose pawn key is key
+   */
+  PawnInfo const & probe(uint64_t key, Piece*** const board);
+
+  void getStats(unsigned long& numHits, unsigned long& numMisses) const;
+};
+
+
+#endif
@@ -1,48 +1,10 @@
 #include "piece.h"
-#include "helper.h"
-#include <cmath>
+#include "rules.h"
 
 /*===== Base Class =====*/
 
 Piece::Piece(PieceType type, bool color, int rank, int file):
-  TYPE(type), COLOR(color), currentRank(rank), currentFile(file){}
-
-
-
-/**
- * Test if the destination of a move is in of the board, true if so
- */
-bool Piece::isInside(int rank, int file) const
-{
-  if(rank < 0|| rank > BOARD_SIZE-1 || file < 0 || file > BOARD_SIZE-1) return false;
-  else return true;
-}
-
-
-
-/**
- * Test if the destination of a move has opponent's pieces (hostile piece), returns true if so
- */
-bool Piece::isDestHostile(int const RANK_D, int const FILE_D, Piece*** const board) const
-{
-  if(!board[RANK_D][FILE_D]) return false;
-  else if(board[RANK_D][FILE_D]->getColor() != COLOR) return true;
-  else return false;
-}
-
-
-
-/*
- * Return the type of this piece 
- */
-PieceType Piece::getType() const { return TYPE; }
-
-
-
-/*
- * Return the colour of this piece 
- */
-bool Piece::getColor() const { return COLOR; }
+  TYPE(type), COLOR(color), currentRank(rank), currentFile(file), moveTimes(0){}
 
 
 
@@ -72,52 +34,10 @@ Piece::~Piece(){}
 
 /*===== King =====*/
 
-King::King(bool color, int rank, int file): Piece(KING,color,rank,file), moveTimes(0){}
+King::King(bool color, int rank, int file): Piece(KING,color,rank,file){}
 
 bool King::movePieceRuleTest(int const RANK_D, int const FILE_D, Piece*** const board) const
-{
-  // The current coordinate
-  int const RANK_S = currentRank; int const FILE_S = currentFile;
-  
-  // Test if the destination of a move is in of the board
-  if(isInside(RANK_D,FILE_D) == false) return false;
-
-  // Test if the destination has own side's piece
-  if(board[RANK_D][FILE_D] != nullptr)
-  {
-    if(board[RANK_D][FILE_D]->getColor() == COLOR) return false;
-  }
-
-  // Test if the destination follows the rule:
-  // a king could only make one quare of move
-  if(RANK_D <= RANK_S+1 && RANK_D >= RANK_S-1)
-  {
-    if(FILE_D <= FILE_S+1 && FILE_D >= FILE_S-1)
-    {
-      if(RANK_D != RANK_S || FILE_D != FILE_S) // mustn't remain where it was
-        return true;
-    }
-  }
-  return false;
-}
-
-
-/**
- * Get the moving times value
- */
-int King::getCount(){ return moveTimes; }
-
-
-/**
- * Increment the King's moving times
- */
-void King::incCount(){ ++moveTimes; }
-
-
-/**
- * Decrement the King's moving times
- */
-void King::decCount() { --moveTimes; }
+{ return pieceRule<KING>(this,RANK_D,FILE_D,board); }
 
 
 King::~King(){}
@@ -129,25 +49,7 @@ Queen::Queen(bool color, int rank, int file): Piece(QUEEN,color,rank,file){}
 
 
 bool Queen::movePieceRuleTest(int const RANK_D, int const FILE_D, Piece*** const board) const
-{
-  // The current coordinate
-  int const RANK_S = currentRank; int const FILE_S = currentFile;
-  
-  // Test if the destination of a move is in of the board
-  if(isInside(RANK_D,FILE_D) == false) return false;
-  
-  // Test if the desttination has own side's piece
-  if(board[RANK_D][FILE_D] != nullptr)
-  {
-    if(board[RANK_D][FILE_D]->getColor() == COLOR) return false;
-  }
-  
-  // Test if the destination follows the rule:
-  // a queen combines the power of rook and bishop
-  return (bishopMove(RANK_D,FILE_D,RANK_S,FILE_S,board) ||
-          rookMove(RANK_D,FILE_D,RANK_S,FILE_S,board));
-
-}
+{ return pieceRule<QUEEN>(this,RANK_D,FILE_D,board); }
 
 
 Queen::~Queen(){}
@@ -156,44 +58,11 @@ Queen::~Queen(){}
 
 /*===== Rook =====*/
 
-Rook::Rook(bool color, int rank, int file): Piece(ROOK,color,rank, file), moveTimes(0){}
+Rook::Rook(bool color, int rank, int file): Piece(ROOK,color,rank, file){}
 
 
 bool Rook::movePieceRuleTest(int const RANK_D, int const FILE_D, Piece*** const board) const
-{
-  // The current coordinate
-  int const RANK_S = currentRank; int const FILE_S = currentFile;
-  
-  // Test if the destination of a move is out of the board
-  if(isInside(RANK_D,FILE_D) == false) return false;
-
-  // Test if the destination has own side's piece
-  if(board[RANK_D][FILE_D] != nullptr)
-  {
-    if(board[RANK_D][FILE_D]->getColor() == COLOR) return false;
-  }
-
-  // Test if the destination follows the rule of moving a rook
-  return rookMove(RANK_D,FILE_D,RANK_S,FILE_S,board);
-}
-
-
-/**
- * Get the moving times value
- */
-int Rook::getCount(){ return moveTimes; }
-
-
-/**
- * Increment the Rook's moving times
- */
-void Rook::incCount(){ ++moveTimes; }
-
-
-/**
- * Decrement the Pawn's moving times
- */
-void Rook::decCount() { --moveTimes; }
+{ return pieceRule<ROOK>(this,RANK_D,FILE_D,board); }
 
 
 Rook::~Rook(){}
@@ -204,21 +73,7 @@ Rook::~Rook(){}
 Bishop::Bishop(bool color, int rank, int file): Piece(BISHOP,color,rank,file){}
 
 bool Bishop::movePieceRuleTest(int const RANK_D, int const FILE_D, Piece*** const board) const
-{
-  int const RANK_S = currentRank; int const FILE_S = currentFile;
-
-  // Test if the destination of a move is in of the board
-  if(isInside(RANK_D,FILE_D) == false) return false;
-  
-  // Test if the destination has own side's piece
-  if(board[RANK_D][FILE_D] != nullptr)
-  {
-    if(board[RANK_D][FILE_D]->getColor() == COLOR) return false;
-  }
-  
-  // Test if the destination follows the rule of moving a bishop
-  return bishopMove(RANK_D,FILE_D,RANK_S,FILE_S,board);
-}
+{ return pieceRule<BISHOP>(this,RANK_D,FILE_D,board); }
 
 
 Bishop::~Bishop(){}
@@ -231,26 +86,7 @@ Knight::Knight(bool color, int rank, int file): Piece(KNIGHT,color,rank,file){}
 
 
 bool Knight::movePieceRuleTest(int const RANK_D, int const FILE_D, Piece*** const board) const
-{
-  // The current coordinate
-  int const RANK_S = currentRank; int const FILE_S = currentFile;
-
-  // Test if the destination of a move is in of the board
-  if(isInside(RANK_D,FILE_D) == false) return false;
-
-  // Test if the destination has own side's piece
-  if(board[RANK_D][FILE_D] != nullptr)
-  {
-    if(board[RANK_D][FILE_D]->getColor() == COLOR) return false;
-  }
-  
-  // Test if the destination follows the rule of moving a knight
-  if(abs(RANK_D-RANK_S)==1 && abs(FILE_D-FILE_S)==2) return true; // 1 vertically and 2 horizontally
-
-  if(abs(RANK_D-RANK_S)==2 && abs(FILE_D-FILE_S)==1) return true; // 1 horizontally and 2 vertically
-  
-  return false; // illegal move!
-}
+{ return pieceRule<KNIGHT>(this,RANK_D,FILE_D,board); }
 
 
 Knight::~Knight(){}
@@ -259,121 +95,58 @@ Knight::~Knight(){}
 
 /*===== Pawn =====*/
 
-Pawn::Pawn(bool color, int rank, int file): Piece(PAWN,color,rank,file), moveTimes(0){}
+Pawn::Pawn(bool color, int rank, int file): Piece(PAWN,color,rank,file){}
 
 /**
  * This function could only test but cannot capture a piece nor make a move
  */
 bool Pawn::movePieceRuleTest(int const RANK_D, int const FILE_D, Piece*** const board) const
+{ return pieceRule<PAWN>(this,RANK_D,FILE_D,board); }
+
+
+Pawn::~Pawn(){}
+
+
+
+/*===== PIECE POOL =====*/
+
+PiecePool::PiecePool(): made(0), rewinds(0)
 {
-  // The current coordinate
-  int const RANK_S = currentRank; int const FILE_S = currentFile;
-  
-  // Test if the destination of a move is in of the board
-  if(isInside(RANK_D,FILE_D) == false) return false;
-
-  // NB:1st move of this piece: can move 1 or 2 squares upwards, or capture pieces
-  //--- WHITE PAWN MOVING
-  if(COLOR == WHITE)
-  {
-    // Test if moving 2 squres forwards
-    if(RANK_D-RANK_S == 2 && FILE_D == FILE_S)
-    {
-      if(moveTimes == 0) // it's the first move
-      {
-        for(int i = 1; i <= RANK_D-RANK_S; i++) // test if the squares forward are empty
-          if(board[RANK_S+i][FILE_S] != nullptr) return false;
-
-        //commitFirstMove = true; // first move of this pawn has been made
-        return true;
-      }
-      else return false; // non-first move can't move 2 squres forwards
-    }
-
-    // Test if moving 1 squre forwards
-    if(RANK_D-RANK_S == 1 && FILE_D == FILE_S)
-    {
-      if(board[RANK_D][FILE_D] == nullptr) // test if the square forward is empty
-      {
-        //if(!commitFirstMove) commitFirstMove = true; // it's the first move
-
-        return true;
-      }
-      else return false;
-    }
-
-    // Test if capturing the opponent's pieces
-    if(RANK_D-RANK_S == 1 && abs(FILE_D-FILE_S) == 1)
-    {
-      if(isDestHostile(RANK_D,FILE_D,board)) // test if the detination has opponent's pieces
-      {
-        //if(!commitFirstMove) commitFirstMove = true; // it's the first move
-
-        return true;
-      }
-      else return false;
-    }
-   }
-
-  //--- BLACK PAWN MOVING
-  if(COLOR == BLACK)
-  {
-    if(RANK_S-RANK_D == 2 && FILE_D == FILE_S) // test if Moving 2 squres forwards
-    {
-      if(moveTimes == 0) // it's the first move
-      {
-        for(int i = 1; i <= RANK_S-RANK_D; i++) // test if the square forward is empty
-          if(board[RANK_S-i][FILE_S] != nullptr) return false;
-
-        //commitFirstMove = true; // first move of this pawn has been made
-        return true;
-      }
-      else return false; // non-first move can't move for 2 squres
-    }
-
-    // Test if moving 1 squre forwards
-    if(RANK_S-RANK_D == 1 && FILE_D == FILE_S)
-    {
-      if(board[RANK_D][FILE_D] == nullptr) // test if the square forward is empty
-      {
-        //if(!commitFirstMove) commitFirstMove = true; // it's the first move
-
-        return true;
-      }
-      else return false;
-    }
-
-    // Test if Capturing the opponent's pieces
-    if(RANK_S-RANK_D == 1 && abs(FILE_D-FILE_S) == 1) 
-    {
-      if(isDestHostile(RANK_D,FILE_D,board))  // test if the detination has opponent's pieces
-      {
-        //if(!commitFirstMove) commitFirstMove = true; // it's the first move
-
-        return true;
-      }
-      else return false;
-    }
-  }
-  
-  // Illgal move
-  return false;
+  live.reserve(2*CHUNK_SLOTS);
 }
 
 
 
-/**
- * Increment the Pawn's moving times
- */
-void Pawn::incCount(){ ++moveTimes; }
+void* PiecePool::nextSlot()
+{
+  std::size_t const INDEX = live.size();
+  if(INDEX / CHUNK_SLOTS == chunks.size()) chunks.push_back(new PieceSlot[CHUNK_SLOTS]);
+  return &chunks[INDEX / CHUNK_SLOTS][INDEX % CHUNK_SLOTS];
+}
 
 
 
-/**
- * Decrement the Pawn's moving times
- */
-void Pawn::decCount() { --moveTimes; }
+void PiecePool::rewind()
+{
+  for(Piece* p : live) p->~Piece();
+  live.clear();
+  rewinds++;
+}
 
 
 
-Pawn::~Pawn(){}
+PiecePool::~PiecePool()
+{
+  for(Piece* p : live) p->~Piece();
+  for(PieceSlot* c : chunks) delete [] c;
+}
+
+
+
+unsigned long PiecePool::getMade() const { return made; }
+
+unsigned long PiecePool::getRewinds() const { return rewinds; }
+
+std::size_t PiecePool::getChunks() const { return chunks.size(); }
+
+std::size_t PiecePool::getLive() const { return live.size(); }
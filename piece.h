@@ -3,6 +3,9 @@
 
 #include <string>
 #include <iostream>
+#include <vector>
+#include <new>
+#include <algorithm>
 //#include "helper.h"
 
 #define WHITE false // colour of the pieces
@@ -22,7 +25,9 @@ class Piece
   bool const COLOR; // the colour of this piece: false means white, true means black
   int currentRank; // current position of this piece
   int currentFile;
-  
+  int moveTimes; // how many times this piece has moved: the rules of the king, the rooks and
+                 // the pawns depend on it
+
  public:
 
   Piece(PieceType type, bool color, int rank, int file);
@@ -30,28 +35,47 @@ class Piece
   /**
    * Test if the destination of a move is in of the board, true if so
    */
-  bool isInside(int rank, int file) const;
+  bool isInside(int rank, int file) const
+  {
+    return rank >= 0 && rank < BOARD_SIZE && file >= 0 && file < BOARD_SIZE;
+  }
 
   /**
    * Test if the destination of a move has opponent's pieces (hostile piece), returns true if so
    */
-  bool isDestHostile(int const RANK_D, int const FILE_D, Piece*** const board) const;
+  bool isDestHostile(int const RANK_D, int const FILE_D, Piece*** const board) const
+  {
+    return board[RANK_D][FILE_D] && board[RANK_D][FILE_D]->COLOR != COLOR;
+  }
 
   /**
    * Return the type of this piece 
    */
-  PieceType getType() const;
+  PieceType getType() const { return TYPE; }
   
   /**
    * Return the colour of this piece 
    */
-  bool getColor() const;
+  bool getColor() const { return COLOR; }
 
   /**
    * Return the position of this piece (in char*, e.g. A1, C3)
    */
   std::string getPos() const;
-  
+
+  /**
+   * Return the rank/file index (0 to BOARD_SIZE-1) of this piece, without building a string
+   */
+  int getRank() const { return currentRank; }
+  int getFile() const { return currentFile; }
+
+  /**
+   * Get / increment / decrement the moving times
+   */
+  int getCount() const { return moveTimes; }
+  void incCount() { ++moveTimes; }
+  void decCount() { --moveTimes; }
+
   /**
    * Test if a move of this piece follows the corresponding rule of its type and returns true
    * if succeed.
@@ -76,7 +100,6 @@ class Piece
 
 class King: public Piece::Piece
 {
-  int moveTimes; // a counter indicating how many times this pawn moves
  public:
   
   King(bool color, int rank, int file);
@@ -84,21 +107,6 @@ class King: public Piece::Piece
   bool movePieceRuleTest(int const RANK_D, int const FILE_D,
                          Piece*** const board) const override;
 
-  /**
-   * Get the moving times value
-   */
-  int getCount();
-
-  /**
-   * Increment the moving times
-   */
-  void incCount();
-
-  /**
-   * Decrement the moving times
-   */
-  void decCount();
-
   ~King() override;
 };
 
@@ -120,8 +128,6 @@ class Queen: public Piece::Piece
 
 class Rook: public Piece::Piece
 {
-  int moveTimes; // a counter indicating how many times this pawn moves
-  
  public:
 
   Rook(bool color, int rank, int file);
@@ -129,21 +135,6 @@ class Rook: public Piece::Piece
   bool movePieceRuleTest(int const RANK_D, int const FILE_D,
                          Piece*** const board) const override;
 
-  /**
-   * Get the moving times value
-   */
-  int getCount();
-
-  /**
-   * Increment the moving times
-   */
-  void incCount();
-
-  /**
-   * Decrement the moving times
-   */
-  void decCount();
-
   ~Rook() override;
 };
 
@@ -180,8 +171,6 @@ class Knight: public Piece::Piece
 
 class Pawn : public Piece::Piece
 {
-  int moveTimes; // a counter indicating how many times this pawn moves
-  
  public:
 
   Pawn(bool color, int rank, int file);
@@ -189,19 +178,77 @@ class Pawn : public Piece::Piece
   bool movePieceRuleTest(int const RANK_D, int const FILE_D,
                          Piece*** const board) const override;
 
+
+  ~Pawn() override;
+};
+
+
+/*===== PIECE POOL =====*/
+
+/**
+ * Room for any piece
+ */
+struct PieceSlot
+{
+  alignas(Piece) unsigned char bytes[std::max({sizeof(King), sizeof(Queen), sizeof(Rook),
+                                               sizeof(Bishop), sizeof(Knight), sizeof(Pawn)})];
+};
+
+/**
+ * The pieces of a board, made in contiguous blocks of slots and all destroyed at once by
+ * rewind(): a new game reuses the slots of the previous one instead of freeing and allocating
+ * each piece. The pieces stay where they are made until the rewind
+ */
+class PiecePool
+{
+  static int const CHUNK_SLOTS = 32; // a full set of pieces
+
+  std::vector<PieceSlot*> chunks;
+  std::vector<Piece*> live; // pieces made since the last rewind, in order
+  unsigned long made; // since the pool was created
+  unsigned long rewinds;
+
+  PiecePool(PiecePool const &) = delete;
+  PiecePool& operator=(PiecePool const &) = delete;
+
   /**
-   * Increment the moving times
+   * Return the next free slot, adding a chunk if they are all used
    */
-  void incCount();
+  void* nextSlot();
+
+ public:
+
+  PiecePool();
+  ~PiecePool();
 
   /**
-   * Decrement the moving times
+   * Make a piece, e.g. pool.make<Rook>(WHITE,0,0)
    */
-  void decCount();
-  
-  ~Pawn() override;
-};
+  template <typename P>
+  P* make(bool color, int rank, int file)
+  {
+    static_assert(sizeof(P) <= sizeof(PieceSlot) && alignof(P) <= alignof(PieceSlot),
+                  "a piece must fit in a slot");
+    P* piece = new(nextSlot()) P(color,rank,file);
+    live.push_back(piece);
+    made++;
+    return piece;
+  }
 
+  /**
+   * Destroy every piece made since the last rewind, keeping their slots for the next ones
+   */
+  void rewind();
+
+  /**
+   * Counts for verification: pieces made in all, rewinds, blocks of slots allocated (on the
+   * heap, the only allocations of the pool besides its list of live pieces) and pieces alive
+   */
+  unsigned long getMade() const;
+  unsigned long getRewinds() const;
+  std::size_t getChunks() const;
+  std::size_t getLive() const;
+};
 
 
 #endif
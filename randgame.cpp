@@ -0,0 +1,164 @@
+#include "randgame.h"
+#include "ChessBoard.h"
+#include <cstring>
+
+using namespace std;
+
+/*===== PSEUDO-RANDOM NUMBERS =====*/
+
+static inline uint64_t splitMix(uint64_t& x)
+{
+  uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+
+Rng::Rng(uint64_t seed)
+{
+  for(int i = 0; i < 4; i++) state[i] = splitMix(seed);
+}
+
+
+uint64_t Rng::next()
+{
+  uint64_t const RESULT = rotl(state[1] * 5,7) * 9;
+  uint64_t const T = state[1] << 17;
+  state[2] ^= state[0]; state[3] ^= state[1];
+  state[1] ^= state[2]; state[0] ^= state[3];
+  state[2] ^= T;
+  state[3] = rotl(state[3],45);
+  return RESULT;
+}
+
+
+/**
+ * Uniform in [0, n) by a multiply-shift, rejecting the few values that would bias it
+ */
+uint64_t Rng::below(uint64_t n)
+{
+  unsigned __int128 m = (unsigned __int128)next() * n;
+  if(uint64_t(m) < n)
+  {
+    uint64_t const THRESHOLD = -n % n;
+    while(uint64_t(m) < THRESHOLD) m = (unsigned __int128)next() * n;
+  }
+  return uint64_t(m >> 64);
+}
+
+
+uint64_t streamSeed(uint64_t seed, uint64_t i)
+{
+  uint64_t x = seed ^ (i * 0xd1b54a32d192ed03ULL);
+  return splitMix(x);
+}
+
+
+
+/*===== RANDOM GAMES =====*/
+
+/**
+ * Play random legal moves until the game ends
+ */
+void playRandomGame(ChessBoard& cb, Rng& rng, bool weighted, int maxPlies, RandomGame& game)
+{
+  game.plies.clear();
+  game.result = 0;
+
+  vector<Move> moves;
+  vector<int> weights;
+  for(;;)
+  {
+    //=== 1. The end of the game
+    cb.generateLegalMoves(moves);
+    if(moves.empty())
+    {
+      bool const MATED = cb.isSideToMoveInCheck();
+      game.end = (MATED ? END_CHECKMATE : END_STALEMATE);
+      if(MATED) game.result = (cb.getMoveTurn() == WHITE ? -1 : 1);
+      return;
+    }
+    if(cb.repetitionCount() >= 3) { game.end = END_REPETITION; return; }
+    if(cb.getHalfmoveClock() >= 100) { game.end = END_FIFTY_MOVES; return; }
+    if(cb.isInsufficientMaterial()) { game.end = END_INSUFFICIENT_MATERIAL; return; }
+    if(int(game.plies.size()) >= maxPlies) { game.end = END_PLY_LIMIT; return; }
+
+    //=== 2. Pick a move
+    std::size_t pick = 0;
+    if(!weighted) pick = rng.below(moves.size());
+    else
+    {
+      // Quiet moves weigh 1, castling 4, captures not losing material 8 plus their gain
+      weights.resize(moves.size());
+      int total = 0;
+      for(std::size_t i = 0; i < moves.size(); i++)
+      {
+        Move const & m = moves[i];
+        Piece const * p = cb.pieceAt(m.rankS,m.fileS);
+        int w = 1;
+        if(cb.pieceAt(m.rankD,m.fileD))
+        {
+          int const GAIN = cb.see(m);
+          if(GAIN >= 0) w = 8 + GAIN / 100;
+        }
+        else if(p->getType() == KING && (m.fileD - m.fileS == 2 || m.fileS - m.fileD == 2))
+          w = 4;
+        weights[i] = w; total += w;
+      }
+      int r = int(rng.below(total));
+      while(r >= weights[pick]) r -= weights[pick++];
+    }
+
+    cb.makeMove(moves[pick]);
+    game.plies.push_back(moves[pick]);
+  }
+}
+
+
+char const * resultString(int result)
+{
+  return result > 0 ? "1-0" : (result < 0 ? "0-1" : "1/2-1/2");
+}
+
+
+
+/*===== STREAM FORMATS =====*/
+
+void appendText(std::string& out, RandomGame const & game)
+{
+  for(Move const & m : game.plies)
+  {
+    out += m.uciString();
+    out += ' ';
+  }
+  out += resultString(game.result);
+  out += '\n';
+}
+
+
+void appendBinary(std::string& out, RandomGame const & game)
+{
+  RandomGameRecord r;
+  r.plies = uint16_t(game.plies.size()); r.end = uint8_t(game.end); r.result = int8_t(game.result);
+  out.append(reinterpret_cast<char const *>(&r),sizeof(r));
+
+  for(Move const & m : game.plies)
+  {
+    unsigned const PLY = unsigned(m.rankS*BOARD_SIZE + m.fileS) |
+                         unsigned(m.rankD*BOARD_SIZE + m.fileD) << 6;
+    out += char(PLY & 0xff);
+    out += char(PLY >> 8);
+  }
+}
+
+
+void writeBinaryHeader(std::ostream& out, uint64_t seed)
+{
+  RandomGameFileHeader h;
+  memcpy(h.magic,"MCGS",4);
+  h.version = 1; h.seed = seed;
+  out.write(reinterpret_cast<char const *>(&h),sizeof(h));
+}
@@ -0,0 +1,99 @@
+#ifndef RANDGAME_H
+#define RANDGAME_H
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstdint>
+#include "move.h"
+
+class ChessBoard;
+
+/*===== PSEUDO-RANDOM NUMBERS =====*/
+/**
+ * xoshiro256**, seeded through splitmix64: a few ns per number, and the same sequence for
+ * the same seed on every platform
+ */
+struct Rng
+{
+  uint64_t state[4];
+
+  explicit Rng(uint64_t seed);
+
+  uint64_t next();
+
+  /**
+   * Uniform in [0, n), n > 0
+   */
+  uint64_t below(uint64_t n);
+};
+
+/**
+ * A seed for the i-th stream derived from a master seed, so that each game can be replayed
+ * on its own whatever thread plays it
+ */
+uint64_t streamSeed(uint64_t seed, uint64_t i);
+
+
+/*===== RANDOM GAMES =====*/
+enum GameEnd
+{
+  END_CHECKMATE,
+  END_STALEMATE,
+  END_REPETITION, // threefold
+  END_FIFTY_MOVES,
+  END_INSUFFICIENT_MATERIAL,
+  END_PLY_LIMIT
+};
+
+struct RandomGame
+{
+  std::vector<Move> plies;
+  GameEnd end;
+  int result; // 1 if White won, 0 for a draw, -1 if Black won
+};
+
+/**
+ * Play a game of random legal moves from the position of a board until it ends or reaches
+ * maxPlies; the board is left on the final position. Uniform, every legal move is as
+ * likely; weighted, captures that don't lose material (by ChessBoard::see()) and castling
+ * are favoured, which gives more natural games
+ */
+void playRandomGame(ChessBoard& cb, Rng& rng, bool weighted, int maxPlies, RandomGame& game);
+
+/**
+ * Return "1-0", "0-1" or "1/2-1/2"
+ */
+char const * resultString(int result);
+
+
+/*===== STREAM FORMATS =====*/
+/**
+ * Text: one game per line, its moves in UCI notation followed by its result.
+ * Binary: a RandomGameFileHeader, then for each game a RandomGameRecord followed by its
+ * plies as little-endian uint16 (from | to << 6, squares being rank*BOARD_SIZE+file)
+ */
+struct RandomGameFileHeader
+{
+  char magic[4]; // "MCGS"
+  uint32_t version;
+  uint64_t seed;
+};
+
+struct RandomGameRecord
+{
+  uint16_t plies;
+  uint8_t end; // GameEnd
+  int8_t result;
+};
+
+/**
+ * Append a game to a buffer in either format
+ */
+void appendText(std::string& out, RandomGame const & game);
+void appendBinary(std::string& out, RandomGame const & game);
+
+void writeBinaryHeader(std::ostream& out, uint64_t seed);
+
+
+#endif
@@ -0,0 +1,113 @@
+#include "ChessBoard.h"
+#include "session.h"
+#include "stats.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+
+using namespace std;
+
+/*===== REPLAY =====*/
+
+/**
+ * A stream buffer dropping everything written to it
+ */
+struct NullBuffer: public streambuf
+{
+  int overflow(int c) override { return c; }
+};
+
+
+static void record(HistogramSnapshot& h, uint64_t ns)
+{
+  h.buckets[statBucket(ns)]++;
+  h.count++; h.sum += ns;
+  if(ns > h.max) h.max = ns;
+}
+
+
+static void printHistogram(ostream& out, char const * name, HistogramSnapshot const & h)
+{
+  out << name << ": p50 " << h.quantile(0.5) / 1000.0 << " us, p99 "
+      << h.quantile(0.99) / 1000.0 << " us, max " << h.max / 1000.0 << " us" << endl;
+}
+
+
+/**
+ * Usage: replay LOG [--pace] [--print] [--repeat N]
+ * Makes the calls of a session log again on a board: as fast as possible, or with --pace at
+ * the times they were recorded. Reports on stderr the time the calls took and, with --pace,
+ * the drift: how late each call was made, and how much longer than the recording the whole
+ * replay took. --print shows on stdout (and stderr) what the board reported, as the recorded
+ * program did; --repeat plays the log N times in a row, as a benchmark (not with --pace)
+ */
+int main(int argc, char** argv)
+{
+  char const * path = nullptr;
+  bool pace = false, print = false;
+  long repeat = 1;
+  bool usage = false;
+  for(int i = 1; i < argc; i++)
+  {
+    string const ARG = argv[i];
+    if(ARG == "--pace") pace = true;
+    else if(ARG == "--print") print = true;
+    else if(ARG == "--repeat" && i + 1 < argc) repeat = atol(argv[++i]);
+    else if(!path && ARG[0] != '-') path = argv[i];
+    else usage = true;
+  }
+  if(usage || !path || repeat < 1 || (pace && repeat != 1))
+  {
+    cerr << "Usage: " << argv[0] << " LOG [--pace] [--print] [--repeat N]" << endl;
+    return 1;
+  }
+
+  SessionLogHeader header;
+  vector<SessionEntry> entries;
+  if(!readSessionLog(path,header,entries)) return 1;
+
+  //=== 1. A board reporting nowhere unless asked to; its errors on cerr too
+  NullBuffer discarded;
+  ostream silent(&discarded);
+  ostream report(cerr.rdbuf());
+  if(!print) cerr.rdbuf(&discarded);
+  ChessBoard cb(print ? cout : silent);
+
+  //=== 2. The calls, each timed and, at the original pace, scheduled
+  HistogramSnapshot calls = {}, lateness = {};
+  chrono::steady_clock::time_point const START = chrono::steady_clock::now();
+  for(long r = 0; r < repeat; r++)
+    for(SessionEntry const & e : entries)
+    {
+      if(pace)
+      {
+        chrono::steady_clock::time_point const DUE = START + chrono::microseconds(e.offset);
+        this_thread::sleep_until(DUE);
+        record(lateness,chrono::duration_cast<chrono::nanoseconds>(
+                          chrono::steady_clock::now() - DUE).count());
+      }
+      chrono::steady_clock::time_point const BEFORE = chrono::steady_clock::now();
+      replaySessionCall(cb,e);
+      record(calls,chrono::duration_cast<chrono::nanoseconds>(
+                     chrono::steady_clock::now() - BEFORE).count());
+    }
+  double const SECONDS = chrono::duration<double>(chrono::steady_clock::now() - START).count();
+  cout.flush();
+
+  //=== 3. Report
+  double const RECORDED = (entries.empty() ? 0 : entries.back().offset / 1e6);
+  report << calls.count << " calls in " << SECONDS << " s: " << long(calls.count / SECONDS)
+         << " calls/s" << endl;
+  printHistogram(report,"call time",calls);
+  if(pace)
+  {
+    report << "recorded over " << RECORDED << " s, replayed in " << SECONDS << " s: drift "
+           << (SECONDS - RECORDED) * 1000 << " ms" << endl;
+    printHistogram(report,"call lateness",lateness);
+  }
+  cerr.rdbuf(report.rdbuf());
+  return 0;
+}
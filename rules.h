@@ -0,0 +1,163 @@
+#ifndef RULES_H
+#define RULES_H
+
+#include <cstdlib>
+#include "piece.h"
+#include "helper.h"
+#include "geometry.h"
+
+/*===== RULES BY TYPE =====*/
+/**
+ * The moving rule of each type of piece on a board of geometry G, chosen at compile time:
+ * PieceRule<ROOK,G>::test() is the rook's. They are inline, so that ruleTest() below, and the
+ * loops of the board calling it, get the rule code compiled in rather than a virtual call.
+ * Same contract as Piece::movePieceRuleTest(), whose overrides call them
+ */
+template <PieceType TYPE, class G>
+struct PieceRule;
+
+
+/**
+ * Test if the destination of a move is inside the board and free of own side's pieces
+ */
+template <class G>
+inline bool isOpenTo(Piece const * piece, int const RANK_D, int const FILE_D,
+                     Piece*** const board)
+{
+  if(!G::inside(RANK_D,FILE_D)) return false;
+  return board[RANK_D][FILE_D] == nullptr ||
+         board[RANK_D][FILE_D]->getColor() != piece->getColor();
+}
+
+
+template <class G>
+struct PieceRule<KING,G>
+{
+  static bool test(Piece const * piece, int const RANK_D, int const FILE_D,
+                   Piece*** const board)
+  {
+    if(!isOpenTo<G>(piece,RANK_D,FILE_D,board)) return false;
+
+    // A king could only make one square of move, and mustn't remain where it was
+    int const RANK_S = piece->getRank(); int const FILE_S = piece->getFile();
+    return RANK_D <= RANK_S+1 && RANK_D >= RANK_S-1 && FILE_D <= FILE_S+1 &&
+           FILE_D >= FILE_S-1 && (RANK_D != RANK_S || FILE_D != FILE_S);
+  }
+};
+
+
+template <class G>
+struct PieceRule<QUEEN,G>
+{
+  static bool test(Piece const * piece, int const RANK_D, int const FILE_D,
+                   Piece*** const board)
+  {
+    if(!isOpenTo<G>(piece,RANK_D,FILE_D,board)) return false;
+
+    // A queen combines the power of rook and bishop
+    int const RANK_S = piece->getRank(); int const FILE_S = piece->getFile();
+    return (bishopMove(RANK_D,FILE_D,RANK_S,FILE_S,board) ||
+            rookMove(RANK_D,FILE_D,RANK_S,FILE_S,board));
+  }
+};
+
+
+template <class G>
+struct PieceRule<ROOK,G>
+{
+  static bool test(Piece const * piece, int const RANK_D, int const FILE_D,
+                   Piece*** const board)
+  {
+    if(!isOpenTo<G>(piece,RANK_D,FILE_D,board)) return false;
+    return rookMove(RANK_D,FILE_D,piece->getRank(),piece->getFile(),board);
+  }
+};
+
+
+template <class G>
+struct PieceRule<BISHOP,G>
+{
+  static bool test(Piece const * piece, int const RANK_D, int const FILE_D,
+                   Piece*** const board)
+  {
+    if(!isOpenTo<G>(piece,RANK_D,FILE_D,board)) return false;
+    return bishopMove(RANK_D,FILE_D,piece->getRank(),piece->getFile(),board);
+  }
+};
+
+
+template <class G>
+struct PieceRule<KNIGHT,G>
+{
+  static bool test(Piece const * piece, int const RANK_D, int const FILE_D,
+                   Piece*** const board)
+  {
+    if(!isOpenTo<G>(piece,RANK_D,FILE_D,board)) return false;
+
+    // 1 vertically and 2 horizontally, or 2 vertically and 1 horizontally
+    int const DR = abs(RANK_D - piece->getRank()); int const DF = abs(FILE_D - piece->getFile());
+    return (DR == 1 && DF == 2) || (DR == 2 && DF == 1);
+  }
+};
+
+
+/**
+ * A pawn moves 1 square forwards onto an empty square, 2 on its first move if both are
+ * empty, or captures 1 square diagonally forwards
+ */
+template <class G>
+struct PieceRule<PAWN,G>
+{
+  static bool test(Piece const * piece, int const RANK_D, int const FILE_D,
+                   Piece*** const board)
+  {
+    if(!G::inside(RANK_D,FILE_D)) return false;
+
+    int const RANK_S = piece->getRank(); int const FILE_S = piece->getFile();
+    int const FORWARD = (piece->getColor() == WHITE ? 1 : -1);
+    int const STEPS = (RANK_D - RANK_S) * FORWARD; // squares forwards
+
+    if(FILE_D == FILE_S)
+    {
+      if(STEPS == 1) return board[RANK_D][FILE_D] == nullptr;
+      if(STEPS == 2 && piece->getCount() == 0)
+        return board[RANK_S+FORWARD][FILE_S] == nullptr && board[RANK_D][FILE_D] == nullptr;
+      return false;
+    }
+
+    // Capturing the opponent's pieces
+    return STEPS == 1 && abs(FILE_D-FILE_S) == 1 && piece->isDestHostile(RANK_D,FILE_D,board);
+  }
+};
+
+
+template <PieceType TYPE, class G = StandardGeometry>
+inline bool pieceRule(Piece const * piece, int const RANK_D, int const FILE_D,
+                      Piece*** const board)
+{
+  return PieceRule<TYPE,G>::test(piece,RANK_D,FILE_D,board);
+}
+
+
+/**
+ * Test if a move of a piece follows its rule, dispatching on its type to the inline rules
+ * instead of through the virtual movePieceRuleTest()
+ */
+template <class G = StandardGeometry>
+inline bool ruleTest(Piece const * piece, int const RANK_D, int const FILE_D,
+                     Piece*** const board)
+{
+  switch(piece->getType())
+  {
+  case KING: return pieceRule<KING,G>(piece,RANK_D,FILE_D,board);
+  case QUEEN: return pieceRule<QUEEN,G>(piece,RANK_D,FILE_D,board);
+  case ROOK: return pieceRule<ROOK,G>(piece,RANK_D,FILE_D,board);
+  case BISHOP: return pieceRule<BISHOP,G>(piece,RANK_D,FILE_D,board);
+  case KNIGHT: return pieceRule<KNIGHT,G>(piece,RANK_D,FILE_D,board);
+  case PAWN: return pieceRule<PAWN,G>(piece,RANK_D,FILE_D,board);
+  }
+  return false;
+}
+
+
+#endif
@@ -0,0 +1,462 @@
+#include "search.h"
+#include "ChessBoard.h"
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+static int const SCORE_INF = MATE_SCORE + 1;
+static int const CHECK_EVERY = 1024; // nodes between two looks at the clock
+
+enum { BOUND_EXACT, BOUND_LOWER, BOUND_UPPER };
+
+
+/**
+ * Return the number of moves to a mate for a mate score
+ */
+int mateIn(int score)
+{
+  if(score >= MATE_SCORE - MAX_PLY) return (MATE_SCORE - score + 1) / 2;
+  if(score <= -MATE_SCORE + MAX_PLY) return -(MATE_SCORE + score) / 2;
+  return 0;
+}
+
+
+
+/*===== TRANSPOSITION TABLE =====*/
+
+Search::Search(std::size_t ttEntries): mask(0), stopFlag(false), pondering(false), deadline(0),
+                                       softDeadline(0), allotted(0), nodes(0), stopped(false)
+{
+  std::size_t size = 1;
+  while(size * 2 <= ttEntries) size *= 2;
+  table.resize(size);
+  mask = size - 1;
+  clear();
+}
+
+
+/**
+ * Resize the transposition table to a number of megabytes
+ */
+void Search::resize(std::size_t megaBytes)
+{
+  std::size_t const ENTRIES = megaBytes * 1024 * 1024 / sizeof(TTEntry);
+  std::size_t size = 1;
+  while(size * 2 <= ENTRIES) size *= 2;
+  table.assign(size,TTEntry());
+  mask = size - 1;
+  clear();
+}
+
+
+/**
+ * Forget every entry of the table
+ */
+void Search::clear()
+{
+  for(TTEntry& e : table)
+  {
+    e.key = 0; e.move = Move(); e.score = 0; e.depth = -1; e.bound = BOUND_UPPER;
+  }
+}
+
+
+/**
+ * Return the entry of a position, nullptr if it isn't in the table
+ */
+Search::TTEntry const* Search::probe(uint64_t key) const
+{
+  TTEntry const & e = table[key & mask];
+  return (e.key == key && e.depth >= 0) ? &e : nullptr;
+}
+
+
+/**
+ * Keep the result of a search, unless the same position was searched deeper. Mate scores
+ * are stored as distances from the position rather than from the root
+ */
+void Search::store(uint64_t key, Move const & move, int score, int depth, int bound, int ply)
+{
+  TTEntry& e = table[key & mask];
+  if(e.key == key && e.depth > depth) return;
+
+  if(score >= MATE_SCORE - MAX_PLY) score += ply;
+  else if(score <= -MATE_SCORE + MAX_PLY) score -= ply;
+  e.key = key; e.move = move; e.score = int16_t(score); e.depth = int8_t(depth);
+  e.bound = uint8_t(bound);
+}
+
+
+
+/*===== LIMITS =====*/
+
+/**
+ * Time allotted to the move of a colour in ns, 0 for no limit: the move time if given,
+ * otherwise a share of the clock for the moves to the time control (30 if none) plus most
+ * of the increment, keeping a margin on the clock
+ */
+int64_t Search::allotTime(bool color) const
+{
+  int64_t const MS = 1000000;
+  if(limits.moveTime > 0) return limits.moveTime * MS;
+  if(limits.time[color] < 0) return 0;
+
+  int64_t const LEFT = limits.time[color];
+  int64_t const MOVES = (limits.movesToGo > 0 ? limits.movesToGo : 30);
+  int64_t ms = LEFT / MOVES + limits.inc[color] * 3 / 4;
+  ms = min(ms,LEFT - 50);
+  return max<int64_t>(ms,1) * MS;
+}
+
+
+/**
+ * Set the limits of a search starting now
+ */
+void Search::prepare(SearchLimits const & l, bool color)
+{
+  limits = l;
+  nodes = 0;
+  stopped = false;
+  startTime = chrono::steady_clock::now();
+  allotted = allotTime(color);
+  pondering.store(l.ponder);
+  stopFlag.store(false);
+
+  // With a clock, don't start an iteration after half the time allotted: it would not end
+  int64_t const SOFT = (limits.moveTime > 0 ? allotted : allotted / 2);
+  deadline.store(l.ponder ? 0 : allotted);
+  softDeadline.store(l.ponder ? 0 : SOFT);
+}
+
+
+/**
+ * Test the limits: stopped, out of nodes or out of time (looked at every CHECK_EVERY nodes)
+ */
+bool Search::shouldStop()
+{
+  if(stopped) return true;
+  if(stopFlag.load(memory_order_relaxed)) return stopped = true;
+  if(limits.nodes && nodes >= limits.nodes) return stopped = true;
+  if(nodes % CHECK_EVERY == 0)
+  {
+    int64_t const DEADLINE = deadline.load(memory_order_relaxed);
+    if(DEADLINE && elapsedNs() >= DEADLINE) return stopped = true;
+  }
+  return false;
+}
+
+
+/**
+ * Nanoseconds since the start of the search
+ */
+int64_t Search::elapsedNs() const
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - startTime).count();
+}
+
+
+/**
+ * Ask the search to end as soon as possible
+ */
+void Search::stop()
+{
+  lock_guard<mutex> guard(waitLock);
+  stopFlag.store(true);
+  waitSignal.notify_all();
+}
+
+
+/**
+ * The opponent played the move pondered on: the time allotted starts now
+ */
+void Search::ponderHit()
+{
+  lock_guard<mutex> guard(waitLock);
+  if(!pondering.load()) return;
+
+  int64_t const NOW = elapsedNs();
+  int64_t const SOFT = (limits.moveTime > 0 ? allotted : allotted / 2);
+  deadline.store(allotted ? NOW + allotted : 0);
+  softDeadline.store(allotted ? NOW + SOFT : 0);
+  pondering.store(false);
+  waitSignal.notify_all();
+}
+
+
+
+/*===== SEARCH =====*/
+
+/**
+ * Order moves: the move of the table first, then the captures by their exchange value,
+ * the quiet moves, and the captures losing material last
+ */
+void Search::orderMoves(ChessBoard& cb, vector<Move>& moves, Move const & ttMove) const
+{
+  vector<pair<int,Move>> keyed;
+  keyed.reserve(moves.size());
+  for(Move const & m : moves)
+  {
+    int key = 0;
+    if(m == ttMove) key = 1 << 20;
+    else if(cb.pieceAt(m.rankD,m.fileD))
+    {
+      int const GAIN = cb.see(m);
+      key = (GAIN >= 0 ? (1 << 16) + GAIN : GAIN - (1 << 16));
+    }
+    keyed.push_back(make_pair(key,m));
+  }
+
+  stable_sort(keyed.begin(),keyed.end(),
+              [](pair<int,Move> const & a, pair<int,Move> const & b) { return a.first > b.first; });
+  for(std::size_t i = 0; i < moves.size(); i++) moves[i] = keyed[i].second;
+}
+
+
+/**
+ * Negamax alpha-beta search of a node to a depth (extended when in check)
+ */
+int Search::alphaBeta(ChessBoard& cb, int depth, int ply, int alpha, int beta)
+{
+  pvLength[ply] = ply;
+
+  //=== 1. Draws, leaves and limits
+  if(ply > 0 && (cb.getHalfmoveClock() >= 100 || cb.repetitionCount() >= 2)) return 0;
+
+  // A position the endgame tables cover is scored without searching, as a mate while its
+  // distance from the root fits the mate scores
+  TbWDL wdl; int dtm;
+  if(ply > 0 && cb.probeEndgameValue(wdl,dtm))
+  {
+    if(wdl == TB_DRAW) return 0;
+    return wdl * (ply + dtm < MAX_PLY ? MATE_SCORE - ply - dtm : TB_WIN_SCORE - dtm);
+  }
+
+  bool const IN_CHECK = cb.isSideToMoveInCheck();
+  if(IN_CHECK) depth++;
+  if(depth <= 0 || ply >= MAX_PLY - 1) return quiesce(cb,ply,alpha,beta);
+
+  if(shouldStop()) return 0;
+  nodes++;
+
+  //=== 2. Transposition table
+  uint64_t const KEY = cb.getKey();
+  Move ttMove(0,0,0,0);
+  TTEntry const* e = probe(KEY);
+  if(e)
+  {
+    ttMove = e->move;
+    if(ply > 0 && e->depth >= depth)
+    {
+      int score = e->score;
+      if(score >= MATE_SCORE - MAX_PLY) score -= ply;
+      else if(score <= -MATE_SCORE + MAX_PLY) score += ply;
+
+      if(e->bound == BOUND_EXACT || (e->bound == BOUND_LOWER && score >= beta) ||
+         (e->bound == BOUND_UPPER && score <= alpha))
+        return score;
+    }
+  }
+
+  //=== 3. Moves
+  vector<Move> moves;
+  cb.generateLegalMoves(moves);
+  if(moves.empty()) return IN_CHECK ? -MATE_SCORE + ply : 0; // mated or stalemate
+  orderMoves(cb,moves,ttMove);
+
+  int const ALPHA = alpha;
+  int best = -SCORE_INF;
+  Move bestMove = moves[0];
+  for(Move const & m : moves)
+  {
+    cb.makeMove(m);
+    int const SCORE = -alphaBeta(cb,depth - 1,ply + 1,-beta,-alpha);
+    cb.undoMove();
+    if(stopped) return 0;
+
+    if(SCORE > best)
+    {
+      best = SCORE; bestMove = m;
+      if(SCORE > alpha)
+      {
+        alpha = SCORE;
+        pvTable[ply][ply] = m;
+        for(int i = ply + 1; i < pvLength[ply + 1]; i++) pvTable[ply][i] = pvTable[ply + 1][i];
+        pvLength[ply] = pvLength[ply + 1];
+        if(alpha >= beta) break;
+      }
+    }
+  }
+
+  store(KEY,bestMove,best,depth,
+        best >= beta ? BOUND_LOWER : (best > ALPHA ? BOUND_EXACT : BOUND_UPPER),ply);
+  return best;
+}
+
+
+/**
+ * Quiescence search: stand pat on the evaluation or play on with the captures that don't
+ * lose material, the best exchanges first
+ */
+int Search::quiesce(ChessBoard& cb, int ply, int alpha, int beta)
+{
+  pvLength[ply] = ply;
+  if(shouldStop()) return 0;
+  nodes++;
+
+  vector<Move> moves;
+  cb.generateLegalMoves(moves);
+  if(moves.empty()) return cb.isSideToMoveInCheck() ? -MATE_SCORE + ply : 0;
+
+  int best = cb.evaluate();
+  if(best >= beta || ply >= MAX_PLY - 1) return best;
+  if(best > alpha) alpha = best;
+
+  vector<pair<int,Move>> captures;
+  for(Move const & m : moves)
+    if(cb.pieceAt(m.rankD,m.fileD))
+    {
+      int const GAIN = cb.see(m);
+      if(GAIN >= 0) captures.push_back(make_pair(GAIN,m));
+    }
+  stable_sort(captures.begin(),captures.end(),
+              [](pair<int,Move> const & a, pair<int,Move> const & b) { return a.first > b.first; });
+
+  for(pair<int,Move> const & c : captures)
+  {
+    cb.makeMove(c.second);
+    int const SCORE = -quiesce(cb,ply + 1,-beta,-alpha);
+    cb.undoMove();
+    if(stopped) return 0;
+
+    if(SCORE > best)
+    {
+      best = SCORE;
+      if(SCORE > alpha)
+      {
+        alpha = SCORE;
+        if(alpha >= beta) break;
+      }
+    }
+  }
+  return best;
+}
+
+
+/**
+ * Follow the moves of the table where a line was cut short by it, up to a length
+ */
+void Search::extendPv(ChessBoard& cb, vector<Move>& pv, int length)
+{
+  for(Move const & m : pv) cb.makeMove(m);
+  int played = int(pv.size());
+
+  vector<Move> legal;
+  while(int(pv.size()) < length && cb.repetitionCount() < 2)
+  {
+    TTEntry const* e = probe(cb.getKey());
+    if(!e) break;
+    cb.generateLegalMoves(legal);
+    if(find(legal.begin(),legal.end(),e->move) == legal.end()) break;
+    pv.push_back(e->move);
+    cb.makeMove(e->move);
+    played++;
+  }
+
+  while(played-- > 0) cb.undoMove();
+}
+
+
+/**
+ * Iterative deepening: search one ply deeper at a time until a limit is reached, keeping the
+ * principal variation of the last completed iteration
+ */
+vector<Move> Search::iterate(ChessBoard& cb, function<void(SearchInfo const&)> const & report)
+{
+  vector<Move> pv;
+  vector<Move> rootMoves;
+  cb.generateLegalMoves(rootMoves);
+
+  if(!rootMoves.empty())
+  {
+    pv.push_back(rootMoves[0]); // in case the first iteration can't end
+    int const MAX_DEPTH = (limits.depth > 0 ? min(limits.depth,MAX_PLY - 2) : MAX_PLY - 2);
+
+    for(int depth = 1; depth <= MAX_DEPTH; depth++)
+    {
+      stopped = false;
+      int const SCORE = alphaBeta(cb,depth,0,-SCORE_INF,SCORE_INF);
+      if(stopped) break;
+
+      pv.assign(pvTable[0],pvTable[0] + pvLength[0]);
+      extendPv(cb,pv,depth);
+      if(report)
+      {
+        SearchInfo info;
+        info.depth = depth; info.score = SCORE; info.nodes = nodes;
+        info.seconds = elapsedNs() / 1e9;
+        info.nodesPerSecond = uint64_t(info.seconds > 0 ? nodes / info.seconds : 0);
+        info.pv = pv;
+        report(info);
+      }
+
+      // Deep enough to have seen the shortest mate, or no time for another iteration
+      if(mateIn(SCORE) != 0 && 2 * abs(mateIn(SCORE)) <= depth) break;
+      int64_t const SOFT = softDeadline.load();
+      if(SOFT && elapsedNs() >= SOFT) break;
+    }
+  }
+
+  // An infinite or pondering search waits to be stopped, or pondering, for ponderHit()
+  unique_lock<mutex> lock(waitLock);
+  waitSignal.wait(lock,[this]()
+  {
+    return stopFlag.load() || (!limits.infinite && !pondering.load());
+  });
+  return pv;
+}
+
+
+/**
+ * Search on the calling thread
+ */
+vector<Move> Search::think(ChessBoard& cb, SearchLimits const & l,
+                           function<void(SearchInfo const&)> report)
+{
+  wait();
+  prepare(l,cb.getMoveTurn());
+  return iterate(cb,report);
+}
+
+
+/**
+ * Search on a thread of its own
+ */
+void Search::start(ChessBoard& cb, SearchLimits const & l,
+                   function<void(SearchInfo const&)> report,
+                   function<void(vector<Move> const&)> done)
+{
+  wait();
+  prepare(l,cb.getMoveTurn()); // now, so that a stop() coming before the thread runs counts
+  worker = thread([this,&cb,report,done]()
+  {
+    vector<Move> const PV = iterate(cb,report);
+    if(done) done(PV);
+  });
+}
+
+
+/**
+ * Wait for the search thread to finish
+ */
+void Search::wait()
+{
+  if(worker.joinable()) worker.join();
+}
+
+
+Search::~Search()
+{
+  stop();
+  wait();
+}
@@ -0,0 +1,175 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include "move.h"
+
+class ChessBoard;
+
+#define MAX_PLY 64 // deepest line searched, quiescence included
+#define MATE_SCORE 30000 // score of a mate on the board; mate in n plies is MATE_SCORE - n
+
+/*===== LIMITS AND PROGRESS =====*/
+struct SearchLimits
+{
+  int depth; // plies, 0 for no limit
+  uint64_t nodes; // 0 for no limit
+  int moveTime; // ms, 0 for no limit
+  int time[2]; // ms left on the clock of White and Black, -1 if not playing on a clock
+  int inc[2]; // ms added per move
+  int movesToGo; // moves to the next time control, 0 if none
+  bool infinite; // search until stopped
+  bool ponder; // searching on the opponent's time: no time limit until ponderHit()
+
+  SearchLimits(): depth(0), nodes(0), moveTime(0), time{-1, -1}, inc{0, 0}, movesToGo(0),
+                  infinite(false), ponder(false){}
+};
+
+/**
+ * Result of a completed iteration
+ */
+struct SearchInfo
+{
+  int depth;
+  int score; // centipawns for the side to move, or a mate score
+  uint64_t nodes;
+  double seconds;
+  uint64_t nodesPerSecond;
+  std::vector<Move> pv; // principal variation
+};
+
+/**
+ * Return the number of moves to a mate for a mate score (negative if the side to move is
+ * mated), 0 otherwise
+ */
+int mateIn(int score);
+
+
+/*===== ALPHA-BETA SEARCH =====*/
+/**
+ * Iterative deepening alpha-beta over the moves of ChessBoard::generateLegalMoves(), with a
+ * quiescence search of the captures that don't lose material (by ChessBoard::see()), a
+ * transposition table and ChessBoard::evaluate() at the leaves. Repetitions and the
+ * fifty-move rule score as draws, and the positions the endgame tables of the board cover
+ * score from them without being searched.
+ * A search either runs on the calling thread (think()) or on a thread of its own (start()),
+ * which stop() and ponderHit() may control from any other thread. The board belongs to the
+ * search until it has finished
+ */
+class Search
+{
+  struct TTEntry
+  {
+    uint64_t key;
+    Move move;
+    int16_t score;
+    int8_t depth;
+    uint8_t bound; // BOUND_EXACT, BOUND_LOWER or BOUND_UPPER
+  };
+
+  std::vector<TTEntry> table;
+  uint64_t mask;
+
+  // Limits of the current search
+  SearchLimits limits;
+  std::chrono::steady_clock::time_point startTime;
+  std::atomic<bool> stopFlag;
+  std::atomic<bool> pondering;
+  std::atomic<int64_t> deadline; // ns since startTime, 0 for none
+  std::atomic<int64_t> softDeadline; // no new iteration after it, 0 for none
+  int64_t allotted; // ns for the move, 0 for no limit
+  uint64_t nodes;
+  bool stopped; // the current iteration was cut short
+
+  Move pvTable[MAX_PLY][MAX_PLY];
+  int pvLength[MAX_PLY];
+
+  // The search thread
+  std::thread worker;
+  std::mutex waitLock;
+  std::condition_variable waitSignal;
+
+  /**
+   * Set the limits and the time allotted to a search, from now
+   */
+  void prepare(SearchLimits const & l, bool color);
+  int64_t allotTime(bool color) const;
+
+  /**
+   * Test the limits every few thousand nodes
+   */
+  bool shouldStop();
+  int64_t elapsedNs() const;
+
+  TTEntry const* probe(uint64_t key) const;
+  void store(uint64_t key, Move const & move, int score, int depth, int bound, int ply);
+
+  void orderMoves(ChessBoard& cb, std::vector<Move>& moves, Move const & ttMove) const;
+
+  int alphaBeta(ChessBoard& cb, int depth, int ply, int alpha, int beta);
+  int quiesce(ChessBoard& cb, int ply, int alpha, int beta);
+
+  /**
+   * Follow the moves of the table where the principal variation was cut short by it
+   */
+  void extendPv(ChessBoard& cb, std::vector<Move>& pv, int length);
+
+  /**
+   * Iterative deepening from the prepared limits
+   */
+  std::vector<Move> iterate(ChessBoard& cb, std::function<void(SearchInfo const&)> const & report);
+
+ public:
+
+  /**
+   * ttEntries is rounded down to a power of 2
+   */
+  explicit Search(std::size_t ttEntries = std::size_t(1) << 18);
+
+  /**
+   * Search the position of a board on the calling thread and return its principal variation
+   * (empty if there is no legal move); report is called after every completed iteration.
+   * The board is left as it was
+   */
+  std::vector<Move> think(ChessBoard& cb, SearchLimits const & l,
+                          std::function<void(SearchInfo const&)> report = nullptr);
+
+  /**
+   * Start a search on a thread of its own and return at once; done is called on that thread
+   * with the principal variation at the end. An infinite or pondering search only ends once
+   * stopped (or, pondering, on reaching its limits after ponderHit())
+   */
+  void start(ChessBoard& cb, SearchLimits const & l,
+             std::function<void(SearchInfo const&)> report,
+             std::function<void(std::vector<Move> const&)> done);
+
+  /**
+   * Ask the search to end as soon as possible / the opponent played the move pondered on:
+   * the clock starts now. Both return at once and may be called from any thread
+   */
+  void stop();
+  void ponderHit();
+
+  /**
+   * Wait for the search thread to finish
+   */
+  void wait();
+
+  /**
+   * Resize the transposition table (to MB megabytes) / forget its content, between searches
+   */
+  void resize(std::size_t megaBytes);
+  void clear();
+
+  ~Search();
+};
+
+
+#endif
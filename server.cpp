@@ -0,0 +1,682 @@
+#include "ChessBoard.h"
+#include "stats.h"
+#include "session.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+/*===== PROTOCOL =====*/
+/**
+ * One request per line, one response line per request. Games are numbered by the clients:
+ *   NEW <game>             -> OK <game> new             (starts or restarts a game)
+ *                          -> ERR <game> cannot record  (with --record, if its log cannot be
+ *                                                        created)
+ *   MOVE <game> <e2e4>     -> OK <game> <status>        status: ok, check, checkmate,
+ *                                                        stalemate or draw
+ *                          -> ERR <game> <reason>       unknown game, game over, illegal move
+ *   END <game>             -> OK <game> ended           (frees the board)
+ *   STATS                  -> STATS games=... moves=... moves_per_sec=... validate_p50_us=...
+ *                             validate_p99_us=... server_p50_us=... server_p99_us=...
+ *                          (the rate being over the time since the previous STATS, the
+ *                          latencies since the start)
+ * Responses to the requests of different games may come out of order. A client may shut down
+ * its side of the connection once it has sent its requests: they are all answered before the
+ * server closes it
+ */
+
+static chrono::steady_clock::time_point const EPOCH = chrono::steady_clock::now();
+
+static inline int64_t nowNs()
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - EPOCH).count();
+}
+
+
+/*===== CONNECTIONS =====*/
+
+// A client whose unfinished line, requests waiting for the workers or unread responses outgrow
+// these is dropped
+static std::size_t const MAX_INPUT = 64 * 1024;
+static std::size_t const MAX_UNANSWERED = 256 * 1024;
+static std::size_t const MAX_OUTPUT = 16 * 1024 * 1024;
+
+/**
+ * A client socket. The event loop reads it; responses are written by the workers, what the
+ * socket can't take at once being flushed by the loop when it becomes writable again.
+ * A client may shut down its side once it has sent its requests: the connection is then shut
+ * down once they are all answered and written, the hang-up waking the loop to close it
+ */
+struct Connection
+{
+  int fd;
+  string input; // received, not yet a whole line
+  mutex lock; // guards output, unanswered, readShut and closed
+  string output; // waiting for the socket
+  std::size_t unanswered; // requests given to the workers
+  bool readShut; // the client has sent everything
+  bool closed;
+
+  explicit Connection(int f): fd(f), unanswered(0), readShut(false), closed(false){}
+
+  /**
+   * Write as much of the pending output as the socket takes, and shut the socket down if
+   * nothing is left to do; with lock held
+   */
+  void flushLocked()
+  {
+    while(!output.empty() && !closed)
+    {
+      ssize_t const N = write(fd,output.data(),output.size());
+      if(N <= 0) break; // EAGAIN: EPOLLOUT will tell when to go on
+      output.erase(0,N);
+    }
+
+    if(closed) return;
+    if(output.size() > MAX_OUTPUT) // the client doesn't read: drop it
+    {
+      output.clear();
+      shutdown(fd,SHUT_RDWR);
+    }
+    else if(readShut && unanswered == 0 && output.empty()) shutdown(fd,SHUT_WR);
+  }
+
+  /**
+   * Send a line not answering a request given to the workers
+   */
+  void send(string const & line)
+  {
+    lock_guard<mutex> guard(lock);
+    if(closed) return;
+    output += line;
+    flushLocked();
+  }
+
+  /**
+   * Send the response to a request given to the workers
+   */
+  void answer(string const & line)
+  {
+    lock_guard<mutex> guard(lock);
+    unanswered--;
+    if(closed) return;
+    output += line;
+    flushLocked();
+  }
+
+  /**
+   * Count requests about to be given to the workers; false if too many are waiting
+   */
+  bool expect(std::size_t requests)
+  {
+    lock_guard<mutex> guard(lock);
+    unanswered += requests;
+    return unanswered <= MAX_UNANSWERED;
+  }
+
+  /**
+   * The client has sent everything: shut down once it is all answered
+   */
+  void shutRead()
+  {
+    lock_guard<mutex> guard(lock);
+    readShut = true;
+    flushLocked();
+  }
+
+  void close()
+  {
+    lock_guard<mutex> guard(lock);
+    if(closed) return;
+    closed = true;
+    ::close(fd);
+  }
+};
+
+
+struct Request
+{
+  shared_ptr<Connection> connection;
+  string line;
+  int64_t received; // ns
+};
+
+
+
+/*===== WORKERS =====*/
+
+/**
+ * A game being played: a board from the pool of its worker, and with --record its log
+ */
+struct Game
+{
+  ChessBoard* board;
+  SessionRecorder* recorder; // nullptr if not recording
+  bool over;
+};
+
+/**
+ * A worker thread owns the games whose number maps to it, so that a game's moves are taken in
+ * order and its board is only ever touched by one thread
+ */
+class Worker
+{
+  mutex queueLock;
+  condition_variable queued;
+  deque<Request> queue;
+  bool stopping;
+
+  unordered_map<uint64_t,Game> games;
+  vector<ChessBoard*> spareBoards; // boards of ended games, kept for the next ones
+  string recordDir; // where the games are logged, empty for nowhere
+  vector<Move> moves;
+
+  thread runner;
+
+  // Statistics, read by STATS from the loop thread
+  mutex statsLock;
+  HistogramSnapshot validation; // ns from the start of a MOVE to its status
+  HistogramSnapshot latency; // ns from reading a request to writing its response
+  uint64_t movesDone;
+  uint64_t gamesStarted;
+  uint64_t liveGames; // copy of games.size(): only the worker thread touches games
+
+  static void record(HistogramSnapshot& h, uint64_t ns)
+  {
+    h.buckets[statBucket(ns)]++;
+    h.count++; h.sum += ns;
+    if(ns > h.max) h.max = ns;
+  }
+
+  string handle(string const & line, bool& isMove);
+  string move(uint64_t id, string const & uci);
+  void run();
+
+ public:
+
+  explicit Worker(string const & record): stopping(false), recordDir(record), movesDone(0),
+    gamesStarted(0), liveGames(0)
+  {
+    memset(&validation,0,sizeof(validation));
+    memset(&latency,0,sizeof(latency));
+    runner = thread(&Worker::run,this);
+  }
+
+  void submit(vector<Request>& batch)
+  {
+    {
+      lock_guard<mutex> guard(queueLock);
+      for(Request& r : batch) queue.push_back(std::move(r));
+    }
+    batch.clear();
+    queued.notify_one();
+  }
+
+  /**
+   * Add this worker's figures to totals
+   */
+  void collect(HistogramSnapshot& v, HistogramSnapshot& l, uint64_t& numMoves, uint64_t& numGames)
+  {
+    lock_guard<mutex> guard(statsLock);
+    for(int b = 0; b < STAT_BUCKETS; b++)
+    {
+      v.buckets[b] += validation.buckets[b];
+      l.buckets[b] += latency.buckets[b];
+    }
+    v.count += validation.count; v.sum += validation.sum; v.max = max(v.max,validation.max);
+    l.count += latency.count; l.sum += latency.sum; l.max = max(l.max,latency.max);
+    numMoves += movesDone;
+    numGames += liveGames;
+  }
+
+  ~Worker()
+  {
+    {
+      lock_guard<mutex> guard(queueLock);
+      stopping = true;
+    }
+    queued.notify_one();
+    runner.join();
+    for(auto& g : games)
+    {
+      delete g.second.board;
+      delete g.second.recorder;
+    }
+    for(ChessBoard* b : spareBoards) delete b;
+  }
+};
+
+
+/**
+ * Take requests off the queue, a batch at a time
+ */
+void Worker::run()
+{
+  deque<Request> batch;
+  for(;;)
+  {
+    {
+      unique_lock<mutex> guard(queueLock);
+      queued.wait(guard,[this]() { return stopping || !queue.empty(); });
+      if(queue.empty()) return; // stopping
+      batch.swap(queue);
+    }
+
+    for(Request& r : batch)
+    {
+      bool isMove = false;
+      string const RESPONSE = handle(r.line,isMove);
+      r.connection->answer(RESPONSE);
+
+      lock_guard<mutex> guard(statsLock);
+      record(latency,uint64_t(nowNs() - r.received));
+    }
+    batch.clear();
+  }
+}
+
+
+/**
+ * Carry out a request and return its response
+ */
+string Worker::handle(string const & line, bool& isMove)
+{
+  istringstream in(line);
+  string command;
+  uint64_t id = 0;
+  in >> command >> id;
+  string const GAME = to_string(id);
+
+  if(command == "MOVE")
+  {
+    string uci;
+    in >> uci;
+    isMove = true;
+    return move(id,uci);
+  }
+  if(command == "NEW")
+  {
+    // A new game gets a log of its own, a restarted one goes on with its log
+    auto found = games.find(id);
+    SessionRecorder* recorder = (found != games.end() ? found->second.recorder : nullptr);
+    if(!recorder && !recordDir.empty())
+    {
+      recorder = new SessionRecorder();
+      if(!recorder->open((recordDir + "/" + GAME + ".log").c_str()))
+      {
+        delete recorder;
+        return "ERR " + GAME + " cannot record\n";
+      }
+    }
+
+    ChessBoard* board = nullptr;
+    if(found != games.end()) board = found->second.board;
+    else if(!spareBoards.empty())
+    {
+      board = spareBoards.back();
+      spareBoards.pop_back();
+    }
+
+    if(board) board->resetBoard();
+    else board = new ChessBoard();
+    board->setRecorder(recorder);
+    games[id] = Game{board, recorder, false};
+
+    lock_guard<mutex> guard(statsLock);
+    gamesStarted++;
+    liveGames = games.size();
+    return "OK " + GAME + " new\n";
+  }
+  if(command == "END")
+  {
+    auto found = games.find(id);
+    if(found == games.end()) return "ERR " + GAME + " unknown game\n";
+    found->second.board->setRecorder(nullptr);
+    delete found->second.recorder;
+    spareBoards.push_back(found->second.board);
+    games.erase(found);
+    lock_guard<mutex> guard(statsLock);
+    liveGames = games.size();
+    return "OK " + GAME + " ended\n";
+  }
+  return "ERR " + GAME + " unknown command\n";
+}
+
+
+/**
+ * Validate and play a move, returning the status of the game after it
+ */
+string Worker::move(uint64_t id, string const & uci)
+{
+  int64_t const START = nowNs();
+  string const GAME = to_string(id);
+
+  auto found = games.find(id);
+  if(found == games.end()) return "ERR " + GAME + " unknown game\n";
+  Game& g = found->second;
+  if(g.over) return "ERR " + GAME + " game over\n";
+
+  //=== 1. Validate: the destination must be one of the legal ones of the source square
+  if(uci.size() < 4) return "ERR " + GAME + " illegal move\n";
+  int const FILE_S = uci[0] - 'a', RANK_S = uci[1] - '1';
+  int const FILE_D = uci[2] - 'a', RANK_D = uci[3] - '1';
+  if(FILE_S < 0 || FILE_S >= BOARD_SIZE || RANK_S < 0 || RANK_S >= BOARD_SIZE ||
+     FILE_D < 0 || FILE_D >= BOARD_SIZE || RANK_D < 0 || RANK_D >= BOARD_SIZE)
+    return "ERR " + GAME + " illegal move\n";
+
+  uint64_t const TARGETS = g.board->legalTargetsAll()[RANK_S*BOARD_SIZE + FILE_S];
+  if(!((TARGETS >> (RANK_D*BOARD_SIZE + FILE_D)) & 1)) return "ERR " + GAME + " illegal move\n";
+
+  //=== 2. Play it, and find the status of the game (the legal moves found here are cached for
+  // the validation of the next move)
+  ChessBoard& cb = *g.board;
+  cb.makeMove(Move(RANK_S,FILE_S,RANK_D,FILE_D));
+
+  uint64_t const * const NEXT = cb.legalTargetsAll();
+  bool anyMove = false;
+  for(int sq = 0; sq < BOARD_SIZE*BOARD_SIZE && !anyMove; sq++) anyMove = (NEXT[sq] != 0);
+
+  char const * status = "ok";
+  bool const IN_CHECK = cb.isSideToMoveInCheck();
+  if(!anyMove) status = (IN_CHECK ? "checkmate" : "stalemate");
+  else if(cb.repetitionCount() >= 3 || cb.getHalfmoveClock() >= 100 ||
+          cb.isInsufficientMaterial())
+    status = "draw";
+  else if(IN_CHECK) status = "check";
+  g.over = (!anyMove || status[0] == 'd');
+
+  lock_guard<mutex> guard(statsLock);
+  movesDone++;
+  record(validation,uint64_t(nowNs() - START));
+  return "OK " + GAME + " " + status + "\n";
+}
+
+
+
+/*===== EVENT LOOP =====*/
+
+/**
+ * A stream buffer dropping everything written to it
+ */
+struct NullBuffer: public streambuf
+{
+  int overflow(int c) override { return c; }
+};
+
+static atomic<bool> interrupted(false);
+static void onSignal(int) { interrupted = true; }
+
+static bool setNonBlocking(int fd)
+{
+  int const FLAGS = fcntl(fd,F_GETFL,0);
+  return FLAGS >= 0 && fcntl(fd,F_SETFL,FLAGS | O_NONBLOCK) == 0;
+}
+
+
+/**
+ * Open the listening socket: a Unix-domain one at path, or TCP on localhost:port
+ */
+static int listenOn(string const & path, int port)
+{
+  int fd = -1;
+  if(!path.empty())
+  {
+    fd = socket(AF_UNIX,SOCK_STREAM,0);
+    sockaddr_un addr;
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path,path.c_str(),sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    if(fd < 0 || bind(fd,(sockaddr*)&addr,sizeof(addr)) != 0)
+    {
+      cerr << "Cannot bind " << path << ": " << strerror(errno) << endl;
+      return -1;
+    }
+  }
+  else
+  {
+    fd = socket(AF_INET,SOCK_STREAM,0);
+    int const ON = 1;
+    setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&ON,sizeof(ON));
+    sockaddr_in addr;
+    memset(&addr,0,sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(uint16_t(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(fd < 0 || bind(fd,(sockaddr*)&addr,sizeof(addr)) != 0)
+    {
+      cerr << "Cannot bind 127.0.0.1:" << port << ": " << strerror(errno) << endl;
+      return -1;
+    }
+  }
+
+  if(listen(fd,SOMAXCONN) != 0 || !setNonBlocking(fd))
+  {
+    cerr << "Cannot listen: " << strerror(errno) << endl;
+    return -1;
+  }
+  return fd;
+}
+
+
+/**
+ * Figures of every worker
+ */
+static string statsLine(vector<Worker*> const & workers, double seconds, uint64_t& lastMoves)
+{
+  HistogramSnapshot v, l;
+  memset(&v,0,sizeof(v)); memset(&l,0,sizeof(l));
+  uint64_t numMoves = 0, numGames = 0;
+  for(Worker* w : workers) w->collect(v,l,numMoves,numGames);
+
+  ostringstream out;
+  out << "STATS games=" << numGames << " moves=" << numMoves << " moves_per_sec="
+      << uint64_t(seconds > 0 ? (numMoves - lastMoves) / seconds : 0)
+      << " validate_p50_us=" << v.quantile(0.5) / 1000.0
+      << " validate_p99_us=" << v.quantile(0.99) / 1000.0
+      << " server_p50_us=" << l.quantile(0.5) / 1000.0
+      << " server_p99_us=" << l.quantile(0.99) / 1000.0;
+  lastMoves = numMoves;
+  return out.str();
+}
+
+
+/**
+ * Usage: server [--unix PATH | --port N] [--workers N] [--report SECONDS] [--record DIR]
+ * Serves until interrupted, printing the figures to stderr every report seconds (0: never).
+ * --record writes the calls made to the board of each game to the session log DIR/<game>.log,
+ * for the replay tool; a game started again with NEW goes on in the same log
+ */
+int main(int argc, char** argv)
+{
+  string path;
+  int port = 0;
+  int numWorkers = 2;
+  int reportEvery = 5;
+  string recordDir;
+  for(int i = 1; i < argc; i++)
+  {
+    string const ARG = argv[i];
+    bool const VALUE = (i + 1 < argc);
+    if(ARG == "--unix" && VALUE) path = argv[++i];
+    else if(ARG == "--port" && VALUE) port = atoi(argv[++i]);
+    else if(ARG == "--workers" && VALUE) numWorkers = atoi(argv[++i]);
+    else if(ARG == "--report" && VALUE) reportEvery = atoi(argv[++i]);
+    else if(ARG == "--record" && VALUE) recordDir = argv[++i];
+    else
+    {
+      cerr << "Usage: " << argv[0] << " [--unix PATH | --port N] [--workers N] [--report SECONDS]"
+           << " [--record DIR]" << endl;
+      return 1;
+    }
+  }
+  if((path.empty() && (port <= 0 || port > 65535)) || numWorkers < 1 || reportEvery < 0)
+  {
+    cerr << "A socket path or a port, and at least one worker are needed!" << endl;
+    return 1;
+  }
+  if(!recordDir.empty() && access(recordDir.c_str(),W_OK) != 0)
+  {
+    cerr << "Cannot write session logs to " << recordDir << ": " << strerror(errno) << endl;
+    return 1;
+  }
+
+  // The boards report on cout: nothing of it is wanted here
+  NullBuffer discarded;
+  streambuf* const STDOUT = cout.rdbuf(&discarded);
+  signal(SIGPIPE,SIG_IGN);
+  signal(SIGINT,onSignal);
+  signal(SIGTERM,onSignal);
+
+  int const LISTENER = listenOn(path,port);
+  if(LISTENER < 0) return 1;
+  int const EPOLL = epoll_create1(0);
+  epoll_event ev;
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.ptr = nullptr; // the listener
+  epoll_ctl(EPOLL,EPOLL_CTL_ADD,LISTENER,&ev);
+
+  vector<Worker*> workers;
+  for(int w = 0; w < numWorkers; w++) workers.push_back(new Worker(recordDir));
+  vector<vector<Request>> batches(numWorkers);
+  unordered_map<Connection*,shared_ptr<Connection>> connections;
+
+  cerr << "Serving on " << (path.empty() ? "127.0.0.1:" + to_string(port) : path) << " with "
+       << numWorkers << " workers" << endl;
+
+  int64_t lastReport = nowNs();
+  uint64_t reportedMoves = 0, statsMoves = 0;
+  int64_t lastStats = nowNs();
+  epoll_event events[256];
+  while(!interrupted)
+  {
+    int const N = epoll_wait(EPOLL,events,256,1000);
+
+    for(int e = 0; e < N; e++)
+    {
+      //=== 1. New connections: accept them all (edge-triggered)
+      if(!events[e].data.ptr)
+      {
+        for(;;)
+        {
+          int const FD = accept(LISTENER,nullptr,nullptr);
+          if(FD < 0) break;
+          setNonBlocking(FD);
+          if(path.empty())
+          {
+            int const ON = 1;
+            setsockopt(FD,IPPROTO_TCP,TCP_NODELAY,&ON,sizeof(ON));
+          }
+          shared_ptr<Connection> c = make_shared<Connection>(FD);
+          connections[c.get()] = c;
+          epoll_event cev;
+          cev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+          cev.data.ptr = c.get();
+          epoll_ctl(EPOLL,EPOLL_CTL_ADD,FD,&cev);
+        }
+        continue;
+      }
+
+      shared_ptr<Connection> c = connections[static_cast<Connection*>(events[e].data.ptr)];
+      if(events[e].events & EPOLLOUT)
+      {
+        lock_guard<mutex> guard(c->lock);
+        c->flushLocked();
+      }
+
+      //=== 2. Requests: read until the socket is drained, dispatching the whole lines of each
+      // read. The end of the input only stops the reading, the connection staying open for
+      // the responses
+      bool hangUp = (events[e].events & (EPOLLHUP | EPOLLERR)) != 0;
+      if((events[e].events & (EPOLLIN | EPOLLRDHUP)) && !hangUp)
+      {
+        char buffer[65536];
+        for(;;)
+        {
+          ssize_t const READ = read(c->fd,buffer,sizeof(buffer));
+          if(READ == 0) c->shutRead();
+          if(READ < 0 && errno != EAGAIN) hangUp = true;
+          if(READ <= 0) break;
+          c->input.append(buffer,READ);
+
+          int64_t const RECEIVED = nowNs();
+          std::size_t start = 0, end, requests = 0;
+          while((end = c->input.find('\n',start)) != string::npos)
+          {
+            string line = c->input.substr(start,end - start);
+            start = end + 1;
+            if(line.compare(0,5,"STATS") == 0)
+            {
+              double const SECONDS = (nowNs() - lastStats) / 1e9;
+              c->send(statsLine(workers,SECONDS,statsMoves) + "\n");
+              lastStats = nowNs();
+              continue;
+            }
+
+            // The game number picks the worker
+            std::size_t const SPACE = line.find(' ');
+            uint64_t const ID = (SPACE == string::npos ? 0 : strtoull(line.c_str() + SPACE + 1,
+                                                                       nullptr,10));
+            batches[ID % numWorkers].push_back(Request{c, std::move(line), RECEIVED});
+            requests++;
+          }
+          c->input.erase(0,start);
+          bool const KEPT_UP = c->expect(requests);
+          for(int w = 0; w < numWorkers; w++)
+            if(!batches[w].empty()) workers[w]->submit(batches[w]);
+
+          if(!KEPT_UP || c->input.size() > MAX_INPUT) // flooding, or not a request: drop it
+          {
+            hangUp = true;
+            break;
+          }
+        }
+      }
+
+      if(hangUp)
+      {
+        epoll_ctl(EPOLL,EPOLL_CTL_DEL,c->fd,nullptr);
+        c->close();
+        connections.erase(c.get());
+      }
+    }
+
+    //=== 3. Periodic report
+    if(reportEvery > 0 && nowNs() - lastReport >= int64_t(reportEvery) * 1000000000)
+    {
+      double const SECONDS = (nowNs() - lastReport) / 1e9;
+      string const LINE = statsLine(workers,SECONDS,reportedMoves);
+      if(LINE.find("moves_per_sec=0 ") == string::npos) cerr << LINE << endl;
+      lastReport = nowNs();
+    }
+  }
+
+  for(Worker* w : workers) delete w;
+  for(auto& c : connections) c.second->close();
+  close(LISTENER); close(EPOLL);
+  if(!path.empty()) unlink(path.c_str());
+  cout.rdbuf(STDOUT);
+  return 0;
+}
@@ -0,0 +1,226 @@
+#include "session.h"
+#include "ChessBoard.h"
+#include <iostream>
+#include <iterator>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+#define SESSION_VERSION 2
+#define SESSION_MAX_RECORD (1 + 10 + 2*(1 + 255) + 10) // call, varint, two strings, count
+
+/**
+ * The number of strings and whether a count follow a call in its record
+ */
+static int sessionStrings(SessionCall call)
+{
+  return (call == SESSION_MOVE || call == SESSION_MAKE_MOVE ? 2 : call == SESSION_LOAD ? 1 : 0);
+}
+
+static bool sessionCounted(SessionCall call)
+{
+  return call == SESSION_TAKE_BACK || call == SESSION_REDO;
+}
+
+
+static size_t putVarint(char* buffer, uint64_t v)
+{
+  size_t size = 0;
+  do
+  {
+    buffer[size++] = char((v & 0x7f) | (v > 0x7f ? 0x80 : 0));
+    v >>= 7;
+  }
+  while(v);
+  return size;
+}
+
+
+static bool getVarint(unsigned char const *& p, unsigned char const * end, uint64_t& v)
+{
+  v = 0;
+  for(int shift = 0; p < end && shift < 64; shift += 7)
+  {
+    v |= uint64_t(*p & 0x7f) << shift;
+    if(!(*p++ & 0x80)) return true;
+  }
+  return false;
+}
+
+
+
+/*===== RECORDING =====*/
+
+SessionRecorder::SessionRecorder(): records(0) {}
+
+
+
+bool SessionRecorder::open(char const * path)
+{
+  close();
+  file.open(path,ios::binary | ios::trunc);
+  if(!file)
+  {
+    cerr << "Cannot create the session log " << path << "!" << endl;
+    return false;
+  }
+
+  SessionLogHeader h;
+  memcpy(h.magic,"MCSR",4);
+  h.version = SESSION_VERSION;
+  h.startTime = chrono::duration_cast<chrono::nanoseconds>(
+                  chrono::system_clock::now().time_since_epoch()).count();
+  file.write(reinterpret_cast<char const *>(&h),sizeof(h));
+  last = chrono::steady_clock::now();
+  records = 0;
+  return true;
+}
+
+
+
+bool SessionRecorder::isOpen() const { return file.is_open(); }
+
+void SessionRecorder::flush() { if(file.is_open()) file.flush(); }
+
+void SessionRecorder::close() { if(file.is_open()) file.close(); }
+
+
+
+/**
+ * Encode a record into a small buffer and hand it to the stream at once
+ */
+void SessionRecorder::record(SessionCall call, char const * first, char const * second,
+                             uint64_t count)
+{
+  if(!file.is_open()) return;
+
+  chrono::steady_clock::time_point const NOW = chrono::steady_clock::now();
+  uint64_t delta = chrono::duration_cast<chrono::microseconds>(NOW - last).count();
+  last = NOW;
+
+  char buffer[SESSION_MAX_RECORD];
+  size_t size = 0;
+  buffer[size++] = char(call);
+  size += putVarint(buffer + size,delta);
+
+  char const * const STRINGS[2] = {first, second};
+  for(int i = 0; i < sessionStrings(call); i++)
+  {
+    size_t const LENGTH = (STRINGS[i] ? min<size_t>(strlen(STRINGS[i]),255) : 0);
+    buffer[size++] = char(LENGTH);
+    if(LENGTH) memcpy(buffer + size,STRINGS[i],LENGTH);
+    size += LENGTH;
+  }
+  if(sessionCounted(call)) size += putVarint(buffer + size,count);
+
+  file.write(buffer,size);
+  records++;
+}
+
+
+
+void SessionRecorder::recordReset() { record(SESSION_RESET,nullptr,nullptr,0); }
+
+void SessionRecorder::recordMove(char const * srcPos, char const * desPos)
+{
+  record(SESSION_MOVE,srcPos,desPos,0);
+}
+
+void SessionRecorder::recordLoad(char const * fen) { record(SESSION_LOAD,fen,nullptr,0); }
+
+void SessionRecorder::recordTakeBack(int n) { record(SESSION_TAKE_BACK,nullptr,nullptr,n); }
+
+void SessionRecorder::recordRedo(int n) { record(SESSION_REDO,nullptr,nullptr,n); }
+
+void SessionRecorder::recordMakeMove(Move const & move)
+{
+  char const SRC[3] = {char('A' + move.fileS), char('1' + move.rankS), 0};
+  char const DES[3] = {char('A' + move.fileD), char('1' + move.rankD), 0};
+  record(SESSION_MAKE_MOVE,SRC,DES,0);
+}
+
+void SessionRecorder::recordUndoMove() { record(SESSION_UNDO_MOVE,nullptr,nullptr,0); }
+
+uint64_t SessionRecorder::getRecords() const { return records; }
+
+SessionRecorder::~SessionRecorder() { close(); }
+
+
+
+/*===== READING =====*/
+
+bool readSessionLog(char const * path, SessionLogHeader& header, vector<SessionEntry>& entries)
+{
+  ifstream in(path,ios::binary);
+  if(!in)
+  {
+    cerr << "Cannot open the session log " << path << "!" << endl;
+    return false;
+  }
+  string const DATA((istreambuf_iterator<char>(in)),istreambuf_iterator<char>());
+  if(DATA.size() >= sizeof(header)) memcpy(&header,DATA.data(),sizeof(header));
+  if(DATA.size() < sizeof(header) || memcmp(header.magic,"MCSR",4) != 0 ||
+     header.version != SESSION_VERSION)
+  {
+    cerr << path << " is not a session log!" << endl;
+    return false;
+  }
+
+  entries.clear();
+  unsigned char const * const BEGIN = reinterpret_cast<unsigned char const *>(DATA.data());
+  unsigned char const * const END = BEGIN + DATA.size();
+  unsigned char const * p = BEGIN + sizeof(header);
+  uint64_t offset = 0;
+  while(p < END)
+  {
+    //=== 1. The call and its time
+    SessionEntry e;
+    if(*p > SESSION_UNDO_MOVE)
+    {
+      cerr << path << ": unknown call at byte " << (p - BEGIN) << "!" << endl;
+      return false;
+    }
+    e.call = SessionCall(*p++);
+
+    uint64_t delta;
+    if(!getVarint(p,END,delta)) break; // cut short
+    offset += delta;
+    e.offset = offset;
+
+    //=== 2. Its strings and count
+    bool complete = true;
+    for(int s = 0; s < sessionStrings(e.call); s++)
+    {
+      if(p >= END || END - p - 1 < *p) { complete = false; break; }
+      (s == 0 ? e.first : e.second).assign(reinterpret_cast<char const *>(p + 1),*p);
+      p += 1 + *p;
+    }
+    e.count = 0;
+    if(complete && sessionCounted(e.call)) complete = getVarint(p,END,e.count);
+    if(!complete) break;
+    entries.push_back(e);
+  }
+  return true;
+}
+
+
+
+/*===== REPLAY =====*/
+
+void replaySessionCall(ChessBoard& cb, SessionEntry const & e)
+{
+  switch(e.call)
+  {
+  case SESSION_RESET: cb.resetBoard(); break;
+  case SESSION_MOVE: cb.submitMove(e.first.c_str(),e.second.c_str()); break;
+  case SESSION_LOAD: cb.loadPosition(e.first.c_str()); break;
+  case SESSION_TAKE_BACK: cb.takeBack(int(e.count)); break;
+  case SESSION_REDO: cb.redo(int(e.count)); break;
+  case SESSION_MAKE_MOVE:
+    if(e.first.size() != 2 || e.second.size() != 2) break;
+    cb.makeMove(Move(e.first[1] - '1',e.first[0] - 'A',e.second[1] - '1',e.second[0] - 'A'));
+    break;
+  case SESSION_UNDO_MOVE: cb.undoMove(); break;
+  }
+}
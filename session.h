@@ -0,0 +1,111 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include "move.h"
+
+class ChessBoard;
+
+/*===== SESSION LOGS =====*/
+/**
+ * The calls a board received, in order, to be replayed: a SessionLogHeader, then a record
+ * per call made of
+ *   a uint8 SessionCall,
+ *   the microseconds since the previous record (since the log was opened for the first) as
+ *   an unsigned LEB128 varint,
+ *   for SESSION_MOVE and SESSION_MAKE_MOVE the source then the destination position, and
+ *   for SESSION_LOAD the FEN, each as a uint8 length followed by its bytes (longer strings
+ *   are cut to 255, a null one is empty),
+ *   for SESSION_TAKE_BACK and SESSION_REDO the number of moves asked for as a varint
+ * A move typically takes 7 bytes
+ */
+enum SessionCall
+{
+  SESSION_RESET, // resetBoard()
+  SESSION_MOVE, // submitMove()
+  SESSION_LOAD, // loadPosition()
+  SESSION_TAKE_BACK, // takeBack()
+  SESSION_REDO, // redo()
+  SESSION_MAKE_MOVE, // makeMove()
+  SESSION_UNDO_MOVE // undoMove()
+};
+
+struct SessionLogHeader
+{
+  char magic[4]; // "MCSR"
+  uint32_t version;
+  int64_t startTime; // when the log was opened, in ns since the epoch (UTC)
+};
+
+struct SessionEntry
+{
+  SessionCall call;
+  uint64_t offset; // microseconds since the log was opened
+  std::string first; // source position or FEN
+  std::string second; // destination position
+  uint64_t count; // moves to take back or redo
+};
+
+
+/**
+ * Appends the calls of a board to a session log: attached to a board by
+ * ChessBoard::setRecorder(). The records are buffered by the stream, flush() (or closing
+ * the recorder) writes them out. Searching with makeMove() and undoMove() records every
+ * move tried, so a recorder is best attached to boards that are not searched
+ */
+class SessionRecorder
+{
+  std::ofstream file;
+  std::chrono::steady_clock::time_point last; // time of the previous record
+  uint64_t records;
+
+  void record(SessionCall call, char const * first, char const * second, uint64_t count);
+
+  SessionRecorder(SessionRecorder const &) = delete;
+  SessionRecorder& operator=(SessionRecorder const &) = delete;
+
+ public:
+
+  SessionRecorder();
+
+  /**
+   * Start a new log at path, replacing any file there. Returns false if it cannot be written
+   */
+  bool open(char const * path);
+  bool isOpen() const;
+  void flush();
+  void close();
+
+  void recordReset();
+  void recordMove(char const * srcPos, char const * desPos);
+  void recordLoad(char const * fen);
+  void recordTakeBack(int n);
+  void recordRedo(int n);
+  void recordMakeMove(Move const & move);
+  void recordUndoMove();
+
+  uint64_t getRecords() const;
+
+  ~SessionRecorder();
+};
+
+
+/**
+ * Read a whole session log. Returns false if it cannot be read or is not a session log; a
+ * record cut short at the end (by a crash of the recording program) is left out
+ */
+bool readSessionLog(char const * path, SessionLogHeader& header,
+                    std::vector<SessionEntry>& entries);
+
+/**
+ * Make a recorded call again on a board
+ */
+void replaySessionCall(ChessBoard& cb, SessionEntry const & e);
+
+
+#endif
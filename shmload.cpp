@@ -0,0 +1,249 @@
+#include "ChessBoard.h"
+#include "piece.h"
+#include "randgame.h"
+#include "shmring.h"
+#include "stats.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+
+/*===== REQUESTS =====*/
+
+static chrono::steady_clock::time_point const EPOCH = chrono::steady_clock::now();
+
+static inline uint64_t nowNs()
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - EPOCH).count();
+}
+
+/**
+ * A stream buffer dropping everything written to it
+ */
+struct NullBuffer: public streambuf
+{
+  int overflow(int c) override { return c; }
+};
+
+/**
+ * FEN (placement, side to move, castling) of a board
+ */
+static string fenOf(ChessBoard& cb)
+{
+  static char const LETTERS[] = "kqrbnp";
+  string fen;
+  for(int rank = BOARD_SIZE - 1; rank >= 0; rank--)
+  {
+    int empty = 0;
+    for(int file = 0; file < BOARD_SIZE; file++)
+    {
+      Piece* p = cb.pieceAt(rank,file);
+      if(!p) { empty++; continue; }
+      if(empty) fen += char('0' + empty);
+      empty = 0;
+      char const LETTER = LETTERS[p->getType()];
+      fen += (p->getColor() == WHITE ? char(LETTER - 'a' + 'A') : LETTER);
+    }
+    if(empty) fen += char('0' + empty);
+    if(rank > 0) fen += '/';
+  }
+  fen += (cb.getMoveTurn() == WHITE ? " w " : " b ");
+
+  // A side may castle with a rook if neither it nor the king has moved
+  string castling;
+  for(int side = 0; side < 2; side++)
+  {
+    int const RANK = (side == 0 ? 0 : BOARD_SIZE - 1);
+    bool const COLOR = (side == 0 ? WHITE : BLACK);
+    Piece* king = cb.pieceAt(RANK,4);
+    if(!king || king->getType() != KING || king->getColor() != COLOR ||
+       king->getCount() != 0)
+      continue;
+    for(int const FILE : {7, 0})
+    {
+      Piece* rook = cb.pieceAt(RANK,FILE);
+      if(rook && rook->getType() == ROOK && rook->getColor() == COLOR &&
+         rook->getCount() == 0)
+      {
+        char const LETTER = (FILE == 7 ? 'k' : 'q');
+        castling += (COLOR == WHITE ? char(LETTER - 'a' + 'A') : LETTER);
+      }
+    }
+  }
+  return fen + (castling.empty() ? "-" : castling);
+}
+
+
+/**
+ * A request with the legality the service must find
+ */
+struct Expected
+{
+  ShmRequest request;
+  bool legal;
+};
+
+/**
+ * Requests from the positions of random games: in each position the move played, another
+ * legal move and two arbitrary square pairs (mostly illegal)
+ */
+static void generateRequests(long positions, uint64_t seed, vector<Expected>& requests)
+{
+  ChessBoard cb;
+  RandomGame game;
+  vector<Move> moves;
+  Rng pick(seed);
+  long done = 0;
+  for(uint64_t g = 0; done < positions; g++)
+  {
+    Rng rng(streamSeed(seed,g));
+    cb.resetBoard();
+    playRandomGame(cb,rng,true,200,game);
+    cb.resetBoard();
+    for(std::size_t ply = 0; ply < game.plies.size() && done < positions; ply++, done++)
+    {
+      cb.generateLegalMoves(moves);
+      string const FEN = fenOf(cb);
+      Move const TRIED[4] = {game.plies[ply], moves[pick.below(moves.size())],
+                             Move(int(pick.below(BOARD_SIZE)),int(pick.below(BOARD_SIZE)),
+                                  int(pick.below(BOARD_SIZE)),int(pick.below(BOARD_SIZE))),
+                             Move(int(pick.below(BOARD_SIZE)),int(pick.below(BOARD_SIZE)),
+                                  int(pick.below(BOARD_SIZE)),int(pick.below(BOARD_SIZE)))};
+      for(Move const & m : TRIED)
+      {
+        Expected e;
+        memset(&e.request,0,sizeof(e.request));
+        e.request.tag = requests.size();
+        e.request.from = uint8_t(m.rankS*BOARD_SIZE + m.fileS);
+        e.request.to = uint8_t(m.rankD*BOARD_SIZE + m.fileD);
+        strncpy(e.request.fen,FEN.c_str(),SHM_FEN_SIZE - 1);
+        e.legal = false;
+        for(Move const & legal : moves) e.legal = e.legal || legal == m;
+        requests.push_back(e);
+      }
+      cb.makeMove(game.plies[ply]);
+    }
+  }
+}
+
+
+
+/*===== LOAD =====*/
+
+/**
+ * Usage: shmload [--name NAME] [--requests N] [--batch N] [--positions N] [--seed S]
+ * Sends N requests (cycling through those of the positions of random games) to a running
+ * shmservice, batch at most at a time, and prints the throughput and the latencies
+ */
+int main(int argc, char** argv)
+{
+  string name = "/mcslab-validate";
+  long total = 1000000, batch = 64, positions = 4096;
+  uint64_t seed = 1;
+  for(int i = 1; i < argc; i++)
+  {
+    string const ARG = argv[i];
+    bool const VALUE = (i + 1 < argc);
+    if(ARG == "--name" && VALUE) name = argv[++i];
+    else if(ARG == "--requests" && VALUE) total = atol(argv[++i]);
+    else if(ARG == "--batch" && VALUE) batch = atol(argv[++i]);
+    else if(ARG == "--positions" && VALUE) positions = atol(argv[++i]);
+    else if(ARG == "--seed" && VALUE) seed = strtoull(argv[++i],nullptr,0);
+    else
+    {
+      cerr << "Usage: " << argv[0] << " [--name NAME] [--requests N] [--batch N]"
+           << " [--positions N] [--seed S]" << endl;
+      return 1;
+    }
+  }
+  if(total < 1 || batch < 1 || positions < 1)
+  {
+    cerr << "The numbers of requests, of positions and the batch size must be positive!" << endl;
+    return 1;
+  }
+
+  NullBuffer discarded;
+  streambuf* const STDOUT = cout.rdbuf(&discarded);
+  vector<Expected> requests;
+  generateRequests(positions,seed,requests);
+  cout.rdbuf(STDOUT);
+
+  ShmChannel channel;
+  if(!openChannel(name.c_str(),channel)) return 1;
+  if(!channel.header->serving.load(memory_order_acquire))
+  {
+    cerr << "No service is running on " << name << "!" << endl;
+    return 1;
+  }
+
+  //=== 1. Keep up to batch requests in flight, timing each from its publication to the
+  // reading of its reply
+  vector<uint64_t> sentAt(requests.size());
+  HistogramSnapshot latency;
+  memset(&latency,0,sizeof(latency));
+  long sent = 0, received = 0, errors = 0;
+  long statuses[SHM_BAD_POSITION + 1] = {};
+  unsigned idle = 0;
+
+  uint64_t const START = nowNs();
+  while(received < total)
+  {
+    bool busy = false;
+    uint64_t const FREE = min<uint64_t>(channel.requests.writable(),
+                                        uint64_t(batch - (sent - received)));
+    uint64_t const N = min<uint64_t>(FREE,uint64_t(total - sent));
+    if(N > 0 && sent - received < batch)
+    {
+      uint64_t const NOW = nowNs();
+      for(uint64_t k = 0; k < N; k++)
+      {
+        std::size_t const R = std::size_t(sent + k) % requests.size();
+        channel.requests.slot(k) = requests[R].request;
+        sentAt[R] = NOW;
+      }
+      channel.requests.publish(N);
+      sent += N; busy = true;
+    }
+
+    uint64_t const M = channel.replies.readable();
+    if(M > 0)
+    {
+      uint64_t const NOW = nowNs();
+      for(uint64_t k = 0; k < M; k++)
+      {
+        ShmReply const & reply = channel.replies.slot(k);
+        Expected const & e = requests[reply.tag];
+        uint64_t const NS = NOW - sentAt[reply.tag];
+        latency.buckets[statBucket(NS)]++;
+        latency.count++; latency.sum += NS;
+        if(NS > latency.max) latency.max = NS;
+        if(reply.status <= SHM_BAD_POSITION) statuses[reply.status]++;
+        if((reply.status != SHM_ILLEGAL) != e.legal || reply.status == SHM_BAD_POSITION)
+          errors++;
+      }
+      channel.replies.release(M);
+      received += M; busy = true;
+    }
+
+    if(busy) idle = 0;
+    else shmBackoff(idle);
+  }
+  double const SECONDS = (nowNs() - START) / 1e9;
+  closeChannel(channel);
+
+  //=== 2. Report
+  static char const * const NAMES[] = {"legal", "check", "checkmate", "stalemate", "draw",
+                                       "illegal", "bad position"};
+  cout << total << " requests (" << requests.size() << " distinct, batches of " << batch
+       << ") in " << SECONDS << " s: " << long(total / SECONDS) << " per second" << endl;
+  cout << "latency: p50 " << latency.quantile(0.5) / 1000.0 << " us, p99 "
+       << latency.quantile(0.99) / 1000.0 << " us, max " << latency.max / 1000.0 << " us" << endl;
+  for(int s = 0; s <= SHM_BAD_POSITION; s++)
+    if(statuses[s]) cout << NAMES[s] << ": " << statuses[s] << endl;
+  if(errors) cout << errors << " replies disagree with the legality expected" << endl;
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+#include "shmring.h"
+#include <iostream>
+#include <new>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static char const MAGIC[8] = "MCSHMV1";
+
+static std::size_t channelBytes(uint32_t capacity)
+{
+  return sizeof(ShmChannelHeader) + capacity * (sizeof(ShmRequest) + sizeof(ShmReply));
+}
+
+/**
+ * Point the rings at the slots of a mapped channel
+ */
+static void attachRings(ShmChannel& channel, bool service)
+{
+  ShmChannelHeader* h = channel.header;
+  ShmRequest* requests = reinterpret_cast<ShmRequest*>(h + 1);
+  ShmReply* replies = reinterpret_cast<ShmReply*>(requests + h->capacity);
+  channel.requests.attach(requests,&h->requestHead,&h->requestTail,h->capacity,!service);
+  channel.replies.attach(replies,&h->replyHead,&h->replyTail,h->capacity,service);
+}
+
+
+bool createChannel(char const * name, uint32_t capacity, ShmChannel& channel)
+{
+  if(capacity < 2 || (capacity & (capacity - 1)))
+  {
+    cerr << "The capacity of a channel must be a power of 2!" << endl;
+    return false;
+  }
+
+  shm_unlink(name);
+  int const FD = shm_open(name,O_RDWR | O_CREAT | O_EXCL,0600);
+  std::size_t const BYTES = channelBytes(capacity);
+  if(FD < 0 || ftruncate(FD,off_t(BYTES)) != 0)
+  {
+    cerr << "Cannot create " << name << ": " << strerror(errno) << endl;
+    if(FD >= 0) close(FD);
+    return false;
+  }
+  void* memory = mmap(nullptr,BYTES,PROT_READ | PROT_WRITE,MAP_SHARED,FD,0);
+  close(FD);
+  if(memory == MAP_FAILED)
+  {
+    cerr << "Cannot map " << name << ": " << strerror(errno) << endl;
+    return false;
+  }
+
+  // The object comes zeroed; the header is constructed in place, the magic written last
+  ShmChannelHeader* h = new(memory) ShmChannelHeader;
+  h->capacity = capacity;
+  h->serving.store(0);
+  h->requestHead.value.store(0); h->requestTail.value.store(0);
+  h->replyHead.value.store(0); h->replyTail.value.store(0);
+  atomic_thread_fence(memory_order_release);
+  memcpy(h->magic,MAGIC,sizeof(MAGIC));
+
+  channel.header = h; channel.bytes = BYTES;
+  attachRings(channel,true);
+  return true;
+}
+
+
+bool openChannel(char const * name, ShmChannel& channel)
+{
+  int const FD = shm_open(name,O_RDWR,0);
+  struct stat info;
+  if(FD < 0 || fstat(FD,&info) != 0 || std::size_t(info.st_size) < sizeof(ShmChannelHeader))
+  {
+    cerr << "Cannot open " << name << ": " << strerror(errno) << endl;
+    if(FD >= 0) close(FD);
+    return false;
+  }
+  void* memory = mmap(nullptr,info.st_size,PROT_READ | PROT_WRITE,MAP_SHARED,FD,0);
+  close(FD);
+  if(memory == MAP_FAILED)
+  {
+    cerr << "Cannot map " << name << ": " << strerror(errno) << endl;
+    return false;
+  }
+
+  ShmChannelHeader* h = static_cast<ShmChannelHeader*>(memory);
+  if(memcmp(h->magic,MAGIC,sizeof(MAGIC)) != 0 ||
+     channelBytes(h->capacity) > std::size_t(info.st_size))
+  {
+    cerr << name << " is not a validation channel!" << endl;
+    munmap(memory,info.st_size);
+    return false;
+  }
+  atomic_thread_fence(memory_order_acquire);
+
+  channel.header = h; channel.bytes = info.st_size;
+  attachRings(channel,false);
+  return true;
+}
+
+
+void closeChannel(ShmChannel& channel, char const * unlinkName)
+{
+  if(channel.header) munmap(channel.header,channel.bytes);
+  channel.header = nullptr;
+  if(unlinkName) shm_unlink(unlinkName);
+}
+
+
+void shmBackoff(unsigned& idle)
+{
+  idle++;
+  if(idle < 1024)
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+  else if(idle < 1024 + 64) this_thread::yield();
+  else this_thread::sleep_for(chrono::microseconds(50));
+}
@@ -0,0 +1,162 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/*===== MESSAGES =====*/
+#define SHM_FEN_SIZE 112 // room for a FEN, terminating 0 included
+
+/**
+ * Is a move legal in a position: squares are rank*BOARD_SIZE+file, the position a FEN
+ * (placement, side to move, castling). Requests for the same position in a row are cheaper,
+ * the position being set up only once
+ */
+struct ShmRequest
+{
+  uint64_t tag; // copied to the reply
+  uint8_t from, to;
+  uint8_t unused[6];
+  char fen[SHM_FEN_SIZE];
+};
+
+enum ShmStatus
+{
+  SHM_LEGAL, // the game goes on
+  SHM_CHECK, // legal, and the opponent is in check
+  SHM_CHECKMATE,
+  SHM_STALEMATE,
+  SHM_DRAW, // legal, and neither side can mate any more
+  SHM_ILLEGAL,
+  SHM_BAD_POSITION // the FEN cannot be parsed
+};
+
+struct ShmReply
+{
+  uint64_t tag;
+  uint8_t status; // ShmStatus
+  uint8_t unused[7];
+};
+
+
+/*===== RINGS =====*/
+/**
+ * A ring index alone on its cache line, so that the producer and the consumer don't write
+ * the same line
+ */
+struct alignas(64) ShmIndex
+{
+  std::atomic<uint64_t> value;
+};
+
+/**
+ * Single-producer single-consumer ring over slots in shared memory. Each side works on the
+ * slots in place and hands a whole batch over with one release store; the index of the
+ * other side is only loaded again when the cached one says the ring is full / empty.
+ * The producer calls writable(), fills slot(0..n-1) and publish(n); the consumer calls
+ * readable(), reads slot(0..n-1) and release(n)
+ */
+template <typename T>
+class ShmRing
+{
+  T* slots;
+  ShmIndex* head; // next slot to be written, advanced by the producer
+  ShmIndex* tail; // next slot to be read, advanced by the consumer
+  uint64_t mask;
+  uint64_t mine; // this side's index
+  uint64_t other; // the other side's index when last loaded
+
+ public:
+
+  ShmRing(): slots(nullptr), head(nullptr), tail(nullptr), mask(0), mine(0), other(0){}
+
+  /**
+   * Attach to a ring of capacity slots (a power of 2), as its producer or its consumer
+   */
+  void attach(T* s, ShmIndex* h, ShmIndex* t, uint32_t capacity, bool producer)
+  {
+    slots = s; head = h; tail = t; mask = capacity - 1;
+    mine = (producer ? head : tail)->value.load(std::memory_order_relaxed);
+    other = (producer ? tail : head)->value.load(std::memory_order_acquire);
+  }
+
+  //=== Producer
+  uint64_t writable()
+  {
+    if(mine - other > mask) other = tail->value.load(std::memory_order_acquire);
+    return mask + 1 - (mine - other);
+  }
+
+  T& slot(uint64_t k) { return slots[(mine + k) & mask]; }
+
+  void publish(uint64_t n)
+  {
+    mine += n;
+    head->value.store(mine,std::memory_order_release);
+  }
+
+  //=== Consumer
+  uint64_t readable()
+  {
+    if(other == mine) other = head->value.load(std::memory_order_acquire);
+    return other - mine;
+  }
+
+  void release(uint64_t n)
+  {
+    mine += n;
+    tail->value.store(mine,std::memory_order_release);
+  }
+};
+
+
+/*===== CHANNELS =====*/
+/**
+ * A shared memory object holding a request ring and a reply ring of the same capacity:
+ * this header, then the request slots, then the reply slots
+ */
+struct ShmChannelHeader
+{
+  char magic[8]; // "MCSHMV1"
+  uint32_t capacity;
+  std::atomic<uint32_t> serving; // 1 while a service consumes the requests
+  ShmIndex requestHead, requestTail, replyHead, replyTail;
+};
+
+struct ShmChannel
+{
+  ShmChannelHeader* header;
+  std::size_t bytes; // of the mapping
+  ShmRing<ShmRequest> requests;
+  ShmRing<ShmReply> replies;
+
+  ShmChannel(): header(nullptr), bytes(0){}
+};
+
+/**
+ * Create (replacing any previous one) and map the shared memory object name (e.g.
+ * "/mcslab-validate") as the service, the consumer of the requests. capacity must be a
+ * power of 2. Return false on failure
+ */
+bool createChannel(char const * name, uint32_t capacity, ShmChannel& channel);
+
+/**
+ * Map an existing channel as the client, the producer of the requests
+ */
+bool openChannel(char const * name, ShmChannel& channel);
+
+/**
+ * Unmap a channel; the service also removes its name
+ */
+void closeChannel(ShmChannel& channel, char const * unlinkName = nullptr);
+
+/**
+ * Wait a little when a ring has nothing to do: spin with pause first, which keeps the
+ * latency low, then yield and sleep so that an idle side leaves the CPU. idle counts the
+ * successive idle rounds and is reset by the caller when there is work again
+ */
+void shmBackoff(unsigned& idle);
+
+
+#endif
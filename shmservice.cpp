@@ -0,0 +1,163 @@
+#include "ChessBoard.h"
+#include "shmring.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+
+using namespace std;
+
+/*===== VALIDATION =====*/
+
+/**
+ * Validates requests against a board kept on the last position asked about, with the legal
+ * destinations of that position saved so that a run of requests on it costs one move
+ * generation each (for the status after the move) and no set-up
+ */
+class Validator
+{
+  ChessBoard cb;
+  char fen[SHM_FEN_SIZE]; // position of the board, "" if none
+  uint64_t targets[BOARD_SIZE*BOARD_SIZE];
+  vector<Move> moves;
+
+ public:
+
+  Validator() { fen[0] = '\0'; }
+
+  ShmStatus validate(ShmRequest const & r)
+  {
+    //=== 1. Set up the position unless the board is on it already
+    if(strncmp(r.fen,fen,SHM_FEN_SIZE) != 0)
+    {
+      if(memchr(r.fen,'\0',SHM_FEN_SIZE) == nullptr || !cb.loadPosition(r.fen))
+      {
+        fen[0] = '\0';
+        return SHM_BAD_POSITION;
+      }
+      memcpy(targets,cb.legalTargetsAll(),sizeof(targets));
+      strcpy(fen,r.fen);
+    }
+
+    //=== 2. The move must be among the legal ones; its status is found by playing it
+    if(r.from >= BOARD_SIZE*BOARD_SIZE || r.to >= BOARD_SIZE*BOARD_SIZE ||
+       !((targets[r.from] >> r.to) & 1))
+      return SHM_ILLEGAL;
+
+    cb.makeMove(Move(r.from / BOARD_SIZE,r.from % BOARD_SIZE,r.to / BOARD_SIZE,
+                     r.to % BOARD_SIZE));
+    cb.generateLegalMoves(moves);
+    bool const IN_CHECK = cb.isSideToMoveInCheck();
+    bool const DEAD = cb.isInsufficientMaterial();
+    cb.undoMove();
+
+    if(moves.empty()) return IN_CHECK ? SHM_CHECKMATE : SHM_STALEMATE;
+    if(DEAD) return SHM_DRAW;
+    return IN_CHECK ? SHM_CHECK : SHM_LEGAL;
+  }
+};
+
+
+/**
+ * A stream buffer dropping everything written to it
+ */
+struct NullBuffer: public streambuf
+{
+  int overflow(int c) override { return c; }
+};
+
+static atomic<bool> interrupted(false);
+static void onSignal(int) { interrupted = true; }
+
+
+/**
+ * Usage: shmservice [--name NAME] [--capacity N] [--report SECONDS]
+ * Creates the shared memory channel NAME (/mcslab-validate by default) and validates the
+ * requests written to it until interrupted, printing the throughput to stderr every report
+ * seconds (0: never)
+ */
+int main(int argc, char** argv)
+{
+  string name = "/mcslab-validate";
+  long capacity = 4096;
+  int reportEvery = 5;
+  for(int i = 1; i < argc; i++)
+  {
+    string const ARG = argv[i];
+    bool const VALUE = (i + 1 < argc);
+    if(ARG == "--name" && VALUE) name = argv[++i];
+    else if(ARG == "--capacity" && VALUE) capacity = atol(argv[++i]);
+    else if(ARG == "--report" && VALUE) reportEvery = atoi(argv[++i]);
+    else
+    {
+      cerr << "Usage: " << argv[0] << " [--name NAME] [--capacity N] [--report SECONDS]" << endl;
+      return 1;
+    }
+  }
+
+  ShmChannel channel;
+  if(capacity < 2 || capacity > (1L << 24) || reportEvery < 0 ||
+     !createChannel(name.c_str(),uint32_t(capacity),channel))
+    return 1;
+
+  // The boards report on cout: nothing of it is wanted here
+  NullBuffer discarded;
+  streambuf* const STDOUT = cout.rdbuf(&discarded);
+  signal(SIGINT,onSignal);
+  signal(SIGTERM,onSignal);
+  channel.header->serving.store(1,memory_order_release);
+  cerr << "Serving " << name << " (" << capacity << " slots)" << endl;
+
+  Validator validator;
+  chrono::steady_clock::time_point lastReport = chrono::steady_clock::now();
+  uint64_t validated = 0, reported = 0, batches = 0;
+  unsigned idle = 0;
+  while(!interrupted)
+  {
+    //=== 1. A batch: every request available that has room for its reply
+    uint64_t n = channel.requests.readable();
+    if(n > 0) n = min(n,channel.replies.writable());
+    if(n == 0)
+    {
+      shmBackoff(idle);
+      if(idle < 1024 + 64) continue;
+    }
+    else
+    {
+      idle = 0;
+
+      //=== 2. Validate in place, straight from the request slots into the reply slots
+      for(uint64_t k = 0; k < n; k++)
+      {
+        ShmRequest const & request = channel.requests.slot(k);
+        ShmReply& reply = channel.replies.slot(k);
+        reply.tag = request.tag;
+        reply.status = uint8_t(validator.validate(request));
+      }
+      channel.replies.publish(n);
+      channel.requests.release(n);
+      validated += n; batches++;
+      if((batches & 255) != 0) continue;
+    }
+
+    //=== 3. Periodic report, looked at when idle or every 256 batches
+    chrono::steady_clock::time_point const NOW = chrono::steady_clock::now();
+    double const SECONDS = chrono::duration<double>(NOW - lastReport).count();
+    if(reportEvery > 0 && SECONDS >= reportEvery)
+    {
+      if(validated > reported)
+        cerr << validated << " requests validated, " << long((validated - reported) / SECONDS)
+             << " per second over the last " << SECONDS << " s" << endl;
+      reported = validated; lastReport = NOW;
+    }
+  }
+
+  channel.header->serving.store(0,memory_order_release);
+  closeChannel(channel,name.c_str());
+  cout.rdbuf(STDOUT);
+  return 0;
+}
@@ -0,0 +1,227 @@
+#include "stats.h"
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+/*===== HISTOGRAM BUCKETS =====*/
+
+/**
+ * Bucket of a value: exact below STAT_SUB_BUCKETS, then 16 buckets per power of 2
+ */
+int statBucket(uint64_t value)
+{
+  if(value < STAT_SUB_BUCKETS) return int(value);
+
+  int const EXP = 63 - __builtin_clzll(value); // >= 5
+  int const SUB = int(value >> (EXP - 4)) & 15;
+  return STAT_SUB_BUCKETS + (EXP - 5) * (STAT_SUB_BUCKETS/2) + SUB;
+}
+
+
+/**
+ * Largest value of a bucket
+ */
+uint64_t statBucketTop(int bucket)
+{
+  if(bucket < STAT_SUB_BUCKETS) return uint64_t(bucket);
+
+  int const EXP = (bucket - STAT_SUB_BUCKETS) / (STAT_SUB_BUCKETS/2) + 5;
+  uint64_t const SUB = (bucket - STAT_SUB_BUCKETS) % (STAT_SUB_BUCKETS/2);
+  return ((16 + SUB + 1) << (EXP - 4)) - 1;
+}
+
+
+/**
+ * Value below which a fraction q of the recorded values lie
+ */
+uint64_t HistogramSnapshot::quantile(double q) const
+{
+  if(count == 0) return 0;
+
+  uint64_t const RANK = uint64_t(q * count + 0.5) > 0 ? uint64_t(q * count + 0.5) : 1;
+  uint64_t seen = 0;
+  for(int b = 0; b < STAT_BUCKETS; b++)
+  {
+    seen += buckets[b];
+    if(seen >= RANK) return min(statBucketTop(b),max);
+  }
+  return max;
+}
+
+
+
+#ifdef CHESS_STATS
+/*===== PER-THREAD RECORDS =====*/
+
+/**
+ * One thread's counters. Only their thread writes them (relaxed load and store, no locked
+ * instruction), snapshots read them from other threads
+ */
+struct ThreadStats
+{
+  atomic<uint64_t> counters[NUM_STAT_COUNTERS];
+  atomic<uint64_t> buckets[NUM_STAT_HISTOGRAMS][STAT_BUCKETS];
+  atomic<uint64_t> count[NUM_STAT_HISTOGRAMS];
+  atomic<uint64_t> sum[NUM_STAT_HISTOGRAMS];
+  atomic<uint64_t> max[NUM_STAT_HISTOGRAMS];
+
+  ThreadStats()
+  {
+    for(auto& c : counters) c.store(0);
+    for(int h = 0; h < NUM_STAT_HISTOGRAMS; h++)
+    {
+      for(auto& b : buckets[h]) b.store(0);
+      count[h].store(0); sum[h].store(0); max[h].store(0);
+    }
+  }
+};
+
+static inline void bump(atomic<uint64_t>& a, uint64_t by)
+{
+  a.store(a.load(memory_order_relaxed) + by,memory_order_relaxed);
+}
+
+
+/**
+ * Every live thread's record, and the totals of the threads that have exited
+ */
+struct StatsRegistry
+{
+  mutex lock;
+  vector<ThreadStats*> live;
+  StatsSnapshot retired;
+
+  StatsRegistry() { memset(&retired,0,sizeof(retired)); }
+};
+
+static StatsRegistry& registry()
+{
+  static StatsRegistry* r = new StatsRegistry(); // never destroyed: threads may outlive main
+  return *r;
+}
+
+
+/**
+ * Add a record to a snapshot
+ */
+static void accumulate(StatsSnapshot& s, ThreadStats const & t)
+{
+  for(int c = 0; c < NUM_STAT_COUNTERS; c++) s.counters[c] += t.counters[c].load();
+  for(int h = 0; h < NUM_STAT_HISTOGRAMS; h++)
+  {
+    HistogramSnapshot& hs = s.histograms[h];
+    for(int b = 0; b < STAT_BUCKETS; b++) hs.buckets[b] += t.buckets[h][b].load();
+    hs.count += t.count[h].load();
+    hs.sum += t.sum[h].load();
+    hs.max = std::max(hs.max,t.max[h].load());
+  }
+}
+
+
+/**
+ * Registers the record of its thread on creation, folds it into the totals on exit
+ */
+struct ThreadStatsHolder
+{
+  ThreadStats* stats;
+
+  ThreadStatsHolder(): stats(new ThreadStats())
+  {
+    StatsRegistry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    r.live.push_back(stats);
+  }
+
+  ~ThreadStatsHolder()
+  {
+    StatsRegistry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    accumulate(r.retired,*stats);
+    r.live.erase(find(r.live.begin(),r.live.end(),stats));
+    delete stats;
+  }
+};
+
+static inline ThreadStats& threadStats()
+{
+  thread_local ThreadStatsHolder holder;
+  return *holder.stats;
+}
+
+
+void statsCount(StatCounter counter) { bump(threadStats().counters[counter],1); }
+
+
+void statsRecord(StatHistogram histogram, uint64_t ns)
+{
+  ThreadStats& t = threadStats();
+  bump(t.buckets[histogram][statBucket(ns)],1);
+  bump(t.count[histogram],1);
+  bump(t.sum[histogram],ns);
+  if(ns > t.max[histogram].load(memory_order_relaxed))
+    t.max[histogram].store(ns,memory_order_relaxed);
+}
+#endif
+
+
+
+/*===== SNAPSHOTS =====*/
+
+/**
+ * Sum of the records of every thread
+ */
+StatsSnapshot statsSnapshot()
+{
+  StatsSnapshot s;
+  memset(&s,0,sizeof(s));
+#ifdef CHESS_STATS
+  s.enabled = true;
+  StatsRegistry& r = registry();
+  lock_guard<mutex> guard(r.lock);
+  s = r.retired;
+  s.enabled = true;
+  for(ThreadStats const * t : r.live) accumulate(s,*t);
+#endif
+  return s;
+}
+
+
+/**
+ * Print a snapshot in the Prometheus text format
+ */
+void printStats(std::ostream& out, StatsSnapshot const & snapshot)
+{
+  static char const * const COUNTER_NAMES[NUM_STAT_COUNTERS] =
+    {"chess_submitted_moves_total", "chess_fake_moves_total", "chess_rule_tests_total",
+     "chess_check_tests_total", "chess_mate_scans_total"};
+  static char const * const HISTOGRAM_NAMES[NUM_STAT_HISTOGRAMS] =
+    {"chess_submit_move_ns", "chess_game_end_detection_ns"};
+  static double const QUANTILES[4] = {0.5, 0.9, 0.99, 0.999};
+
+  if(!snapshot.enabled)
+  {
+    out << "# statistics disabled: build with make STATS=1" << endl;
+    return;
+  }
+
+  for(int c = 0; c < NUM_STAT_COUNTERS; c++)
+  {
+    out << "# TYPE " << COUNTER_NAMES[c] << " counter" << endl;
+    out << COUNTER_NAMES[c] << " " << snapshot.counters[c] << endl;
+  }
+
+  for(int h = 0; h < NUM_STAT_HISTOGRAMS; h++)
+  {
+    HistogramSnapshot const & hs = snapshot.histograms[h];
+    out << "# TYPE " << HISTOGRAM_NAMES[h] << " summary" << endl;
+    for(double q : QUANTILES)
+      out << HISTOGRAM_NAMES[h] << "{quantile=\"" << q << "\"} " << hs.quantile(q) << endl;
+    out << HISTOGRAM_NAMES[h] << "_sum " << hs.sum << endl;
+    out << HISTOGRAM_NAMES[h] << "_count " << hs.count << endl;
+    out << HISTOGRAM_NAMES[h] << "_max " << hs.max << endl;
+  }
+}
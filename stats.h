@@ -0,0 +1,116 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <iostream>
+#include <cstdint>
+#include <chrono>
+
+/*===== EVENTS =====*/
+enum StatCounter
+{
+  STAT_SUBMITTED_MOVES, // calls of submitMove()
+  STAT_FAKE_MOVES, // makeFakeMove()
+  STAT_RULE_TESTS, // movePieceRuleTest() calls by the board
+  STAT_CHECK_TESTS, // isInCheck()
+  STAT_MATE_SCANS, // isNoFurtherValidMove()
+  NUM_STAT_COUNTERS
+};
+
+enum StatHistogram
+{
+  STAT_SUBMIT_MOVE_NS, // latency of submitMove()
+  STAT_GAME_END_NS, // latency of the check/checkmate/stalemate tests after a move
+  NUM_STAT_HISTOGRAMS
+};
+
+
+/*===== HISTOGRAMS =====*/
+/**
+ * Log-linear buckets in the manner of HDR histograms: values below STAT_SUB_BUCKETS have a
+ * bucket each, above that every power of 2 is split into STAT_SUB_BUCKETS/2 buckets, so a
+ * recorded value is known within 1/16 (about 6%) up to 2^63 ns
+ */
+#define STAT_SUB_BUCKETS 32
+#define STAT_BUCKETS ((64 - 5) * (STAT_SUB_BUCKETS/2) + STAT_SUB_BUCKETS)
+
+struct HistogramSnapshot
+{
+  uint64_t buckets[STAT_BUCKETS];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+
+  /**
+   * Return the value (upper end of its bucket) below which a fraction q of the values lie
+   */
+  uint64_t quantile(double q) const;
+};
+
+/**
+ * Bucket of a value, and the largest value of a bucket
+ */
+int statBucket(uint64_t value);
+uint64_t statBucketTop(int bucket);
+
+
+/*===== SNAPSHOTS =====*/
+/**
+ * Sum of the counters and histograms of every thread, past and present
+ */
+struct StatsSnapshot
+{
+  bool enabled; // false if built without CHESS_STATS: everything is 0
+  uint64_t counters[NUM_STAT_COUNTERS];
+  HistogramSnapshot histograms[NUM_STAT_HISTOGRAMS];
+};
+
+/**
+ * Take a snapshot; it may be called from any thread while others keep counting
+ */
+StatsSnapshot statsSnapshot();
+
+/**
+ * Print a snapshot in the Prometheus text format (counters, then count, sum and the 50th,
+ * 90th, 99th and 99.9th percentiles of each histogram)
+ */
+void printStats(std::ostream& out, StatsSnapshot const & snapshot);
+
+
+/*===== INSTRUMENTATION =====*/
+/**
+ * Built with -DCHESS_STATS (make STATS=1), STATS_COUNT(counter) adds one to a counter of the
+ * calling thread and STATS_TIMER(histogram) records the time until the end of the enclosing
+ * scope. Otherwise both expand to nothing
+ */
+#ifdef CHESS_STATS
+
+void statsCount(StatCounter counter);
+void statsRecord(StatHistogram histogram, uint64_t ns);
+
+class StatsTimer
+{
+  StatHistogram const HISTOGRAM;
+  std::chrono::steady_clock::time_point const START;
+ public:
+  explicit StatsTimer(StatHistogram h): HISTOGRAM(h), START(std::chrono::steady_clock::now()){}
+  ~StatsTimer()
+  {
+    statsRecord(HISTOGRAM,std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now() - START).count());
+  }
+};
+
+#define STATS_CONCAT2(a,b) a##b
+#define STATS_CONCAT(a,b) STATS_CONCAT2(a,b)
+#define STATS_COUNT(counter) statsCount(counter)
+#define STATS_TIMER(histogram) StatsTimer STATS_CONCAT(statsTimer,__LINE__)(histogram)
+
+#else
+
+#define STATS_COUNT(counter) ((void)0)
+#define STATS_TIMER(histogram) ((void)0)
+
+#endif
+
+
+#endif
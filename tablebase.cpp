@@ -0,0 +1,881 @@
+#include "tablebase.h"
+#include "ChessBoard.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <climits>
+#include "tbfile.h"
+#include "rules.h"
+
+#define NUM_SQUARES (BOARD_SIZE*BOARD_SIZE)
+#define MAX_TB_MOVES 128 // more than 4 pieces (kings included) can ever have
+
+
+/*===== SYMMETRY =====*/
+
+/**
+ * Apply a symmetry to a square: bit 0 mirrors the files, bit 1 mirrors the ranks and bit 2
+ * swaps ranks and files (applied last)
+ */
+static inline int transformSquare(int sq, int t)
+{
+  int r = sq / BOARD_SIZE, f = sq % BOARD_SIZE;
+  if(t & 1) f = BOARD_SIZE-1-f;
+  if(t & 2) r = BOARD_SIZE-1-r;
+  if(t & 4) { int tmp = r; r = f; f = tmp; }
+  return r*BOARD_SIZE + f;
+}
+
+/**
+ * Return the symmetry mapping a position onto the representative of its class: the white
+ * king goes into the a1-d1-d4 triangle and, if it ends up on the diagonal, the first other
+ * piece off the diagonal goes below it
+ */
+static int canonicalTransform(TbPosition const & pos, int num)
+{
+  int t = 0;
+  int r = pos.sq[0] / BOARD_SIZE, f = pos.sq[0] % BOARD_SIZE;
+  if(f > BOARD_SIZE/2-1) t |= 1;
+  if(r > BOARD_SIZE/2-1) t |= 2;
+
+  int k = transformSquare(pos.sq[0], t);
+  r = k / BOARD_SIZE, f = k % BOARD_SIZE;
+  if(r > f) return t | 4;
+  if(r < f) return t;
+
+  for(int i = 1; i < num; i++)
+  {
+    int s = transformSquare(pos.sq[i], t);
+    int rs = s / BOARD_SIZE, fs = s % BOARD_SIZE;
+    if(rs > fs) return t | 4;
+    if(rs < fs) return t;
+  }
+  return t;
+}
+
+/**
+ * Return the slot (0 to 9) of a square of the a1-d1-d4 triangle, -1 otherwise
+ */
+static int kingSlot(int sq)
+{
+  int r = sq / BOARD_SIZE, f = sq % BOARD_SIZE;
+  if(f > BOARD_SIZE/2-1 || r > f) return -1;
+
+  int slot = 0;
+  for(int i = 0; i < r; i++) slot += BOARD_SIZE/2 - i;
+  return slot + f - r;
+}
+
+/**
+ * Inverse of kingSlot()
+ */
+static int slotSquare(int slot)
+{
+  for(int r = 0; r < BOARD_SIZE/2; r++)
+  {
+    if(slot < BOARD_SIZE/2 - r) return r*BOARD_SIZE + r + slot;
+    slot -= BOARD_SIZE/2 - r;
+  }
+  return -1;
+}
+
+
+
+/*===== SCRATCH BOARD =====*/
+/**
+ * A board holding one Piece object per slot of a table, so that the positions of the table
+ * can be tested with the very same ruleTest() as a real game
+ */
+class TbScratch
+{
+ public:
+
+  Piece* cells[BOARD_SIZE][BOARD_SIZE];
+  Piece** rows[BOARD_SIZE];
+  Piece* pieces[MAX_TB_PIECES];
+  int num;
+  bool const * colors;
+
+  TbScratch(int n, PieceType const * types, bool const * c): num(n), colors(c)
+  {
+    for(int i = 0; i < BOARD_SIZE; i++)
+    {
+      rows[i] = cells[i];
+      for(int j = 0; j < BOARD_SIZE; j++) cells[i][j] = nullptr;
+    }
+
+    for(int i = 0; i < num; i++)
+    {
+      switch(types[i])
+      {
+      case KING:
+        pieces[i] = new King(c[i],0,0); break;
+      case QUEEN:
+        pieces[i] = new Queen(c[i],0,0); break;
+      case ROOK:
+        pieces[i] = new Rook(c[i],0,0); break;
+      case BISHOP:
+        pieces[i] = new Bishop(c[i],0,0); break;
+      case KNIGHT:
+        pieces[i] = new Knight(c[i],0,0); break;
+      default:
+        pieces[i] = new Pawn(c[i],0,0);
+      }
+    }
+  }
+
+  Piece*** board() { return rows; }
+
+  /**
+   * Put the pieces on the squares of a position (and clear the other squares)
+   */
+  void place(TbPosition const & pos)
+  {
+    for(int i = 0; i < BOARD_SIZE; i++)
+      for(int j = 0; j < BOARD_SIZE; j++) cells[i][j] = nullptr;
+
+    for(int i = 0; i < num; i++)
+    {
+      int r = pos.sq[i] / BOARD_SIZE, f = pos.sq[i] % BOARD_SIZE;
+      cells[r][f] = pieces[i]; pieces[i]->setPos(r,f);
+    }
+  }
+
+  /**
+   * Test if a square is attacked by the pieces of a colour, ignoring the piece in slot skip
+   */
+  bool isAttacked(int sq, bool byColor, int skip)
+  {
+    int r = sq / BOARD_SIZE, f = sq % BOARD_SIZE;
+    for(int i = 0; i < num; i++)
+    {
+      if(i == skip || colors[i] != byColor) continue;
+      if(ruleTest(pieces[i],r,f,rows)) return true;
+    }
+    return false;
+  }
+
+  ~TbScratch()
+  {
+    for(int i = 0; i < num; i++) delete pieces[i];
+  }
+};
+
+
+/*===== MOVES OF A TABLE POSITION =====*/
+struct TbChild
+{
+  Move move;
+  int captured; // slot of the captured piece, -1 if none
+  TbPosition pos; // position after the move (the captured piece is still listed)
+};
+
+/**
+ * Generate the legal moves of the side to move, the scratch board must hold pos
+ */
+static int generateChildren(TbScratch& s, TbPosition const & pos, TbChild* out)
+{
+  int n = 0;
+  int const MY_KING = (pos.turn == WHITE ? 0 : 1);
+
+  for(int i = 0; i < s.num; i++)
+  {
+    if(s.colors[i] != pos.turn) continue;
+
+    int const FROM = pos.sq[i];
+    int const RANK_S = FROM / BOARD_SIZE, FILE_S = FROM % BOARD_SIZE;
+    Piece* myPiece = s.pieces[i];
+
+    for(int to = 0; to < NUM_SQUARES; to++)
+    {
+      int const RANK_D = to / BOARD_SIZE, FILE_D = to % BOARD_SIZE;
+      if(!ruleTest(myPiece,RANK_D,FILE_D,s.board())) continue;
+
+      // Locate the hostile piece, if any
+      int captured = -1;
+      if(s.cells[RANK_D][FILE_D])
+        for(int j = 0; j < s.num; j++)
+          if(j != i && pos.sq[j] == to) { captured = j; break; }
+
+      // Make the move and see if my king is safe
+      Piece* hostPiece = s.cells[RANK_D][FILE_D];
+      s.cells[RANK_D][FILE_D] = myPiece; s.cells[RANK_S][FILE_S] = nullptr;
+      myPiece->setPos(RANK_D,FILE_D);
+
+      int kingSq = (i == MY_KING ? to : pos.sq[MY_KING]);
+      bool legal = !s.isAttacked(kingSq,!pos.turn,captured);
+
+      s.cells[RANK_S][FILE_S] = myPiece; s.cells[RANK_D][FILE_D] = hostPiece;
+      myPiece->setPos(RANK_S,FILE_S);
+
+      if(!legal) continue;
+
+      TbChild& c = out[n++];
+      c.move = Move(RANK_S,FILE_S,RANK_D,FILE_D);
+      c.captured = captured;
+      c.pos = pos; c.pos.sq[i] = to; c.pos.turn = !pos.turn;
+    }
+  }
+  return n;
+}
+
+/**
+ * Generate the positions from which the previous mover could have reached pos without a
+ * capture. The moves of the non-pawn pieces are symmetric, so the squares a piece may have
+ * come from are the empty squares it could move to. The scratch board must hold pos
+ */
+static int generateParents(TbScratch& s, TbPosition const & pos, TbPosition* out)
+{
+  int n = 0;
+  bool const MOVER = !pos.turn;
+  int const OPPO_KING = (pos.turn == WHITE ? 0 : 1); // the king of the side to move in pos
+
+  for(int i = 0; i < s.num; i++)
+  {
+    if(s.colors[i] != MOVER) continue;
+
+    int const CUR = pos.sq[i];
+    int const RANK_C = CUR / BOARD_SIZE, FILE_C = CUR % BOARD_SIZE;
+    Piece* myPiece = s.pieces[i];
+
+    for(int from = 0; from < NUM_SQUARES; from++)
+    {
+      int const RANK_F = from / BOARD_SIZE, FILE_F = from % BOARD_SIZE;
+      if(s.cells[RANK_F][FILE_F]) continue;
+      if(!ruleTest(myPiece,RANK_F,FILE_F,s.board())) continue;
+
+      // Put the piece back and make sure the side to move of pos wasn't left in check
+      s.cells[RANK_F][FILE_F] = myPiece; s.cells[RANK_C][FILE_C] = nullptr;
+      myPiece->setPos(RANK_F,FILE_F);
+
+      int kingSq = (i == OPPO_KING ? from : pos.sq[OPPO_KING]);
+      bool legal = !s.isAttacked(kingSq,MOVER,-1);
+
+      s.cells[RANK_C][FILE_C] = myPiece; s.cells[RANK_F][FILE_F] = nullptr;
+      myPiece->setPos(RANK_C,FILE_C);
+
+      if(!legal) continue;
+
+      TbPosition& p = out[n++];
+      p = pos; p.sq[i] = from; p.turn = MOVER;
+    }
+  }
+  return n;
+}
+
+/**
+ * Remove the piece in slot j from a position, giving the position of the sub-table
+ */
+static TbPosition removeSlot(TbPosition const & pos, int j, int num)
+{
+  TbPosition sub;
+  int k = 0;
+  for(int i = 0; i < num; i++)
+    if(i != j) sub.sq[k++] = pos.sq[i];
+  sub.turn = pos.turn;
+  return sub;
+}
+
+/**
+ * Sort a list of indices and drop the duplicates, returns the new length
+ */
+static int uniqueIndices(long* list, int n)
+{
+  std::sort(list,list+n);
+  return int(std::unique(list,list+n) - list);
+}
+
+/**
+ * Run fn(threadId, begin, end) over [0,n) split among numThreads threads
+ */
+template<typename Fn>
+static void parallelFor(long n, int numThreads, Fn fn)
+{
+  if(numThreads <= 1 || n < 4096)
+  {
+    fn(0,0L,n);
+    return;
+  }
+
+  std::vector<std::thread> workers;
+  long chunk = (n + numThreads - 1) / numThreads;
+  for(int t = 0; t < numThreads; t++)
+  {
+    long begin = t*chunk, end = std::min(n,begin+chunk);
+    if(begin >= end) break;
+    workers.emplace_back(fn,t,begin,end);
+  }
+  for(std::thread& w : workers) w.join();
+}
+
+
+
+/*===== Tablebase =====*/
+
+Tablebase::Tablebase(std::string const & mat, int num, PieceType const * t, bool const * c):
+  material(mat), numPieces(num), file(nullptr)
+{
+  for(int i = 0; i < MAX_TB_PIECES; i++)
+  {
+    types[i] = (i < num ? t[i] : KING);
+    colors[i] = (i < num ? c[i] : WHITE);
+    subTables[i] = nullptr;
+  }
+}
+
+
+/**
+ * Return the material string of this table
+ */
+std::string const & Tablebase::getMaterial() const { return material; }
+
+
+/**
+ * Return the number of pieces of the table
+ */
+int Tablebase::getNumPieces() const { return numPieces; }
+
+
+/**
+ * Return the table reached by capturing the piece in a slot
+ */
+Tablebase const* Tablebase::getSubTable(int slot) const { return subTables[slot]; }
+
+
+/**
+ * Return the material string left after capturing the piece in a slot
+ */
+std::string Tablebase::subMaterial(int slot) const
+{
+  std::string sub[2];
+  for(int i = 0; i < numPieces; i++)
+  {
+    if(i == slot) continue;
+    char letter = "KQRBNP"[types[i]];
+    if(i < 2) sub[colors[i] == WHITE ? 0 : 1].insert(0,1,letter);
+    else sub[colors[i] == WHITE ? 0 : 1] += letter;
+  }
+  return sub[0] + sub[1];
+}
+
+
+/**
+ * Parse a material string into the table's piece order
+ */
+bool Tablebase::parseMaterial(std::string const & mat, int& num, PieceType* t, bool* c)
+{
+  if(mat.empty() || mat[0] != 'K') return false;
+
+  std::size_t const SECOND_KING = mat.find('K',1);
+  if(SECOND_KING == std::string::npos || mat.find('K',SECOND_KING+1) != std::string::npos)
+    return false;
+  if(mat.size() > MAX_TB_PIECES) return false;
+
+  num = 0;
+  t[num] = KING; c[num++] = WHITE;
+  t[num] = KING; c[num++] = BLACK;
+
+  for(std::size_t i = 1; i < mat.size(); i++)
+  {
+    if(i == SECOND_KING) continue;
+
+    switch(mat[i])
+    {
+    case 'Q':
+      t[num] = QUEEN; break;
+    case 'R':
+      t[num] = ROOK; break;
+    case 'B':
+      t[num] = BISHOP; break;
+    case 'N':
+      t[num] = KNIGHT; break;
+    default:
+      return false; // pawns need promotions, which the rules do not have
+    }
+    c[num++] = (i < SECOND_KING ? WHITE : BLACK);
+  }
+  return true;
+}
+
+
+/**
+ * Return the number of entries of the table
+ */
+std::size_t Tablebase::size() const
+{
+  std::size_t n = 2 * TB_KING_SLOTS;
+  for(int i = 1; i < numPieces; i++) n *= NUM_SQUARES;
+  return n;
+}
+
+
+/**
+ * Return the index of a position, -1 if it is not a representative or if squares collide
+ */
+long Tablebase::indexOf(TbPosition const & pos) const
+{
+  if(canonicalTransform(pos,numPieces) != 0) return -1;
+
+  for(int i = 0; i < numPieces; i++)
+    for(int j = i+1; j < numPieces; j++)
+      if(pos.sq[i] == pos.sq[j]) return -1;
+
+  long index = (pos.turn == WHITE ? 0 : 1) * TB_KING_SLOTS + kingSlot(pos.sq[0]);
+  for(int i = 1; i < numPieces; i++) index = index*NUM_SQUARES + pos.sq[i];
+  return index;
+}
+
+
+/**
+ * Return the index of the representative of the symmetry class of a position
+ */
+long Tablebase::canonicalIndexOf(TbPosition const & pos) const
+{
+  int t = canonicalTransform(pos,numPieces);
+  if(t == 0) return indexOf(pos);
+
+  TbPosition c = pos;
+  for(int i = 0; i < numPieces; i++) c.sq[i] = transformSquare(pos.sq[i],t);
+  return indexOf(c);
+}
+
+
+/**
+ * Inverse of indexOf()
+ */
+static TbPosition decodeIndex(long index, int num)
+{
+  TbPosition pos;
+  for(int i = num-1; i >= 1; i--)
+  {
+    pos.sq[i] = int(index % NUM_SQUARES); index /= NUM_SQUARES;
+  }
+  pos.sq[0] = slotSquare(int(index % TB_KING_SLOTS));
+  pos.turn = (index / TB_KING_SLOTS == 0 ? WHITE : BLACK);
+  return pos;
+}
+
+
+/**
+ * Return the raw value stored for an index
+ */
+int16_t Tablebase::rawValue(long index) const
+{
+  if(index < 0) return TB_VAL_ILLEGAL;
+  if(file) return file->dtmValue(index);
+  return table[index];
+}
+
+
+/**
+ * Value of the position reached by a move, from the point of view of its side to move
+ */
+static int16_t childValue(Tablebase const & tb, Tablebase const * const * subTables,
+                          TbChild const & c, int num)
+{
+  if(c.captured < 0) return tb.rawValue(tb.canonicalIndexOf(c.pos));
+
+  if(num == 3) return TB_VAL_DRAW; // bare kings
+  Tablebase const * sub = subTables[c.captured];
+  if(!sub) return TB_VAL_ILLEGAL; // unknown: the sub-table was not loaded
+  return sub->rawValue(sub->canonicalIndexOf(removeSlot(c.pos,c.captured,num)));
+}
+
+
+/**
+ * Look up a position given in this table's piece order
+ */
+TbResult Tablebase::probe(TbPosition const & pos) const
+{
+  TbResult result;
+  result.found = false; result.wdl = TB_DRAW; result.dtm = 0;
+
+  // Files don't keep the illegal positions, so test for them here
+  long const INDEX = canonicalIndexOf(pos);
+  if(INDEX < 0) return result;
+
+  TbScratch s(numPieces,types,colors);
+  s.place(pos);
+  if(s.isAttacked(pos.sq[pos.turn == WHITE ? 1 : 0],pos.turn,-1)) return result;
+
+  int16_t v = rawValue(INDEX);
+  if(v == TB_VAL_ILLEGAL) return result;
+
+  result.found = true;
+  result.wdl = (tbIsWin(v) ? TB_WIN : (tbIsLoss(v) ? TB_LOSS : TB_DRAW));
+  result.dtm = tbDtm(v);
+
+  // Pick the move keeping the value: the fastest mate, the longest defence or a drawing move
+  TbChild children[MAX_TB_MOVES];
+  int n = generateChildren(s,pos,children);
+
+  int bestDtm = -1;
+  for(int i = 0; i < n; i++)
+  {
+    int16_t cv = childValue(*this,subTables,children[i],numPieces);
+    bool better = false;
+    if(result.wdl == TB_WIN)
+      better = tbIsLoss(cv) && tbDtm(cv)+1 == result.dtm;
+    else if(result.wdl == TB_LOSS)
+      better = tbIsWin(cv) && tbDtm(cv) > bestDtm;
+    else
+      better = (cv == TB_VAL_DRAW) && bestDtm < 0;
+
+    if(better)
+    {
+      bestDtm = tbDtm(cv);
+      result.bestMove = children[i].move;
+      if(result.wdl == TB_WIN) break;
+    }
+  }
+  return result;
+}
+
+
+/**
+ * Map the pieces of a chess board onto this table's piece order
+ */
+bool Tablebase::positionOf(ChessBoard const & cb, TbPosition& pos, bool& flipped) const
+{
+  int total = 0;
+  for(int r = 0; r < BOARD_SIZE; r++)
+    for(int f = 0; f < BOARD_SIZE; f++)
+      if(cb.pieceAt(r,f)) total++;
+  if(total != numPieces) return false;
+
+  // Try the material as it is, then with the colours swapped
+  for(int flip = 0; flip < 2; flip++)
+  {
+    bool used[BOARD_SIZE][BOARD_SIZE] = {};
+    int assigned = 0;
+
+    for(int i = 0; i < numPieces; i++)
+    {
+      bool color = (flip ? !colors[i] : colors[i]);
+      bool ok = false;
+      for(int r = 0; r < BOARD_SIZE && !ok; r++)
+      {
+        for(int f = 0; f < BOARD_SIZE && !ok; f++)
+        {
+          Piece* p = cb.pieceAt(r,f);
+          if(!p || used[r][f] || p->getType() != types[i] || p->getColor() != color) continue;
+
+          used[r][f] = true; ok = true;
+          pos.sq[i] = (flip ? BOARD_SIZE-1-r : r)*BOARD_SIZE + f;
+        }
+      }
+      if(!ok) break;
+      assigned++;
+    }
+    if(assigned != numPieces) continue;
+
+    pos.turn = (flip ? !cb.getMoveTurn() : cb.getMoveTurn());
+    flipped = flip;
+    return true;
+  }
+  return false;
+}
+
+
+/**
+ * Look up the current position of a chess board
+ */
+TbResult Tablebase::probe(ChessBoard const & cb) const
+{
+  TbPosition pos; bool flipped;
+  if(!positionOf(cb,pos,flipped))
+  {
+    TbResult notFound;
+    notFound.found = false; notFound.wdl = TB_DRAW; notFound.dtm = 0;
+    return notFound;
+  }
+
+  TbResult result = probe(pos);
+  if(flipped)
+  {
+    result.bestMove.rankS = BOARD_SIZE-1-result.bestMove.rankS;
+    result.bestMove.rankD = BOARD_SIZE-1-result.bestMove.rankD;
+  }
+  return result;
+}
+
+
+/**
+ * Win/draw/loss only look-up of a chess board
+ */
+bool Tablebase::probeWDL(ChessBoard const & cb, TbWDL& wdl) const
+{
+  TbPosition pos; bool flipped;
+  if(!positionOf(cb,pos,flipped)) return false;
+
+  long const INDEX = canonicalIndexOf(pos);
+  if(INDEX < 0) return false;
+
+  if(file)
+  {
+    // Files don't keep the illegal positions, so test for them here as probe() does
+    TbScratch s(numPieces,types,colors);
+    s.place(pos);
+    if(s.isAttacked(pos.sq[pos.turn == WHITE ? 1 : 0],pos.turn,-1)) return false;
+
+    return file->wdlValue(INDEX,wdl);
+  }
+
+  int16_t v = table[INDEX];
+  if(v == TB_VAL_ILLEGAL) return false;
+  wdl = (tbIsWin(v) ? TB_WIN : (tbIsLoss(v) ? TB_LOSS : TB_DRAW));
+  return true;
+}
+
+
+/**
+ * Win/draw/loss and distance to mate look-up of a chess board
+ */
+bool Tablebase::probeValue(ChessBoard const & cb, TbWDL& wdl, int& dtm) const
+{
+  TbPosition pos; bool flipped;
+  if(!positionOf(cb,pos,flipped)) return false;
+
+  long const INDEX = canonicalIndexOf(pos);
+  if(INDEX < 0) return false;
+
+  if(file)
+  {
+    // Files don't keep the illegal positions, so test for them here as probe() does
+    TbScratch s(numPieces,types,colors);
+    s.place(pos);
+    if(s.isAttacked(pos.sq[pos.turn == WHITE ? 1 : 0],pos.turn,-1)) return false;
+  }
+
+  int16_t const V = rawValue(INDEX);
+  if(V == TB_VAL_ILLEGAL) return false;
+  wdl = (tbIsWin(V) ? TB_WIN : (tbIsLoss(V) ? TB_LOSS : TB_DRAW));
+  dtm = tbDtm(V);
+  return true;
+}
+
+
+/**
+ * Number of won / drawn / lost / illegal entries
+ */
+void Tablebase::countResults(long& wins, long& draws, long& losses, long& illegal) const
+{
+  wins = draws = losses = illegal = 0;
+  for(int16_t v : table)
+  {
+    if(v == TB_VAL_ILLEGAL) illegal++;
+    else if(tbIsWin(v)) wins++;
+    else if(tbIsLoss(v)) losses++;
+    else draws++;
+  }
+}
+
+
+/**
+ * Return the longest distance to mate in plies
+ */
+int Tablebase::longestMate() const
+{
+  int longest = 0;
+  for(int16_t v : table)
+    if(v != TB_VAL_ILLEGAL) longest = std::max(longest,tbDtm(v));
+  return longest;
+}
+
+
+
+/*===== TablebaseGenerator =====*/
+
+TablebaseGenerator::TablebaseGenerator(int n): numThreads(n)
+{
+  if(numThreads <= 0) numThreads = std::max(1u,std::thread::hardware_concurrency());
+}
+
+
+/**
+ * Return the table of a material set, generating it if necessary
+ */
+Tablebase const* TablebaseGenerator::generate(std::string const & material)
+{
+  std::map<std::string, Tablebase*>::iterator it = tables.find(material);
+  if(it != tables.end()) return it->second;
+
+  int num; PieceType t[MAX_TB_PIECES]; bool c[MAX_TB_PIECES];
+  if(!Tablebase::parseMaterial(material,num,t,c)) return nullptr;
+
+  Tablebase* tb = new Tablebase(material,num,t,c);
+
+  // The tables reached by a capture come first
+  if(num > 3)
+    for(int j = 2; j < num; j++) tb->subTables[j] = generate(tb->subMaterial(j));
+
+  build(tb);
+  tables[material] = tb;
+  return tb;
+}
+
+
+/**
+ * Return an already generated table
+ */
+Tablebase const* TablebaseGenerator::find(std::string const & material) const
+{
+  std::map<std::string, Tablebase*>::const_iterator it = tables.find(material);
+  return it == tables.end() ? nullptr : it->second;
+}
+
+
+/**
+ * Retrograde analysis of one table.
+ * 1. Every position counts its distinct successors within the table; the moves that capture
+ *    are resolved at once from the sub-tables. Checkmates are queued as losses in 0.
+ * 2. Plies are then processed in increasing order: a position lost in n plies makes all its
+ *    predecessors won in n+1, and a position won in n plies decrements the counter of its
+ *    predecessors, which are lost once it drops to zero.
+ * Each ply is split among the threads; the values are claimed with compare-and-swap so that
+ * every position is resolved exactly once, at its shortest distance.
+ */
+void TablebaseGenerator::build(Tablebase* tb)
+{
+  int const NUM = tb->numPieces;
+  long const SIZE = long(tb->size());
+
+  std::vector<std::atomic<int16_t>> value(SIZE);
+  std::vector<std::atomic<uint8_t>> remaining(SIZE);
+  std::vector<uint16_t> captureLoss(SIZE); // longest loss via a capture + 1, 0 if none
+  std::vector<uint8_t> captureWin(SIZE); // 1 if a capture wins
+
+  // Queued entries: (index << 1) | 1 for a loss, (index << 1) for a win
+  std::vector<std::vector<uint32_t>> queue(1);
+  std::vector<std::vector<std::vector<uint32_t>>> local(numThreads);
+
+  auto push = [](std::vector<std::vector<uint32_t>>& q, int ply, long index, bool loss)
+  {
+    if(int(q.size()) <= ply) q.resize(ply+1);
+    q[ply].push_back(uint32_t((index << 1) | (loss ? 1 : 0)));
+  };
+
+  auto mergeLocal = [&]()
+  {
+    for(std::vector<std::vector<uint32_t>>& q : local)
+    {
+      for(int ply = 0; ply < int(q.size()); ply++)
+      {
+        if(int(queue.size()) <= ply) queue.resize(ply+1);
+        queue[ply].insert(queue[ply].end(),q[ply].begin(),q[ply].end());
+        q[ply].clear();
+      }
+    }
+  };
+
+  //=== 1. Initialisation
+  parallelFor(SIZE,numThreads,[&](int tid, long begin, long end)
+  {
+    TbScratch s(NUM,tb->types,tb->colors);
+    TbChild children[MAX_TB_MOVES];
+    long successors[MAX_TB_MOVES];
+
+    for(long i = begin; i < end; i++)
+    {
+      TbPosition pos = decodeIndex(i,NUM);
+      if(tb->indexOf(pos) != i)
+      {
+        value[i].store(TB_VAL_ILLEGAL,std::memory_order_relaxed); continue;
+      }
+
+      s.place(pos);
+      int const THEIR_KING = (pos.turn == WHITE ? 1 : 0);
+      if(s.isAttacked(pos.sq[THEIR_KING],pos.turn,-1))
+      {
+        value[i].store(TB_VAL_ILLEGAL,std::memory_order_relaxed); continue;
+      }
+
+      int n = generateChildren(s,pos,children);
+      if(n == 0)
+      {
+        if(s.isAttacked(pos.sq[1-THEIR_KING],!pos.turn,-1)) push(local[tid],0,i,true);
+        continue; // otherwise stalemate: stays a draw
+      }
+
+      int numSucc = 0, bestWin = INT_MAX, worstLoss = 0;
+      bool drawExit = false;
+      for(int k = 0; k < n; k++)
+      {
+        if(children[k].captured < 0)
+        {
+          successors[numSucc++] = tb->canonicalIndexOf(children[k].pos);
+          continue;
+        }
+
+        int16_t cv = childValue(*tb,tb->subTables,children[k],NUM);
+        if(tbIsLoss(cv)) bestWin = std::min(bestWin,tbDtm(cv)+1);
+        else if(tbIsWin(cv)) worstLoss = std::max(worstLoss,tbDtm(cv)+1);
+        else drawExit = true;
+      }
+      numSucc = uniqueIndices(successors,numSucc);
+
+      remaining[i].store(uint8_t(numSucc + (drawExit ? 1 : 0)),std::memory_order_relaxed);
+      captureLoss[i] = uint16_t(worstLoss);
+      if(bestWin != INT_MAX)
+      {
+        captureWin[i] = 1;
+        push(local[tid],bestWin,i,false);
+      }
+      else if(numSucc == 0 && !drawExit)
+        push(local[tid],worstLoss,i,true);
+    }
+  });
+  mergeLocal();
+
+  //=== 2. Retrograde propagation, ply by ply
+  for(int ply = 0; ply < int(queue.size()); ply++)
+  {
+    std::vector<uint32_t> entries;
+    entries.swap(queue[ply]);
+
+    parallelFor(long(entries.size()),numThreads,[&](int tid, long begin, long end)
+    {
+      TbScratch s(NUM,tb->types,tb->colors);
+      TbPosition parents[MAX_TB_MOVES];
+      long parentIndex[MAX_TB_MOVES];
+
+      for(long e = begin; e < end; e++)
+      {
+        long const INDEX = long(entries[e] >> 1);
+        bool const LOSS = entries[e] & 1;
+
+        int16_t expected = TB_VAL_DRAW;
+        if(!value[INDEX].compare_exchange_strong(expected,LOSS ? tbLossValue(ply) : tbWinValue(ply)))
+          continue; // already resolved at a shorter distance
+
+        TbPosition pos = decodeIndex(INDEX,NUM);
+        s.place(pos);
+        int n = generateParents(s,pos,parents);
+        for(int k = 0; k < n; k++) parentIndex[k] = tb->canonicalIndexOf(parents[k]);
+        n = uniqueIndices(parentIndex,n);
+
+        for(int k = 0; k < n; k++)
+        {
+          long const P = parentIndex[k];
+          if(value[P].load(std::memory_order_relaxed) != TB_VAL_DRAW) continue;
+
+          if(LOSS)
+            push(local[tid],ply+1,P,false);
+          else if(!captureWin[P] && remaining[P].fetch_sub(1) == 1)
+            push(local[tid],std::max(ply+1,int(captureLoss[P])),P,true);
+        }
+      }
+    });
+    mergeLocal();
+  }
+
+  tb->table.resize(SIZE);
+  for(long i = 0; i < SIZE; i++) tb->table[i] = value[i].load(std::memory_order_relaxed);
+}
+
+
+TablebaseGenerator::~TablebaseGenerator()
+{
+  for(std::map<std::string, Tablebase*>::iterator it = tables.begin(); it != tables.end(); it++)
+    delete it->second;
+}
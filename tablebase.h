@@ -0,0 +1,206 @@
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include "piece.h"
+#include "move.h"
+
+class ChessBoard;
+class TbFile;
+
+#define MAX_TB_PIECES 5 // kings included
+#define TB_KING_SLOTS 10 // squares of the a1-d1-d4 triangle the white king is mapped into
+
+/*===== VALUE ENCODING =====*/
+// 0 is a draw (and "not resolved yet" during the generation), a win in d plies is stored as
+// +d (d >= 1) and a loss in d plies as -(d+1) so that being checkmated now is -1
+static const int16_t TB_VAL_DRAW = 0;
+static const int16_t TB_VAL_ILLEGAL = INT16_MIN;
+
+inline int16_t tbWinValue(int d) { return int16_t(d); }
+inline int16_t tbLossValue(int d) { return int16_t(-(d+1)); }
+inline bool tbIsWin(int16_t v) { return v > 0; }
+inline bool tbIsLoss(int16_t v) { return v < 0 && v != TB_VAL_ILLEGAL; }
+inline int tbDtm(int16_t v) { return v > 0 ? v : (v < 0 ? -v-1 : 0); }
+
+
+/*===== RESULT OF A PROBE =====*/
+enum TbWDL {TB_LOSS = -1, TB_DRAW = 0, TB_WIN = 1}; // from the side to move's point of view
+
+#define TB_WIN_SCORE 20000 // ChessBoard::evaluate() of a won position, less its distance to mate
+
+struct TbResult
+{
+  bool found; // false if the position does not belong to the table (or is illegal)
+  TbWDL wdl;
+  int dtm; // distance to mate in plies, 0 for a draw or if the side to move is checkmated
+  Move bestMove; // only meaningful if found and the side to move has a legal move
+};
+
+
+/*===== A POSITION OF A MATERIAL SET =====*/
+struct TbPosition
+{
+  int sq[MAX_TB_PIECES]; // square (rank*BOARD_SIZE+file) of each piece, in the table's order
+  bool turn; // side to move
+};
+
+
+/*===== AN IN-MEMORY ENDGAME TABLE =====*/
+/**
+ * Distance-to-mate table of a pawnless material set such as "KQK", "KRK" or "KBNK" (white's
+ * pieces first, then black's starting with the second K).
+ * The pieces are indexed as white king, black king, then white's and black's other pieces in
+ * the order of the material string. Positions are reduced by the 8 symmetries of the board
+ * so that the white king always stands in the a1-d1-d4 triangle.
+ */
+class Tablebase
+{
+  friend class TablebaseGenerator;
+  friend class EndgameTables;
+
+  std::string material;
+  int numPieces;
+  PieceType types[MAX_TB_PIECES];
+  bool colors[MAX_TB_PIECES];
+
+  std::vector<int16_t> table; // one entry per index, see the value encoding above
+  Tablebase const* subTables[MAX_TB_PIECES]; // table after capturing piece i, nullptr if K vs K
+  TbFile const* file; // if not nullptr, the values are read from this file instead of table
+
+  Tablebase(std::string const & mat, int num, PieceType const * t, bool const * c);
+
+  /**
+   * Map the pieces of a chess board onto this table's piece order, swapping the colours (and
+   * mirroring the ranks) if that is what makes them match. Returns false if they don't
+   */
+  bool positionOf(ChessBoard const & cb, TbPosition& pos, bool& flipped) const;
+
+ public:
+
+  /**
+   * Return the material string of this table, e.g. "KBNK"
+   */
+  std::string const & getMaterial() const;
+
+  /**
+   * Return the number of pieces (kings included) of the table
+   */
+  int getNumPieces() const;
+
+  /**
+   * Return the table reached by capturing the piece in a slot, nullptr if only the kings
+   * remain or if it has not been generated / loaded
+   */
+  Tablebase const* getSubTable(int slot) const;
+
+  /**
+   * Return the material string left after capturing the piece in a slot, e.g. "KRK" for the
+   * queen (slot 2) of "KQKR"
+   */
+  std::string subMaterial(int slot) const;
+
+  /**
+   * Parse a material string such as "KQK" or "KBNK" into the table's piece order: white king,
+   * black king, white's other pieces, black's other pieces. Returns false if not supported
+   */
+  static bool parseMaterial(std::string const & mat, int& num, PieceType* t, bool* c);
+
+  /**
+   * Return the number of entries (both sides to move) of the table
+   */
+  std::size_t size() const;
+
+  /**
+   * Return the index of a position, or -1 if it is not the representative of its symmetry
+   * class or if two pieces share a square
+   */
+  long indexOf(TbPosition const & pos) const;
+
+  /**
+   * Return the index of the representative of the symmetry class of a position
+   */
+  long canonicalIndexOf(TbPosition const & pos) const;
+
+  /**
+   * Return the raw value stored for an index
+   */
+  int16_t rawValue(long index) const;
+
+  /**
+   * Look up a position given in this table's piece order. The best move is searched with the
+   * same move rules as the generation and is given in the coordinates of pos
+   */
+  TbResult probe(TbPosition const & pos) const;
+
+  /**
+   * Look up the current position of a chess board. Either side may own the stronger
+   * material, e.g. a KQK table also answers for a black king and queen against a white king
+   */
+  TbResult probe(ChessBoard const & cb) const;
+
+  /**
+   * Win/draw/loss only look-up of a chess board, without searching for the best move.
+   * Tables loaded from a file answer from the (smaller) win/draw/loss section
+   */
+  bool probeWDL(ChessBoard const & cb, TbWDL& wdl) const;
+
+  /**
+   * Win/draw/loss and distance to mate look-up of a chess board, without searching for the
+   * best move either
+   */
+  bool probeValue(ChessBoard const & cb, TbWDL& wdl, int& dtm) const;
+
+  /**
+   * Number of won / drawn / lost / illegal entries, for reporting (in-memory tables only)
+   */
+  void countResults(long& wins, long& draws, long& losses, long& illegal) const;
+
+  /**
+   * Return the longest distance to mate of the table in plies
+   */
+  int longestMate() const;
+};
+
+
+/*===== GENERATOR =====*/
+/**
+ * Builds tables by retrograde analysis. The sub-tables reached by a capture (e.g. KRK from
+ * KQKR) are generated first and kept by the generator, which owns every table it returns
+ */
+class TablebaseGenerator
+{
+  std::map<std::string, Tablebase*> tables;
+  int numThreads;
+
+  /**
+   * Build one table, provided that all its sub-tables exist
+   */
+  void build(Tablebase* tb);
+
+ public:
+
+  /**
+   * numThreads <= 0 means one thread per hardware thread
+   */
+  explicit TablebaseGenerator(int numThreads = 0);
+
+  /**
+   * Return the table of a material set, generating it (and its sub-tables) if necessary.
+   * Returns nullptr if the material set is not supported
+   */
+  Tablebase const* generate(std::string const & material);
+
+  /**
+   * Return an already generated table, nullptr if none
+   */
+  Tablebase const* find(std::string const & material) const;
+
+  ~TablebaseGenerator();
+};
+
+
+#endif
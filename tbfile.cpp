@@ -0,0 +1,453 @@
+#include "tbfile.h"
+#include "ChessBoard.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static char const TB_MAGIC[4] = {'M','C','T','B'};
+static uint32_t const TB_VERSION = 1;
+
+
+/*===== RUN-LENGTH CODING =====*/
+
+static void putVarint(vector<unsigned char>& out, uint64_t v)
+{
+  while(v >= 0x80)
+  {
+    out.push_back((unsigned char)(v | 0x80)); v >>= 7;
+  }
+  out.push_back((unsigned char)v);
+}
+
+/**
+ * Read a varint ending before end; returns false if it doesn't
+ */
+static bool getVarint(unsigned char const *& in, unsigned char const * end, uint64_t& v)
+{
+  v = 0;
+  for(int shift = 0; in < end && shift < 64; shift += 7)
+  {
+    unsigned char b = *in++;
+    v |= uint64_t(b & 0x7f) << shift;
+    if(!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+/**
+ * Win/draw/loss symbol of a raw value: 0 = loss, 1 = draw, 2 = win
+ */
+static inline int wdlSymbol(int16_t v) { return tbIsWin(v) ? 2 : (tbIsLoss(v) ? 0 : 1); }
+
+/**
+ * Compress the entries [begin, end) of a table as a run-length coded block of a section
+ */
+static void compressBlock(Tablebase const & tb, bool dtm, long begin, long end,
+                          vector<unsigned char>& out)
+{
+  long run = 0; // length of the current run, leading "don't care" entries included
+  int16_t current = 0; bool started = false;
+
+  auto flush = [&]()
+  {
+    if(dtm)
+    {
+      putVarint(out,uint32_t((current << 1) ^ (current >> 15)) & 0xffff);
+      putVarint(out,uint64_t(run));
+    }
+    else
+      putVarint(out,(uint64_t(run) << 2) | uint64_t(wdlSymbol(current)));
+  };
+
+  for(long i = begin; i < end; i++)
+  {
+    int16_t v = tb.rawValue(i);
+    if(v == TB_VAL_ILLEGAL) { run++; continue; } // don't care: extend the current run
+
+    if(!dtm) v = int16_t(wdlSymbol(v) - 1); // only the sign matters
+    if(started && v != current)
+    {
+      flush(); run = 0;
+    }
+    current = v; started = true; run++;
+  }
+  flush();
+}
+
+
+/*===== TbFile =====*/
+
+TbFile::TbFile(): fd(-1), data(nullptr), dataSize(0), header(nullptr), hits(0), misses(0)
+{
+  offsets[0] = offsets[1] = nullptr;
+}
+
+
+/**
+ * Compress a generated table into a file
+ */
+bool TbFile::write(Tablebase const & tb, std::string const & path)
+{
+  TbFileHeader h;
+  memset(&h,0,sizeof(h));
+  memcpy(h.magic,TB_MAGIC,4);
+  h.version = TB_VERSION;
+  strncpy(h.material,tb.getMaterial().c_str(),sizeof(h.material)-1);
+  h.entries = tb.size();
+  h.blockEntries = TB_BLOCK_ENTRIES;
+  h.numBlocks = uint32_t((h.entries + TB_BLOCK_ENTRIES - 1) / TB_BLOCK_ENTRIES);
+
+  // Compress both sections
+  vector<unsigned char> blocks[2];
+  vector<uint64_t> blockOffsets[2];
+  for(int s = 0; s < 2; s++)
+  {
+    for(uint32_t b = 0; b < h.numBlocks; b++)
+    {
+      blockOffsets[s].push_back(blocks[s].size());
+      long begin = long(b) * TB_BLOCK_ENTRIES;
+      compressBlock(tb,s == DTM_SECTION,begin,min(long(h.entries),begin+TB_BLOCK_ENTRIES),
+                    blocks[s]);
+    }
+    blockOffsets[s].push_back(blocks[s].size());
+  }
+
+  // Lay out: header, offsets of both sections, then the blocks
+  uint64_t const OFFSETS_SIZE = (uint64_t(h.numBlocks) + 1) * sizeof(uint64_t);
+  h.wdlOffsets = sizeof(h);
+  h.dtmOffsets = h.wdlOffsets + OFFSETS_SIZE;
+  uint64_t base[2] = {h.dtmOffsets + OFFSETS_SIZE, 0};
+  base[1] = base[0] + blocks[0].size();
+  for(int s = 0; s < 2; s++)
+    for(uint64_t& o : blockOffsets[s]) o += base[s];
+
+  ofstream out(path.c_str(),ios::binary | ios::trunc);
+  if(!out)
+  {
+    cerr << "Cannot create the table file " << path << "!" << endl;
+    return false;
+  }
+  out.write(reinterpret_cast<char const *>(&h),sizeof(h));
+  for(int s = 0; s < 2; s++)
+    out.write(reinterpret_cast<char const *>(blockOffsets[s].data()),OFFSETS_SIZE);
+  for(int s = 0; s < 2; s++)
+    out.write(reinterpret_cast<char const *>(blocks[s].data()),blocks[s].size());
+
+  return bool(out);
+}
+
+
+/**
+ * Map a table file
+ */
+TbFile* TbFile::open(std::string const & path)
+{
+  int fd = ::open(path.c_str(),O_RDONLY);
+  if(fd < 0)
+  {
+    cerr << "Cannot open the table file " << path << "!" << endl;
+    return nullptr;
+  }
+
+  struct stat st;
+  if(fstat(fd,&st) != 0 || std::size_t(st.st_size) < sizeof(TbFileHeader))
+  {
+    cerr << path << " is not a table file!" << endl;
+    ::close(fd); return nullptr;
+  }
+
+  void* m = mmap(nullptr,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+  if(m == MAP_FAILED)
+  {
+    cerr << "Cannot map the table file " << path << "!" << endl;
+    ::close(fd); return nullptr;
+  }
+  madvise(m,st.st_size,MADV_RANDOM); // probes jump around: no read-ahead
+
+  TbFile* f = new TbFile();
+  f->fd = fd;
+  f->data = static_cast<unsigned char const *>(m);
+  f->dataSize = st.st_size;
+  f->header = reinterpret_cast<TbFileHeader const *>(f->data);
+
+  // Validate the header and the offset tables
+  TbFileHeader const & h = *f->header;
+  uint64_t const OFFSETS_SIZE = (uint64_t(h.numBlocks) + 1) * sizeof(uint64_t);
+  bool ok = memcmp(h.magic,TB_MAGIC,4) == 0 && h.version == TB_VERSION &&
+            h.blockEntries == TB_BLOCK_ENTRIES &&
+            h.numBlocks == (h.entries + h.blockEntries - 1) / h.blockEntries &&
+            h.wdlOffsets + OFFSETS_SIZE <= f->dataSize &&
+            h.dtmOffsets + OFFSETS_SIZE <= f->dataSize &&
+            memchr(h.material,'\0',sizeof(h.material)) != nullptr;
+  if(ok)
+  {
+    f->offsets[WDL_SECTION] = reinterpret_cast<uint64_t const *>(f->data + h.wdlOffsets);
+    f->offsets[DTM_SECTION] = reinterpret_cast<uint64_t const *>(f->data + h.dtmOffsets);
+    // Every block must lie after the offset tables, inside the file, and not end before
+    // it starts
+    uint64_t const DATA_START = max(h.wdlOffsets,h.dtmOffsets) + OFFSETS_SIZE;
+    for(int s = 0; s < 2 && ok; s++)
+    {
+      uint64_t const * const o = f->offsets[s];
+      ok = o[0] >= DATA_START && o[h.numBlocks] <= f->dataSize;
+      for(uint32_t b = 0; b < h.numBlocks && ok; b++) ok = o[b] <= o[b+1];
+    }
+  }
+  if(!ok)
+  {
+    cerr << path << " is not a valid table file!" << endl;
+    delete f; return nullptr;
+  }
+  return f;
+}
+
+
+/**
+ * Return the material string stored in the header
+ */
+std::string TbFile::getMaterial() const { return std::string(header->material); }
+
+
+/**
+ * Decompress one block of a section. A corrupt block (a run going past its end or past the
+ * block, or of length 0) decompresses as TB_VAL_ILLEGAL entries, i.e. unknown
+ */
+bool TbFile::decompress(Section section, uint32_t block, int16_t* out) const
+{
+  unsigned char const * in = data + offsets[section][block];
+  unsigned char const * const END = data + offsets[section][block+1];
+  long const COUNT = min<long>(header->blockEntries,
+                               long(header->entries) - long(block) * header->blockEntries);
+
+  for(long n = 0; n < COUNT; )
+  {
+    int16_t v; uint64_t run;
+    bool ok;
+    if(section == DTM_SECTION)
+    {
+      uint64_t z;
+      ok = getVarint(in,END,z) && getVarint(in,END,run);
+      v = int16_t((uint32_t(z) >> 1) ^ -(uint32_t(z) & 1));
+    }
+    else
+    {
+      uint64_t r;
+      ok = getVarint(in,END,r);
+      v = int16_t(int(r & 3) - 1);
+      run = r >> 2;
+    }
+    if(!ok || run == 0 || run > uint64_t(COUNT - n))
+    {
+      cerr << "Block " << block << " of the table file " << header->material
+           << " is corrupt!" << endl;
+      for(long i = 0; i < COUNT; i++) out[i] = TB_VAL_ILLEGAL;
+      return false;
+    }
+    for(uint64_t i = 0; i < run; i++) out[n++] = v;
+  }
+  return true;
+}
+
+
+/**
+ * Return a value of a section, through the LRU of decompressed blocks
+ */
+int16_t TbFile::value(Section section, long index) const
+{
+  uint32_t const BLOCK = uint32_t(index / header->blockEntries);
+  uint64_t const KEY = (uint64_t(section) << 32) | BLOCK;
+
+  std::lock_guard<std::mutex> guard(cacheLock);
+
+  std::unordered_map<uint64_t, std::list<CachedBlock>::iterator>::iterator it =
+    cacheIndex.find(KEY);
+  if(it != cacheIndex.end())
+  {
+    hits++;
+    cache.splice(cache.begin(),cache,it->second); // now the most recently used
+    return it->second->values[index % header->blockEntries];
+  }
+
+  // Miss: take a new entry while there is room, otherwise recycle the least recently used
+  misses++;
+  if(cache.size() < TB_CACHE_BLOCKS)
+    cache.push_front(CachedBlock{KEY,std::vector<int16_t>(header->blockEntries)});
+  else
+  {
+    cacheIndex.erase(cache.back().key);
+    cache.splice(cache.begin(),cache,std::prev(cache.end()));
+    cache.front().key = KEY;
+  }
+  cacheIndex[KEY] = cache.begin();
+
+  decompress(section,BLOCK,cache.front().values.data());
+  return cache.front().values[index % header->blockEntries];
+}
+
+
+/**
+ * Return the raw value of an index
+ */
+int16_t TbFile::dtmValue(long index) const { return value(DTM_SECTION,index); }
+
+
+/**
+ * Return the win/draw/loss value of an index
+ */
+bool TbFile::wdlValue(long index, TbWDL& wdl) const
+{
+  int16_t const V = value(WDL_SECTION,index);
+  if(V == TB_VAL_ILLEGAL) return false;
+  wdl = TbWDL(V);
+  return true;
+}
+
+
+/**
+ * Return the size of the file
+ */
+std::size_t TbFile::fileSize() const { return dataSize; }
+
+
+/**
+ * Return the cache statistics
+ */
+void TbFile::cacheStats(unsigned long& numHits, unsigned long& numMisses) const
+{
+  std::lock_guard<std::mutex> guard(cacheLock);
+  numHits = hits; numMisses = misses;
+}
+
+
+TbFile::~TbFile()
+{
+  if(data) munmap(const_cast<unsigned char*>(data),dataSize);
+  if(fd >= 0) ::close(fd);
+}
+
+
+
+/*===== EndgameTables =====*/
+
+EndgameTables::EndgameTables(){}
+
+
+/**
+ * Map every table file of a directory
+ */
+int EndgameTables::load(std::string const & dir)
+{
+  DIR* d = opendir(dir.c_str());
+  if(!d)
+  {
+    cerr << "Cannot open the table directory " << dir << "!" << endl;
+    return 0;
+  }
+
+  int loaded = 0;
+  std::string const EXT = TB_FILE_EXT;
+  for(struct dirent* e = readdir(d); e; e = readdir(d))
+  {
+    std::string name = e->d_name;
+    if(name.size() <= EXT.size() || name.compare(name.size()-EXT.size(),EXT.size(),EXT) != 0)
+      continue;
+
+    TbFile* f = TbFile::open(dir + "/" + name);
+    if(!f) continue;
+
+    int num; PieceType t[MAX_TB_PIECES]; bool c[MAX_TB_PIECES];
+    std::string const MATERIAL = f->getMaterial();
+    if(!Tablebase::parseMaterial(MATERIAL,num,t,c) || tables.count(MATERIAL))
+    {
+      delete f; continue;
+    }
+
+    Tablebase* tb = new Tablebase(MATERIAL,num,t,c);
+    tb->file = f;
+    files.push_back(f);
+    tables[MATERIAL] = tb;
+    loaded++;
+  }
+  closedir(d);
+
+  // Link the sub-tables reached by captures
+  for(std::map<std::string, Tablebase*>::iterator it = tables.begin(); it != tables.end(); it++)
+  {
+    Tablebase* tb = it->second;
+    if(tb->numPieces <= 3) continue;
+    for(int j = 2; j < tb->numPieces; j++)
+    {
+      std::map<std::string, Tablebase*>::iterator sub = tables.find(tb->subMaterial(j));
+      tb->subTables[j] = (sub == tables.end() ? nullptr : sub->second);
+    }
+  }
+  return loaded;
+}
+
+
+/**
+ * Return a loaded table
+ */
+Tablebase const* EndgameTables::find(std::string const & material) const
+{
+  std::map<std::string, Tablebase*>::const_iterator it = tables.find(material);
+  return it == tables.end() ? nullptr : it->second;
+}
+
+
+/**
+ * Look up the position of a chess board
+ */
+TbResult EndgameTables::probe(ChessBoard const & cb) const
+{
+  for(std::map<std::string, Tablebase*>::const_iterator it = tables.begin();
+      it != tables.end(); it++)
+  {
+    TbResult result = it->second->probe(cb);
+    if(result.found) return result;
+  }
+
+  TbResult notFound;
+  notFound.found = false; notFound.wdl = TB_DRAW; notFound.dtm = 0;
+  return notFound;
+}
+
+
+/**
+ * Win/draw/loss only look-up
+ */
+bool EndgameTables::probeWDL(ChessBoard const & cb, TbWDL& wdl) const
+{
+  for(std::map<std::string, Tablebase*>::const_iterator it = tables.begin();
+      it != tables.end(); it++)
+    if(it->second->probeWDL(cb,wdl)) return true;
+  return false;
+}
+
+
+/**
+ * Win/draw/loss and distance to mate look-up
+ */
+bool EndgameTables::probeValue(ChessBoard const & cb, TbWDL& wdl, int& dtm) const
+{
+  for(std::map<std::string, Tablebase*>::const_iterator it = tables.begin();
+      it != tables.end(); it++)
+    if(it->second->probeValue(cb,wdl,dtm)) return true;
+  return false;
+}
+
+
+EndgameTables::~EndgameTables()
+{
+  for(std::map<std::string, Tablebase*>::iterator it = tables.begin(); it != tables.end(); it++)
+    delete it->second;
+  for(TbFile* f : files) delete f;
+}
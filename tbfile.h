@@ -0,0 +1,160 @@
+#ifndef TBFILE_H
+#define TBFILE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include "tablebase.h"
+
+#define TB_FILE_EXT ".mctb"
+#define TB_BLOCK_ENTRIES 4096 // entries per compressed block
+#define TB_CACHE_BLOCKS 64 // decompressed blocks kept per file
+
+/*===== FILE LAYOUT =====*/
+/**
+ * A table file starts with this header, followed by the block offset tables and the blocks.
+ * Both sections (win/draw/loss and distance to mate) cover the same indices in blocks of
+ * TB_BLOCK_ENTRIES; block i of a section spans [offsets[i], offsets[i+1]) in the file.
+ * Blocks are run-length coded, illegal positions being "don't care" values that extend the
+ * current run:
+ *  - WDL runs are varints of (length << 2 | symbol) with symbol 0 = loss, 1 = draw, 2 = win
+ *  - DTM runs are a zigzag varint of the value followed by a varint of the length
+ */
+struct TbFileHeader
+{
+  char magic[4]; // "MCTB"
+  uint32_t version;
+  char material[8]; // nul padded
+  uint64_t entries;
+  uint32_t blockEntries;
+  uint32_t numBlocks;
+  uint64_t wdlOffsets; // file offset of the numBlocks+1 uint64 block offsets of each section
+  uint64_t dtmOffsets;
+};
+
+
+/*===== A MEMORY-MAPPED TABLE FILE =====*/
+/**
+ * The file is mapped read-only, so the page cache of the OS is the only cache of the
+ * compressed data. A small LRU keeps the last decompressed blocks of each section
+ */
+class TbFile
+{
+  enum Section {WDL_SECTION = 0, DTM_SECTION = 1};
+
+  struct CachedBlock
+  {
+    uint64_t key; // (section << 32) | block
+    std::vector<int16_t> values;
+  };
+
+  int fd;
+  unsigned char const * data; // the mapping
+  std::size_t dataSize;
+  TbFileHeader const * header;
+  uint64_t const * offsets[2]; // block offsets of each section
+
+  mutable std::mutex cacheLock;
+  mutable std::list<CachedBlock> cache; // most recently used first
+  mutable std::unordered_map<uint64_t, std::list<CachedBlock>::iterator> cacheIndex;
+  mutable unsigned long hits, misses;
+
+  TbFile();
+
+  /**
+   * Return a value of a section, decompressing its block if it is not cached
+   */
+  int16_t value(Section section, long index) const;
+
+  /**
+   * Decompress one block of a section into out (TB_BLOCK_ENTRIES values), returns false
+   * (and fills it with TB_VAL_ILLEGAL) if the block is corrupt
+   */
+  bool decompress(Section section, uint32_t block, int16_t* out) const;
+
+ public:
+
+  /**
+   * Compress a generated table into a file, returns false on I/O errors
+   */
+  static bool write(Tablebase const & tb, std::string const & path);
+
+  /**
+   * Map a table file, returns nullptr (with a message on cerr) if it is not a valid file
+   */
+  static TbFile* open(std::string const & path);
+
+  /**
+   * Return the material string stored in the header
+   */
+  std::string getMaterial() const;
+
+  /**
+   * Return the raw value (see tablebase.h) of an index, for a legal position; TB_VAL_ILLEGAL
+   * if its block is corrupt
+   */
+  int16_t dtmValue(long index) const;
+
+  /**
+   * Find the win/draw/loss value of an index, for a legal position; returns false if its
+   * block is corrupt
+   */
+  bool wdlValue(long index, TbWDL& wdl) const;
+
+  /**
+   * Return the size of the file and the cache statistics, for reporting
+   */
+  std::size_t fileSize() const;
+  void cacheStats(unsigned long& numHits, unsigned long& numMisses) const;
+
+  ~TbFile();
+};
+
+
+/*===== A SET OF TABLE FILES =====*/
+/**
+ * The table files of a directory, with the sub-tables reached by captures linked together
+ */
+class EndgameTables
+{
+  std::vector<TbFile*> files;
+  std::map<std::string, Tablebase*> tables;
+
+ public:
+
+  EndgameTables();
+
+  /**
+   * Map every table file of a directory, returns the number of tables loaded
+   */
+  int load(std::string const & dir);
+
+  /**
+   * Return a loaded table, nullptr if none
+   */
+  Tablebase const* find(std::string const & material) const;
+
+  /**
+   * Look up the position of a chess board in the table of its material, if any
+   */
+  TbResult probe(ChessBoard const & cb) const;
+
+  /**
+   * Win/draw/loss only look-up, returns false if no table covers the position
+   */
+  bool probeWDL(ChessBoard const & cb, TbWDL& wdl) const;
+
+  /**
+   * Win/draw/loss and distance to mate look-up, returns false if no table covers the position
+   */
+  bool probeValue(ChessBoard const & cb, TbWDL& wdl, int& dtm) const;
+
+  ~EndgameTables();
+};
+
+
+#endif
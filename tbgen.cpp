@@ -0,0 +1,72 @@
+#include "tablebase.h"
+#include "tbfile.h"
+#include <iostream>
+#include <set>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+
+/**
+ * Write a table and, recursively, the sub-tables it was generated from
+ */
+static void writeTables(Tablebase const * tb, string const & dir, set<string>& written)
+{
+  if(!tb || written.count(tb->getMaterial())) return;
+  written.insert(tb->getMaterial());
+
+  for(int j = 2; j < tb->getNumPieces(); j++) writeTables(tb->getSubTable(j),dir,written);
+
+  string path = dir + "/" + tb->getMaterial() + TB_FILE_EXT;
+  if(!TbFile::write(*tb,path)) return;
+
+  TbFile* f = TbFile::open(path);
+  if(!f) return;
+  cout << "Wrote " << path << ": " << f->fileSize() << " bytes for " << tb->size()
+       << " entries (" << double(f->fileSize()) * 8 / tb->size() << " bits per entry)" << endl;
+  delete f;
+}
+
+
+/**
+ * Usage: tbgen [-j threads] <directory> <material>...
+ * e.g. tbgen tables KQK KRK KBNK
+ */
+int main(int argc, char** argv)
+{
+  int numThreads = 0, arg = 1;
+  if(argc > 2 && string(argv[1]) == "-j")
+  {
+    numThreads = atoi(argv[2]); arg = 3;
+  }
+  if(argc - arg < 2)
+  {
+    cerr << "Usage: " << argv[0] << " [-j threads] <directory> <material>..." << endl;
+    return 1;
+  }
+
+  string const DIR = argv[arg++];
+  TablebaseGenerator generator(numThreads);
+  set<string> written;
+
+  for(; arg < argc; arg++)
+  {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Tablebase const * tb = generator.generate(argv[arg]);
+    if(!tb)
+    {
+      cerr << "Unsupported material set " << argv[arg] << "!" << endl;
+      continue;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    long wins, draws, losses, illegal;
+    tb->countResults(wins,draws,losses,illegal);
+    cout << tb->getMaterial() << ": " << wins << " won, " << draws << " drawn, " << losses
+         << " lost, " << illegal << " illegal, longest mate " << (tb->longestMate()+1)/2
+         << " moves, generated in " << seconds << " s" << endl;
+
+    writeTables(tb,DIR,written);
+  }
+  return 0;
+}
@@ -0,0 +1,515 @@
+#include "ChessBoard.h"
+#include "nnue.h"
+#include "randgame.h"
+#include "session.h"
+#include "rules.h"
+#include "geometry.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <tuple>
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * A stream buffer dropping everything written to it, for the boards' reports
+ */
+struct NullBuffer: public streambuf
+{
+  int overflow(int c) override { return c; }
+};
+
+static NullBuffer discarded;
+static ostream silent(&discarded);
+
+
+/**
+ * Friend of ChessBoard: exposes the incrementally updated state to the checks
+ */
+class ChessBoardTest
+{
+ public:
+  /**
+   * Test if the accumulator kept up to date move by move is the one computed from scratch
+   */
+  static bool accumulatorIsFresh(ChessBoard& cb)
+  {
+    NnueAccumulator const KEPT = cb.accumulator;
+    cb.refreshAccumulator(WHITE); cb.refreshAccumulator(BLACK);
+    return memcmp(&KEPT,&cb.accumulator,sizeof(KEPT)) == 0;
+  }
+
+  /**
+   * Return the legal moves found by a fake move for every move following a rule, plus the
+   * castlings, sorted
+   */
+  static vector<Move> probedMoves(ChessBoard& cb)
+  {
+    vector<Move> moves;
+    for(int rs = 0; rs < BOARD_SIZE; rs++)
+      for(int fs = 0; fs < BOARD_SIZE; fs++)
+      {
+        Piece* const p = cb.board[rs][fs];
+        if(!p || p->getColor() != cb.moveTurn) continue;
+        for(int rd = 0; rd < BOARD_SIZE; rd++)
+          for(int fd = 0; fd < BOARD_SIZE; fd++)
+            if(cb.doesThisMoveSaveKing(rs,fs,rd,fd)) moves.push_back(Move(rs,fs,rd,fd));
+        if(p->getType() == KING)
+          for(int step = -2; step <= 2; step += 4)
+            if(cb.isCastlingLegal(p,rs,fs+step)) moves.push_back(Move(rs,fs,rs,fs+step));
+      }
+    sort(moves.begin(),moves.end(),lessMove);
+    return moves;
+  }
+
+  static bool lessMove(Move const & a, Move const & b)
+  {
+    return make_tuple(a.rankS,a.fileS,a.rankD,a.fileD) < make_tuple(b.rankS,b.fileS,b.rankD,b.fileD);
+  }
+};
+
+
+/**
+ * Report the outcome of a check, returns its number of failures
+ */
+static int report(char const * name, int failures, string const & detail)
+{
+  cout << name << ": " << (failures ? "FAILED" : "ok") << " (" << detail << ")" << endl;
+  return failures;
+}
+
+
+/**
+ * Return the name of a square, e.g. "E2"
+ */
+static string squareName(int rank, int file)
+{
+  return string(1,char('A' + file)) + char('1' + rank);
+}
+
+
+
+/*===== MOVE GENERATION =====*/
+
+/**
+ * Play random games and compare at each ply the legal moves generated, where only the king and
+ * the pinned pieces are probed with a fake move unless in check, with those found by probing
+ * every move
+ */
+static int checkLegalMoves()
+{
+  int failures = 0;
+  long positions = 0;
+  Rng rng(3);
+  for(int game = 0; game < 200; game++)
+  {
+    ChessBoard cb(silent);
+    vector<Move> moves;
+    for(int ply = 0; ply < 200; ply++)
+    {
+      cb.generateLegalMoves(moves);
+      positions++;
+      vector<Move> sorted = moves;
+      sort(sorted.begin(),sorted.end(),ChessBoardTest::lessMove);
+      vector<Move> const PROBED = ChessBoardTest::probedMoves(cb);
+      bool const SAME = sorted.size() == PROBED.size() &&
+        equal(sorted.begin(),sorted.end(),PROBED.begin(),[](Move const & a, Move const & b)
+              { return !ChessBoardTest::lessMove(a,b) && !ChessBoardTest::lessMove(b,a); });
+      if(!SAME && failures++ < 10)
+        cerr << "game " << game << " ply " << ply << ": " << moves.size() << " moves generated, "
+             << PROBED.size() << " probed" << endl;
+
+      if(moves.empty() || cb.repetitionCount() >= 3 || cb.getHalfmoveClock() >= 100) break;
+      cb.makeMove(moves[rng.below(moves.size())]);
+    }
+  }
+  return report("legal moves",failures,to_string(positions) + " positions checked");
+}
+
+
+
+/*===== RULES ON OTHER GEOMETRIES =====*/
+
+static char const * const TYPE_NAMES[6] = {"king", "queen", "rook", "bishop", "knight", "pawn"};
+
+/**
+ * The tables of the wider boards, 10x8 (Capablanca) and 10x10 (Grand chess), checked when
+ * compiled: corners, edges and centre. checkRules() checks the rules of rules.h on them
+ */
+typedef Geometry<10,8> Geometry10x8;
+typedef Geometry<10,10> Geometry10x10;
+
+static_assert(GEOMETRY_TABLES<Geometry10x8>.leaperCount[KING_LEAP][0] == 3 &&
+              GEOMETRY_TABLES<Geometry10x8>.leaperCount[KNIGHT_LEAP][0] == 2 &&
+              GEOMETRY_TABLES<Geometry10x8>.leaperCount[KNIGHT_LEAP][79] == 2 &&
+              GEOMETRY_TABLES<Geometry10x8>.leaperCount[KING_LEAP][34] == 8 &&
+              GEOMETRY_TABLES<Geometry10x8>.leaperCount[KNIGHT_LEAP][34] == 8,
+              "10x8 king and knight targets");
+static_assert(GEOMETRY_TABLES<Geometry10x8>.rayLength[0][0] == 7 &&
+              GEOMETRY_TABLES<Geometry10x8>.rayLength[0][2] == 9 &&
+              GEOMETRY_TABLES<Geometry10x8>.rayLength[0][4] == 7 &&
+              GEOMETRY_TABLES<Geometry10x8>.ray[0][0][6] == 70 &&
+              GEOMETRY_TABLES<Geometry10x8>.ray[0][2][8] == 9 &&
+              GEOMETRY_TABLES<Geometry10x8>.ray[0][4][6] == 77 &&
+              GEOMETRY_TABLES<Geometry10x8>.rayLength[79][7] == 7 &&
+              GEOMETRY_TABLES<Geometry10x8>.ray[79][7][6] == 2,
+              "10x8 rays");
+static_assert(GEOMETRY_TABLES<Geometry10x10>.leaperCount[KNIGHT_LEAP][1] == 3 &&
+              GEOMETRY_TABLES<Geometry10x10>.leaperCount[KNIGHT_LEAP][99] == 2 &&
+              GEOMETRY_TABLES<Geometry10x10>.leaperCount[KING_LEAP][44] == 8 &&
+              GEOMETRY_TABLES<Geometry10x10>.leaperCount[KNIGHT_LEAP][44] == 8,
+              "10x10 king and knight targets");
+static_assert(GEOMETRY_TABLES<Geometry10x10>.rayLength[0][0] == 9 &&
+              GEOMETRY_TABLES<Geometry10x10>.rayLength[0][4] == 9 &&
+              GEOMETRY_TABLES<Geometry10x10>.ray[0][0][8] == 90 &&
+              GEOMETRY_TABLES<Geometry10x10>.ray[0][4][8] == 99 &&
+              GEOMETRY_TABLES<Geometry10x10>.rayLength[44][3] == 4 &&
+              GEOMETRY_TABLES<Geometry10x10>.ray[44][3][3] == 40,
+              "10x10 rays");
+
+
+/**
+ * Check ruleTest<G>() on a board of geometry G against GEOMETRY_TABLES<G>: a white piece of
+ * each type alone on each square, then with a black piece and a white one on the nearest
+ * square of each of its rays (or in front of and beside a pawn). Each disagreement is
+ * reported on cerr
+ */
+template <class G>
+static int checkRules(char const * name)
+{
+  Piece* squares[G::RANKS][G::FILES] = {};
+  Piece** rows[G::RANKS];
+  for(int r = 0; r < G::RANKS; r++) rows[r] = squares[r];
+  Piece*** const board = rows;
+  GeometryTables<G> const & T = GEOMETRY_TABLES<G>;
+
+  King king(WHITE,0,0); Queen queen(WHITE,0,0); Rook rook(WHITE,0,0);
+  Bishop bishop(WHITE,0,0); Knight knight(WHITE,0,0); Pawn pawn(WHITE,0,0);
+  Piece* const PIECES[6] = {&king, &queen, &rook, &bishop, &knight, &pawn};
+  Pawn own(WHITE,0,0), hostile(BLACK,0,0);
+
+  int errors = 0;
+  auto expect = [&](Piece* p, int sq, bool legal, char const * what)
+  {
+    int const RANK = G::rankOf(sq), FILE = G::fileOf(sq);
+    if(ruleTest<G>(p,RANK,FILE,board) == legal) return;
+    if(errors++ < 10)
+      cerr << name << ": " << TYPE_NAMES[p->getType()] << " from " << p->getRank() << ","
+           << p->getFile() << (legal ? " cannot" : " can") << " reach " << RANK << "," << FILE
+           << " " << what << endl;
+  };
+
+  for(Piece* p : PIECES)
+    for(int from = 0; from < G::SQUARES; from++)
+    {
+      int const RANK = G::rankOf(from), FILE = G::fileOf(from);
+      p->setPos(RANK,FILE);
+      squares[RANK][FILE] = p;
+
+      //=== 1. Alone: the squares of its leaps or rays, a pawn's one or two steps forwards
+      bool reach[G::SQUARES] = {};
+      PieceType const TYPE = p->getType();
+      if(TYPE == KING || TYPE == KNIGHT)
+      {
+        Leaper const L = (TYPE == KING ? KING_LEAP : KNIGHT_LEAP);
+        for(int k = 0; k < T.leaperCount[L][from]; k++) reach[T.leaper[L][from][k]] = true;
+      }
+      else if(TYPE == PAWN)
+      {
+        for(int k = 0; k < T.rayLength[from][0] && k < 2; k++) reach[T.ray[from][0][k]] = true;
+      }
+      else
+        for(int d = (TYPE == BISHOP ? 4 : 0); d < (TYPE == ROOK ? 4 : 8); d++)
+          for(int k = 0; k < T.rayLength[from][d]; k++) reach[T.ray[from][d][k]] = true;
+
+      for(int to = 0; to < G::SQUARES; to++) expect(p,to,reach[to],"alone");
+      if(ruleTest<G>(p,RANK,G::FILES,board) || ruleTest<G>(p,G::RANKS,FILE,board) ||
+         ruleTest<G>(p,RANK,-1,board) || ruleTest<G>(p,-1,FILE,board))
+      {
+        if(errors++ < 10)
+          cerr << name << ": " << TYPE_NAMES[TYPE] << " from " << RANK << "," << FILE
+               << " can leave the board" << endl;
+      }
+
+      //=== 2. Blocked: the nearest square can be taken, not the ones behind
+      if(TYPE != KING && TYPE != KNIGHT)
+        for(int d = 0; d < (TYPE == PAWN ? 1 : 8); d++)
+        {
+          if(!T.rayLength[from][d] || !reach[T.ray[from][d][0]]) continue;
+          int const NEAR = T.ray[from][d][0];
+          for(Piece* blocker : {&hostile, &own})
+          {
+            squares[G::rankOf(NEAR)][G::fileOf(NEAR)] = blocker;
+            expect(p,NEAR,blocker == &hostile && TYPE != PAWN,"onto a piece");
+            for(int k = 1; k < T.rayLength[from][d]; k++)
+              expect(p,T.ray[from][d][k],false,"past a piece");
+            squares[G::rankOf(NEAR)][G::fileOf(NEAR)] = nullptr;
+          }
+        }
+
+      //=== 3. A pawn takes forwards diagonally
+      if(TYPE == PAWN)
+        for(int d = 4; d < 6; d++)
+        {
+          if(!T.rayLength[from][d]) continue;
+          int const DIAGONAL = T.ray[from][d][0];
+          squares[G::rankOf(DIAGONAL)][G::fileOf(DIAGONAL)] = &hostile;
+          expect(p,DIAGONAL,true,"taking");
+          squares[G::rankOf(DIAGONAL)][G::fileOf(DIAGONAL)] = nullptr;
+        }
+
+      squares[RANK][FILE] = nullptr;
+    }
+  return report(name,errors,"each piece on each of the " + to_string(G::SQUARES) + " squares");
+}
+
+
+
+/*===== SESSION LOGS =====*/
+
+/**
+ * Record random games played through every call a log keeps (illegal moves, moves made and
+ * unmade, moves taken back and redone included), then replay the log on a new board: after
+ * each call its position must have the key the recorded board had
+ */
+static int checkSessionReplay()
+{
+  char path[] = "/tmp/mcsr-testXXXXXX";
+  int const FD = mkstemp(path);
+  if(FD < 0) return report("session replay",1,"cannot create a log file");
+  close(FD);
+
+  // The boards report illegal moves on cerr: the check's own messages go to errors
+  streambuf* const ERRORS = cerr.rdbuf(&discarded);
+  ostream errors(ERRORS);
+  vector<uint64_t> keys; // after each recorded call
+  SessionRecorder recorder;
+  if(recorder.open(path))
+  {
+    ChessBoard cb(silent);
+    cb.setRecorder(&recorder);
+    Rng rng(9);
+    vector<Move> moves;
+    for(int game = 0; game < 40; game++)
+    {
+      if(game % 4 == 3)
+        cb.loadPosition("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -");
+      else cb.resetBoard();
+      keys.push_back(cb.getKey());
+
+      for(int ply = 0; ply < 150; ply++)
+      {
+        cb.generateLegalMoves(moves);
+        if(moves.empty() || cb.repetitionCount() >= 3 || cb.getHalfmoveClock() >= 100) break;
+        Move const M = moves[rng.below(moves.size())];
+        switch(rng.below(8))
+        {
+        case 0: // tried and unmade, as a search does
+          cb.makeMove(M); keys.push_back(cb.getKey());
+          cb.undoMove(); keys.push_back(cb.getKey());
+          break;
+        case 1: cb.takeBack(1 + int(rng.below(3))); keys.push_back(cb.getKey()); break;
+        case 2: cb.redo(1 + int(rng.below(3))); keys.push_back(cb.getKey()); break;
+        case 3: // most likely illegal
+        {
+          Move const ANY(int(rng.below(8)),int(rng.below(8)),int(rng.below(8)),int(rng.below(8)));
+          cb.submitMove(ANY.srcString().c_str(),ANY.destString().c_str());
+          keys.push_back(cb.getKey());
+          break;
+        }
+        default:
+          cb.submitMove(M.srcString().c_str(),M.destString().c_str());
+          keys.push_back(cb.getKey());
+        }
+      }
+    }
+    cb.setRecorder(nullptr);
+  }
+  recorder.close();
+
+  SessionLogHeader header;
+  vector<SessionEntry> entries;
+  bool const READ = !keys.empty() && readSessionLog(path,header,entries);
+  unlink(path);
+  int failures = 0;
+  if(!READ || entries.size() != keys.size())
+  {
+    cerr.rdbuf(ERRORS);
+    return report("session replay",1,to_string(keys.size()) + " calls recorded, " +
+                  to_string(entries.size()) + " read back");
+  }
+
+  ChessBoard cb(silent);
+  for(std::size_t i = 0; i < entries.size(); i++)
+  {
+    replaySessionCall(cb,entries[i]);
+    if(cb.getKey() != keys[i] && failures++ < 10)
+      errors << "session replay: call " << i << " leads to another position" << endl;
+  }
+  cerr.rdbuf(ERRORS);
+  return report("session replay",failures,to_string(entries.size()) + " calls replayed");
+}
+
+
+
+/*===== NNUE =====*/
+
+/**
+ * Write a network of random weights, small enough for the accumulators to stay in range but
+ * large enough to be clipped. Returns false on I/O errors
+ */
+static bool writeRandomNetwork(string const & path, uint64_t seed)
+{
+  NnueLayout const L = nnueLayout();
+  vector<unsigned char> data(L.fileSize,0);
+  Rng rng(seed);
+
+  NnueFileHeader h = {};
+  memcpy(h.magic,"MCNN",4);
+  h.version = 1; h.inputs = NNUE_INPUTS; h.halfDims = NNUE_HALF_DIMS; h.hidden = NNUE_HIDDEN;
+  memcpy(data.data(),&h,sizeof(h));
+
+  auto fill16 = [&](size_t at, size_t n, int range)
+  {
+    for(size_t i = 0; i < n; i++)
+    {
+      int16_t const V = int16_t(int(rng.below(2*range)) - range);
+      memcpy(data.data() + at + i*sizeof(V),&V,sizeof(V));
+    }
+  };
+  auto fill32 = [&](size_t at, size_t n, int range)
+  {
+    for(size_t i = 0; i < n; i++)
+    {
+      int32_t const V = int32_t(rng.below(2*range)) - range;
+      memcpy(data.data() + at + i*sizeof(V),&V,sizeof(V));
+    }
+  };
+  auto fill8 = [&](size_t at, size_t n)
+  {
+    for(size_t i = 0; i < n; i++) data[at + i] = uint8_t(int(rng.below(128)) - 64);
+  };
+
+  fill16(L.ftBiases,NNUE_HALF_DIMS,64);
+  fill16(L.ftWeights,size_t(NNUE_INPUTS) * NNUE_HALF_DIMS,16);
+  fill32(L.l1Biases,NNUE_HIDDEN,2000);
+  fill8(L.l1Weights,NNUE_HIDDEN * 2*NNUE_HALF_DIMS);
+  fill32(L.l2Biases,NNUE_HIDDEN,2000);
+  fill8(L.l2Weights,NNUE_HIDDEN * NNUE_HIDDEN);
+  fill32(L.outBias,1,2000);
+  fill8(L.outWeights,NNUE_HIDDEN);
+
+  ofstream out(path,ios::binary | ios::trunc);
+  out.write(reinterpret_cast<char const *>(data.data()),data.size());
+  return bool(out);
+}
+
+
+/**
+ * Play random games with each set of kernels the CPU runs: each ply is submitted, after a
+ * few plies made and unmade as a search would, and the games end being taken back and
+ * replayed. After every step the accumulator must be the one computed from scratch, and
+ * every set of kernels must give the same evaluations
+ */
+static int checkAccumulators()
+{
+  char path[] = "/tmp/mcnn-testXXXXXX";
+  int const FD = mkstemp(path);
+  if(FD < 0 || !writeRandomNetwork(path,1))
+  {
+    if(FD >= 0) { close(FD); unlink(path); }
+    return report("nnue accumulators",1,"cannot write a network file");
+  }
+  close(FD);
+  Nnue* net = Nnue::open(path);
+  unlink(path); // the mapping stays
+  if(!net) return report("nnue accumulators",1,"cannot map the network file");
+
+  int failures = 0;
+  long steps = 0;
+  vector<int> reference; // evaluations with the first set of kernels
+  string kernelsRun;
+  for(char const * kernels : {"scalar", "sse", "avx2"})
+  {
+    if(!Nnue::useKernels(kernels)) continue;
+    kernelsRun += string(kernelsRun.empty() ? "" : " ") + kernels;
+
+    Rng rng(7);
+    vector<int> evaluations;
+    auto step = [&](ChessBoard& cb)
+    {
+      steps++;
+      if(!ChessBoardTest::accumulatorIsFresh(cb) && failures++ < 10)
+        cerr << kernels << ": stale accumulator after step " << steps << endl;
+      evaluations.push_back(cb.evaluate());
+    };
+
+    for(int game = 0; game < 20; game++)
+    {
+      ChessBoard cb(silent);
+      cb.setNetwork(net);
+      vector<Move> moves;
+      int plies = 0;
+      for(; plies < 120; plies++)
+      {
+        // A short line made and unmade
+        int const DEPTH = int(rng.below(4));
+        int made = 0;
+        for(; made < DEPTH; made++)
+        {
+          cb.generateLegalMoves(moves);
+          if(moves.empty()) break;
+          cb.makeMove(moves[rng.below(moves.size())]);
+          step(cb);
+        }
+        while(made-- > 0)
+        {
+          cb.undoMove();
+          step(cb);
+        }
+
+        // The ply of the game, unless it is over
+        cb.generateLegalMoves(moves);
+        if(moves.empty() || cb.repetitionCount() >= 3 || cb.getHalfmoveClock() >= 100) break;
+        Move const M = moves[rng.below(moves.size())];
+        cb.submitMove(squareName(M.rankS,M.fileS).c_str(),squareName(M.rankD,M.fileD).c_str());
+        step(cb);
+      }
+
+      int const BACK = int(rng.below(plies + 1));
+      cb.takeBack(BACK); step(cb);
+      cb.redo(BACK / 2); step(cb);
+    }
+
+    if(reference.empty()) reference = evaluations;
+    else if(evaluations != reference && failures++ < 10)
+      cerr << kernels << ": evaluations differ from those of the first kernels" << endl;
+  }
+  delete net;
+
+  return report("nnue accumulators",failures,
+                to_string(steps) + " steps checked with the " + kernelsRun + " kernels");
+}
+
+
+
+/**
+ * Usage: tests
+ * Runs every check, one line each; the exit status is 1 if any failed
+ */
+int main()
+{
+  int failures = 0;
+  failures += checkRules<StandardGeometry>("rules on 8x8");
+  failures += checkRules<Geometry10x8>("rules on 10x8");
+  failures += checkRules<Geometry10x10>("rules on 10x10");
+  failures += checkLegalMoves();
+  failures += checkSessionReplay();
+  failures += checkAccumulators();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+#include "trace.h"
+#include <fstream>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+using namespace std;
+
+#ifdef CHESS_TRACE
+/*===== PER-THREAD RING BUFFERS =====*/
+
+std::atomic<int> tracePeriod(0);
+thread_local bool traceActive = false;
+thread_local unsigned traceRoots = 0;
+
+/**
+ * A span as stored: written by its thread only, read by the dumps (hence the atomics, which
+ * are plain loads and stores on x86)
+ */
+struct TraceEvent
+{
+  atomic<char const *> name;
+  atomic<uint64_t> start;
+  atomic<uint64_t> end;
+};
+
+struct TraceBuffer
+{
+  int tid; // numbered in order of the first span of each thread
+  atomic<uint64_t> head; // number of spans ever written: the next one goes to head % size
+  TraceEvent events[TRACE_BUFFER_EVENTS];
+};
+
+/**
+ * Every thread's buffer, and the time stamp and clock time of the first one. Buffers are
+ * kept after their thread exits, so that a dump still sees its spans
+ */
+struct TraceRegistry
+{
+  mutex lock;
+  vector<TraceBuffer*> buffers;
+  uint64_t epochTicks;
+  chrono::steady_clock::time_point epochTime;
+};
+
+static TraceRegistry& registry()
+{
+  static TraceRegistry* r = new TraceRegistry(); // never destroyed: threads may outlive main
+  return *r;
+}
+
+static thread_local TraceBuffer* threadBuffer = nullptr;
+
+
+/**
+ * Give the calling thread its buffer
+ */
+void traceAttach()
+{
+  if(threadBuffer) return;
+
+  TraceBuffer* b = new TraceBuffer();
+  b->head.store(0);
+  TraceRegistry& r = registry();
+  lock_guard<mutex> guard(r.lock);
+  if(r.buffers.empty())
+  {
+    r.epochTicks = traceNow();
+    r.epochTime = chrono::steady_clock::now();
+  }
+  b->tid = int(r.buffers.size()) + 1;
+  r.buffers.push_back(b);
+  threadBuffer = b;
+}
+
+
+/**
+ * Record a closed span into the buffer of the calling thread
+ */
+void traceRecord(char const * name, uint64_t start, uint64_t end)
+{
+  TraceBuffer* const B = threadBuffer;
+  uint64_t const HEAD = B->head.load(memory_order_relaxed);
+  TraceEvent& e = B->events[HEAD & (TRACE_BUFFER_EVENTS-1)];
+  e.name.store(name,memory_order_relaxed);
+  e.start.store(start,memory_order_relaxed);
+  e.end.store(end,memory_order_relaxed);
+  B->head.store(HEAD + 1,memory_order_release); // publishes the span
+}
+
+
+void traceSetEnabled(bool on, int every)
+{
+  tracePeriod.store(on && every > 0 ? every : 0);
+}
+
+#else
+
+void traceSetEnabled(bool, int) {}
+
+#endif
+
+
+
+/*===== CHROME TRACE OUTPUT =====*/
+
+/**
+ * Write the spans of every buffer as complete ("X") events, times in microseconds
+ */
+void traceWrite(std::ostream& out)
+{
+  out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+  bool first = true;
+
+#ifdef CHESS_TRACE
+  TraceRegistry& r = registry();
+  lock_guard<mutex> guard(r.lock);
+
+  // Time stamp ticks per microsecond, measured over at least 20ms since the first span
+  double usPerTick = 0;
+  if(!r.buffers.empty())
+  {
+    this_thread::sleep_until(r.epochTime + chrono::milliseconds(20));
+    uint64_t const TICKS = traceNow();
+    double const US =
+      chrono::duration<double,micro>(chrono::steady_clock::now() - r.epochTime).count();
+    usPerTick = US / double(TICKS - r.epochTicks);
+  }
+
+  for(TraceBuffer* b : r.buffers)
+  {
+    // Copy the spans from the oldest one still in the buffer
+    uint64_t const HEAD = b->head.load(memory_order_acquire);
+    uint64_t const FIRST = (HEAD > TRACE_BUFFER_EVENTS ? HEAD - TRACE_BUFFER_EVENTS : 0);
+    vector<uint64_t> starts, ends;
+    vector<char const *> names;
+    for(uint64_t i = FIRST; i < HEAD; i++)
+    {
+      TraceEvent const & e = b->events[i & (TRACE_BUFFER_EVENTS-1)];
+      names.push_back(e.name.load(memory_order_relaxed));
+      starts.push_back(e.start.load(memory_order_relaxed));
+      ends.push_back(e.end.load(memory_order_relaxed));
+    }
+
+    // Drop what the thread may have overwritten meanwhile, and the slot it may be writing
+    uint64_t const HEAD_AFTER = b->head.load(memory_order_acquire) + 1;
+    uint64_t const SAFE = (HEAD_AFTER > TRACE_BUFFER_EVENTS ? HEAD_AFTER - TRACE_BUFFER_EVENTS : 0);
+
+    for(uint64_t i = FIRST; i < HEAD; i++)
+    {
+      if(i < SAFE) continue;
+      std::size_t const K = i - FIRST;
+      char line[256];
+      snprintf(line,sizeof(line),
+               "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+               "\"ts\": %.3f, \"dur\": %.3f}",
+               first ? "" : ",",names[K],b->tid,(starts[K] - r.epochTicks) * usPerTick,
+               (ends[K] - starts[K]) * usPerTick);
+      out << line;
+      first = false;
+    }
+  }
+#endif
+
+  out << (first ? "" : "\n") << "]}" << endl;
+}
+
+
+/**
+ * Write the trace to a file
+ */
+bool traceDump(std::string const & path)
+{
+  ofstream out(path);
+  if(!out)
+  {
+    cerr << "Cannot write the trace file " << path << "!" << endl;
+    return false;
+  }
+  traceWrite(out);
+  return bool(out);
+}
@@ -0,0 +1,124 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define TRACE_BUFFER_EVENTS (1 << 16) // spans kept per thread, a power of 2
+
+/*===== TRACE SPANS =====*/
+/**
+ * Built with -DCHESS_TRACE (make TRACE=1), spans are recorded while tracing is switched on:
+ *   TRACE_ROOT("name")             a span to the end of the enclosing scope, which decides
+ *                                  whether the spans nested in it are recorded
+ *   TRACE_BEGIN(span, "name") ... TRACE_END(span)
+ *                                  a span over a few statements, nested in a root; it also
+ *                                  ends if the scope is left early
+ * Each thread writes the spans it closes into its own ring buffer, without locking, the
+ * oldest ones being overwritten. Built without CHESS_TRACE the macros expand to nothing
+ */
+
+/**
+ * Switch recording on (every-th root span and what is nested in it is recorded) or off
+ * (every = 0, the default); a no-op without CHESS_TRACE.
+ * A span costs two reads of the time stamp counter, so recording every submitMove() with its
+ * 8 phases slows it down by about a quarter; every = 16 keeps that to a few percent
+ */
+void traceSetEnabled(bool on, int every = 1);
+
+/**
+ * Write the spans of every thread's buffer as a Chrome trace (JSON, loadable by
+ * chrome://tracing or Perfetto), from any thread
+ */
+void traceWrite(std::ostream& out);
+
+/**
+ * Write the trace to a file, returns false if it can't be written
+ */
+bool traceDump(std::string const & path);
+
+
+#ifdef CHESS_TRACE
+
+extern std::atomic<int> tracePeriod; // record one root in tracePeriod, 0 when off
+extern thread_local bool traceActive; // in a root span being recorded
+extern thread_local unsigned traceRoots; // root spans started by the thread
+
+/**
+ * Time stamp in ticks of the time stamp counter (ns where there isn't one)
+ */
+static inline uint64_t traceNow()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * Make sure the calling thread has a buffer, and record a closed span into it
+ */
+void traceAttach();
+void traceRecord(char const * name, uint64_t start, uint64_t end);
+
+class TraceSpan
+{
+ protected:
+  char const * name; // nullptr once recorded, or if not recording
+  uint64_t start;
+ public:
+  explicit TraceSpan(char const * n): name(traceActive ? n : nullptr), start(name ? traceNow() : 0){}
+
+  void end()
+  {
+    if(name) traceRecord(name,start,traceNow());
+    name = nullptr;
+  }
+
+  ~TraceSpan() { end(); }
+};
+
+class TraceRoot: public TraceSpan
+{
+  bool owner; // started the recording of its nested spans
+ public:
+  explicit TraceRoot(char const * n): TraceSpan(nullptr), owner(false)
+  {
+    int const PERIOD = tracePeriod.load(std::memory_order_relaxed);
+    if(traceActive || PERIOD == 0 || traceRoots++ % PERIOD != 0) return;
+    traceAttach();
+    owner = traceActive = true;
+    name = n; start = traceNow();
+  }
+
+  ~TraceRoot()
+  {
+    end();
+    if(owner) traceActive = false;
+  }
+};
+
+#define TRACE_CONCAT2(a,b) a##b
+#define TRACE_CONCAT(a,b) TRACE_CONCAT2(a,b)
+#define TRACE_ROOT(name) TraceRoot TRACE_CONCAT(traceRoot,__LINE__)(name)
+#define TRACE_BEGIN(span,name) TraceSpan span(name)
+#define TRACE_END(span) span.end()
+
+#else
+
+#define TRACE_ROOT(name) ((void)0)
+#define TRACE_BEGIN(span,name) ((void)0)
+#define TRACE_END(span) ((void)0)
+
+#endif
+
+
+#endif
@@ -0,0 +1,261 @@
+#include "ChessBoard.h"
+#include "search.h"
+#include "tbfile.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdlib>
+
+using namespace std;
+
+/*===== OUTPUT =====*/
+
+/**
+ * A stream buffer dropping everything written to it: the board's own messages must not
+ * reach the GUI
+ */
+struct NullBuffer: public streambuf
+{
+  int overflow(int c) override { return c; }
+};
+
+static ostream* protocol; // stdout
+static mutex protocolLock; // the search thread writes too
+
+static void send(string const & line)
+{
+  lock_guard<mutex> guard(protocolLock);
+  *protocol << line << endl;
+}
+
+
+/**
+ * An info line for a completed iteration
+ */
+static void sendInfo(SearchInfo const & info)
+{
+  ostringstream line;
+  line << "info depth " << info.depth << " score ";
+  if(mateIn(info.score) != 0) line << "mate " << mateIn(info.score);
+  else line << "cp " << info.score;
+  line << " nodes " << info.nodes << " nps " << info.nodesPerSecond
+       << " time " << long(info.seconds * 1000) << " pv";
+  for(Move const & m : info.pv) line << " " << m.uciString();
+  send(line.str());
+}
+
+
+static void sendBestMove(vector<Move> const & pv)
+{
+  if(pv.empty())
+  {
+    send("bestmove 0000");
+    return;
+  }
+  string line = "bestmove " + pv[0].uciString();
+  if(pv.size() > 1) line += " ponder " + pv[1].uciString();
+  send(line);
+}
+
+
+
+/*===== COMMANDS =====*/
+
+/**
+ * position [startpos | fen <fields>] [moves <move> ...]
+ */
+static void setPosition(ChessBoard& cb, istringstream& in)
+{
+  string token, fen;
+  in >> token;
+  if(token == "startpos")
+  {
+    cb.resetBoard();
+    in >> token;
+  }
+  else if(token == "fen")
+  {
+    while(in >> token && token != "moves") fen += token + " ";
+    if(!cb.loadPosition(fen.c_str())) return;
+  }
+  else
+  {
+    cerr << "Unknown position \"" << token << "\"!" << endl;
+    return;
+  }
+
+  if(token != "moves") return;
+
+  vector<Move> legal;
+  while(in >> token)
+  {
+    cb.generateLegalMoves(legal);
+    bool found = false;
+    for(Move const & m : legal)
+      if(m.uciString() == token)
+      {
+        cb.makeMove(m);
+        found = true;
+        break;
+      }
+    if(!found)
+    {
+      cerr << "Illegal move " << token << "!" << endl;
+      return;
+    }
+  }
+}
+
+
+/**
+ * Replace the endgame tables of the board by the table files of a directory (none if empty)
+ */
+static void loadTables(ChessBoard& cb, EndgameTables*& tables, string const & dir)
+{
+  cb.setEndgameTables(nullptr);
+  delete tables;
+  tables = nullptr;
+  if(dir.empty() || dir == "<empty>") return;
+
+  tables = new EndgameTables();
+  int const LOADED = tables->load(dir);
+  cb.setEndgameTables(tables);
+  send("info string " + to_string(LOADED) + " endgame tables loaded from " + dir);
+}
+
+
+/**
+ * Evaluate with the network of a file from now on (the piece-square tables if empty)
+ */
+static void loadNetwork(ChessBoard& cb, Nnue*& network, string const & path)
+{
+  cb.setNetwork(nullptr);
+  delete network;
+  network = nullptr;
+  if(path.empty() || path == "<empty>") return;
+
+  network = Nnue::open(path);
+  if(!network) return; // said why on cerr
+  cb.setNetwork(network);
+  send("info string network " + path + " loaded, " + Nnue::kernelName() + " kernels");
+}
+
+
+/**
+ * go [wtime|btime|winc|binc|movestogo|depth|nodes|movetime|mate <n>] [infinite] [ponder]
+ */
+static SearchLimits parseGo(istringstream& in)
+{
+  SearchLimits limits;
+  string token;
+  while(in >> token)
+  {
+    if(token == "infinite") limits.infinite = true;
+    else if(token == "ponder") limits.ponder = true;
+    else
+    {
+      long value = 0;
+      if(!(in >> value)) break;
+      if(token == "wtime") limits.time[WHITE] = int(value);
+      else if(token == "btime") limits.time[BLACK] = int(value);
+      else if(token == "winc") limits.inc[WHITE] = int(value);
+      else if(token == "binc") limits.inc[BLACK] = int(value);
+      else if(token == "movestogo") limits.movesToGo = int(value);
+      else if(token == "depth") limits.depth = int(value);
+      else if(token == "nodes") limits.nodes = uint64_t(value);
+      else if(token == "movetime") limits.moveTime = int(value);
+      else if(token == "mate") limits.depth = int(2 * value);
+    }
+  }
+  return limits;
+}
+
+
+/**
+ * Read UCI commands from stdin until quit. The search runs on a thread of its own, so that
+ * stop, ponderhit and isready are answered while searching
+ */
+int main()
+{
+  ostream out(cout.rdbuf());
+  NullBuffer discarded;
+  cout.rdbuf(&discarded);
+  protocol = &out;
+
+  ChessBoard cb;
+  Search search;
+  EndgameTables* tables = nullptr; // of the EndgameTablePath option
+  Nnue* network = nullptr; // of the EvalFile option
+
+  string line;
+  while(getline(cin,line))
+  {
+    istringstream in(line);
+    string command;
+    in >> command;
+
+    if(command == "uci")
+    {
+      send("id name mcslab chess");
+      send("id author wl419");
+      send("option name Hash type spin default 8 min 1 max 4096");
+      send("option name Ponder type check default false");
+      send("option name EndgameTablePath type string default <empty>");
+      send("option name EvalFile type string default <empty>");
+      send("uciok");
+    }
+    else if(command == "isready") send("readyok");
+    else if(command == "setoption")
+    {
+      string token, name, value;
+      in >> token >> name >> token; // name <name> value <value>
+      getline(in >> ws,value);
+      if(name == "Hash" && atol(value.c_str()) > 0)
+      {
+        search.stop(); search.wait();
+        search.resize(std::size_t(atol(value.c_str())));
+      }
+      else if(name == "EndgameTablePath")
+      {
+        search.stop(); search.wait();
+        loadTables(cb,tables,value);
+      }
+      else if(name == "EvalFile")
+      {
+        search.stop(); search.wait();
+        loadNetwork(cb,network,value);
+      }
+    }
+    else if(command == "ucinewgame")
+    {
+      search.stop(); search.wait();
+      search.clear();
+      cb.resetBoard();
+    }
+    else if(command == "position")
+    {
+      search.stop(); search.wait();
+      setPosition(cb,in);
+    }
+    else if(command == "go")
+    {
+      search.stop(); search.wait();
+      search.start(cb,parseGo(in),sendInfo,sendBestMove);
+    }
+    else if(command == "stop") search.stop();
+    else if(command == "ponderhit") search.ponderHit();
+    else if(command == "quit") break;
+    else if(!command.empty()) cerr << "Unknown command \"" << command << "\"!" << endl;
+  }
+
+  search.stop();
+  search.wait();
+  cb.setEndgameTables(nullptr);
+  delete tables;
+  cb.setNetwork(nullptr);
+  delete network;
+  cout.rdbuf(out.rdbuf());
+  return 0;
+}
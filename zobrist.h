@@ -0,0 +1,50 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+
+#include <cstdint>
+#include "piece.h"
+
+/*===== ZOBRIST KEYS =====*/
+/**
+ * Random keys for hashing positions: one per (colour, piece type, square) plus one for the
+ * side to move. Generated at compile time with splitmix64 from a fixed seed, so that keys
+ * (and anything stored with them) are the same from one build to the next
+ */
+struct ZobristKeys
+{
+  uint64_t piece[2][6][BOARD_SIZE*BOARD_SIZE];
+  uint64_t blackToMove;
+};
+
+constexpr uint64_t splitmix64(uint64_t& state)
+{
+  uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+constexpr ZobristKeys makeZobristKeys()
+{
+  ZobristKeys keys = {};
+  uint64_t state = 0x4d43534c41423321ULL;
+  for(int c = 0; c < 2; c++)
+    for(int t = 0; t < 6; t++)
+      for(int sq = 0; sq < BOARD_SIZE*BOARD_SIZE; sq++)
+        keys.piece[c][t][sq] = splitmix64(state);
+  keys.blackToMove = splitmix64(state);
+  return keys;
+}
+
+inline constexpr ZobristKeys ZOBRIST = makeZobristKeys();
+
+/**
+ * Key of a piece standing on a square
+ */
+inline uint64_t zobristPiece(bool color, PieceType type, int rank, int file)
+{
+  return ZOBRIST.piece[color == WHITE ? 0 : 1][type][rank*BOARD_SIZE + file];
+}
+
+
+#endif